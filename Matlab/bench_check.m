@@ -0,0 +1,71 @@
+function result = bench_check(fileName, chunkLen, stats)
+% Checks the data of a loopback benchmark (host command 'bench1', or a
+% binary bench command giving the chunk length and rate), captured with
+% record mode off and split into EEG_BLE_Data.bin by either splitter.
+% Every chunk is a counter (uint32), filler bytes of
+% mod(counter + offset, 256), then a CRC-16/CCITT-FALSE of the rest.
+% result.lost counts the chunks the dongle dropped for lack of packets,
+% result.corrupt the chunks whose CRC or filler is wrong.
+% Pass the "stats" array of the splitter to get result.mbPerSecond, the
+% USB throughput of the stream from its STAT counters.
+if nargin < 2
+    chunkLen = 244;
+end
+fid = fopen(fileName,'rb');
+raw = fread(fid,inf,'uint8=>uint8');
+fclose(fid);
+
+crcTable = crc16_ccitt_table();
+n = floor(numel(raw)/chunkLen);
+chunks = double(reshape(raw(1:n*chunkLen), chunkLen, n));
+counters = chunks(1,:) + 256*chunks(2,:) + 65536*chunks(3,:) + 16777216*chunks(4,:);
+
+corrupt = false(1,n);
+for i=1:n
+    c = chunks(:,i);
+    filler = mod(counters(i) + (4:chunkLen-3)', 256);
+    crc = crc16_ccitt(crcTable, c(1:end-2));
+    corrupt(i) = crc ~= c(end-1) + 256*c(end) || any(c(5:end-2) ~= filler);
+end
+good = counters(~corrupt);
+
+result.chunks = n;
+result.corrupt = sum(corrupt);
+result.lost = sum(max(diff(good) - 1, 0));
+result.bytes = n*chunkLen;
+fprintf('%d chunks of %d bytes: %d corrupt, %d lost\n', ...
+    result.chunks, chunkLen, result.corrupt, result.lost);
+
+if nargin >= 3 && numel(stats) > 1
+    % Link 0 EEG is the first stream of every STAT packet.
+    bytesOut = arrayfun(@(s) s.streams(1).bytesOut, stats);
+    seconds = sum([stats(2:end).intervalMs])/1000;
+    result.mbPerSecond = mod(bytesOut(end) - bytesOut(1), 2^32)/seconds/1e6;
+    fprintf('USB throughput: %.3f MB/s over %.1f s\n', result.mbPerSecond, seconds);
+end
+end
+
+
+function table = crc16_ccitt_table()
+    table = zeros(1,256,'uint16');
+    for i=0:255
+        c = bitshift(uint16(i),8);
+        for k=1:8
+            if bitand(c,hex2dec('8000'))
+                c = bitxor(bitshift(c,1),hex2dec('1021'));
+            else
+                c = bitshift(c,1);
+            end
+        end
+        table(i+1) = c;
+    end
+end
+
+function crc = crc16_ccitt(table, data)
+    crc = uint16(hex2dec('FFFF'));
+    for i=1:numel(data)
+        idx = bitxor(bitshift(crc,-8),uint16(data(i)));
+        crc = bitxor(bitshift(crc,8),table(double(idx)+1));
+    end
+    crc = double(crc);
+end
@@ -0,0 +1,56 @@
+function lnk = decode_link(payload)
+% Decodes the payload of a LINK packet, sent by the dongle for every
+% connected Hearable along with each STAT packet.
+% lnk.intervalMs is the time since the previous LINK packet of the same
+% link; notifications, connectionEvents and notificationsPerEvent cover it.
+% connectionEvents is derived from the connection interval. rssiDbm is NaN
+% until the dongle has measured a packet of the link.
+% Version 2 packets add the Hearable clock estimate in lnk.clock. Around
+% the time of the packet, a device time t (31.25 kHz ticks) maps to
+%   rxAnchor + ((t - devAnchor)/31250 + offsetUs*1e-6)*32768
+% app_timer ticks, and offsetUs grows by driftPpb*1e-3 us per second once
+% state is 'tracking'. offsetUs comes from the least delayed notification
+% of the period, so it includes the shortest link delay.
+payload = double(payload(:))';
+u16 = @(p) payload(p) + 256*payload(p+1);
+u32 = @(p) u16(p) + 65536*u16(p+2);
+s32 = @(p) u32(p) - 2^32*(payload(p+3) >= 128);
+phys = containers.Map({1,2,4},{'1M','2M','Coded'});
+
+lnk.version = payload(1);
+lnk.link = payload(2);
+lnk.txPhy = phy_name(payload(3));
+lnk.rxPhy = phy_name(payload(4));
+lnk.rssiDbm = payload(5) - 256*(payload(5) >= 128);
+if lnk.rssiDbm == 127
+    lnk.rssiDbm = NaN;
+end
+lnk.rssiChannel = payload(6);
+lnk.connIntervalMs = u16(7)*1.25;
+lnk.slaveLatency = u16(9);
+lnk.supervisionTimeoutMs = u16(11)*10;
+lnk.attMtu = u16(13);
+lnk.dataLength = u16(15);
+lnk.intervalMs = u16(17);
+lnk.notifications = u32(19);
+lnk.connectionEvents = u16(23);
+lnk.notificationsPerEvent = u16(25)/100;
+if lnk.version >= 2
+    states = {'none','anchored','tracking'};
+    lnk.clock.state = states{min(payload(27),2)+1};
+    lnk.clock.devAnchor = u32(28);
+    lnk.clock.rxAnchor = u32(32);
+    lnk.clock.offsetUs = s32(36);
+    lnk.clock.driftPpb = s32(40);
+    lnk.clock.samples = u16(44);
+    lnk.clock.rejected = u16(46);
+end
+
+    function name = phy_name(phy)
+        if isKey(phys,phy)
+            name = phys(phy);
+        else
+            name = sprintf('0x%02x',phy);
+        end
+    end
+end
@@ -0,0 +1,17 @@
+function resp = decode_resp(payload)
+% Decodes the payload of a RESP packet, sent by the dongle to answer each
+% binary host command (see host_cmd_frame.m), in the order received.
+% resp.reqId is the request id of the command; a PING response carries its
+% payload back in resp.data.
+payload = double(payload(:))';
+statuses = {'ok','bad crc','bad length','unknown','not connected','queue full','failed','busy'};
+
+resp.type = payload(1);
+resp.reqId = payload(2);
+if payload(3) < numel(statuses)
+    resp.status = statuses{payload(3)+1};
+else
+    resp.status = sprintf('status %d', payload(3));
+end
+resp.data = uint8(payload(4:end));
+end
@@ -0,0 +1,55 @@
+function stat = decode_stat(payload)
+% Decodes the payload of a STAT packet sent by the dongle, periodically or
+% in answer to the 'stats' command.
+% stat.intervalMs is the time since the previous STAT packet. stat.streams
+% has one entry per stream (EEG, PPG, ACC) of each link, link by link, and
+% stat.streams(i).link tells which; version 1 packets have a single link.
+% The counters are free-running totals except notificationsPerSecond,
+% which covers intervalMs.
+% Version 3 packets add the main loop counters over intervalMs:
+% stat.loop.wakeups is the number of passes through the sleeping main loop
+% and stat.loop.latencyHist(i) the number of packets the loop got to within
+% latencyBinUs(i) microseconds of their commit (the last bin: any longer).
+payload = double(payload(:))';
+u16 = @(p) payload(p) + 256*payload(p+1);
+u32 = @(p) u16(p) + 65536*u16(p+2);
+
+stat.version = payload(1);
+if stat.version >= 2
+    nLinks = payload(2);
+    nStreams = payload(3);
+    stat.intervalMs = u16(5);
+    first = 7;
+else
+    nLinks = 1;
+    nStreams = payload(2);
+    stat.intervalMs = u16(3);
+    first = 5;
+end
+names = {'EEG','PPG','ACC'};
+for i=1:nLinks*nStreams
+    s = mod(i-1,nStreams) + 1;
+    p = first + (i-1)*24;
+    stat.streams(i).link = floor((i-1)/nStreams);
+    if s <= numel(names)
+        stat.streams(i).name = names{s};
+    else
+        stat.streams(i).name = sprintf('stream%d',s-1);
+    end
+    stat.streams(i).notifications = u32(p);
+    stat.streams(i).bytesIn = u32(p+4);
+    stat.streams(i).bytesDropped = u32(p+8);
+    stat.streams(i).bytesOut = u32(p+12);
+    stat.streams(i).usbWriteFailures = u32(p+16);
+    stat.streams(i).notificationsPerSecond = u16(p+20);
+    stat.streams(i).packetsHighWaterMark = payload(p+22);
+    stat.streams(i).packetLimit = payload(p+23);
+end
+if stat.version >= 3
+    p = first + nLinks*nStreams*24;
+    stat.loop.wakeups = u32(p);
+    nBins = payload(p+4);
+    stat.loop.latencyHist = arrayfun(@(b) u16(p+5+2*b), 0:nBins-1);
+    stat.loop.latencyBinUs = [2.^(0:nBins-2) inf]*1e6/32768;
+end
+end
@@ -0,0 +1,28 @@
+function frame = host_cmd_frame(type, reqId, payload)
+% Builds a binary host command, to be written to the dongle's serial port:
+%   fwrite(port, host_cmd_frame(7, 1, eegConfig))
+% Types: 1 start, 2 stop, 3 format (payload 1 or 2), 4 records (payload 0
+% or 1), 5 stats, 6 uname, 7 EEG config, 8 PPG config, 9 ACC config,
+% 10 ping, 11 bench (payload on, then optionally the chunk length as a
+% uint16 and the rate in bytes/s as a uint32, 0 as fast as possible).
+% reqId (0-255) comes back in the RESP packet answering the frame; decode
+% it with decode_resp.m.
+if nargin < 3
+    payload = [];
+end
+payload = uint8(payload(:))';
+len = numel(payload);
+frame = [uint8([hex2dec('C5') hex2dec('5C') type reqId mod(len,256) floor(len/256)]) payload];
+crc = uint16(hex2dec('FFFF'));
+for i=1:numel(frame)
+    crc = bitxor(crc, bitshift(uint16(frame(i)),8));
+    for k=1:8
+        if bitand(crc,hex2dec('8000'))
+            crc = bitxor(bitshift(crc,1),hex2dec('1021'));
+        else
+            crc = bitshift(crc,1);
+        end
+    end
+end
+frame = [frame uint8([bitand(crc,255) bitshift(crc,-8)])];
+end
@@ -1,41 +1,78 @@
 fid = fopen('capture.bin','rb');
 eegFid = fopen('EEG_BLE_Data.bin','wb');
 ppgFid = fopen('PPG_BLE_Data.bin','wb');
+accFid = fopen('ACC_BLE_Data.bin','wb');
+eegRecFid = fopen('EEG_BLE_Records.bin','wb');
+ppgRecFid = fopen('PPG_BLE_Records.bin','wb');
+accRecFid = fopen('ACC_BLE_Records.bin','wb');
 
 eegKeyword='EEG_';
 ppgKeyword='PPG_';
-timeKeyword='Time';
+accKeyword='ACC_';
+nameKeyword='NAME';
+statKeyword='STAT';
+linkKeyword='LINK';
+respKeyword='RESP';
+stats = [];
+links = [];
+resps = [];
 keywordSize = 4;
-% The data is sent from the dongle to the PC in USB packets of size 2048 bytes
+% The data is sent from the dongle to the PC in USB packets of up to 2048 bytes
 % The packets are dumped to a file as binary.
-% Each packet contains just EEG or just PPG data and is prefixed with a
-% keyword ('EEG_' or 'PPG_') that identifies where the data comes from
-% so each packet is a 4 byte keyword and 2044 bytes of data
-packetSize = 2048; 
+% Each packet contains the data of just one stream and starts with a
+% 6 byte header: a keyword ('EEG_', 'PPG_', 'ACC_' or 'NAME') that identifies
+% where the data comes from, then the payload length as a little endian uint16.
+% Busy streams send full packets of 2034 bytes of data; a low-rate stream
+% sends a shorter packet once its data has waited for its maximum latency.
+% In record mode (host command 'records1') the keyword ends in 'R' instead
+% of '_' and the data goes to separate *_BLE_Records.bin files; read them
+% with read_ble_records.m.
+headerSize = keywordSize + 2;
 
 %GEt the size of the file in bytes
 fseek(fid,0,1);
 fsize = ftell(fid);
 frewind(fid);
 
-%Get the number of packets
-nPackets = fsize/packetSize;  
-
 %Read in each packet, check the keyword and save the data accordingly
-for i=1:nPackets
-    fseek(fid,(i-1)*packetSize,-1);
-    keyword = strcat(char(fread(fid,4,'uint8')))';
-    a=[];
-    a = fread(fid,packetSize-keywordSize,'uint8');
+while ftell(fid) + headerSize <= fsize
+    keyword = char(fread(fid,keywordSize,'uint8'))';
+    len = fread(fid,1,'uint16',0,'l');
+    if ftell(fid) + len > fsize
+        disp('truncated packet at end of capture')
+        break;
+    end
+    a = fread(fid,len,'uint8');
     if strcmp(keyword,eegKeyword)
         fwrite(eegFid,a,'uint8');
     elseif strcmp(keyword,ppgKeyword)
         fwrite(ppgFid,a,'uint8');
+    elseif strcmp(keyword,accKeyword)
+        fwrite(accFid,a,'uint8');
+    elseif strcmp(keyword,'EEGR')
+        fwrite(eegRecFid,a,'uint8');
+    elseif strcmp(keyword,'PPGR')
+        fwrite(ppgRecFid,a,'uint8');
+    elseif strcmp(keyword,'ACCR')
+        fwrite(accRecFid,a,'uint8');
+    elseif strcmp(keyword,nameKeyword)
+        disp(['Hardware name: ' char(a')])
+    elseif strcmp(keyword,statKeyword)
+        stats = [stats decode_stat(a)]; %#ok<AGROW>
+    elseif strcmp(keyword,linkKeyword)
+        links = [links decode_link(a)]; %#ok<AGROW>
+    elseif strcmp(keyword,respKeyword)
+        resps = [resps decode_resp(a)]; %#ok<AGROW>
     else
         disp('error')
+        break;
     end
-    
 end
 
+fclose(fid);
 fclose(eegFid);
 fclose(ppgFid);
+fclose(accFid);
+fclose(eegRecFid);
+fclose(ppgRecFid);
+fclose(accRecFid);
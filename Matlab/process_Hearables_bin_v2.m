@@ -0,0 +1,140 @@
+% Splits a capture taken with the dongle in frame format 2 (host command
+% 'format2') into one file per stream of each connected Hearable (link).
+% Every packet starts with a 14 byte header, all fields little endian:
+%   magic uint16 (0x5AA5), version uint8 (2), stream byte uint8
+%   (bits 0-3 stream: 0 EEG, 1 PPG, 2 ACC, 12 RESP, 13 LINK, 14 STAT,
+%   15 NAME; bits 4-6 link;
+%   bit 7 set in record mode), sequence number uint16,
+%   payload length uint16, receive time uint32 (app_timer ticks),
+%   CRC-16/CCITT-FALSE uint16 of the first 12 header bytes and the payload.
+% A packet whose header or CRC does not check out is skipped by searching
+% for the next magic, so a corrupted or truncated capture still decodes.
+% Packets sent in record mode (host command 'records1') go to separate
+% *_BLE_Records.bin files; read them with read_ble_records.m.
+% Link 0 writes EEG_BLE_Data.bin and so on; link k writes EEG_BLE_Data_linkk.bin.
+fid = fopen('capture.bin','rb');
+raw = fread(fid,inf,'uint8=>uint8');
+fclose(fid);
+
+maxLinks = 8;
+outNames = {'EEG_BLE_Data','PPG_BLE_Data','ACC_BLE_Data'};
+recNames = {'EEG_BLE_Records','PPG_BLE_Records','ACC_BLE_Records'};
+outFid = zeros(maxLinks,3); % Opened when a link first sends data
+recFid = zeros(maxLinks,3);
+
+headerSize = 14;
+maxPayload = 2048 - headerSize;
+crcTable = crc16_ccitt_table();
+lastSeq = -ones(maxLinks,7);
+lost = zeros(maxLinks,7);
+stats = [];
+links = [];
+resps = [];
+skipped = 0;
+
+pos = 1;
+n = numel(raw);
+while pos + headerSize - 1 <= n
+    h = double(raw(pos:pos+headerSize-1));
+    len = h(7) + 256*h(8);
+    if h(1)~=hex2dec('A5') || h(2)~=hex2dec('5A') || h(3)~=2 || len>maxPayload
+        pos = pos + 1; skipped = skipped + 1;
+        continue;
+    end
+    if pos + headerSize + len - 1 > n
+        disp('truncated packet at end of capture')
+        break;
+    end
+    payload = raw(pos+headerSize:pos+headerSize+len-1);
+    crc = crc16_ccitt(crcTable, [raw(pos:pos+11); payload]);
+    if crc ~= h(13) + 256*h(14)
+        pos = pos + 1; skipped = skipped + 1;
+        continue;
+    end
+
+    streamId = bitand(h(4),15);
+    link = bitand(bitshift(h(4),-4),7) + 1;
+    records = h(4) >= 128;
+    seq = h(5) + 256*h(6);
+    if streamId == 15
+        s = 4;
+        fprintf('Hardware name on link %d: %s\n', link-1, char(payload'));
+    elseif streamId == 14
+        s = 5;
+        stats = [stats decode_stat(payload)]; %#ok<AGROW>
+    elseif streamId == 13
+        s = 6;
+        links = [links decode_link(payload)]; %#ok<AGROW>
+    elseif streamId == 12
+        s = 7;
+        resps = [resps decode_resp(payload)]; %#ok<AGROW>
+    elseif streamId <= 2
+        s = streamId + 1;
+        if outFid(link,s) == 0
+            outFid(link,s) = fopen(link_file(outNames{s},link),'wb');
+            recFid(link,s) = fopen(link_file(recNames{s},link),'wb');
+        end
+        if records
+            fwrite(recFid(link,s),payload,'uint8');
+        else
+            fwrite(outFid(link,s),payload,'uint8');
+        end
+    else
+        s = 0;
+    end
+    if s > 0
+        if lastSeq(link,s) >= 0
+            lost(link,s) = lost(link,s) + mod(seq - lastSeq(link,s) - 1, 65536);
+        end
+        lastSeq(link,s) = seq;
+    end
+    pos = pos + headerSize + len;
+end
+
+for link=1:maxLinks
+    if any(outFid(link,:))
+        fprintf('Link %d packets lost: EEG %d, PPG %d, ACC %d\n', ...
+            link-1, lost(link,1), lost(link,2), lost(link,3));
+    end
+    for s=1:3
+        if outFid(link,s) > 0
+            fclose(outFid(link,s));
+            fclose(recFid(link,s));
+        end
+    end
+end
+fprintf('Bytes skipped while resynchronising: %d\n', skipped);
+
+
+function name = link_file(base, link)
+    if link == 1
+        name = [base '.bin'];
+    else
+        name = sprintf('%s_link%d.bin', base, link-1);
+    end
+end
+
+
+function table = crc16_ccitt_table()
+    table = zeros(1,256,'uint16');
+    for i=0:255
+        c = bitshift(uint16(i),8);
+        for k=1:8
+            if bitand(c,hex2dec('8000'))
+                c = bitxor(bitshift(c,1),hex2dec('1021'));
+            else
+                c = bitshift(c,1);
+            end
+        end
+        table(i+1) = c;
+    end
+end
+
+function crc = crc16_ccitt(table, data)
+    crc = uint16(hex2dec('FFFF'));
+    for i=1:numel(data)
+        idx = bitxor(bitshift(crc,-8),uint16(data(i)));
+        crc = bitxor(bitshift(crc,8),table(double(idx)+1));
+    end
+    crc = double(crc);
+end
@@ -0,0 +1,29 @@
+function [records, rxTicks] = read_ble_records(fileName)
+% Reads a *_BLE_Records.bin file written by process_Hearables_bin.m or
+% process_Hearables_bin_v2.m and returns one cell per BLE notification, in
+% the order they were received.
+% Every record in the file is its length (uint16, little endian), the time
+% the dongle received it (uint32, app_timer ticks of 1/32768 s, wrapping
+% at 2^24) and the notification data, so a lost notification only loses
+% that record and never shifts the blocks after it.
+% rxTicks holds the receive time of each record, unwrapped.
+fid = fopen(fileName,'r');
+raw = fread(fid,inf,'uint8=>uint8');
+fclose(fid);
+
+records = {};
+rxTicks = [];
+pos = 1;
+while pos + 5 <= numel(raw)
+    h = double(raw(pos:pos+5));
+    len = h(1) + 256*h(2);
+    if pos + 5 + len > numel(raw)
+        disp('truncated record at end of file')
+        break;
+    end
+    records{end+1} = raw(pos+6:pos+5+len); %#ok<AGROW>
+    rxTicks(end+1) = h(3) + 256*h(4) + 65536*h(5) + 16777216*h(6); %#ok<AGROW>
+    pos = pos + 6 + len;
+end
+rxTicks = rxTicks + 2^24*cumsum([0 diff(rxTicks) < 0]);
+end
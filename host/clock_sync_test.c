@@ -0,0 +1,329 @@
+/**@file
+ *
+ * @brief Unit test of the device clock tracking (src/clock_sync.c).
+ *
+ * @details A Hearable clock running a known number of ppm slower or faster than the dongle clock
+ *          stamps a sample every connection interval, and each sample reaches the dongle after a
+ *          random radio delay of up to @ref DELAY_MAX_US. The test keeps the least delayed sample
+ *          of each report period itself, and checks the offset against the residual of the latest
+ *          one and the drift against the slope from the first one, within the rounding of the
+ *          two counters, as well as the drift against the true one over a long span and the
+ *          states before and after @ref CLOCK_SYNC_MIN_SPAN_S of device time.
+ *
+ *          Samples off the estimate by more than @ref CLOCK_SYNC_MAX_JUMP_US either way are
+ *          rejected and leave it as it was, while samples just within are used. Last, the dongle
+ *          time is taken across wraps of the 24-bit app_timer counter, with samples and with only
+ *          reports for longer than a wrap, the device counter wraps as well, and the Hearable is
+ *          anchored again after a wrap, as after a reconnect, which restarts the estimate.
+ *
+ *          Usage: clock_sync_test
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "app_timer.h"
+#include "clock_sync.h"
+
+#define CHECK(cond)                                                     \
+    do                                                                  \
+    {                                                                   \
+        if (!(cond))                                                    \
+        {                                                               \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            m_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+#define INTERVAL_US         15000       /**< Time between samples, a connection interval. */
+#define DELAY_MAX_US        10000       /**< Longest radio delay of a sample. */
+#define REPORT_US           1000000     /**< Report period. */
+#define WRAP_US             ((uint64_t)(APP_TIMER_MAX_CNT_VAL + 1) * 1000000 / APP_TIMER_CLOCK_FREQ)   /**< Period of the app_timer counter. */
+#define ROUNDING_US         70          /**< Largest error of a residual from the ticks of both counters. */
+#define DRIFT_TOL_PPB       5000        /**< Largest error of the drift against the true one after 2 minutes: minima 0.6 ms apart. */
+
+/**@brief Sample of a report period with the least delay. */
+typedef struct
+{
+    double t_us;            /**< Time the Hearable stamped it. */
+    double delay_us;        /**< Radio delay. */
+} least_t;
+
+/**@brief Hearable: its clock against the dongle clock, the tracking of the dongle and the least
+ *        delayed samples the estimate should rest on.
+ */
+typedef struct
+{
+    double       ppm;           /**< Dongle clock rate minus Hearable clock rate, in ppm. */
+    uint32_t     dev_start;     /**< Hearable counter at time 0. */
+    uint64_t     rx_start_us;   /**< Dongle time at time 0, so the app_timer counter wraps where the test wants. */
+    clock_sync_t sync;          /**< Tracking of the dongle. */
+    double       anchor_us;     /**< Time of the anchor. */
+    bool         first_valid;
+    least_t      first;         /**< Least delayed sample of the first period with samples. */
+    least_t      last;          /**< Least delayed sample of the latest period with samples. */
+    bool         win_valid;
+    least_t      win;           /**< Least delayed sample of the current period. */
+} hearable_t;
+
+static unsigned m_failures;
+static uint32_t m_rand_state = 1;
+
+
+/**@brief Function for a uniform random number in [0, 1), the same sequence on every host. */
+static double rand_unit(void)
+{
+    m_rand_state = m_rand_state * 1664525UL + 1013904223UL;
+    return (double)(m_rand_state >> 8) / (double)(1UL << 24);
+}
+
+
+/**@brief Function for the Hearable counter at a time, wrapping at 32 bits. */
+static uint32_t dev_ticks(hearable_t const * p_hearable, double t_us)
+{
+    double ticks = floor(t_us * CLOCK_SYNC_DEVICE_FREQ / 1e6 * (1 - p_hearable->ppm * 1e-6));
+
+    return p_hearable->dev_start + (uint32_t)(uint64_t)ticks;
+}
+
+
+/**@brief Function for the app_timer counter of the dongle at a time, wrapping at 24 bits. */
+static uint32_t rx_ticks(hearable_t const * p_hearable, double t_us)
+{
+    return (uint32_t)(uint64_t)floor((p_hearable->rx_start_us + t_us) * APP_TIMER_CLOCK_FREQ / 1e6) & APP_TIMER_MAX_CNT_VAL;
+}
+
+
+/**@brief Function for the start time of the Hearable reaching the dongle with no delay. */
+static void anchor(hearable_t * p_hearable, double t_us)
+{
+    clock_sync_anchor(&p_hearable->sync, dev_ticks(p_hearable, t_us), rx_ticks(p_hearable, t_us));
+    p_hearable->anchor_us   = t_us;
+    p_hearable->first_valid = false;
+    p_hearable->win_valid   = false;
+}
+
+
+/**@brief Function for a sample stamped at a time reaching the dongle after a delay. */
+static void sample(hearable_t * p_hearable, double t_us, double delay_us)
+{
+    clock_sync_sample(&p_hearable->sync, dev_ticks(p_hearable, t_us), rx_ticks(p_hearable, t_us + delay_us));
+    if (!p_hearable->win_valid || (delay_us < p_hearable->win.delay_us))
+    {
+        p_hearable->win_valid    = true;
+        p_hearable->win.t_us     = t_us;
+        p_hearable->win.delay_us = delay_us;
+    }
+}
+
+
+/**@brief Function for the end of a report period. */
+static void report(hearable_t * p_hearable, double t_us, clock_sync_report_t * p_report)
+{
+    clock_sync_report(&p_hearable->sync, rx_ticks(p_hearable, t_us), p_report);
+    if (p_hearable->win_valid)
+    {
+        if (!p_hearable->first_valid)
+        {
+            p_hearable->first_valid = true;
+            p_hearable->first       = p_hearable->win;
+        }
+        p_hearable->last      = p_hearable->win;
+        p_hearable->win_valid = false;
+    }
+}
+
+
+/**@brief Function for streaming from a Hearable: a sample every interval, received after a random
+ *        delay, and a report at the end of every period.
+ *
+ * @param[in]  p_hearable Hearable.
+ * @param[in]  from_us    Time of the first sample.
+ * @param[in]  to_us      End of the stream, and of its last period.
+ * @param[in]  samples    Send samples, or only report.
+ * @param[out] p_report   Latest report.
+ */
+static void stream(hearable_t * p_hearable, double from_us, double to_us, bool samples, clock_sync_report_t * p_report)
+{
+    double next_report_us = from_us + REPORT_US;
+
+    for (double t_us = from_us; t_us < to_us; t_us += INTERVAL_US)
+    {
+        if (t_us >= next_report_us)
+        {
+            report(p_hearable, next_report_us, p_report);
+            next_report_us += REPORT_US;
+        }
+        if (samples)
+        {
+            sample(p_hearable, t_us, rand_unit() * DELAY_MAX_US);
+        }
+    }
+    report(p_hearable, to_us, p_report);
+}
+
+
+/**@brief Function for the residual of a sample: its delay plus the drift since the anchor. */
+static double residual_us(hearable_t const * p_hearable, least_t const * p_least)
+{
+    return p_least->delay_us + p_hearable->ppm * (p_least->t_us - p_hearable->anchor_us) / 1e6;
+}
+
+
+/**@brief Function for checking a report against the least delayed samples: the offset is the
+ *        residual of the latest, and once tracking the drift is the slope from the first.
+ */
+static bool estimate_ok(hearable_t const * p_hearable, clock_sync_report_t const * p_report)
+{
+    double span_us = p_hearable->last.t_us - p_hearable->first.t_us;
+    double drift_ppb;
+
+    if (fabs(p_report->offset_us - residual_us(p_hearable, &p_hearable->last)) > ROUNDING_US)
+    {
+        return false;
+    }
+    if (span_us < CLOCK_SYNC_MIN_SPAN_S * 1e6)
+    {
+        return p_report->state == CLOCK_SYNC_STATE_ANCHORED;
+    }
+    drift_ppb = (residual_us(p_hearable, &p_hearable->last) - residual_us(p_hearable, &p_hearable->first)) * 1e9 / span_us;
+    return (p_report->state == CLOCK_SYNC_STATE_TRACKING)
+        && (fabs(p_report->drift_ppb - drift_ppb) <= 2 * ROUNDING_US * 1e9 / span_us);
+}
+
+
+/**@brief Test of the offset and the drift under jitter, for clocks drifting either way. */
+static void test_drift(void)
+{
+    static double const ppms[] = {40, -40, 0, 150};
+
+    for (size_t i = 0; i < sizeof(ppms) / sizeof(ppms[0]); i++)
+    {
+        hearable_t          hearable = {.ppm = ppms[i], .dev_start = 123456, .rx_start_us = 1000000};
+        clock_sync_report_t rep;
+
+        clock_sync_reset(&hearable.sync);
+
+        // Samples before the start time are ignored.
+        clock_sync_sample(&hearable.sync, dev_ticks(&hearable, 0), rx_ticks(&hearable, 0));
+        clock_sync_report(&hearable.sync, rx_ticks(&hearable, 0), &rep);
+        CHECK(rep.state == CLOCK_SYNC_STATE_NONE);
+        CHECK(rep.samples == 0);
+
+        anchor(&hearable, 0);
+        stream(&hearable, 0, 5e6, true, &rep);
+        CHECK(rep.state == CLOCK_SYNC_STATE_ANCHORED);
+        CHECK(rep.dev_anchor == hearable.dev_start);
+        CHECK(rep.rx_anchor == rx_ticks(&hearable, 0));
+        CHECK(rep.samples >= REPORT_US / INTERVAL_US);
+        CHECK(rep.rejected == 0);
+        CHECK(estimate_ok(&hearable, &rep));
+
+        // Tracking once the first and latest minima are far enough apart.
+        stream(&hearable, 5e6, 20e6, true, &rep);
+        CHECK(rep.state == CLOCK_SYNC_STATE_TRACKING);
+        CHECK(estimate_ok(&hearable, &rep));
+        stream(&hearable, 20e6, 120e6, true, &rep);
+        CHECK(estimate_ok(&hearable, &rep));
+        CHECK(fabs(rep.drift_ppb - ppms[i] * 1000) <= DRIFT_TOL_PPB);
+    }
+}
+
+
+/**@brief Test of the samples rejected for being too far from the estimate. */
+static void test_outliers(void)
+{
+    hearable_t          hearable = {.ppm = 40};
+    clock_sync_report_t rep;
+    clock_sync_report_t before;
+    uint32_t            dev;
+    uint32_t            rx;
+
+    anchor(&hearable, 0);
+    stream(&hearable, 0, 30e6, true, &rep);
+    CHECK(estimate_ok(&hearable, &rep));
+
+    // Device times 300 ms late and early, and one that is no device time at all, among samples
+    // within the bound, only one of them close to the estimate.
+    dev = dev_ticks(&hearable, 30.1e6);
+    rx  = rx_ticks(&hearable, 30.1e6);
+    clock_sync_sample(&hearable.sync, dev - 300 * CLOCK_SYNC_DEVICE_FREQ / 1000, rx);
+    clock_sync_sample(&hearable.sync, dev + 300 * CLOCK_SYNC_DEVICE_FREQ / 1000, rx);
+    clock_sync_sample(&hearable.sync, dev + 0x80000000UL, rx);
+    clock_sync_sample(&hearable.sync, dev - 240 * CLOCK_SYNC_DEVICE_FREQ / 1000, rx);
+    sample(&hearable, 30.1e6, 0);
+    report(&hearable, 30.5e6, &rep);
+    CHECK(rep.rejected == 3);
+    CHECK(rep.samples == 2);
+    CHECK(estimate_ok(&hearable, &rep));
+
+    // A period of outliers only leaves the estimate as it was.
+    before = rep;
+    dev    = dev_ticks(&hearable, 31e6);
+    rx     = rx_ticks(&hearable, 31e6);
+    clock_sync_sample(&hearable.sync, dev - 260 * CLOCK_SYNC_DEVICE_FREQ / 1000, rx);
+    clock_sync_sample(&hearable.sync, dev + 260 * CLOCK_SYNC_DEVICE_FREQ / 1000, rx);
+    report(&hearable, 31.5e6, &rep);
+    CHECK(rep.rejected == 2);
+    CHECK(rep.samples == 0);
+    CHECK(rep.offset_us == before.offset_us);
+    CHECK(rep.drift_ppb == before.drift_ppb);
+
+    // Tracking goes on.
+    stream(&hearable, 31.5e6, 60e6, true, &rep);
+    CHECK(rep.rejected == 0);
+    CHECK(estimate_ok(&hearable, &rep));
+}
+
+
+/**@brief Test of the dongle and device counters wrapping, and of a new anchor after a wrap. */
+static void test_wrap(void)
+{
+    // The app_timer counter wraps 10 s in, and the device counter 20 s in.
+    hearable_t          hearable = {.ppm = -60, .dev_start = 0 - 20 * CLOCK_SYNC_DEVICE_FREQ, .rx_start_us = WRAP_US - 10000000};
+    clock_sync_report_t rep;
+    double              t_us;
+
+    anchor(&hearable, 0);
+    stream(&hearable, 0, 60e6, true, &rep);
+    CHECK(estimate_ok(&hearable, &rep));
+
+    // Samples stop for longer than a wrap; the reports keep the dongle time.
+    t_us = 60e6 + WRAP_US + 100e6;
+    stream(&hearable, 60e6, t_us, false, &rep);
+    CHECK(rep.samples == 0);
+    stream(&hearable, t_us, t_us + 30e6, true, &rep);
+    CHECK(estimate_ok(&hearable, &rep));
+
+    // Through another wrap with samples.
+    stream(&hearable, t_us + 30e6, t_us + 30e6 + WRAP_US, true, &rep);
+    CHECK(estimate_ok(&hearable, &rep));
+
+    // The Hearable reconnects with its counter restarted and its clock drifting the other way.
+    t_us                = 3 * WRAP_US + 5e6;
+    hearable.ppm        = 25;
+    hearable.dev_start  = 0;
+    hearable.dev_start  = 0 - dev_ticks(&hearable, t_us);
+    anchor(&hearable, t_us);
+    clock_sync_report(&hearable.sync, rx_ticks(&hearable, t_us), &rep);
+    CHECK(rep.state == CLOCK_SYNC_STATE_ANCHORED);
+    CHECK(rep.dev_anchor == 0);
+    CHECK(rep.rx_anchor == rx_ticks(&hearable, t_us));
+    CHECK(rep.offset_us == 0);
+    CHECK(rep.drift_ppb == 0);
+    stream(&hearable, t_us, t_us + 60e6, true, &rep);
+    CHECK(estimate_ok(&hearable, &rep));
+}
+
+
+int main(void)
+{
+    test_drift();
+    test_outliers();
+    test_wrap();
+
+    printf("clock_sync_test: %s\n", (m_failures == 0) ? "ok" : "FAILED");
+    return (m_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,437 @@
+/**@file
+ *
+ * @brief Scripted event driver of the dongle data path.
+ *
+ * @details Plays a script of notifications, timer ticks and TX_DONE events into the data path
+ *          of the dongle (src/data_path.c) and checks the packets written to the CDC ACM stand-in
+ *          with the USB sink (usb_sink.c). After every event a main loop pass runs, as on the
+ *          dongle. One command per line, # starts a comment:
+ *
+ *          links N                  Links of the path, before the first event (default 1).
+ *          format 1|2               Header format, before the first event.
+ *          sched wrr|drain          Stream choice, before the first event.
+ *          records 0|1              Record mode, before the first event.
+ *          notif LINK STREAM LEN [N]  N notifications of LEN bytes (default 1).
+ *          txdone [N]               N writes completed, each followed by a main loop pass (default 1).
+ *          wait MS                  Time passes; the flush timer ticks every 10 ms.
+ *          drain                    Writes complete until no committed packet is left.
+ *          port 0|1                 The host closes or opens the port; writes are refused while
+ *                                   it is closed, and a write in progress is abandoned.
+ *          repeat N ... end         The lines in between, N times. Blocks do not nest.
+ *          restart                  A new data path with the default configuration, for another
+ *                                   run in the same script.
+ *          expect WHAT LINK STREAM OP VALUE
+ *                                   Check a counter of a stream. WHAT is puts, drops, bytes_in,
+ *                                   bytes_dropped, packets, bytes_out, failures, sink_packets,
+ *                                   sink_bytes or seq_gaps; OP is ==, <=, >= or <. Also "expect crc_errors 0 0 == 0"
+ *                                   and "expect bad_headers 0 0 == 0" for the sink as a whole.
+ *
+ *          The program exits with 1 if an expectation fails or a line is invalid.
+ *
+ *          Usage: event_driver SCRIPT...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "app_timer.h"
+#include "app_usbd_cdc_acm.h"
+#include "data_path.h"
+#include "usb_sink.h"
+
+#define LINE_MAX_LEN 256
+#define BLOCK_MAX_LINES 64
+
+/**@brief State of a script being played. */
+typedef struct
+{
+    data_path_cfg_t    cfg;         /**< Configuration, fixed by the first event. */
+    usb_frame_format_t format;      /**< Header format, fixed by the first event. */
+    bool               records;     /**< Record mode, fixed by the first event. */
+    data_path_t        path;        /**< Data path. */
+    app_usbd_cdc_acm_t cdc_acm;     /**< Port the path writes to. */
+    usb_sink_t         sink;        /**< Packets written. */
+    bool               started;     /**< The path is set up. */
+    uint32_t           now_ms;      /**< Time played so far. */
+    uint32_t           failures;    /**< Failed expectations. */
+    uint8_t            storage[DATA_PATH_LINK_MAX*DATA_PATH_FRAMES_PER_LINK*DATA_PATH_FRAME_SIZE];  /**< Pool storage. */
+    uint8_t            payload[USB_FRAME_V2_HEADER_LEN + DATA_PATH_FRAME_SIZE];                     /**< Data of the notifications. */
+} driver_t;
+
+
+/**@brief Function for a main loop pass, as in main of src/main.c: the transmit queue is topped up
+ *        and its head written, and a write started is handed to the sink.
+ */
+static void loop_pass(driver_t * p_drv)
+{
+    uint8_t const * p_data;
+    size_t          len;
+
+    data_path_tx_fill(&p_drv->path);
+    data_path_tx_start(&p_drv->path);
+    if (host_cdc_acm_tx_take(&p_drv->cdc_acm, &p_data, &len))
+    {
+        (void)usb_sink_packet(&p_drv->sink, p_data, (uint16_t)len);
+    }
+}
+
+
+/**@brief Function for the host taking the write in progress: TX_DONE, then a main loop pass.
+ *
+ * @return false if no write was in progress.
+ */
+static bool tx_done(driver_t * p_drv)
+{
+    if (!p_drv->cdc_acm.busy)
+    {
+        return false;
+    }
+    host_cdc_acm_tx_end(&p_drv->cdc_acm);
+    data_path_tx_done(&p_drv->path);
+    loop_pass(p_drv);
+    return true;
+}
+
+
+/**@brief Function for setting up the path once the configuration is complete. */
+static bool start(driver_t * p_drv)
+{
+    if (p_drv->started)
+    {
+        return true;
+    }
+    if (data_path_init(&p_drv->path, &p_drv->cfg, p_drv->storage, sizeof(p_drv->storage), &p_drv->cdc_acm) != NRF_SUCCESS)
+    {
+        return false;
+    }
+    p_drv->path.format  = p_drv->format;
+    p_drv->path.records = p_drv->records;
+    host_cdc_acm_port_set(&p_drv->cdc_acm, true);
+    usb_sink_init(&p_drv->sink, p_drv->format);
+    p_drv->started = true;
+    return true;
+}
+
+
+/**@brief Function for the configuration of the dongle, for a number of links. */
+static void cfg_default(driver_t * p_drv, uint8_t link_count)
+{
+    data_path_cfg_default(&p_drv->cfg, link_count);
+    p_drv->format  = (link_count > 1) ? USB_FRAME_FORMAT_V2 : USB_FRAME_FORMAT_V1;
+    p_drv->records = false;
+}
+
+
+/**@brief Function for getting a counter named in an expect line. */
+static bool counter_get(driver_t * p_drv, char const * p_what, unsigned link, unsigned stream, uint64_t * p_value)
+{
+    pktbuf_stats_t const    * p_ring;
+    data_path_stats_t const * p_out;
+    usb_sink_stream_t const * p_sink;
+
+    if (strcmp(p_what, "crc_errors") == 0)
+    {
+        *p_value = p_drv->sink.crc_errors;
+        return true;
+    }
+    if (strcmp(p_what, "bad_headers") == 0)
+    {
+        *p_value = p_drv->sink.bad_headers;
+        return true;
+    }
+    if ((link >= p_drv->cfg.link_count) || (stream >= STREAM_COUNT))
+    {
+        return false;
+    }
+
+    p_ring = &p_drv->path.ring[link][stream].stats;
+    p_out  = &p_drv->path.stats[link][stream];
+    p_sink = &p_drv->sink.streams[link][stream];
+    if      (strcmp(p_what, "puts") == 0)          { *p_value = p_ring->puts; }
+    else if (strcmp(p_what, "drops") == 0)         { *p_value = p_ring->drops; }
+    else if (strcmp(p_what, "bytes_in") == 0)      { *p_value = p_ring->bytes_in; }
+    else if (strcmp(p_what, "bytes_dropped") == 0) { *p_value = p_ring->bytes_dropped; }
+    else if (strcmp(p_what, "packets") == 0)       { *p_value = p_out->packets_out; }
+    else if (strcmp(p_what, "bytes_out") == 0)     { *p_value = p_out->bytes_out; }
+    else if (strcmp(p_what, "failures") == 0)      { *p_value = p_out->usb_write_failures; }
+    else if (strcmp(p_what, "sink_packets") == 0)  { *p_value = p_sink->packets; }
+    else if (strcmp(p_what, "sink_bytes") == 0)    { *p_value = p_sink->bytes; }
+    else if (strcmp(p_what, "seq_gaps") == 0)      { *p_value = p_sink->seq_gaps; }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+
+/**@brief Function for checking an expect line.
+ *
+ * @return false if the line is invalid. A failed expectation is counted, not returned.
+ */
+static bool expect(driver_t * p_drv, char const * p_args, char const * p_file, unsigned line_no)
+{
+    char               what[32];
+    char               op[3];
+    unsigned           link;
+    unsigned           stream;
+    unsigned long long expected;
+    uint64_t           value;
+    bool               ok;
+
+    if ((sscanf(p_args, "%31s %u %u %2s %llu", what, &link, &stream, op, &expected) != 5)
+            || !counter_get(p_drv, what, link, stream, &value))
+    {
+        return false;
+    }
+    if      (strcmp(op, "==") == 0) { ok = (value == expected); }
+    else if (strcmp(op, "<=") == 0) { ok = (value <= expected); }
+    else if (strcmp(op, ">=") == 0) { ok = (value >= expected); }
+    else if (strcmp(op, "<") == 0)  { ok = (value < expected); }
+    else
+    {
+        return false;
+    }
+
+    if (!ok)
+    {
+        printf("%s:%u: expected %s of link %u stream %u %s %llu, got %llu\n",
+               p_file, line_no, what, link, stream, op, expected, (unsigned long long)value);
+        p_drv->failures++;
+    }
+    return true;
+}
+
+
+/**@brief Function for playing one line of a script.
+ *
+ * @return false if the line is invalid.
+ */
+static bool line_play(driver_t * p_drv, char * p_line, char const * p_file, unsigned line_no)
+{
+    char     cmd[16];
+    int      args_pos = 0;
+    unsigned a;
+    unsigned b;
+    unsigned c;
+    unsigned n;
+    char     word[16];
+
+    if (strchr(p_line, '#') != NULL)
+    {
+        *strchr(p_line, '#') = '\0';
+    }
+    if (sscanf(p_line, "%15s %n", cmd, &args_pos) != 1)
+    {
+        return true;    // Blank line
+    }
+    p_line += args_pos;
+
+    if (strcmp(cmd, "restart") == 0)
+    {
+        uint32_t failures = p_drv->failures;
+
+        memset(p_drv, 0, sizeof(*p_drv));
+        p_drv->failures = failures;
+        cfg_default(p_drv, 1);
+        return true;
+    }
+    if ((strcmp(cmd, "links") == 0) && !p_drv->started && (sscanf(p_line, "%u", &a) == 1))
+    {
+        cfg_default(p_drv, (uint8_t)a);
+        return (a > 0) && (a <= DATA_PATH_LINK_MAX);
+    }
+    if ((strcmp(cmd, "format") == 0) && !p_drv->started && (sscanf(p_line, "%u", &a) == 1))
+    {
+        p_drv->format = (a == 1) ? USB_FRAME_FORMAT_V1 : USB_FRAME_FORMAT_V2;
+        return (a == 1) || (a == 2);
+    }
+    if ((strcmp(cmd, "sched") == 0) && !p_drv->started && (sscanf(p_line, "%15s", word) == 1))
+    {
+        p_drv->cfg.sched = (strcmp(word, "drain") == 0) ? DATA_PATH_SCHED_DRAIN : DATA_PATH_SCHED_WRR;
+        return (strcmp(word, "drain") == 0) || (strcmp(word, "wrr") == 0);
+    }
+    if ((strcmp(cmd, "records") == 0) && !p_drv->started && (sscanf(p_line, "%u", &a) == 1))
+    {
+        p_drv->records = (a != 0);
+        return true;
+    }
+
+    if (!start(p_drv))
+    {
+        return false;
+    }
+
+    if (strcmp(cmd, "notif") == 0)
+    {
+        int fields = sscanf(p_line, "%u %u %u %u", &a, &b, &c, &n);
+
+        if ((fields < 3) || (a >= p_drv->cfg.link_count) || (b >= STREAM_COUNT) || (c > sizeof(p_drv->payload)))
+        {
+            return false;
+        }
+        for (unsigned i = 0; i < ((fields == 4) ? n : 1); i++)
+        {
+            memset(p_drv->payload, (int)i, c);
+            (void)data_path_put(&p_drv->path, (uint8_t)a, (uint8_t)b, p_drv->payload, (uint16_t)c, app_timer_cnt_get());
+            loop_pass(p_drv);
+        }
+        return true;
+    }
+    if (strcmp(cmd, "txdone") == 0)
+    {
+        n = (sscanf(p_line, "%u", &n) == 1) ? n : 1;
+        for (unsigned i = 0; i < n; i++)
+        {
+            if (!tx_done(p_drv))
+            {
+                loop_pass(p_drv);
+            }
+        }
+        return true;
+    }
+    if ((strcmp(cmd, "wait") == 0) && (sscanf(p_line, "%u", &a) == 1))
+    {
+        for (unsigned ms = 0; ms < a; ms++)
+        {
+            host_timer_advance_us(1000);
+            if (++p_drv->now_ms % DATA_PATH_TICK_MS == 0)
+            {
+                data_path_tick(&p_drv->path);
+                loop_pass(p_drv);
+            }
+        }
+        return true;
+    }
+    if (strcmp(cmd, "drain") == 0)
+    {
+        // Nothing is written while the port is closed.
+        while (data_path_busy(&p_drv->path) && tx_done(p_drv))
+        {
+        }
+        return true;
+    }
+    if ((strcmp(cmd, "port") == 0) && (sscanf(p_line, "%u", &a) == 1))
+    {
+        // Closing the port abandons the write in progress without TX_DONE.
+        host_cdc_acm_port_set(&p_drv->cdc_acm, a != 0);
+        if (a == 0)
+        {
+            data_path_tx_abort(&p_drv->path);
+        }
+        loop_pass(p_drv);
+        return a <= 1;
+    }
+    if (strcmp(cmd, "expect") == 0)
+    {
+        return expect(p_drv, p_line, p_file, line_no);
+    }
+    return false;
+}
+
+
+/**@brief Function for playing a script file.
+ *
+ * @return Number of failures: invalid lines and failed expectations.
+ */
+static uint32_t script_play(char const * p_file)
+{
+    static driver_t drv;
+    static char     block[BLOCK_MAX_LINES][LINE_MAX_LEN];
+    char            line[LINE_MAX_LEN];
+    char            play[LINE_MAX_LEN];
+    unsigned        line_no     = 0;
+    unsigned        block_start = 0;
+    unsigned        block_lines = 0;
+    unsigned        repeats     = 0;
+    bool            in_block    = false;
+    uint32_t        errors      = 0;
+    FILE          * p_fp        = fopen(p_file, "r");
+
+    if (p_fp == NULL)
+    {
+        printf("%s: cannot open\n", p_file);
+        return 1;
+    }
+    memset(&drv, 0, sizeof(drv));
+    cfg_default(&drv, 1);
+
+    while (fgets(line, sizeof(line), p_fp) != NULL)
+    {
+        char word[8] = "";
+
+        line_no++;
+        (void)sscanf(line, "%7s", word);
+        if (!in_block && (strcmp(word, "repeat") == 0))
+        {
+            in_block    = (sscanf(line, "%*s %u", &repeats) == 1);
+            block_start = line_no;
+            block_lines = 0;
+            if (!in_block)
+            {
+                printf("%s:%u: invalid line\n", p_file, line_no);
+                errors++;
+            }
+            continue;
+        }
+        if (in_block && (strcmp(word, "end") == 0))
+        {
+            in_block = false;
+            for (unsigned r = 0; r < repeats; r++)
+            {
+                for (unsigned i = 0; i < block_lines; i++)
+                {
+                    // line_play cuts comments off, so it gets a copy.
+                    strcpy(play, block[i]);
+                    if (!line_play(&drv, play, p_file, block_start + 1 + i) && (r == 0))
+                    {
+                        printf("%s:%u: invalid line\n", p_file, block_start + 1 + i);
+                        errors++;
+                    }
+                }
+            }
+            continue;
+        }
+        if (in_block)
+        {
+            if (block_lines == BLOCK_MAX_LINES)
+            {
+                printf("%s:%u: block too long\n", p_file, line_no);
+                errors++;
+                continue;
+            }
+            strcpy(block[block_lines++], line);
+            continue;
+        }
+        if (!line_play(&drv, line, p_file, line_no))
+        {
+            printf("%s:%u: invalid line\n", p_file, line_no);
+            errors++;
+        }
+    }
+    fclose(p_fp);
+    if (in_block)
+    {
+        printf("%s:%u: repeat without end\n", p_file, block_start);
+        errors++;
+    }
+    printf("%s: %s\n", p_file, (errors + drv.failures == 0) ? "ok" : "FAILED");
+    return errors + drv.failures;
+}
+
+
+int main(int argc, char * argv[])
+{
+    uint32_t failures = 0;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s SCRIPT...\n", argv[0]);
+        return 2;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        failures += script_play(argv[i]);
+    }
+    return (failures == 0) ? 0 : 1;
+}
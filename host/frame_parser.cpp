@@ -0,0 +1,183 @@
+/**@file
+ *
+ * @brief Reference parser of the version 2 USB frame format, implementation.
+ */
+
+#include <array>
+#include <cstring>
+#include <utility>
+#include "frame_parser.hpp"
+
+namespace hearable
+{
+
+namespace
+{
+
+/**@brief Table of the CRC-16/CCITT-FALSE polynomial, 0x1021, one entry per byte value. */
+std::array<uint16_t, 256> const crc_table = []
+{
+    std::array<uint16_t, 256> table{};
+
+    for (unsigned i = 0; i < 256; i++)
+    {
+        uint16_t crc = (uint16_t)(i << 8);
+
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (uint16_t)((crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1));
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+uint16_t get_u16(uint8_t const * p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t get_u32(uint8_t const * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+} // namespace
+
+
+frame_parser::frame_parser(handler_t handler, uint16_t max_payload)
+    : m_handler(std::move(handler)), m_max_payload(max_payload)
+{
+    m_buf.reserve(2 * (header_len + max_payload));
+}
+
+
+uint16_t frame_parser::crc16(uint8_t const * p_data, size_t len, uint16_t crc)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = (uint16_t)((crc << 8) ^ crc_table[(uint8_t)((crc >> 8) ^ p_data[i])]);
+    }
+    return crc;
+}
+
+
+void frame_parser::feed(uint8_t const * p_data, size_t len)
+{
+    m_stats.bytes_in += len;
+
+    // Drop what was parsed once it is at least half the buffer, so a byte is moved at most once on
+    // average and the buffer stays at about two packets.
+    if ((m_start > 0) && (2 * m_start >= m_buf.size()))
+    {
+        m_buf.erase(m_buf.begin(), m_buf.begin() + (ptrdiff_t)m_start);
+        m_start = 0;
+    }
+    m_buf.insert(m_buf.end(), p_data, p_data + len);
+
+    while (parse_one())
+    {
+    }
+}
+
+
+void frame_parser::skip()
+{
+    uint8_t const * p_begin = m_buf.data() + m_start + 1;
+    size_t          left    = m_buf.size() - m_start - 1;
+    void const    * p_next  = std::memchr(p_begin, magic & 0xFF, left);
+    size_t          dropped = (p_next == nullptr) ? left + 1 : (size_t)((uint8_t const *)p_next - p_begin) + 1;
+
+    m_stats.bytes_skipped += dropped;
+    m_start               += dropped;
+    m_in_step              = false;
+}
+
+
+bool frame_parser::parse_one()
+{
+    uint8_t const * p_header = m_buf.data() + m_start;
+    size_t          avail    = m_buf.size() - m_start;
+    uint16_t        len;
+
+    if (avail == 0)
+    {
+        return false;
+    }
+    if (p_header[0] != (magic & 0xFF))
+    {
+        skip();
+        return true;
+    }
+    if (avail < header_len)
+    {
+        // The first byte is right; check what is there of the rest of the magic before waiting.
+        if ((avail >= 2) && (get_u16(p_header) != magic))
+        {
+            skip();
+            return true;
+        }
+        return false;
+    }
+
+    len = get_u16(&p_header[6]);
+    if ((get_u16(p_header) != magic) || (p_header[2] != version) || (len > m_max_payload))
+    {
+        if (get_u16(p_header) == magic)
+        {
+            m_stats.bad_headers++;
+        }
+        skip();
+        return true;
+    }
+    if (avail < header_len + len)
+    {
+        return false;
+    }
+
+    {
+        uint16_t crc = crc16(p_header, 12);
+
+        crc = crc16(&p_header[header_len], len, crc);
+        if (crc != get_u16(&p_header[12]))
+        {
+            m_stats.crc_errors++;
+            skip();
+            return true;
+        }
+    }
+
+    frame f;
+    f.link      = (uint8_t)((p_header[3] >> 4) & (link_count - 1));
+    f.stream_id = (uint8_t)(p_header[3] & 0x0F);
+    f.records   = (p_header[3] & 0x80) != 0;
+    f.seq       = get_u16(&p_header[4]);
+    f.timestamp = get_u32(&p_header[8]);
+    f.p_payload = &p_header[header_len];
+    f.len       = len;
+
+    {
+        stream_stats & s = m_streams[f.link][f.stream_id];
+
+        if (s.seq_valid && (f.seq != s.next_seq))
+        {
+            s.seq_gaps += (uint16_t)(f.seq - s.next_seq);
+        }
+        s.seq_valid = true;
+        s.next_seq  = (uint16_t)(f.seq + 1);
+        s.packets++;
+        s.bytes += len;
+    }
+    if (!m_in_step)
+    {
+        m_stats.resyncs++;
+        m_in_step = true;
+    }
+    m_stats.packets++;
+    m_start += header_len + len;
+
+    m_handler(f);
+    return true;
+}
+
+} // namespace hearable
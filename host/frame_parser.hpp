@@ -0,0 +1,125 @@
+/**@file
+ *
+ * @brief Reference parser of the version 2 USB frame format (src/usb_frame.h), in C++.
+ *
+ * @details The parser takes the bytes of the CDC ACM port in chunks of any size, as a read from
+ *          the serial port returns them, and hands every packet with a good header and CRC to a
+ *          handler. It does not use the firmware sources, so it checks them as well as the host.
+ *
+ *          A packet is accepted when the magic, the version, a payload length of at most
+ *          @ref frame_parser::max_payload and the CRC all match. Anything else, such as lost,
+ *          repeated or corrupted bytes, makes the parser drop one byte and look for the next magic,
+ *          so it is back in step at the first whole packet after the damage. While in step it
+ *          never searches a payload for the magic, so data that happens to contain it costs
+ *          nothing.
+ *
+ *          Sequence numbers are followed per stream of each link, and a jump counts the packets
+ *          missed. Version 1 headers carry no magic nor CRC and cannot be resynchronised; the
+ *          parser only takes version 2.
+ */
+
+#ifndef FRAME_PARSER_HPP__
+#define FRAME_PARSER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace hearable
+{
+
+/**@brief Packet found by the parser. The payload is only valid during the call to the handler. */
+struct frame
+{
+    uint8_t         link;       /**< Link the stream belongs to. */
+    uint8_t         stream_id;  /**< Stream id: 0 to 2 for EEG, PPG and ACC, or one of the 0x0C to 0x0F ids. */
+    bool            records;    /**< The payload is made of records. */
+    uint16_t        seq;        /**< Sequence number. */
+    uint32_t        timestamp;  /**< Receive time of the first payload byte, in dongle app_timer ticks. */
+    uint8_t const * p_payload;  /**< Payload. */
+    uint16_t        len;        /**< Length of the payload. */
+};
+
+/**@brief Counters of a stream. */
+struct stream_stats
+{
+    uint64_t packets   = 0;     /**< Packets accepted. */
+    uint64_t bytes     = 0;     /**< Payload bytes accepted. */
+    uint64_t seq_gaps  = 0;     /**< Packets missed, from the sequence numbers. */
+    bool     seq_valid = false; /**< A packet was seen and next_seq is set. */
+    uint16_t next_seq  = 0;     /**< Sequence number expected next. */
+};
+
+/**@brief Counters of the parser. */
+struct parser_stats
+{
+    uint64_t bytes_in      = 0; /**< Bytes fed. */
+    uint64_t packets       = 0; /**< Packets accepted. */
+    uint64_t bytes_skipped = 0; /**< Bytes dropped while looking for a packet. */
+    uint64_t bad_headers   = 0; /**< Magics followed by a wrong version or length. */
+    uint64_t crc_errors    = 0; /**< Packets with a wrong CRC. */
+    uint64_t resyncs       = 0; /**< Times the parser found a packet again after dropping bytes. */
+};
+
+class frame_parser
+{
+public:
+    static constexpr uint16_t magic       = 0x5AA5; /**< USB_FRAME_V2_MAGIC. */
+    static constexpr uint8_t  version     = 2;
+    static constexpr size_t   header_len  = 14;     /**< USB_FRAME_V2_HEADER_LEN. */
+    static constexpr uint16_t max_payload = 2034;   /**< Largest payload of the dongle: a 2048 byte frame less the header. */
+    static constexpr size_t   link_count  = 8;      /**< USB_FRAME_LINK_MAX. */
+    static constexpr size_t   stream_count = 16;    /**< Stream ids the header can carry. */
+
+    using handler_t = std::function<void(frame const &)>;
+
+    /**@brief Constructor.
+     *
+     * @param[in] handler     Called for every packet accepted, in order.
+     * @param[in] max_payload Longest payload to accept; a longer length is taken for damage.
+     */
+    explicit frame_parser(handler_t handler, uint16_t max_payload = frame_parser::max_payload);
+
+    /**@brief Function for parsing the next bytes of the port. */
+    void feed(uint8_t const * p_data, size_t len);
+
+    /**@brief Function for getting the counters of the parser. */
+    parser_stats const & stats() const { return m_stats; }
+
+    /**@brief Function for getting the counters of a stream. */
+    stream_stats const & stream(uint8_t link, uint8_t stream_id) const
+    {
+        return m_streams[link % link_count][stream_id % stream_count];
+    }
+
+    /**@brief Function for computing a CRC-16/CCITT-FALSE, as the dongle does.
+     *
+     * @param[in] p_data Data.
+     * @param[in] len    Length of the data.
+     * @param[in] crc    CRC of the data before, or 0xFFFF to start.
+     */
+    static uint16_t crc16(uint8_t const * p_data, size_t len, uint16_t crc = 0xFFFF);
+
+private:
+    /**@brief Function for parsing what is buffered.
+     *
+     * @return false once more bytes are needed.
+     */
+    bool parse_one();
+
+    /**@brief Function for dropping a byte and moving to the next candidate magic. */
+    void skip();
+
+    handler_t            m_handler;
+    uint16_t             m_max_payload;
+    std::vector<uint8_t> m_buf;             /**< Bytes fed and not parsed yet, from m_start on. */
+    size_t               m_start = 0;
+    bool                 m_in_step = true;  /**< No byte was dropped since the last packet. */
+    parser_stats         m_stats;
+    stream_stats         m_streams[link_count][stream_count];
+};
+
+} // namespace hearable
+
+#endif // FRAME_PARSER_HPP__
@@ -0,0 +1,253 @@
+/**@file
+ *
+ * @brief Throughput and resynchronisation benchmark of the reference parser (frame_parser.hpp).
+ *
+ * @details Builds the byte stream of the dongle with the header writer of the firmware
+ *          (src/usb_frame.c): two links of EEG, PPG and ACC packets, format 2, random payloads,
+ *          which contain the magic now and then. The stream is fed to the parser in reads of 1 to
+ *          512 bytes, once as it is and once with every 50th packet damaged, by turns: a byte lost,
+ *          a byte added, a bit flipped, or the packet cut short. Every packet the parser hands over
+ *          must be the next undamaged packet, byte for byte, and each damaged packet must show as
+ *          exactly one sequence gap.
+ *
+ *          The report gives the parse rate of both runs and, for the damaged one, how many bytes
+ *          the parser dropped to get back in step after each damage.
+ *
+ *          Usage: frame_parser_bench [--check]
+ *            --check  A shorter run that only reports failures; exit code 1 on any.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "frame_parser.hpp"
+#include "usb_frame.h"
+
+namespace
+{
+
+constexpr unsigned links          = 2;
+constexpr unsigned streams        = 3;
+constexpr unsigned damage_every   = 50;     /**< Every how many packets one is damaged. */
+constexpr unsigned bench_packets  = 200000;
+constexpr unsigned check_packets  = 20000;
+constexpr unsigned bench_rounds   = 5;      /**< Each stream is parsed this many times; the fastest run counts. */
+
+char const * const stream_tags[streams] = {"EEG_", "PPG_", "ACC_"};
+
+/**@brief Packet of the generated stream. */
+struct expected_packet
+{
+    uint8_t              link;
+    uint8_t              stream_id;
+    uint16_t             seq;
+    bool                 damaged;
+    std::vector<uint8_t> payload;
+};
+
+/**@brief Damage done to a packet. */
+enum damage_t
+{
+    DAMAGE_DROP_BYTE,
+    DAMAGE_ADD_BYTE,
+    DAMAGE_FLIP_BIT,
+    DAMAGE_CUT,
+    DAMAGE_COUNT
+};
+
+/**@brief Function for building the packets and the byte stream, damaged or not. */
+void stream_build(unsigned packet_count, bool damage, std::vector<expected_packet> & packets, std::vector<uint8_t> & out)
+{
+    std::mt19937 rng(1234);
+    uint16_t     seq[links][streams] = {};
+    unsigned     damage_kind         = 0;
+    uint8_t      frame[USB_FRAME_HEADER_MAX_LEN + hearable::frame_parser::max_payload];
+
+    packets.clear();
+    out.clear();
+    for (unsigned i = 0; i < packet_count; i++)
+    {
+        expected_packet  p;
+        usb_frame_info_t info;
+        uint16_t         len;
+        uint16_t         size;
+        uint8_t        * p_packet;
+
+        p.link      = (uint8_t)(i % links);
+        p.stream_id = (uint8_t)((i / links) % streams);
+        p.seq       = seq[p.link][p.stream_id]++;
+        // EEG packets are full; the others are flushed partial after their latency.
+        len = (p.stream_id == 0) ? hearable::frame_parser::max_payload
+                                 : (uint16_t)(1 + rng() % hearable::frame_parser::max_payload);
+        p.payload.resize(len);
+        for (auto & b : p.payload)
+        {
+            b = (uint8_t)rng();
+        }
+
+        info.p_tag     = stream_tags[p.stream_id];
+        info.stream_id = p.stream_id;
+        info.link      = p.link;
+        info.seq       = p.seq;
+        info.timestamp = i * 100;
+        info.records   = false;
+        memcpy(&frame[USB_FRAME_HEADER_MAX_LEN], p.payload.data(), len);
+        p_packet = usb_frame_header_write(USB_FRAME_FORMAT_V2, &info, &frame[USB_FRAME_HEADER_MAX_LEN], len, &size);
+
+        // Never the last packets of a stream, so that each damage shows as a gap.
+        p.damaged = damage && (i % damage_every == damage_every - 1) && (i + links * streams < packet_count);
+        if (!p.damaged)
+        {
+            out.insert(out.end(), p_packet, p_packet + size);
+        }
+        else
+        {
+            // Past the first byte: a byte added in front of a packet or a packet cut to nothing
+            // is damage between packets, which loses nothing.
+            size_t at = 1 + rng() % (size - 1u);
+
+            switch (damage_kind++ % DAMAGE_COUNT)
+            {
+                case DAMAGE_DROP_BYTE:
+                    out.insert(out.end(), p_packet, p_packet + at);
+                    out.insert(out.end(), p_packet + at + 1, p_packet + size);
+                    break;
+
+                case DAMAGE_ADD_BYTE:
+                    out.insert(out.end(), p_packet, p_packet + at);
+                    out.push_back((uint8_t)rng());
+                    out.insert(out.end(), p_packet + at, p_packet + size);
+                    break;
+
+                case DAMAGE_FLIP_BIT:
+                    p_packet[at] ^= (uint8_t)(1u << (rng() % 8));
+                    out.insert(out.end(), p_packet, p_packet + size);
+                    break;
+
+                default:
+                    out.insert(out.end(), p_packet, p_packet + at);
+                    break;
+            }
+        }
+        packets.push_back(std::move(p));
+    }
+}
+
+/**@brief Result of a parse of the stream. */
+struct run_result
+{
+    double                 seconds  = 0;
+    unsigned               accepted = 0;
+    unsigned               wrong    = 0;    /**< Packets that were not the next undamaged one. */
+    uint64_t               gaps     = 0;
+    hearable::parser_stats stats;
+};
+
+/**@brief Function for parsing the stream in reads of random length and checking every packet. */
+run_result stream_parse(std::vector<expected_packet> const & packets, std::vector<uint8_t> const & bytes)
+{
+    std::mt19937 rng(99);
+    run_result   result;
+    size_t       next = 0;
+
+    hearable::frame_parser parser([&](hearable::frame const & f)
+    {
+        while ((next < packets.size()) && packets[next].damaged)
+        {
+            next++;
+        }
+        if ((next >= packets.size())
+                || (f.link != packets[next].link) || (f.stream_id != packets[next].stream_id)
+                || (f.seq != packets[next].seq) || (f.len != packets[next].payload.size())
+                || (memcmp(f.p_payload, packets[next].payload.data(), f.len) != 0))
+        {
+            result.wrong++;
+        }
+        result.accepted++;
+        next++;
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t pos = 0; pos < bytes.size(); )
+    {
+        size_t len = std::min<size_t>(1 + rng() % 512, bytes.size() - pos);
+
+        parser.feed(&bytes[pos], len);
+        pos += len;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (uint8_t link = 0; link < links; link++)
+    {
+        for (uint8_t stream_id = 0; stream_id < streams; stream_id++)
+        {
+            result.gaps += parser.stream(link, stream_id).seq_gaps;
+        }
+    }
+    result.stats = parser.stats();
+    return result;
+}
+
+} // namespace
+
+
+int main(int argc, char * argv[])
+{
+    bool                         check    = (argc > 1) && (strcmp(argv[1], "--check") == 0);
+    unsigned                     count    = check ? check_packets : bench_packets;
+    unsigned                     failures = 0;
+    std::vector<expected_packet> packets;
+    std::vector<uint8_t>         bytes;
+
+    for (int damaged = 0; damaged <= 1; damaged++)
+    {
+        unsigned   damages = 0;
+        run_result result;
+
+        stream_build(count, damaged != 0, packets, bytes);
+        for (auto const & p : packets)
+        {
+            damages += p.damaged ? 1 : 0;
+        }
+
+        for (unsigned round = 0; round < (check ? 1 : bench_rounds); round++)
+        {
+            run_result r = stream_parse(packets, bytes);
+
+            if ((round == 0) || (r.seconds < result.seconds))
+            {
+                result = r;
+            }
+        }
+
+        if ((result.wrong != 0) || (result.accepted != count - damages) || (result.gaps != damages)
+                || (result.stats.resyncs != damages))
+        {
+            printf("%s stream: %u packets accepted of %u, %u wrong, %llu gaps and %llu resyncs for %u damaged\n",
+                   damaged ? "damaged" : "clean", result.accepted, count - damages, result.wrong,
+                   (unsigned long long)result.gaps, (unsigned long long)result.stats.resyncs, damages);
+            failures++;
+        }
+        if (check)
+        {
+            continue;
+        }
+
+        printf("%s: %u packets, %.1f MB in %.1f ms, %.0f MB/s\n",
+               damaged ? "every 50th packet damaged" : "clean", count, bytes.size() / 1e6,
+               result.seconds * 1e3, bytes.size() / 1e6 / result.seconds);
+        if (damaged)
+        {
+            printf("  %u damaged, %llu resyncs, %.0f bytes dropped per resync, %llu CRC errors, %llu bad headers\n",
+                   damages, (unsigned long long)result.stats.resyncs,
+                   (double)result.stats.bytes_skipped / (double)result.stats.resyncs,
+                   (unsigned long long)result.stats.crc_errors, (unsigned long long)result.stats.bad_headers);
+        }
+    }
+
+    printf("frame_parser_bench: %s\n", (failures == 0) ? "ok" : "FAILED");
+    return (failures == 0) ? 0 : 1;
+}
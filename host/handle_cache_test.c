@@ -0,0 +1,543 @@
+/**@file
+ *
+ * @brief Unit test of the GATT handle cache (src/handle_cache.c) and of the way a link gets its
+ *        handles from it (src/hearable_gatt.c).
+ *
+ * @details The cache runs on the FDS stand-in of stub/, which carries out the flash operations
+ *          only when the test says so, and keeps flash across a reset of the dongle. The test
+ *          covers a hit, a miss, a change of revision or of descriptor table layout, the eviction
+ *          of the least recently used of the @ref HANDLE_CACHE_SIZE slots, entries stored before
+ *          FDS is ready and while a write of the same slot is in flight, a write retried after
+ *          garbage collection, and the entries reloaded from flash after each.
+ *
+ *          A Hearable is then scripted behind the GATT client stand-in: it answers the revision
+ *          read and the CCCD writes of the NUS client from its attribute table, whose handles the
+ *          test can move without changing the revision. The link is set up as src/main.c does:
+ *          discovery on a miss, the cached handles on a hit, and discovery after all once a CCCD
+ *          write on the cached handles fails because they are stale. Discovery itself is a
+ *          stand-in that counts its starts; the test completes it with the handles of the table.
+ *
+ *          Usage: handle_cache_test
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "nordic_common.h"
+#include "app_util.h"
+#include "crc16.h"
+#include "fds.h"
+#include "ble.h"
+#include "ble_nus_c.h"
+#include "handle_cache.h"
+#include "hearable_gatt.h"
+
+#define CHECK(cond)                                                     \
+    do                                                                  \
+    {                                                                   \
+        if (!(cond))                                                    \
+        {                                                               \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            m_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+#define CONN_HANDLE         0
+#define HANDLE_BASE         0x10    /**< First handle of the attribute table of the Hearable. */
+#define HANDLES_PER_CHAR    3       /**< Declaration, value and CCCD of each characteristic. */
+#define REV_HANDLE          0x0C    /**< Handle of the firmware revision string. */
+
+/**@brief Hearable scripted behind the GATT client stand-in. */
+typedef struct
+{
+    ble_gap_addr_t addr;
+    char const   * p_rev;           /**< Firmware revision string, NULL for none. */
+    uint16_t       base;            /**< First handle of its characteristics. */
+    uint8_t        cccd_written;    /**< CCCD writes answered with success. */
+    uint8_t        cccd_failed;     /**< CCCD writes answered with an error. */
+} peer_t;
+
+static unsigned            m_failures;
+static uint16_t            m_layout;
+static ble_nus_c_t         m_nus_c;
+static ble_db_discovery_t  m_db_disc;
+static hearable_gatt_rev_t m_rev;
+static peer_t            * m_p_peer;            /**< Hearable of the link. */
+static bool                m_handles_cached;    /**< The handles of the link came from the cache. */
+static uint32_t            m_discoveries;       /**< Discoveries started. */
+static uint32_t            m_evt_buf[BLE_EVT_LEN_MAX(BLE_GATT_ATT_MTU_DEFAULT) / sizeof(uint32_t) + 1];
+
+
+// The NUS client registers its services with the discovery, which the test plays itself.
+uint32_t ble_db_discovery_evt_register(ble_uuid_t const * const p_uuid)
+{
+    (void)p_uuid;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t ble_db_discovery_start(ble_db_discovery_t * p_db_discovery, uint16_t conn_handle)
+{
+    (void)p_db_discovery;
+    (void)conn_handle;
+    m_discoveries++;
+    return NRF_SUCCESS;
+}
+
+
+/**@brief Function for carrying out every queued flash operation. */
+static void fds_run(void)
+{
+    while (host_fds_step())
+    {
+    }
+}
+
+
+/**@brief Function for starting the cache as after a reset of the dongle, flash kept unless erased. */
+static void cache_start(bool erase, uint16_t layout)
+{
+    host_fds_reset(erase);
+    CHECK(handle_cache_init(layout) == NRF_SUCCESS);
+    fds_run();
+}
+
+
+/**@brief Function for making a peer address. */
+static ble_gap_addr_t addr_make(uint8_t id)
+{
+    ble_gap_addr_t addr = {.addr_type = 1, .addr = {id, 0x22, 0x33, 0x44, 0x55, 0xC6}};
+
+    return addr;
+}
+
+
+/**@brief Function for the handles of the attribute table of a Hearable starting at a handle. */
+static ble_nus_c_handles_t handles_make(uint16_t base)
+{
+    ble_nus_c_handles_t handles;
+
+    memset(&handles, 0, sizeof(handles));
+    for (uint8_t i = 0; i < hearable_gatt_char_count; i++)
+    {
+        handles.value[i] = (uint16_t)(base + HANDLES_PER_CHAR * i + 1);
+        handles.cccd[i]  = hearable_gatt_chars[i].cccd ? (uint16_t)(handles.value[i] + 1) : BLE_GATT_HANDLE_INVALID;
+    }
+    return handles;
+}
+
+
+/**@brief Function for storing the handles of a peer under a revision string. */
+static void store(ble_gap_addr_t const * p_addr, char const * p_rev, uint16_t base)
+{
+    ble_nus_c_handles_t handles = handles_make(base);
+
+    handle_cache_store(p_addr, (uint8_t const *)p_rev, (uint8_t)strlen(p_rev), &handles);
+}
+
+
+/**@brief Function for looking up a peer under a revision string, and checking the handles found. */
+static bool find(ble_gap_addr_t const * p_addr, char const * p_rev, uint16_t base)
+{
+    ble_nus_c_handles_t expected = handles_make(base);
+    ble_nus_c_handles_t handles;
+
+    if (!handle_cache_find(p_addr, (uint8_t const *)p_rev, (uint8_t)strlen(p_rev), &handles))
+    {
+        return false;
+    }
+    return memcmp(&handles, &expected, sizeof(handles)) == 0;
+}
+
+
+static void test_hit_miss(void)
+{
+    ble_gap_addr_t const a = addr_make(1);
+    ble_gap_addr_t const b = addr_make(2);
+
+    cache_start(true, m_layout);
+    CHECK(!find(&a, "1.4.2", 0x10));
+
+    store(&a, "1.4.2", 0x10);
+    CHECK(find(&a, "1.4.2", 0x10));
+    CHECK(!find(&b, "1.4.2", 0x10));
+    CHECK(!find(&a, "", 0x10));                 // No revision never matches.
+
+    // Kept across a reset.
+    fds_run();
+    cache_start(false, m_layout);
+    CHECK(find(&a, "1.4.2", 0x10));
+    CHECK(!find(&b, "1.4.2", 0x10));
+}
+
+
+static void test_revision_change(void)
+{
+    ble_gap_addr_t const a = addr_make(1);
+
+    cache_start(true, m_layout);
+    store(&a, "1.4.2", 0x10);
+    fds_run();
+    CHECK(!find(&a, "1.5.0", 0x10));
+    CHECK(!find(&a, "1.4.20", 0x10));
+    CHECK(!find(&a, "1.4", 0x10));
+    CHECK(find(&a, "1.4.2", 0x10));
+
+    // A new descriptor table leaves the entries of the old one unused, and they are there again
+    // with the old table.
+    cache_start(false, (uint16_t)(m_layout + 1));
+    CHECK(!find(&a, "1.4.2", 0x10));
+    cache_start(false, m_layout);
+    CHECK(find(&a, "1.4.2", 0x10));
+
+    // The peer discovered again under its new revision keeps its slot.
+    store(&a, "1.5.0", 0x20);
+    CHECK(find(&a, "1.5.0", 0x20));
+    CHECK(!find(&a, "1.4.2", 0x10));
+}
+
+
+static void test_lru_eviction(void)
+{
+    ble_gap_addr_t peers[HANDLE_CACHE_SIZE + 1];
+
+    STATIC_ASSERT(HANDLE_CACHE_SIZE == 4);
+
+    cache_start(true, m_layout);
+    for (uint8_t i = 0; i < ARRAY_SIZE(peers); i++)
+    {
+        peers[i] = addr_make((uint8_t)(i + 1));
+    }
+    for (uint8_t i = 0; i < HANDLE_CACHE_SIZE; i++)
+    {
+        store(&peers[i], "1.4.2", (uint16_t)(0x10 * (i + 1)));
+        fds_run();
+    }
+    for (uint8_t i = 0; i < HANDLE_CACHE_SIZE; i++)
+    {
+        CHECK(find(&peers[i], "1.4.2", (uint16_t)(0x10 * (i + 1))));
+    }
+
+    // Peer 0 used again, so peer 1 is the least recently used and makes room for peer 4.
+    CHECK(find(&peers[0], "1.4.2", 0x10));
+    store(&peers[4], "1.4.2", 0x50);
+    fds_run();
+    CHECK(find(&peers[0], "1.4.2", 0x10));
+    CHECK(!find(&peers[1], "1.4.2", 0x20));
+    CHECK(find(&peers[2], "1.4.2", 0x30));
+    CHECK(find(&peers[3], "1.4.2", 0x40));
+    CHECK(find(&peers[4], "1.4.2", 0x50));
+
+    // A peer already cached is stored in place, evicting nobody.
+    store(&peers[2], "1.5.0", 0x60);
+    fds_run();
+    CHECK(find(&peers[0], "1.4.2", 0x10));
+    CHECK(find(&peers[2], "1.5.0", 0x60));
+    CHECK(find(&peers[3], "1.4.2", 0x40));
+    CHECK(find(&peers[4], "1.4.2", 0x50));
+
+    // Flash holds the same after a reset.
+    cache_start(false, m_layout);
+    CHECK(find(&peers[0], "1.4.2", 0x10));
+    CHECK(!find(&peers[1], "1.4.2", 0x20));
+    CHECK(find(&peers[2], "1.5.0", 0x60));
+    CHECK(find(&peers[3], "1.4.2", 0x40));
+    CHECK(find(&peers[4], "1.4.2", 0x50));
+}
+
+
+static void test_write_in_flight(void)
+{
+    ble_gap_addr_t const a = addr_make(1);
+    ble_gap_addr_t const b = addr_make(2);
+
+    // Stored before FDS is ready: written once it is.
+    host_fds_reset(true);
+    CHECK(handle_cache_init(m_layout) == NRF_SUCCESS);
+    store(&a, "1.4.2", 0x10);
+    CHECK(find(&a, "1.4.2", 0x10));
+    CHECK(host_fds_queued() == 1);              // FDS initialization only.
+    fds_run();
+    CHECK(host_fds_writes() == 1);
+
+    // Stored twice while the first write is in flight: FDS reads the entry only when it carries
+    // the write out, so the second one waits for the first to be done instead of changing it.
+    store(&b, "1.4.2", 0x20);
+    CHECK(host_fds_queued() == 1);
+    store(&b, "1.5.0", 0x30);
+    CHECK(host_fds_queued() == 1);
+    CHECK(find(&b, "1.5.0", 0x30));
+    CHECK(host_fds_step());                     // First write done, the second one queued.
+    CHECK(host_fds_queued() == 1);
+    fds_run();
+    CHECK(host_fds_writes() == 3);
+
+    cache_start(false, m_layout);
+    CHECK(find(&a, "1.4.2", 0x10));
+    CHECK(find(&b, "1.5.0", 0x30));
+
+    // A failed write is tried again after garbage collection.
+    host_fds_fail_next(FDS_ERR_INTERNAL);
+    store(&a, "1.6.0", 0x40);
+    fds_run();
+    CHECK(host_fds_writes() == 1);
+    cache_start(false, m_layout);
+    CHECK(find(&a, "1.6.0", 0x40));
+
+    // A write that does not fit while replaced records hold their words is written once garbage
+    // collection has freed them.
+    cache_start(true, m_layout);
+    host_fds_flash_words_set(2 * (FDS_HEADER_SIZE + 24));
+    store(&a, "1.4.2", 0x10);
+    fds_run();
+    store(&a, "1.5.0", 0x20);
+    fds_run();
+    store(&a, "1.6.0", 0x30);
+    fds_run();
+    CHECK(host_fds_writes() == 3);
+    cache_start(false, m_layout);
+    CHECK(find(&a, "1.6.0", 0x30));
+}
+
+
+/**@brief Function for playing the Hearable: answering the GATT client procedures of the link
+ *        until there is none left.
+ */
+static void peer_run(void)
+{
+    ble_evt_t       * p_evt   = (ble_evt_t *)m_evt_buf;
+    ble_gattc_evt_t * p_gattc = &p_evt->evt.gattc_evt;
+    peer_t          * p_peer  = m_p_peer;
+    host_gattc_proc_t proc;
+
+    while (host_gattc_proc_take(CONN_HANDLE, &proc))
+    {
+        ble_nus_c_handles_t const handles = handles_make(p_peer->base);
+
+        memset(p_evt, 0, sizeof(*p_evt));
+        p_gattc->conn_handle = CONN_HANDLE;
+        p_gattc->gatt_status = BLE_GATT_STATUS_SUCCESS;
+
+        switch (proc.type)
+        {
+            case HOST_GATTC_PROC_CHAR_VALUE_BY_UUID_READ:
+                p_evt->header.evt_id = BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP;
+                if ((proc.uuid.uuid == BLE_UUID_FIRMWARE_REVISION_STRING_CHAR) && (p_peer->p_rev != NULL))
+                {
+                    ble_gattc_evt_char_val_by_uuid_read_rsp_t * p_rsp = &p_gattc->params.char_val_by_uuid_read_rsp;
+
+                    p_rsp->count     = 1;
+                    p_rsp->value_len = (uint16_t)strlen(p_peer->p_rev);
+                    (void)uint16_encode(REV_HANDLE, p_rsp->handle_value);
+                    memcpy(&p_rsp->handle_value[sizeof(uint16_t)], p_peer->p_rev, p_rsp->value_len);
+                }
+                else
+                {
+                    p_gattc->gatt_status = BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND;
+                }
+                break;
+
+            case HOST_GATTC_PROC_WRITE_REQ:
+                p_evt->header.evt_id = BLE_GATTC_EVT_WRITE_RSP;
+                p_gattc->params.write_rsp.handle   = proc.handle;
+                p_gattc->params.write_rsp.write_op = BLE_GATT_OP_WRITE_REQ;
+                p_gattc->gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_HANDLE;
+                for (uint8_t i = 0; i < hearable_gatt_char_count; i++)
+                {
+                    if ((handles.cccd[i] != BLE_GATT_HANDLE_INVALID) && (handles.cccd[i] == proc.handle))
+                    {
+                        p_gattc->gatt_status = BLE_GATT_STATUS_SUCCESS;
+                    }
+                }
+                if (p_gattc->gatt_status == BLE_GATT_STATUS_SUCCESS)
+                {
+                    p_peer->cccd_written++;
+                }
+                else
+                {
+                    p_peer->cccd_failed++;
+                }
+                break;
+
+            default:
+                p_evt->header.evt_id = BLE_GATTC_EVT_READ_RSP;
+                p_gattc->params.read_rsp.handle = proc.handle;
+                break;
+        }
+
+        host_gattc_proc_end(CONN_HANDLE);
+        ble_nus_c_on_ble_evt(p_evt, &m_nus_c);
+        hearable_gatt_rev_on_ble_evt(&m_rev, p_evt);
+    }
+}
+
+
+/**@brief Function for counting the CCCD writes answered, falling back to discovery on stale
+ *        cached handles as link_cccd_done of src/main.c does.
+ */
+static void link_cccd_done(ble_nus_c_t * p_ble_nus_c, uint16_t handle, uint16_t gatt_status)
+{
+    (void)handle;
+    if (m_handles_cached && hearable_gatt_status_stale(gatt_status))
+    {
+        m_handles_cached = false;
+        CHECK(hearable_gatt_handles_rediscover(&m_p_peer->addr, p_ble_nus_c, &m_db_disc) == NRF_SUCCESS);
+    }
+}
+
+
+/**@brief Function for enabling the notifications of the link. */
+static void link_notif_enable(void)
+{
+    uint8_t enabled;
+
+    CHECK(ble_nus_c_notif_enable_all(&m_nus_c, &enabled, link_cccd_done) == NRF_SUCCESS);
+}
+
+
+/**@brief Function for acting on the revision of the link, as link_revision_done of src/main.c. */
+static void link_revision_done(hearable_gatt_rev_t * p_rev)
+{
+    CHECK(hearable_gatt_handles_get(p_rev, &m_p_peer->addr, &m_nus_c, &m_db_disc, &m_handles_cached) == NRF_SUCCESS);
+    if (m_handles_cached)
+    {
+        link_notif_enable();
+    }
+}
+
+
+/**@brief Function for completing a discovery with the handles of the Hearable, as the discovery
+ *        events do through the NUS client and ble_nus_c_evt_handler of src/main.c.
+ */
+static void link_discovery_complete(void)
+{
+    ble_nus_c_handles_t const handles = handles_make(m_p_peer->base);
+
+    CHECK(ble_nus_c_handles_assign(&m_nus_c, CONN_HANDLE, &handles) == NRF_SUCCESS);
+    handle_cache_store(&m_p_peer->addr, m_rev.value, m_rev.len, &handles);
+    link_notif_enable();
+    peer_run();
+}
+
+
+/**@brief Function for connecting to a Hearable and setting up the link as far as it goes without
+ *        a discovery.
+ */
+static void link_connect(peer_t * p_peer)
+{
+    m_p_peer             = p_peer;
+    m_handles_cached     = false;
+    p_peer->cccd_written = 0;
+    p_peer->cccd_failed  = 0;
+    host_gattc_reset(CONN_HANDLE);
+    CHECK(ble_nus_c_handles_assign(&m_nus_c, CONN_HANDLE, NULL) == NRF_SUCCESS);
+    hearable_gatt_rev_read(&m_rev, CONN_HANDLE, link_revision_done);
+    peer_run();
+}
+
+
+static void test_link_setup(void)
+{
+    uint8_t cccds   = 0;
+    peer_t  hearable = {.addr = addr_make(1), .p_rev = "1.4.2", .base = HANDLE_BASE};
+    peer_t  bare     = {.addr = addr_make(2), .p_rev = NULL, .base = HANDLE_BASE};
+
+    for (uint8_t i = 0; i < hearable_gatt_char_count; i++)
+    {
+        cccds += hearable_gatt_chars[i].cccd ? 1 : 0;
+    }
+    cache_start(true, m_layout);
+    m_discoveries = 0;
+
+    // Miss: discovered, then cached.
+    link_connect(&hearable);
+    CHECK(m_rev.len == strlen("1.4.2"));
+    CHECK(!m_handles_cached);
+    CHECK(m_discoveries == 1);
+    link_discovery_complete();
+    CHECK(hearable.cccd_written == cccds);
+    CHECK(find(&hearable.addr, "1.4.2", HANDLE_BASE));
+    fds_run();
+
+    // Hit: no discovery, notifications enabled on the cached handles.
+    link_connect(&hearable);
+    CHECK(m_handles_cached);
+    CHECK(m_discoveries == 1);
+    CHECK(hearable.cccd_written == cccds);
+    CHECK(hearable.cccd_failed == 0);
+
+    // The database moved under the same revision: the first CCCD write on the cached handles
+    // fails, the other writes queued on them are dropped, the entry is dropped from flash too and
+    // the Hearable is discovered after all.
+    hearable.base = HANDLE_BASE + 0x20;
+    link_connect(&hearable);
+    CHECK(!m_handles_cached);
+    CHECK(m_discoveries == 2);
+    CHECK(hearable.cccd_written == 0);
+    CHECK(hearable.cccd_failed == 1);
+    CHECK(!find(&hearable.addr, "1.4.2", HANDLE_BASE));
+    fds_run();
+    link_discovery_complete();
+    CHECK(hearable.cccd_written == cccds);
+    CHECK(find(&hearable.addr, "1.4.2", HANDLE_BASE + 0x20));
+    fds_run();
+    cache_start(false, m_layout);
+    CHECK(find(&hearable.addr, "1.4.2", HANDLE_BASE + 0x20));
+
+    // Handles that fail for another reason, such as a missing CCCD permission, are kept.
+    CHECK(!hearable_gatt_status_stale(BLE_GATT_STATUS_UNKNOWN));
+    CHECK(!hearable_gatt_status_stale(BLE_NUS_C_REQ_STATUS_FAILED));
+    CHECK(hearable_gatt_status_stale(BLE_GATT_STATUS_ATTERR_INVALID_HANDLE));
+
+    // New revision: discovered.
+    hearable.p_rev = "1.5.0";
+    link_connect(&hearable);
+    CHECK(!m_handles_cached);
+    CHECK(m_discoveries == 3);
+    link_discovery_complete();
+    CHECK(find(&hearable.addr, "1.5.0", HANDLE_BASE + 0x20));
+
+    // No revision at all: always discovered, never cached.
+    link_connect(&bare);
+    CHECK(m_rev.len == 0);
+    CHECK(m_discoveries == 4);
+    link_discovery_complete();
+    link_connect(&bare);
+    CHECK(!m_handles_cached);
+    CHECK(m_discoveries == 5);
+}
+
+
+/**@brief Function for dropping the notifications of the link: the test sends none. */
+static void sink(void * p_context, uint8_t stream_id, uint8_t const * p_data, uint16_t len)
+{
+    (void)p_context;
+    (void)stream_id;
+    (void)p_data;
+    (void)len;
+}
+
+
+int main(void)
+{
+    ble_nus_c_init_t init =
+    {
+        .p_chars    = hearable_gatt_chars,
+        .char_count = hearable_gatt_char_count,
+        .sink       = sink,
+    };
+
+    // As handle_cache_init of src/main.c.
+    m_layout = crc16_compute((uint8_t const *)hearable_gatt_chars, hearable_gatt_char_count * sizeof(hearable_gatt_chars[0]), NULL);
+    CHECK(ble_nus_c_init(&m_nus_c, &init) == NRF_SUCCESS);
+
+    test_hit_miss();
+    test_revision_change();
+    test_lru_eviction();
+    test_write_in_flight();
+    test_link_setup();
+
+    printf("handle_cache_test: %s\n", (m_failures == 0) ? "ok" : "FAILED");
+    return (m_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,1097 @@
+/**@file
+ *
+ * @brief Synthetic Hearable streams through the dongle data path, for throughput and loss.
+ *
+ * @details Every link streams EEG, PPG and ACC the way a Hearable does: samples are gathered in
+ *          blocks, each block starts with the Hearable time of its first sample (uint32, 31.25 kHz
+ *          ticks) and is cut into notifications of up to ATT MTU - 3 bytes. The notifications
+ *          waiting on a link go out at its connection events, as BLE_GATTC_EVT_HVX events to the
+ *          NUS client of the dongle (src/ble_nus_c.c), whose stream sink puts them in the data path
+ *          (src/data_path.c) as stream_data_put of src/main.c does. USB takes one packet at a time
+ *          at a fixed byte rate and signals TX_DONE when done, and the packets are checked by the
+ *          USB sink.
+ *
+ *          Each link is set up as on the dongle, through the GATT client stand-in of
+ *          stub/ble_gattc.h: the ATT MTU exchange, the revision read of src/hearable_gatt.c,
+ *          refused as busy until the exchange is answered, then the Database Hash, which the
+ *          Hearable lacks, and its firmware revision string, the handles of the Hearable assigned
+ *          as a handle cache hit would, the CCCD writes and the read of the hardware revision
+ *          string. The Hearable answers one GATT client procedure per connection event and starts
+ *          a stream once its CCCD is written.
+ *
+ *          Once every link streams, the host may send an EEG configuration as a binary command
+ *          frame (src/host_cmd.c), which the dongle writes to each Hearable as write commands of
+ *          ATT MTU - 3 bytes. A connection event carries the write commands the SoftDevice buffers,
+ *          then BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE lets the NUS client hand it the next ones; the
+ *          Hearable checks it receives the configuration whole.
+ *
+ *          Notifications may be lost over the air, at random or in bursts, before they reach the
+ *          dongle, and a connection event may carry only so many of them; the rest wait for the
+ *          next event, and are lost once the Hearable's queue is full. The report separates that
+ *          loss from the data the dongle itself had to drop.
+ *
+ *          The host may stop reading USB for a while at a fixed period, as a busy PC does; the
+ *          dongle then has to hold what arrives in its pool. --pool split gives each stream a fixed
+ *          share of the same pool instead of sharing it, the way the three rings of the dongle
+ *          did before, to compare the loss for the same RAM.
+ *
+ *          Usage: hearable_sim [OPTION]...
+ *            --links N            Hearables (default 2)
+ *            --seconds S          Time simulated (default 10)
+ *            --eeg-rate HZ        EEG samples per second (default 500); also --ppg-rate, --acc-rate
+ *            --eeg-sample BYTES   Bytes per EEG sample (default 27); also --ppg-sample, --acc-sample
+ *            --eeg-block N        Samples per EEG block (default 227); also --ppg-block, --acc-block
+ *            --mtu BYTES          ATT MTU (default 247)
+ *            --interval-ms MS     Connection interval (default 15)
+ *            --event-notifs N     Notifications per connection event, 0 for no limit (default 0)
+ *            --loss-pct P         Chance, in percent, that a notification is lost over the air (default 0)
+ *            --loss-burst N       Notifications lost in a row each time (default 1)
+ *            --usb-rate BYTES     USB throughput in bytes per second (default 1000000)
+ *            --sched wrr|drain    Stream choice of the dongle (default wrr)
+ *            --pool shared|split  Pool shared by the streams of a link with reservations, or split in
+ *                                 fixed parts, each stream its reservation and EEG what is left over
+ *                                 (default shared)
+ *            --stall-ms MS        Time the host stops reading USB each period (default 0)
+ *            --stall-every-ms MS  Period of the USB stalls (default 1000)
+ *            --records            Record mode
+ *            --seed N             Seed of the loss pattern (default 1)
+ *            --handle-base N      Declaration handle of the first characteristic of the Hearable,
+ *                                 which places its notifying handles (default 16)
+ *            --config-len BYTES   EEG configuration the host sends once every link streams, 0 for
+ *                                 none (default 0)
+ *            --sweep              Find the largest factor on all rates that the dongle forwards without
+ *                                 dropping anything
+ *            --stall-sweep        Find the longest USB stall that the dongle rides out without dropping
+ *                                 anything
+ *            --check              Exit with 1 if the dongle dropped data, a packet was bad, a link
+ *                                 was not set up, a notification did not reach its stream or a
+ *                                 Hearable did not receive the configuration whole
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_usbd_cdc_acm.h"
+#include "ble.h"
+#include "ble_nus_c.h"
+#include "crc16.h"
+#include "data_path.h"
+#include "hearable_gatt.h"
+#include "host_cmd.h"
+#include "usb_sink.h"
+
+#define HEARABLE_CLOCK_HZ   31250   /**< Hearable timestamp clock. */
+#define ATT_HEADER_LEN      3       /**< Opcode and handle of a notification. */
+#define NOTIF_MAX_LEN       244     /**< Longest notification, at the largest ATT MTU. */
+#define NOTIF_QUEUE_SIZE    4096    /**< Notifications a link can hold between connection events. */
+#define SWEEP_STEPS         12      /**< Bisection steps of --sweep. */
+#define HANDLE_BASE         0x10    /**< Declaration handle of the first characteristic of the Hearable, by default. */
+#define HANDLES_PER_CHAR    3       /**< Declaration, value and CCCD handles of each characteristic. */
+#define USB_RX_PACKET_LEN   64      /**< Bytes of a USB packet from the host. */
+#define FIRMWARE_REVISION   "1.4.2" /**< Firmware revision string of the Hearable. */
+#define HARDWARE_REVISION   "HRB-%u" /**< Hardware revision string of the Hearable, by link. */
+
+static char const * const m_stream_names[STREAM_COUNT] = {"EEG", "PPG", "ACC"};
+
+/**@brief Stream of a simulated Hearable. */
+typedef struct
+{
+    double   rate;              /**< Samples per second. */
+    uint16_t sample_len;        /**< Bytes per sample. */
+    uint16_t block_samples;     /**< Samples per block. */
+} sim_stream_cfg_t;
+
+/**@brief Simulation settings. */
+typedef struct
+{
+    uint8_t          link_count;
+    double           seconds;
+    sim_stream_cfg_t streams[STREAM_COUNT];
+    uint16_t         mtu;
+    uint32_t         interval_us;
+    uint32_t         event_notifs;
+    double           loss_pct;
+    uint32_t         loss_burst;
+    double           usb_rate;
+    data_path_sched_t     sched;
+    bool             split_pool;
+    double           stall_us;
+    double           stall_every_us;
+    bool             records;
+    uint32_t         seed;
+    uint16_t         handle_base;   /**< Declaration handle of the first characteristic of the Hearable. */
+    uint16_t         config_len;    /**< EEG configuration the host sends once every link streams, 0 for none. */
+} sim_cfg_t;
+
+/**@brief Notification waiting for a connection event. */
+typedef struct
+{
+    uint8_t  stream;
+    uint16_t len;
+} sim_notif_t;
+
+/**@brief Counters of one stream of one link. */
+typedef struct
+{
+    uint64_t notifs;            /**< Notifications the Hearable sent. */
+    uint64_t bytes;             /**< Their bytes. */
+    uint64_t air_lost;          /**< Notifications lost over the air or for lack of room on the Hearable. */
+    uint64_t air_lost_bytes;    /**< Their bytes. */
+    uint64_t rx_bytes;          /**< Bytes the NUS client of the dongle passed on to the data path. */
+} sim_stream_stats_t;
+
+/**@brief State of one simulated Hearable. */
+typedef struct
+{
+    double             next_block_us[STREAM_COUNT];    /**< Time the next block of each stream is complete. */
+    uint32_t           samples[STREAM_COUNT];          /**< Samples of each stream so far. */
+    sim_notif_t        queue[NOTIF_QUEUE_SIZE];             /**< Notifications waiting for the next connection event. */
+    uint32_t           queue_count;                         /**< Notifications in queue. */
+    uint64_t           next_event_us;                       /**< Time of the next connection event. */
+    uint32_t           burst_left;                          /**< Notifications still to lose in the current burst. */
+    sim_stream_stats_t stats[STREAM_COUNT];            /**< Counters. */
+    ble_nus_c_t        nus_c;                               /**< NUS client of the dongle for the link. */
+    hearable_gatt_rev_t rev;                                /**< Revision read of the dongle for the link. */
+    uint8_t            cccd_pending;                        /**< CCCD writes of the dongle not answered yet. */
+    bool               streaming;                           /**< Every CCCD write was answered. */
+    uint64_t           setup_us;                            /**< Time from connecting until streaming. */
+    uint32_t           rev_busy;                            /**< GATT client procedures refused as busy. */
+    char               name[32];                            /**< Hardware revision string read by the dongle. */
+    uint8_t            config[HOST_CMD_PAYLOAD_MAX];        /**< EEG configuration received by the Hearable. */
+    uint16_t           config_len;                          /**< Its bytes so far. */
+    uint32_t           config_writes;                       /**< Write commands it came in. */
+    uint64_t           config_us;                           /**< Time from sending it until it was received whole. */
+} sim_link_t;
+
+/**@brief Result of a run. */
+typedef struct
+{
+    uint64_t sent_bytes;        /**< Bytes the Hearables sent. */
+    uint64_t air_lost_bytes;    /**< Bytes lost over the air. */
+    uint64_t dropped_bytes;     /**< Bytes the dongle dropped. */
+    uint64_t unrouted_bytes;    /**< Bytes received that the NUS client did not pass on to the data path. */
+    uint64_t usb_bytes;         /**< Payload bytes written to USB. */
+    uint32_t bad_packets;       /**< Packets failing the sink checks. */
+    uint32_t seq_gaps;          /**< Packets missing according to the sequence numbers. */
+    uint32_t links_not_set_up;  /**< Links that never streamed or whose hardware revision was not read. */
+    uint32_t configs_bad;       /**< Links whose Hearable did not receive the configuration whole. */
+} sim_result_t;
+
+static uint32_t       m_rand_state;   /**< State of the loss pattern generator. */
+static sim_link_t     m_links[DATA_PATH_LINK_MAX];
+static data_path_t    m_path;
+static uint64_t       m_now_us;       /**< Time simulated so far. */
+static uint16_t       m_handle_base;  /**< Declaration handle of the first characteristic of the Hearable. */
+static uint64_t       m_config_us;    /**< Time the host sent the configuration, UINT64_MAX until then. */
+static uint32_t       m_evt_buf[BLE_EVT_LEN_MAX(NOTIF_MAX_LEN + ATT_HEADER_LEN) / sizeof(uint32_t) + 1]; /**< BLE events are built here. */
+
+
+/**@brief Function for a uniform random number in [0, 1), the same sequence on every host. */
+static double rand_unit(void)
+{
+    m_rand_state = m_rand_state * 1664525UL + 1013904223UL;
+    return (double)(m_rand_state >> 8) / (double)(1UL << 24);
+}
+
+
+/**@brief Function for the time the host reads USB again: now, or the end of the stall it is in.
+ *        Stalls take the start of every period but the first.
+ */
+static uint64_t usb_read_us(sim_cfg_t const * p_cfg, uint64_t now_us)
+{
+    uint64_t period = (uint64_t)p_cfg->stall_every_us;
+    uint64_t phase;
+
+    if ((p_cfg->stall_us <= 0) || (period == 0) || (now_us < period))
+    {
+        return now_us;
+    }
+    phase = now_us % period;
+    return (phase < (uint64_t)p_cfg->stall_us) ? (now_us - phase + (uint64_t)p_cfg->stall_us) : now_us;
+}
+
+
+/**@brief Function for splitting the pool of each link in fixed parts, as separate rings would:
+ *        each stream its reservation, and EEG, the stream that needs it most, what is left.
+ */
+static void pool_split(data_path_cfg_t * p_path_cfg)
+{
+    uint8_t left = p_path_cfg->frame_count / p_path_cfg->link_count;
+
+    for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+    {
+        left -= p_path_cfg->reserved[stream];
+    }
+    for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+    {
+        uint8_t share = p_path_cfg->reserved[stream] + ((stream == STREAM_EEG) ? left : 0);
+
+        p_path_cfg->reserved[stream] = share;
+        p_path_cfg->limit[stream]    = share;
+    }
+}
+
+
+// The handles of the Hearable are assigned as a handle cache hit would, so discovery never runs.
+uint32_t ble_db_discovery_evt_register(ble_uuid_t const * const p_uuid)
+{
+    (void)p_uuid;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t ble_db_discovery_start(ble_db_discovery_t * p_db_discovery, uint16_t conn_handle)
+{
+    (void)p_db_discovery;
+    (void)conn_handle;
+    return NRF_ERROR_NOT_SUPPORTED;
+}
+
+
+/**@brief Function for the value handle of a characteristic of the Hearable, by its index in
+ *        hearable_gatt_chars. The CCCD of a notifying characteristic follows it.
+ */
+static uint16_t char_value_handle(uint8_t idx)
+{
+    return (uint16_t)(m_handle_base + HANDLES_PER_CHAR * idx + 1);
+}
+
+
+/**@brief Function for the index in hearable_gatt_chars of the characteristic a handle belongs to.
+ *
+ * @return The index, or hearable_gatt_char_count if the handle is none of the table.
+ */
+static uint8_t char_index_get(uint16_t handle)
+{
+    if ((handle < m_handle_base) || (handle >= m_handle_base + HANDLES_PER_CHAR * hearable_gatt_char_count))
+    {
+        return hearable_gatt_char_count;
+    }
+    return (uint8_t)((handle - m_handle_base) / HANDLES_PER_CHAR);
+}
+
+
+/**@brief Function for the index in hearable_gatt_chars of the characteristic notifying a stream. */
+static uint8_t stream_char_get(uint8_t stream)
+{
+    uint8_t idx;
+
+    for (idx = 0; idx < hearable_gatt_char_count; idx++)
+    {
+        if (hearable_gatt_chars[idx].stream_id == stream)
+        {
+            break;
+        }
+    }
+    return idx;
+}
+
+
+/**@brief Function for handing an event of a link to the BLE event handlers of the dongle, in the
+ *        order of their observer priorities.
+ */
+static void ble_evt_dispatch(sim_link_t * p_link, ble_evt_t const * p_ble_evt)
+{
+    bool busy = p_link->rev.busy;
+
+    ble_nus_c_on_ble_evt(p_ble_evt, &p_link->nus_c);
+    hearable_gatt_rev_on_ble_evt(&p_link->rev, p_ble_evt);
+    if (p_link->rev.busy && !busy)
+    {
+        p_link->rev_busy++;
+    }
+}
+
+
+/**@brief Function for storing a notification of a stream, the stream sink of the NUS client. */
+static void sim_stream_put(void * p_context, uint8_t stream_id, uint8_t const * p_data, uint16_t len)
+{
+    sim_link_t * p_link = (sim_link_t *)p_context;
+
+    p_link->stats[stream_id].rx_bytes += len;
+    (void)data_path_put(&m_path, (uint8_t)(p_link - m_links), stream_id, p_data, len, app_timer_cnt_get());
+}
+
+
+/**@brief Function for handling the NUS client events of a link: the hardware revision read. */
+static void sim_nus_c_evt(ble_nus_c_t * p_ble_nus_c, ble_nus_c_evt_t const * p_evt)
+{
+    sim_link_t * p_link = &m_links[p_ble_nus_c->conn_handle];
+
+    if ((p_evt->evt_type == BLE_NUS_C_EVT_READ_RESP) && (p_evt->char_uuid == BLE_UUID_HARDWARE_REVISION_STRING_CHAR))
+    {
+        size_t len = MIN(p_evt->data_len, sizeof(p_link->name) - 1);
+
+        memcpy(p_link->name, p_evt->p_data, len);
+        p_link->name[len] = '\0';
+    }
+}
+
+
+/**@brief Function for counting the CCCD writes of a link as they are answered. */
+static void sim_cccd_done(ble_nus_c_t * p_ble_nus_c, uint16_t handle, uint16_t gatt_status)
+{
+    sim_link_t * p_link = &m_links[p_ble_nus_c->conn_handle];
+
+    (void)handle;
+    if ((gatt_status == BLE_GATT_STATUS_SUCCESS) && (p_link->cccd_pending > 0) && (--p_link->cccd_pending == 0))
+    {
+        p_link->streaming = true;
+        p_link->setup_us  = m_now_us;
+    }
+}
+
+
+/**@brief Function for acting on the revision of a link once read, as link_revision_done of
+ *        src/main.c does on a handle cache hit.
+ */
+static void sim_rev_done(hearable_gatt_rev_t * p_rev)
+{
+    sim_link_t        * p_link = &m_links[p_rev->conn_handle];
+    ble_nus_c_handles_t handles;
+    uint8_t             enabled;
+
+    for (uint8_t i = 0; i < hearable_gatt_char_count; i++)
+    {
+        handles.value[i] = char_value_handle(i);
+        handles.cccd[i]  = (hearable_gatt_chars[i].role == BLE_NUS_C_CHAR_NOTIFY) ? (handles.value[i] + 1) : BLE_GATT_HANDLE_INVALID;
+    }
+    (void)ble_nus_c_handles_assign(&p_link->nus_c, p_rev->conn_handle, &handles);
+    (void)ble_nus_c_notif_enable_all(&p_link->nus_c, &enabled, sim_cccd_done);
+    p_link->cccd_pending = enabled;
+    (void)ble_nus_c_read(&p_link->nus_c, ble_nus_c_handle_get(&p_link->nus_c, BLE_UUID_HARDWARE_REVISION_STRING_CHAR), NULL);
+}
+
+
+/**@brief Function for the byte at an offset of the configuration the host sends. Magic, CR and
+ *        LF bytes all come up.
+ */
+static uint8_t config_byte(uint16_t offset)
+{
+    return (uint8_t)(offset * 7 + 0x0D);
+}
+
+
+/**@brief Function for handling a command from the host, as host_cmd_step of src/main.c does with
+ *        a configuration: it is written to every link, split by the NUS client of each.
+ */
+static void sim_host_cmd(host_cmd_t const * p_cmd)
+{
+    if (!p_cmd->binary || (p_cmd->status != HOST_CMD_STATUS_OK) || (p_cmd->type != HOST_CMD_TYPE_CONFIG_EEG))
+    {
+        return;
+    }
+    for (uint8_t link = 0; link < DATA_PATH_LINK_MAX; link++)
+    {
+        ble_nus_c_t * p_nus_c = &m_links[link].nus_c;
+        uint16_t      handle  = ble_nus_c_handle_get(p_nus_c, BLE_UUID_NUS_EEG_RX_CHARACTERISTIC);
+
+        if (m_links[link].streaming && (handle != BLE_GATT_HANDLE_INVALID))
+        {
+            (void)ble_nus_c_string_send(p_nus_c, (uint8_t *)p_cmd->p_data, p_cmd->len, handle);
+        }
+    }
+}
+
+
+/**@brief Function for the host sending the configuration as a binary command frame, in USB
+ *        packets.
+ */
+static void host_config_send(sim_cfg_t const * p_cfg)
+{
+    static host_cmd_parser_t parser;
+    uint8_t                  frame[HOST_CMD_BUF_LEN];
+    uint16_t                 len = HOST_CMD_HEADER_LEN + p_cfg->config_len;
+
+    frame[0] = (uint8_t)(HOST_CMD_MAGIC & 0xFF);
+    frame[1] = (uint8_t)(HOST_CMD_MAGIC >> 8);
+    frame[2] = HOST_CMD_TYPE_CONFIG_EEG;
+    frame[3] = 1;
+    (void)uint16_encode(p_cfg->config_len, &frame[4]);
+    for (uint16_t i = 0; i < p_cfg->config_len; i++)
+    {
+        frame[HOST_CMD_HEADER_LEN + i] = config_byte(i);
+    }
+    len += uint16_encode(crc16_compute(frame, len, NULL), &frame[len]);
+
+    host_cmd_parser_init(&parser, sim_host_cmd);
+    for (uint16_t i = 0; i < len; i += USB_RX_PACKET_LEN)
+    {
+        host_cmd_parse(&parser, &frame[i], MIN(len - i, USB_RX_PACKET_LEN));
+    }
+    m_config_us = m_now_us;
+}
+
+
+/**@brief Function for the Hearable receiving the write commands buffered on a link, then
+ *        telling the dongle its buffers are free.
+ */
+static void write_cmds_receive(sim_link_t * p_link, uint8_t link)
+{
+    ble_evt_t            * p_evt = (ble_evt_t *)m_evt_buf;
+    host_gattc_write_cmd_t cmd;
+    uint8_t                count = 0;
+
+    while (host_gattc_write_cmd_take(link, &cmd))
+    {
+        uint8_t idx = char_index_get(cmd.handle);
+
+        count++;
+        if ((idx < hearable_gatt_char_count) && (cmd.handle == char_value_handle(idx))
+                && (hearable_gatt_chars[idx].char_uuid == BLE_UUID_NUS_EEG_RX_CHARACTERISTIC)
+                && (p_link->config_len + cmd.len <= sizeof(p_link->config)))
+        {
+            memcpy(&p_link->config[p_link->config_len], cmd.value, cmd.len);
+            p_link->config_len += cmd.len;
+            p_link->config_writes++;
+            p_link->config_us   = m_now_us - m_config_us;
+        }
+    }
+    if (count == 0)
+    {
+        return;
+    }
+    memset(p_evt, 0, sizeof(*p_evt));
+    p_evt->header.evt_id                                     = BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE;
+    p_evt->evt.gattc_evt.conn_handle                         = link;
+    p_evt->evt.gattc_evt.params.write_cmd_tx_complete.count = count;
+    ble_evt_dispatch(p_link, p_evt);
+}
+
+
+/**@brief Function for checking the configuration a link received.
+ *
+ * @return false if the host sent one and the Hearable did not receive it whole.
+ */
+static bool config_check(sim_cfg_t const * p_cfg, sim_link_t const * p_link)
+{
+    if (p_cfg->config_len == 0)
+    {
+        return true;
+    }
+    if (p_link->config_len != p_cfg->config_len)
+    {
+        return false;
+    }
+    for (uint16_t i = 0; i < p_link->config_len; i++)
+    {
+        if (p_link->config[i] != config_byte(i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**@brief Function for connecting a link: the dongle starts the ATT MTU exchange, as its GATT
+ *        module does, then the revision read.
+ */
+static void sim_connect(sim_link_t * p_link, uint8_t link)
+{
+    ble_nus_c_init_t init =
+    {
+        .evt_handler    = sim_nus_c_evt,
+        .p_chars        = hearable_gatt_chars,
+        .char_count     = hearable_gatt_char_count,
+        .sink           = sim_stream_put,
+        .p_sink_context = p_link,
+    };
+
+    (void)ble_nus_c_init(&p_link->nus_c, &init);
+    host_gattc_reset(link);
+    (void)ble_nus_c_handles_assign(&p_link->nus_c, link, NULL);
+    (void)sd_ble_gattc_exchange_mtu_request(link, NRF_SDH_BLE_GATT_MAX_MTU_SIZE);
+    hearable_gatt_rev_read(&p_link->rev, link, sim_rev_done);
+    if (p_link->rev.busy)
+    {
+        p_link->rev_busy++;
+    }
+}
+
+
+/**@brief Function for the Hearable answering the GATT client procedure of the dongle in progress
+ *        on a link, if any.
+ */
+static void gattc_answer(sim_cfg_t const * p_cfg, sim_link_t * p_link, uint8_t link)
+{
+    ble_evt_t       * p_evt   = (ble_evt_t *)m_evt_buf;
+    ble_gattc_evt_t * p_gattc = &p_evt->evt.gattc_evt;
+    host_gattc_proc_t proc;
+    uint8_t           idx;
+
+    if (!host_gattc_proc_take(link, &proc))
+    {
+        return;
+    }
+    memset(p_evt, 0, sizeof(*p_evt));
+    p_gattc->conn_handle = link;
+    p_gattc->gatt_status = BLE_GATT_STATUS_SUCCESS;
+    idx                  = char_index_get(proc.handle);
+
+    switch (proc.type)
+    {
+        case HOST_GATTC_PROC_EXCHANGE_MTU:
+            p_evt->header.evt_id = BLE_GATTC_EVT_EXCHANGE_MTU_RSP;
+            p_gattc->params.exchange_mtu_rsp.server_rx_mtu = p_cfg->mtu;
+            ble_nus_c_att_mtu_set(&p_link->nus_c, MIN(p_cfg->mtu, proc.mtu));
+            break;
+
+        case HOST_GATTC_PROC_CHAR_VALUE_BY_UUID_READ:
+            // The Hearable has no Database Hash, only its firmware revision string.
+            p_evt->header.evt_id = BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP;
+            if (proc.uuid.uuid == BLE_UUID_FIRMWARE_REVISION_STRING_CHAR)
+            {
+                ble_gattc_evt_char_val_by_uuid_read_rsp_t * p_rsp = &p_gattc->params.char_val_by_uuid_read_rsp;
+
+                p_rsp->count     = 1;
+                p_rsp->value_len = (uint16_t)strlen(FIRMWARE_REVISION);
+                (void)uint16_encode(m_handle_base - 1, p_rsp->handle_value);
+                memcpy(&p_rsp->handle_value[sizeof(uint16_t)], FIRMWARE_REVISION, p_rsp->value_len);
+            }
+            else
+            {
+                p_gattc->gatt_status = BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND;
+            }
+            break;
+
+        case HOST_GATTC_PROC_READ:
+            p_evt->header.evt_id = BLE_GATTC_EVT_READ_RSP;
+            p_gattc->params.read_rsp.handle = proc.handle;
+            if ((idx < hearable_gatt_char_count) && (proc.handle == char_value_handle(idx))
+                    && (hearable_gatt_chars[idx].char_uuid == BLE_UUID_HARDWARE_REVISION_STRING_CHAR))
+            {
+                char name[sizeof(p_link->name)];
+
+                p_gattc->params.read_rsp.len = (uint16_t)snprintf(name, sizeof(name), HARDWARE_REVISION, link);
+                memcpy(p_gattc->params.read_rsp.data, name, p_gattc->params.read_rsp.len);
+            }
+            else
+            {
+                p_gattc->gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_HANDLE;
+            }
+            break;
+
+        case HOST_GATTC_PROC_WRITE_REQ:
+            p_evt->header.evt_id = BLE_GATTC_EVT_WRITE_RSP;
+            p_gattc->params.write_rsp.handle   = proc.handle;
+            p_gattc->params.write_rsp.write_op = BLE_GATT_OP_WRITE_REQ;
+            if ((idx < hearable_gatt_char_count) && (proc.handle == char_value_handle(idx) + 1)
+                    && (hearable_gatt_chars[idx].role == BLE_NUS_C_CHAR_NOTIFY))
+            {
+                uint8_t stream = hearable_gatt_chars[idx].stream_id;
+
+                // A stream starts sampling once it is enabled.
+                if ((stream != BLE_NUS_C_NO_STREAM) && (p_cfg->streams[stream].rate > 0)
+                        && (proc.value[0] & BLE_GATT_HVX_NOTIFICATION))
+                {
+                    sim_stream_cfg_t const * p_stream = &p_cfg->streams[stream];
+
+                    p_link->next_block_us[stream] = (double)m_now_us + p_stream->block_samples * 1e6 / p_stream->rate;
+                }
+            }
+            else
+            {
+                p_gattc->gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_HANDLE;
+            }
+            break;
+
+        default:
+            return;
+    }
+
+    host_gattc_proc_end(link);
+    ble_evt_dispatch(p_link, p_evt);
+}
+
+
+/**@brief Function for queueing the notifications of a block that has just been completed. */
+static void block_send(sim_cfg_t const * p_cfg, sim_link_t * p_link, uint8_t stream)
+{
+    sim_stream_cfg_t const * p_stream = &p_cfg->streams[stream];
+    uint32_t                 left     = sizeof(uint32_t) + (uint32_t)p_stream->sample_len * p_stream->block_samples;
+    uint16_t                 max_len  = (uint16_t)MIN(p_cfg->mtu - ATT_HEADER_LEN, NOTIF_MAX_LEN);
+
+    while (left > 0)
+    {
+        uint16_t len = (uint16_t)MIN(left, max_len);
+
+        left -= len;
+        if (p_link->queue_count == NOTIF_QUEUE_SIZE)
+        {
+            p_link->stats[stream].notifs++;
+            p_link->stats[stream].bytes += len;
+            p_link->stats[stream].air_lost++;
+            p_link->stats[stream].air_lost_bytes += len;
+            continue;
+        }
+        p_link->queue[p_link->queue_count].stream = stream;
+        p_link->queue[p_link->queue_count].len    = len;
+        p_link->queue_count++;
+    }
+}
+
+
+/**@brief Function for a connection event of a link: the Hearable answers the GATT client
+ *        procedure in progress and receives the write commands buffered, then the notifications
+ *        waiting go to the dongle, oldest first and as many as the event carries, unless they are
+ *        lost over the air.
+ */
+static void conn_event(sim_cfg_t const * p_cfg, sim_link_t * p_link, uint8_t link, uint32_t hearable_time)
+{
+    ble_evt_t           * p_evt = (ble_evt_t *)m_evt_buf;
+    ble_gattc_evt_hvx_t * p_hvx = &p_evt->evt.gattc_evt.params.hvx;
+    uint32_t              sent  = p_link->queue_count;
+
+    gattc_answer(p_cfg, p_link, link);
+    write_cmds_receive(p_link, link);
+
+    if ((p_cfg->event_notifs > 0) && (sent > p_cfg->event_notifs))
+    {
+        sent = p_cfg->event_notifs;
+    }
+    for (uint32_t i = 0; i < sent; i++)
+    {
+        sim_notif_t const  * p_notif = &p_link->queue[i];
+        sim_stream_stats_t * p_stats = &p_link->stats[p_notif->stream];
+
+        p_stats->notifs++;
+        p_stats->bytes += p_notif->len;
+        if ((p_link->burst_left == 0) && (rand_unit() * 100.0 < p_cfg->loss_pct))
+        {
+            p_link->burst_left = p_cfg->loss_burst;
+        }
+        if (p_link->burst_left > 0)
+        {
+            p_link->burst_left--;
+            p_stats->air_lost++;
+            p_stats->air_lost_bytes += p_notif->len;
+            continue;
+        }
+
+        memset(p_evt, 0, sizeof(*p_evt));
+        p_evt->header.evt_id            = BLE_GATTC_EVT_HVX;
+        p_evt->evt.gattc_evt.conn_handle = link;
+        p_hvx->handle = char_value_handle(stream_char_get(p_notif->stream));
+        p_hvx->type   = BLE_GATT_HVX_NOTIFICATION;
+        p_hvx->len    = p_notif->len;
+        memset(p_hvx->data, (int)(p_stats->notifs & 0xFF), p_notif->len);
+        (void)uint32_encode(hearable_time, p_hvx->data);
+        ble_evt_dispatch(p_link, p_evt);
+    }
+    p_link->queue_count -= sent;
+    memmove(p_link->queue, &p_link->queue[sent], p_link->queue_count * sizeof(p_link->queue[0]));
+}
+
+
+/**@brief Function for running one simulation.
+ *
+ * @param[in]  p_cfg     Settings.
+ * @param[in]  verbose   Print the counters of every stream.
+ * @param[out] p_result  Totals.
+ *
+ * @return false if the data path could not be set up.
+ */
+static bool sim_run(sim_cfg_t const * p_cfg, bool verbose, sim_result_t * p_result)
+{
+    static app_usbd_cdc_acm_t cdc_acm;
+    static usb_sink_t         sink;
+    static uint8_t            storage[DATA_PATH_LINK_MAX*DATA_PATH_FRAMES_PER_LINK*DATA_PATH_FRAME_SIZE];
+    data_path_cfg_t           path_cfg;
+    uint64_t const    end_us      = (uint64_t)(p_cfg->seconds * 1e6);
+    uint64_t          next_tick   = (uint64_t)DATA_PATH_TICK_MS * 1000;
+    uint64_t          tx_done_us  = UINT64_MAX;
+    uint8_t const   * p_data;
+    size_t            len;
+
+    data_path_cfg_default(&path_cfg, p_cfg->link_count);
+    path_cfg.sched = p_cfg->sched;
+    if (p_cfg->split_pool)
+    {
+        pool_split(&path_cfg);
+    }
+    if (data_path_init(&m_path, &path_cfg, storage, sizeof(storage), &cdc_acm) != NRF_SUCCESS)
+    {
+        return false;
+    }
+    m_path.format  = USB_FRAME_FORMAT_V2;
+    m_path.records = p_cfg->records;
+    memset(&cdc_acm, 0, sizeof(cdc_acm));
+    host_cdc_acm_port_set(&cdc_acm, true);
+    usb_sink_init(&sink, m_path.format);
+    memset(m_links, 0, sizeof(m_links));
+    m_rand_state  = p_cfg->seed;
+    m_handle_base = p_cfg->handle_base;
+    m_config_us   = UINT64_MAX;
+    m_now_us     = 0;
+
+    for (uint8_t link = 0; link < p_cfg->link_count; link++)
+    {
+        // Links take their connection events in turn. Streams start once their CCCD is written.
+        m_links[link].next_event_us = (uint64_t)link * p_cfg->interval_us / p_cfg->link_count;
+        for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+        {
+            m_links[link].next_block_us[stream] = 1e30;
+        }
+        sim_connect(&m_links[link], link);
+    }
+
+    for (;;)
+    {
+        uint64_t next_us = MIN(next_tick, tx_done_us);
+        int      next_link = -1;
+
+        for (uint8_t link = 0; link < p_cfg->link_count; link++)
+        {
+            if (m_links[link].next_event_us < next_us)
+            {
+                next_us   = m_links[link].next_event_us;
+                next_link = link;
+            }
+        }
+        if (next_us > end_us)
+        {
+            break;
+        }
+        host_timer_advance_us(next_us - m_now_us);
+        m_now_us = next_us;
+
+        if (next_link >= 0)
+        {
+            sim_link_t * p_link = &m_links[next_link];
+
+            for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+            {
+                sim_stream_cfg_t const * p_stream = &p_cfg->streams[stream];
+
+                while (p_link->next_block_us[stream] <= (double)m_now_us)
+                {
+                    block_send(p_cfg, p_link, stream);
+                    p_link->samples[stream]       += p_stream->block_samples;
+                    p_link->next_block_us[stream] += p_stream->block_samples * 1e6 / p_stream->rate;
+                }
+            }
+            conn_event(p_cfg, p_link, (uint8_t)next_link, (uint32_t)((m_now_us * HEARABLE_CLOCK_HZ) / 1000000));
+            p_link->next_event_us += p_cfg->interval_us;
+        }
+        else if (next_us == tx_done_us)
+        {
+            host_cdc_acm_tx_end(&cdc_acm);
+            data_path_tx_done(&m_path);
+            tx_done_us = UINT64_MAX;
+        }
+        else
+        {
+            data_path_tick(&m_path);
+            next_tick += (uint64_t)DATA_PATH_TICK_MS * 1000;
+        }
+
+        // Main loop pass.
+        if ((p_cfg->config_len > 0) && (m_config_us == UINT64_MAX))
+        {
+            bool streaming = true;
+
+            for (uint8_t link = 0; link < p_cfg->link_count; link++)
+            {
+                streaming = streaming && m_links[link].streaming;
+            }
+            if (streaming)
+            {
+                host_config_send(p_cfg);
+            }
+        }
+        data_path_tx_fill(&m_path);
+        data_path_tx_start(&m_path);
+        if (host_cdc_acm_tx_take(&cdc_acm, &p_data, &len))
+        {
+            (void)usb_sink_packet(&sink, p_data, (uint16_t)len);
+            tx_done_us = usb_read_us(p_cfg, m_now_us) + (uint64_t)(len * 1e6 / p_cfg->usb_rate) + 1;
+        }
+    }
+
+    memset(p_result, 0, sizeof(*p_result));
+    p_result->bad_packets = sink.bad_headers + sink.crc_errors;
+    if (verbose)
+    {
+        printf("link stream   sent B  air lost B  dongle dropped B     USB B  loss %%  seq gaps\n");
+    }
+    for (uint8_t link = 0; link < p_cfg->link_count; link++)
+    {
+        for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+        {
+            sim_stream_stats_t const * p_stats = &m_links[link].stats[stream];
+            pktbuf_stats_t const     * p_ring  = &m_path.ring[link][stream].stats;
+            uint64_t                   usb     = m_path.stats[link][stream].bytes_out;
+
+            p_result->sent_bytes     += p_stats->bytes;
+            p_result->air_lost_bytes += p_stats->air_lost_bytes;
+            p_result->dropped_bytes  += p_ring->bytes_dropped;
+            p_result->unrouted_bytes += p_stats->bytes - p_stats->air_lost_bytes - p_stats->rx_bytes;
+            p_result->usb_bytes      += usb;
+            p_result->seq_gaps       += sink.streams[link][stream].seq_gaps;
+            if (verbose)
+            {
+                printf("%4u %-6s %8llu  %10llu  %16llu  %8llu  %6.2f  %8u\n",
+                       link, m_stream_names[stream],
+                       (unsigned long long)p_stats->bytes,
+                       (unsigned long long)p_stats->air_lost_bytes,
+                       (unsigned long long)p_ring->bytes_dropped,
+                       (unsigned long long)usb,
+                       (p_stats->bytes > 0) ? (100.0 * p_ring->bytes_dropped / p_stats->bytes) : 0.0,
+                       sink.streams[link][stream].seq_gaps);
+            }
+        }
+    }
+    for (uint8_t link = 0; link < p_cfg->link_count; link++)
+    {
+        sim_link_t const * p_link = &m_links[link];
+
+        if (!p_link->streaming || (p_link->name[0] == '\0'))
+        {
+            p_result->links_not_set_up++;
+        }
+        if (!config_check(p_cfg, p_link))
+        {
+            p_result->configs_bad++;
+        }
+        if (verbose)
+        {
+            printf("Link %u %s after %.0f ms, revision \"%.*s\" (%u reads refused as busy), hardware \"%s\"\n",
+                   link, p_link->streaming ? "streaming" : "not streaming", p_link->setup_us / 1000.0,
+                   p_link->rev.len, (char const *)p_link->rev.value, p_link->rev_busy, p_link->name);
+            if (p_cfg->config_len > 0)
+            {
+                printf("Link %u configuration: %u of %u B in %u write commands, %s, last one after %.0f ms\n",
+                       link, p_link->config_len, p_cfg->config_len, p_link->config_writes,
+                       config_check(p_cfg, p_link) ? "intact" : "BAD", p_link->config_us / 1000.0);
+            }
+        }
+    }
+    if (verbose)
+    {
+        printf("USB %.1f kB/s of %.1f kB/s, dongle loss %.3f %%, %u bad packets, %llu B not routed to a stream\n",
+               p_result->usb_bytes / p_cfg->seconds / 1000.0, p_cfg->usb_rate / 1000.0,
+               (p_result->sent_bytes > 0) ? (100.0 * p_result->dropped_bytes / p_result->sent_bytes) : 0.0,
+               p_result->bad_packets, (unsigned long long)p_result->unrouted_bytes);
+    }
+
+    return true;
+}
+
+
+/**@brief Function for reading the value of an option.
+ *
+ * @return false if the option is missing its value.
+ */
+static bool arg_value(int argc, char * argv[], int * p_i, double * p_value)
+{
+    if (*p_i + 1 >= argc)
+    {
+        return false;
+    }
+    *p_value = atof(argv[++*p_i]);
+    return true;
+}
+
+
+int main(int argc, char * argv[])
+{
+    static char const * const stream_opts[STREAM_COUNT] = {"eeg", "ppg", "acc"};
+    sim_cfg_t    cfg =
+    {
+        .link_count  = 2,
+        .seconds     = 10,
+        .streams     = {{500, 27, 227}, {100, 6, 17}, {50, 6, 25}},
+        .mtu         = 247,
+        .interval_us = 15000,
+        .event_notifs = 0,
+        .loss_pct    = 0,
+        .loss_burst  = 1,
+        .usb_rate    = 1000000,
+        .sched       = DATA_PATH_SCHED_WRR,
+        .split_pool  = false,
+        .stall_us    = 0,
+        .stall_every_us = 1000000,
+        .records     = false,
+        .seed        = 1,
+        .handle_base = HANDLE_BASE,
+        .config_len  = 0,
+    };
+    sim_result_t result;
+    bool         sweep       = false;
+    bool         stall_sweep = false;
+    bool         check       = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        char const * p_arg = argv[i];
+        double       value = 0;
+        bool         ok    = true;
+
+        if (strcmp(p_arg, "--sweep") == 0)        { sweep = true; continue; }
+        if (strcmp(p_arg, "--stall-sweep") == 0)  { stall_sweep = true; continue; }
+        if (strcmp(p_arg, "--check") == 0)        { check = true; continue; }
+        if (strcmp(p_arg, "--records") == 0)      { cfg.records = true; continue; }
+        if (strcmp(p_arg, "--sched") == 0)
+        {
+            ok = (i + 1 < argc);
+            if (ok)
+            {
+                cfg.sched = (strcmp(argv[++i], "drain") == 0) ? DATA_PATH_SCHED_DRAIN : DATA_PATH_SCHED_WRR;
+                continue;
+            }
+        }
+        else if (strcmp(p_arg, "--pool") == 0)
+        {
+            ok = (i + 1 < argc);
+            if (ok)
+            {
+                cfg.split_pool = (strcmp(argv[++i], "split") == 0);
+                continue;
+            }
+        }
+        else if (strncmp(p_arg, "--", 2) == 0)
+        {
+            char const * p_name = p_arg + 2;
+
+            ok = arg_value(argc, argv, &i, &value);
+            if      (!ok)                                       {}
+            else if (strcmp(p_name, "links") == 0)              { cfg.link_count = (uint8_t)value; }
+            else if (strcmp(p_name, "seconds") == 0)            { cfg.seconds = value; }
+            else if (strcmp(p_name, "mtu") == 0)                { cfg.mtu = (uint16_t)value; }
+            else if (strcmp(p_name, "interval-ms") == 0)        { cfg.interval_us = (uint32_t)(value * 1000); }
+            else if (strcmp(p_name, "event-notifs") == 0)       { cfg.event_notifs = (uint32_t)value; }
+            else if (strcmp(p_name, "loss-pct") == 0)           { cfg.loss_pct = value; }
+            else if (strcmp(p_name, "loss-burst") == 0)         { cfg.loss_burst = (uint32_t)value; }
+            else if (strcmp(p_name, "usb-rate") == 0)           { cfg.usb_rate = value; }
+            else if (strcmp(p_name, "seed") == 0)               { cfg.seed = (uint32_t)value; }
+            else if (strcmp(p_name, "handle-base") == 0)        { cfg.handle_base = (uint16_t)value; }
+            else if (strcmp(p_name, "config-len") == 0)         { cfg.config_len = (uint16_t)value; }
+            else if (strcmp(p_name, "stall-ms") == 0)           { cfg.stall_us = value * 1000; }
+            else if (strcmp(p_name, "stall-every-ms") == 0)     { cfg.stall_every_us = value * 1000; }
+            else
+            {
+                ok = false;
+                for (uint8_t s = 0; s < STREAM_COUNT; s++)
+                {
+                    size_t n = strlen(stream_opts[s]);
+
+                    if ((strncmp(p_name, stream_opts[s], n) == 0) && (p_name[n] == '-'))
+                    {
+                        ok = true;
+                        if      (strcmp(&p_name[n], "-rate") == 0)   { cfg.streams[s].rate = value; }
+                        else if (strcmp(&p_name[n], "-sample") == 0) { cfg.streams[s].sample_len = (uint16_t)value; }
+                        else if (strcmp(&p_name[n], "-block") == 0)  { cfg.streams[s].block_samples = (uint16_t)value; }
+                        else                                         { ok = false; }
+                    }
+                }
+            }
+            if (ok)
+            {
+                continue;
+            }
+        }
+        printf("Invalid option %s, see the top of hearable_sim.c\n", p_arg);
+        return 2;
+    }
+    if ((cfg.link_count == 0) || (cfg.link_count > DATA_PATH_LINK_MAX) || (cfg.mtu <= ATT_HEADER_LEN)
+            || (cfg.usb_rate <= 0) || (cfg.interval_us == 0) || (cfg.loss_burst == 0)
+            || (cfg.stall_us < 0) || (cfg.stall_us >= cfg.stall_every_us) || (cfg.config_len > HOST_CMD_PAYLOAD_MAX))
+    {
+        printf("Invalid settings\n");
+        return 2;
+    }
+    for (uint8_t s = 0; s < STREAM_COUNT; s++)
+    {
+        if ((cfg.streams[s].block_samples == 0)
+                || ((sizeof(uint32_t) + (uint32_t)cfg.streams[s].sample_len * cfg.streams[s].block_samples)
+                    > (uint32_t)NOTIF_QUEUE_SIZE / 4 * MIN(cfg.mtu - ATT_HEADER_LEN, NOTIF_MAX_LEN)))
+        {
+            printf("Invalid %s block\n", m_stream_names[s]);
+            return 2;
+        }
+    }
+
+    printf("%u links, EEG %.0f/s x %u B in blocks of %u, PPG %.0f/s x %u B in blocks of %u, ACC %.0f/s x %u B in blocks of %u\n",
+           cfg.link_count,
+           cfg.streams[0].rate, cfg.streams[0].sample_len, cfg.streams[0].block_samples,
+           cfg.streams[1].rate, cfg.streams[1].sample_len, cfg.streams[1].block_samples,
+           cfg.streams[2].rate, cfg.streams[2].sample_len, cfg.streams[2].block_samples);
+    printf("MTU %u, interval %.2f ms, %u notifications per event (0: no limit), air loss %.2f %% in bursts of %u, USB %.0f B/s, %s scheduling, %s\n",
+           cfg.mtu, cfg.interval_us / 1000.0, cfg.event_notifs, cfg.loss_pct, cfg.loss_burst, cfg.usb_rate,
+           (cfg.sched == DATA_PATH_SCHED_WRR) ? "weighted" : "drain", cfg.records ? "records" : "plain");
+    printf("%s pool, USB stalled %.0f ms every %.0f ms\n",
+           cfg.split_pool ? "split" : "shared", cfg.stall_us / 1000.0, cfg.stall_every_us / 1000.0);
+
+    if (!sim_run(&cfg, true, &result))
+    {
+        printf("Data path set up failed\n");
+        return 2;
+    }
+
+    if (sweep)
+    {
+        // Loss grows with the rate, so bisect on a factor applied to every stream.
+        sim_cfg_t scaled = cfg;
+        double    lo     = 0;
+        double    hi     = 64;
+
+        for (int step = 0; step < SWEEP_STEPS; step++)
+        {
+            double       mid = (lo + hi) / 2;
+            sim_result_t r;
+
+            for (uint8_t s = 0; s < STREAM_COUNT; s++)
+            {
+                scaled.streams[s].rate = cfg.streams[s].rate * mid;
+            }
+            (void)sim_run(&scaled, false, &r);
+            if (r.dropped_bytes == 0)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        printf("Largest rate forwarded without loss: %.2f x the rates above (EEG %.0f samples/s per link)\n",
+               lo, cfg.streams[0].rate * lo);
+    }
+
+    if (stall_sweep)
+    {
+        // Loss grows with the stall, so bisect on its length.
+        sim_cfg_t stalled = cfg;
+        double    lo      = 0;
+        double    hi      = cfg.stall_every_us;
+
+        for (int step = 0; step < SWEEP_STEPS; step++)
+        {
+            sim_result_t r;
+
+            stalled.stall_us = (lo + hi) / 2;
+            (void)sim_run(&stalled, false, &r);
+            if (r.dropped_bytes == 0)
+            {
+                lo = stalled.stall_us;
+            }
+            else
+            {
+                hi = stalled.stall_us;
+            }
+        }
+        printf("Longest USB stall ridden out without loss: %.0f ms every %.0f ms\n",
+               lo / 1000.0, cfg.stall_every_us / 1000.0);
+    }
+
+    if (check && ((result.dropped_bytes > 0) || (result.bad_packets > 0) || (result.seq_gaps > 0)
+                  || (result.links_not_set_up > 0) || (result.unrouted_bytes > 0) || (result.configs_bad > 0)))
+    {
+        printf("Check failed\n");
+        return 1;
+    }
+    return 0;
+}
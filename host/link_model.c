@@ -0,0 +1,222 @@
+/**@file
+ *
+ * @brief Model of the notifications a Hearable link carries per connection event.
+ *
+ * @details Sizes the link settings of config/sdk_config.h, which this program includes: the
+ *          connection event length (NRF_SDH_BLE_GAP_EVENT_LENGTH), the links sharing the radio
+ *          (NRF_SDH_BLE_CENTRAL_LINK_COUNT), the target interval (NRF_BLE_SCAN_MIN_CONNECTION_INTERVAL),
+ *          the data length and the ATT MTU. LINK_MIN_CONN_INTERVAL of src/main.c is the link count
+ *          times the event length, so that every link gets its event in each interval.
+ *
+ *          A notification of MTU - 3 bytes is an ATT header (3 bytes) and an L2CAP header (4 bytes)
+ *          in front of the data, cut into link layer PDUs of at most the data length. Each PDU takes
+ *          an exchange: an empty PDU from the dongle, 150 us, the PDU of the Hearable, 150 us. A PDU
+ *          on air is the preamble (1 byte on 1M, 2 on 2M), the access address (4), the header (2),
+ *          the payload and the CRC (3), at 8 us per byte on 1M and 4 us on 2M; the links are not
+ *          encrypted, so there is no MIC. Only whole PDUs that fit in the event count; a notification
+ *          may span events. Event length extension is left out, so the figures are what a link gets
+ *          when every link is busy.
+ *
+ *          The load is that of the default Hearable of host/hearable_sim.c: EEG 500 x 27 byte samples
+ *          in blocks of 227, PPG 100 x 6 in blocks of 17, ACC 50 x 6 in blocks of 25, each block
+ *          behind a 4 byte timestamp. Each link must also carry the overload of "make sim" on 2M:
+ *          EEG at @ref EEG_OVERLOAD times its rate, the other streams as they are.
+ *
+ *          Usage: link_model [--check]
+ *            --check  Exit with 1 unless the links fit in the target interval, 2M PHY with the full data
+ *                     length carries the overload, and 1M PHY with the full data length carries the
+ *                     load.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "sdk_config.h"
+
+#define UNIT_US             1250    /**< Unit of connection intervals and event lengths. */
+#define T_IFS_US            150     /**< Inter frame space. */
+#define LL_OVERHEAD         (4 + 2 + 3)  /**< Access address, header and CRC of a PDU. */
+#define L2CAP_HEADER_LEN    4
+#define ATT_HEADER_LEN      3
+#define LL_LEN_DEFAULT      27      /**< Data length without data length extension. */
+#define ATT_MTU_DEFAULT     23      /**< ATT MTU without an MTU exchange. */
+#define EEG_OVERLOAD        4       /**< Factor on the EEG rate in the overload of "make sim" (--eeg-rate 2000). */
+
+/**@brief PHY and PDU sizes of a link. */
+typedef struct
+{
+    char const * p_name;
+    uint8_t      phy_mbps;      /**< 1 or 2. */
+    uint16_t     ll_len;        /**< Data length. */
+    uint16_t     mtu;           /**< ATT MTU. */
+} link_setup_t;
+
+/**@brief Stream of the modelled Hearable. */
+typedef struct
+{
+    double   rate;
+    uint16_t sample_len;
+    uint16_t block_samples;
+} model_stream_t;
+
+static model_stream_t const m_streams[] = {{500, 27, 227}, {100, 6, 17}, {50, 6, 25}};
+
+
+/**@brief Function for the air time of a PDU, in microseconds. */
+static uint32_t pdu_us(link_setup_t const * p_setup, uint16_t payload_len)
+{
+    uint32_t preamble = (p_setup->phy_mbps == 2) ? 2 : 1;
+
+    return (preamble + LL_OVERHEAD + payload_len) * 8 / p_setup->phy_mbps;
+}
+
+
+/**@brief Function for the time a full PDU takes, exchange and spaces included. */
+static uint32_t exchange_us(link_setup_t const * p_setup)
+{
+    return pdu_us(p_setup, 0) + T_IFS_US + pdu_us(p_setup, p_setup->ll_len) + T_IFS_US;
+}
+
+
+/**@brief Function for the bytes per second of notification data a link carries.
+ *
+ * @param[in]  p_setup     PHY and PDU sizes.
+ * @param[in]  event_us    Connection event length.
+ * @param[in]  interval_us Connection interval.
+ * @param[out] p_pdus      PDUs per event.
+ */
+static double link_rate(link_setup_t const * p_setup, uint32_t event_us, uint32_t interval_us, uint32_t * p_pdus)
+{
+    // Share of a notification's link layer bytes that is data: the rest are the ATT and L2CAP headers.
+    double data_share = (double)(p_setup->mtu - ATT_HEADER_LEN) / (p_setup->mtu + L2CAP_HEADER_LEN);
+
+    *p_pdus = event_us / exchange_us(p_setup);
+    return (double)*p_pdus * p_setup->ll_len * data_share * 1e6 / interval_us;
+}
+
+
+/**@brief Function for the bytes per second the modelled Hearable sends.
+ *
+ * @param[in] eeg_factor Factor on the EEG rate, the first stream.
+ */
+static double load_rate(double eeg_factor)
+{
+    double rate = 0;
+
+    for (size_t i = 0; i < sizeof(m_streams) / sizeof(m_streams[0]); i++)
+    {
+        double samples = m_streams[i].rate * ((i == 0) ? eeg_factor : 1);
+
+        rate += samples * m_streams[i].sample_len + 4.0 * samples / m_streams[i].block_samples;
+    }
+    return rate;
+}
+
+
+/**@brief Function for the interval used with an event length: the target, or the shortest that
+ *        leaves every link its event, as LINK_MIN_CONN_INTERVAL.
+ */
+static uint32_t interval_units(uint32_t event_units)
+{
+    uint32_t target = (uint32_t)lround(NRF_BLE_SCAN_MIN_CONNECTION_INTERVAL * 1000.0 / UNIT_US);
+    uint32_t min    = NRF_SDH_BLE_CENTRAL_LINK_COUNT * event_units;
+
+    return (target > min) ? target : min;
+}
+
+
+int main(int argc, char * argv[])
+{
+    static link_setup_t const setups[] =
+    {
+        {"2M, full DLE",   2, NRF_SDH_BLE_GAP_DATA_LENGTH, NRF_SDH_BLE_GATT_MAX_MTU_SIZE},
+        {"1M, full DLE",   1, NRF_SDH_BLE_GAP_DATA_LENGTH, NRF_SDH_BLE_GATT_MAX_MTU_SIZE},
+        {"1M, no DLE",     1, LL_LEN_DEFAULT,              NRF_SDH_BLE_GATT_MAX_MTU_SIZE},
+        {"1M, no DLE/MTU", 1, LL_LEN_DEFAULT,              ATT_MTU_DEFAULT},
+    };
+    static uint32_t const event_lengths[] = {2, 4, 6, 8, 10, 12, 16, 20};
+    uint32_t const        setup_count     = sizeof(setups) / sizeof(setups[0]);
+    bool                  check           = (argc > 1) && (strcmp(argv[1], "--check") == 0);
+    double                load            = load_rate(1);
+    double                overload        = load_rate(EEG_OVERLOAD);
+    uint32_t              event_units     = NRF_SDH_BLE_GAP_EVENT_LENGTH;
+    uint32_t              interval        = interval_units(event_units);
+    bool                  ok              = true;
+
+    printf("%u links, event length %u x 1.25 ms, target interval %u ms, data length %u, ATT MTU %u\n",
+           NRF_SDH_BLE_CENTRAL_LINK_COUNT, event_units, NRF_BLE_SCAN_MIN_CONNECTION_INTERVAL,
+           NRF_SDH_BLE_GAP_DATA_LENGTH, NRF_SDH_BLE_GATT_MAX_MTU_SIZE);
+    printf("Load of a Hearable: %.0f B/s, %.0f B/s with EEG x %u\n", load, overload, EEG_OVERLOAD);
+    printf("Time per full PDU: ");
+    for (uint32_t s = 0; s < setup_count; s++)
+    {
+        printf("%s%s %u us", (s > 0) ? ", " : "", setups[s].p_name, exchange_us(&setups[s]));
+    }
+    printf("\n\n");
+
+    printf("event   interval  Hearable data    ");
+    for (uint32_t s = 0; s < setup_count; s++)
+    {
+        printf("  %-20s", setups[s].p_name);
+    }
+    printf("\n units        ms  per interval B  ");
+    for (uint32_t s = 0; s < setup_count; s++)
+    {
+        printf("    PDUs   B/s   x load");
+    }
+    printf("\n");
+
+    for (uint32_t e = 0; e < sizeof(event_lengths) / sizeof(event_lengths[0]); e++)
+    {
+        uint32_t units = interval_units(event_lengths[e]);
+
+        printf("%5u%c %9.2f  %14.0f  ", event_lengths[e], (event_lengths[e] == event_units) ? '*' : ' ',
+               units * UNIT_US / 1000.0, load * units * UNIT_US / 1e6);
+        for (uint32_t s = 0; s < setup_count; s++)
+        {
+            uint32_t pdus;
+            double   rate = link_rate(&setups[s], event_lengths[e] * UNIT_US, units * UNIT_US, &pdus);
+
+            printf("  %6u %6.0f %6.2f", pdus, rate, rate / load);
+        }
+        printf("\n");
+    }
+    printf("* NRF_SDH_BLE_GAP_EVENT_LENGTH. Longer events need a longer interval for %u links, so the\n"
+           "  Hearable holds more data between events for about the same throughput; shorter ones carry less.\n",
+           NRF_SDH_BLE_CENTRAL_LINK_COUNT);
+
+    {
+        uint32_t pdus;
+        double   rate_2m = link_rate(&setups[0], event_units * UNIT_US, interval * UNIT_US, &pdus);
+        double   rate_1m = link_rate(&setups[1], event_units * UNIT_US, interval * UNIT_US, &pdus);
+        uint32_t target  = (uint32_t)lround(NRF_BLE_SCAN_MIN_CONNECTION_INTERVAL * 1000.0 / UNIT_US);
+
+        if (NRF_SDH_BLE_CENTRAL_LINK_COUNT * event_units > target)
+        {
+            printf("LINK_MIN_CONN_INTERVAL (%u units) is longer than the target interval (%u units)\n",
+                   NRF_SDH_BLE_CENTRAL_LINK_COUNT * event_units, target);
+            ok = false;
+        }
+        printf("Per link: 2M PHY carries %.0f B/s, %.2f x the load with EEG x %u; 1M PHY %.0f B/s, %.2f x the load\n",
+               rate_2m, rate_2m / overload, EEG_OVERLOAD, rate_1m, rate_1m / load);
+        if (rate_2m < overload)
+        {
+            printf("2M PHY carries %.2f x the load with EEG x %u, less than 1\n", rate_2m / overload, EEG_OVERLOAD);
+            ok = false;
+        }
+        if (rate_1m < load)
+        {
+            printf("1M PHY carries %.2f x the load, less than 1\n", rate_1m / load);
+            ok = false;
+        }
+    }
+
+    if (check)
+    {
+        printf("link_model: %s\n", ok ? "ok" : "FAILED");
+        return ok ? 0 : 1;
+    }
+    return 0;
+}
@@ -0,0 +1,408 @@
+/**@file
+ *
+ * @brief Unit test and throughput benchmark of the ring buffer (src/ringbuf.c).
+ *
+ * @details The unit test covers the byte and block functions on their own, blocks wrapping around
+ *          the end of the storage, the all-or-nothing rule of ringbuf_put_block, a full buffer,
+ *          the free-running 16-bit indexes wrapping, and a producer thread and a consumer thread
+ *          passing a counter pattern through the buffer without a lock, as the SoftDevice event
+ *          handler and the main loop do on the dongle.
+ *
+ *          The benchmark moves 2044 byte USB packets through a 4096 byte buffer, once a byte at a
+ *          time with ringbuf_put and ringbuf_get, the way the data path did before, and once with
+ *          ringbuf_put_block and ringbuf_get_block in notifications of 244 bytes. The host numbers
+ *          are not those of the Cortex-M4, but the ratio shows the cost of a call per byte.
+ *
+ *          Usage: ringbuf_test [--bench]
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "ringbuf.h"
+
+#define TEST_SIZE           64          /**< Size of the buffer of the unit tests. */
+#define SPSC_SIZE           1024        /**< Size of the buffer of the threaded test. */
+#define SPSC_BYTES          (4UL << 20) /**< Bytes passed between the threads. */
+#define BENCH_SIZE          4096        /**< Size of the buffer of the benchmark. */
+#define BENCH_PACKET_LEN    2044        /**< Payload of a USB packet in the old data path. */
+#define BENCH_NOTIF_LEN     244         /**< Largest notification. */
+#define BENCH_PACKETS       200000      /**< Packets moved by each benchmark. */
+
+#define CHECK(cond)                                                     \
+    do                                                                  \
+    {                                                                   \
+        if (!(cond))                                                    \
+        {                                                               \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            m_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+#define MIN_U32(a, b)   (((uint32_t)(a) < (uint32_t)(b)) ? (uint32_t)(a) : (uint32_t)(b))
+
+static unsigned m_failures;
+
+
+/**@brief Function for filling a block with a counter pattern starting at a byte count. */
+static void pattern_fill(uint8_t * p_data, uint32_t start, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+    {
+        p_data[i] = (uint8_t)((start + i) * 7);
+    }
+}
+
+
+/**@brief Function for checking a block against the counter pattern. */
+static bool pattern_check(uint8_t const * p_data, uint32_t start, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+    {
+        if (p_data[i] != (uint8_t)((start + i) * 7))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static void test_empty(void)
+{
+    static uint8_t storage[TEST_SIZE];
+    struct ringbuf r;
+    uint8_t        out[8];
+
+    ringbuf_init(&r, storage, sizeof(storage));
+    CHECK(ringbuf_size(&r) == TEST_SIZE);
+    CHECK(ringbuf_elements(&r) == 0);
+    CHECK(ringbuf_space(&r) == TEST_SIZE);
+    CHECK(ringbuf_get(&r) == -1);
+    CHECK(ringbuf_get_block(&r, out, sizeof(out)) == 0);
+}
+
+
+static void test_bytes_until_full(void)
+{
+    static uint8_t storage[TEST_SIZE];
+    struct ringbuf r;
+
+    ringbuf_init(&r, storage, sizeof(storage));
+    for (int i = 0; i < TEST_SIZE; i++)
+    {
+        CHECK(ringbuf_put(&r, (uint8_t)i) == 1);
+    }
+    CHECK(ringbuf_put(&r, 0xFF) == 0);
+    CHECK(ringbuf_elements(&r) == TEST_SIZE);
+    CHECK(ringbuf_space(&r) == 0);
+    for (int i = 0; i < TEST_SIZE; i++)
+    {
+        CHECK(ringbuf_get(&r) == i);
+    }
+    CHECK(ringbuf_get(&r) == -1);
+}
+
+
+static void test_block_all_or_nothing(void)
+{
+    static uint8_t storage[TEST_SIZE];
+    struct ringbuf r;
+    uint8_t        in[TEST_SIZE + 1];
+    uint8_t        out[TEST_SIZE];
+
+    ringbuf_init(&r, storage, sizeof(storage));
+    pattern_fill(in, 0, sizeof(in));
+    CHECK(ringbuf_put_block(&r, in, 0) == 0);
+    CHECK(ringbuf_put_block(&r, in, TEST_SIZE + 1) == 0);
+    CHECK(ringbuf_elements(&r) == 0);
+
+    CHECK(ringbuf_put_block(&r, in, 40) == 40);
+    CHECK(ringbuf_put_block(&r, in + 40, 25) == 0);     // 24 bytes free
+    CHECK(ringbuf_elements(&r) == 40);
+    CHECK(ringbuf_put_block(&r, in + 40, 24) == 24);
+    CHECK(ringbuf_space(&r) == 0);
+
+    CHECK(ringbuf_get_block(&r, out, sizeof(out)) == TEST_SIZE);
+    CHECK(pattern_check(out, 0, TEST_SIZE));
+}
+
+
+static void test_block_wrap(void)
+{
+    static uint8_t storage[TEST_SIZE];
+    struct ringbuf r;
+    uint8_t        in[TEST_SIZE];
+    uint8_t        out[TEST_SIZE];
+
+    // Move both indexes to 5 bytes before the end of the storage.
+    ringbuf_init(&r, storage, sizeof(storage));
+    pattern_fill(in, 0, sizeof(in));
+    CHECK(ringbuf_put_block(&r, in, TEST_SIZE - 5) == TEST_SIZE - 5);
+    CHECK(ringbuf_get_block(&r, out, TEST_SIZE - 5) == TEST_SIZE - 5);
+
+    // 12 bytes: 5 at the end, 7 at the start.
+    pattern_fill(in, 1000, 12);
+    CHECK(ringbuf_put_block(&r, in, 12) == 12);
+    CHECK(storage[TEST_SIZE - 1] == in[4]);
+    CHECK(storage[0] == in[5]);
+    memset(out, 0, sizeof(out));
+    CHECK(ringbuf_get_block(&r, out, 12) == 12);
+    CHECK(pattern_check(out, 1000, 12));
+
+    // A wrapped block read back a byte at a time, and bytes read back as a wrapped block.
+    ringbuf_init(&r, storage, sizeof(storage));
+    r.put_ptr = r.get_ptr = TEST_SIZE - 3;
+    CHECK(ringbuf_put_block(&r, in, 10) == 10);
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK(ringbuf_get(&r) == in[i]);
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK(ringbuf_put(&r, in[i]) == 1);
+    }
+    CHECK(ringbuf_get_block(&r, out, 10) == 10);
+    CHECK(memcmp(out, in, 10) == 0);
+}
+
+
+static void test_get_block_short(void)
+{
+    static uint8_t storage[TEST_SIZE];
+    struct ringbuf r;
+    uint8_t        in[10];
+    uint8_t        out[TEST_SIZE];
+
+    ringbuf_init(&r, storage, sizeof(storage));
+    pattern_fill(in, 0, sizeof(in));
+    CHECK(ringbuf_put_block(&r, in, sizeof(in)) == sizeof(in));
+    CHECK(ringbuf_get_block(&r, out, 4) == 4);
+    CHECK(ringbuf_get_block(&r, out + 4, sizeof(out)) == 6);
+    CHECK(pattern_check(out, 0, sizeof(in)));
+    CHECK(ringbuf_elements(&r) == 0);
+}
+
+
+static void test_flush(void)
+{
+    static uint8_t storage[TEST_SIZE];
+    struct ringbuf r;
+    uint8_t        in[20] = {0};
+
+    ringbuf_init(&r, storage, sizeof(storage));
+    CHECK(ringbuf_put_block(&r, in, sizeof(in)) == sizeof(in));
+    ringbuf_flush(&r);
+    CHECK(ringbuf_elements(&r) == 0);
+    CHECK(ringbuf_space(&r) == TEST_SIZE);
+    CHECK(ringbuf_get(&r) == -1);
+}
+
+
+static void test_index_wrap(void)
+{
+    static uint8_t storage[TEST_SIZE];
+    struct ringbuf r;
+    uint8_t        in[30] = {0};
+    uint8_t        out[30];
+    uint32_t       total = 0;
+
+    // Well past 65536 bytes, so both 16-bit indexes wrap, with the buffer partly full.
+    ringbuf_init(&r, storage, sizeof(storage));
+    CHECK(ringbuf_put_block(&r, in, 30) == 30);
+    CHECK(ringbuf_get_block(&r, out, 30) == 30);
+    while (total < 200000)
+    {
+        pattern_fill(in, total, sizeof(in));
+        CHECK(ringbuf_put_block(&r, in, sizeof(in)) == sizeof(in));
+        CHECK(ringbuf_put_block(&r, in, sizeof(in)) == sizeof(in));
+        CHECK(ringbuf_elements(&r) == 2 * sizeof(in));
+        CHECK(ringbuf_get_block(&r, out, sizeof(out)) == sizeof(out));
+        CHECK(pattern_check(out, total, sizeof(out)));
+        CHECK(ringbuf_get_block(&r, out, sizeof(out)) == sizeof(out));
+        CHECK(pattern_check(out, total, sizeof(out)));
+        total += sizeof(in);
+    }
+}
+
+
+/**@brief State shared by the producer and the consumer threads. */
+typedef struct
+{
+    struct ringbuf r;
+    uint8_t        storage[SPSC_SIZE];
+    bool           bytes;       /**< The producer calls ringbuf_put instead of ringbuf_put_block. */
+} spsc_t;
+
+
+/**@brief Producer thread: the counter pattern in blocks of 1 to 251 bytes. */
+static void * spsc_producer(void * p_arg)
+{
+    spsc_t   * p_spsc = p_arg;
+    uint8_t    block[251];
+    uint32_t   sent   = 0;
+    uint16_t   len    = 1;
+
+    while (sent < SPSC_BYTES)
+    {
+        len = (uint16_t)MIN_U32(len, SPSC_BYTES - sent);
+        pattern_fill(block, sent, len);
+        if (p_spsc->bytes)
+        {
+            for (uint16_t i = 0; i < len; i++)
+            {
+                while (ringbuf_put(&p_spsc->r, block[i]) == 0)
+                {
+                    (void)sched_yield();
+                }
+            }
+        }
+        else
+        {
+            while (ringbuf_put_block(&p_spsc->r, block, len) == 0)
+            {
+                (void)sched_yield();
+            }
+        }
+        sent += len;
+        len   = (uint16_t)(len % sizeof(block) + 1);
+    }
+    return NULL;
+}
+
+
+static void test_spsc(bool bytes)
+{
+    static spsc_t spsc;
+    pthread_t     producer;
+    uint8_t       block[173];
+    uint32_t      received = 0;
+    uint16_t      len      = 1;
+    bool          ok       = true;
+
+    ringbuf_init(&spsc.r, spsc.storage, sizeof(spsc.storage));
+    spsc.bytes = bytes;
+    CHECK(pthread_create(&producer, NULL, spsc_producer, &spsc) == 0);
+
+    while (received < SPSC_BYTES)
+    {
+        int n = ringbuf_get_block(&spsc.r, block, (uint16_t)MIN_U32(len, SPSC_BYTES - received));
+
+        if (n == 0)
+        {
+            (void)sched_yield();    // The producer may share the CPU
+        }
+        ok        = ok && pattern_check(block, received, (uint16_t)n);
+        received += (uint32_t)n;
+        len       = (uint16_t)(len % sizeof(block) + 1);
+    }
+    (void)pthread_join(producer, NULL);
+
+    CHECK(ok);
+    CHECK(ringbuf_elements(&spsc.r) == 0);
+}
+
+
+/**@brief Function for the time since an arbitrary start, in seconds. */
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**@brief Function for moving BENCH_PACKETS packets through the buffer.
+ *
+ * @return Seconds taken.
+ */
+static double bench_run(bool bytes)
+{
+    static uint8_t storage[BENCH_SIZE];
+    static uint8_t notif[BENCH_NOTIF_LEN];
+    static uint8_t packet[BENCH_PACKET_LEN];
+    struct ringbuf r;
+    uint32_t       check = 0;
+    double         start;
+
+    pattern_fill(notif, 0, sizeof(notif));
+    ringbuf_init(&r, storage, sizeof(storage));
+    start = now_s();
+    for (uint32_t p = 0; p < BENCH_PACKETS; p++)
+    {
+        // Notifications in until a packet is there, then the packet out, as the old data path.
+        while (ringbuf_elements(&r) < BENCH_PACKET_LEN)
+        {
+            if (bytes)
+            {
+                for (uint16_t i = 0; i < sizeof(notif); i++)
+                {
+                    (void)ringbuf_put(&r, notif[i]);
+                }
+            }
+            else
+            {
+                (void)ringbuf_put_block(&r, notif, sizeof(notif));
+            }
+        }
+        if (bytes)
+        {
+            for (uint16_t i = 0; i < sizeof(packet); i++)
+            {
+                packet[i] = (uint8_t)ringbuf_get(&r);
+            }
+        }
+        else
+        {
+            (void)ringbuf_get_block(&r, packet, sizeof(packet));
+        }
+        check += packet[p % sizeof(packet)];
+    }
+    if (check == 0xFFFFFFFF)
+    {
+        printf("\n");   // Keeps the packets from being optimised away.
+    }
+    return now_s() - start;
+}
+
+
+static void bench(void)
+{
+    double mbytes  = (double)BENCH_PACKETS * BENCH_PACKET_LEN / 1e6;
+    double t_bytes = bench_run(true);
+    double t_block = bench_run(false);
+
+    printf("%u packets of %u bytes through a %u byte buffer, notifications of %u bytes\n",
+           BENCH_PACKETS, BENCH_PACKET_LEN, BENCH_SIZE, BENCH_NOTIF_LEN);
+    printf("byte at a time: %8.1f MB/s, %8.0f ns per packet\n", mbytes / t_bytes, t_bytes * 1e9 / BENCH_PACKETS);
+    printf("blocks:         %8.1f MB/s, %8.0f ns per packet\n", mbytes / t_block, t_block * 1e9 / BENCH_PACKETS);
+    printf("blocks are %.1f times faster\n", t_bytes / t_block);
+}
+
+
+int main(int argc, char * argv[])
+{
+    if ((argc > 1) && (strcmp(argv[1], "--bench") == 0))
+    {
+        bench();
+        return 0;
+    }
+
+    test_empty();
+    test_bytes_until_full();
+    test_block_all_or_nothing();
+    test_block_wrap();
+    test_get_block_short();
+    test_flush();
+    test_index_wrap();
+    test_spsc(false);
+    test_spsc(true);
+
+    printf("ringbuf_test: %s\n", (m_failures == 0) ? "ok" : "FAILED");
+    return (m_failures == 0) ? 0 : 1;
+}
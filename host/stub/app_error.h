@@ -0,0 +1,27 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's app_error.h: an error the dongle would reset on ends the
+ *        program.
+ */
+
+#ifndef APP_ERROR_H__
+#define APP_ERROR_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sdk_errors.h"
+
+#define APP_ERROR_CHECK(ERR_CODE)                                                   \
+    do                                                                              \
+    {                                                                               \
+        uint32_t _err = (uint32_t)(ERR_CODE);                                       \
+        if (_err != NRF_SUCCESS)                                                    \
+        {                                                                           \
+            fprintf(stderr, "%s:%d: error 0x%x\n", __FILE__, __LINE__, _err);     \
+            abort();                                                                \
+        }                                                                           \
+    } while (0)
+
+#define APP_ERROR_CHECK_BOOL(BOOLEAN_VALUE) APP_ERROR_CHECK((BOOLEAN_VALUE) ? NRF_SUCCESS : NRF_ERROR_INTERNAL)
+
+#endif // APP_ERROR_H__
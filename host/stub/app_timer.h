@@ -0,0 +1,31 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's app_timer.h: a 24-bit counter at 32768 Hz that the host
+ *        programs move forward themselves with @ref host_timer_advance_us.
+ */
+
+#ifndef APP_TIMER_H__
+#define APP_TIMER_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define APP_TIMER_CLOCK_FREQ 32768
+#define APP_TIMER_MAX_CNT_VAL 0x00FFFFFF
+#define APP_TIMER_TICKS(MS) ((uint32_t)(((uint64_t)(MS) * APP_TIMER_CLOCK_FREQ) / 1000))
+
+uint32_t app_timer_cnt_get(void);
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from);
+
+/**@brief Function for moving the counter forward, see host_stub.c. */
+void host_timer_advance_us(uint64_t us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // APP_TIMER_H__
@@ -0,0 +1,52 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's app_usbd_cdc_acm.h: a port that takes one write at a time.
+ *
+ * @details @ref app_usbd_cdc_acm_write refuses a write while the port is closed or the previous
+ *          write is not done, as the class does. The host program takes each write started with
+ *          @ref host_cdc_acm_tx_take, plays the host reading it, then ends it with
+ *          @ref host_cdc_acm_tx_end before signalling TX_DONE to the data path.
+ */
+
+#ifndef APP_USBD_CDC_ACM_H__
+#define APP_USBD_CDC_ACM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**@brief CDC ACM class instance. */
+typedef struct
+{
+    bool            port_open;  /**< The host opened the port. */
+    bool            busy;       /**< A write was started and is not done. */
+    bool            taken;      /**< The host program took the write in progress. */
+    uint8_t const * p_tx;       /**< Data of the write in progress. */
+    size_t          tx_len;     /**< Its length. */
+    uint32_t        refused;    /**< Writes refused so far. */
+} app_usbd_cdc_acm_t;
+
+ret_code_t app_usbd_cdc_acm_write(app_usbd_cdc_acm_t const * p_cdc_acm, void const * p_buf, size_t length);
+
+/**@brief Function for opening or closing the port. A write in progress is abandoned on closing. */
+void host_cdc_acm_port_set(app_usbd_cdc_acm_t * p_cdc_acm, bool open);
+
+/**@brief Function for taking the write just started, once.
+ *
+ * @return false if no write was started since the last call.
+ */
+bool host_cdc_acm_tx_take(app_usbd_cdc_acm_t * p_cdc_acm, uint8_t const ** pp_data, size_t * p_len);
+
+/**@brief Function for ending the write in progress, as the host has read it. */
+void host_cdc_acm_tx_end(app_usbd_cdc_acm_t * p_cdc_acm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // APP_USBD_CDC_ACM_H__
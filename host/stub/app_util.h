@@ -0,0 +1,46 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's app_util.h: the little endian encoders and decoders
+ *        and the size macros.
+ */
+
+#ifndef APP_UTIL_H__
+#define APP_UTIL_H__
+
+#include <stdint.h>
+#include "nordic_common.h"
+
+#define STATIC_ASSERT(EXPR) _Static_assert((EXPR), #EXPR)
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define BYTES_TO_WORDS(n_bytes) (((n_bytes) + 3) >> 2)
+
+static inline uint8_t uint16_encode(uint16_t value, uint8_t * p_encoded_data)
+{
+    p_encoded_data[0] = (uint8_t)(value >> 0);
+    p_encoded_data[1] = (uint8_t)(value >> 8);
+    return sizeof(uint16_t);
+}
+
+static inline uint8_t uint32_encode(uint32_t value, uint8_t * p_encoded_data)
+{
+    p_encoded_data[0] = (uint8_t)(value >> 0);
+    p_encoded_data[1] = (uint8_t)(value >> 8);
+    p_encoded_data[2] = (uint8_t)(value >> 16);
+    p_encoded_data[3] = (uint8_t)(value >> 24);
+    return sizeof(uint32_t);
+}
+
+static inline uint16_t uint16_decode(uint8_t const * p_encoded_data)
+{
+    return (uint16_t)(p_encoded_data[0] | ((uint16_t)p_encoded_data[1] << 8));
+}
+
+static inline uint32_t uint32_decode(uint8_t const * p_encoded_data)
+{
+    return ((uint32_t)p_encoded_data[0] << 0)
+         | ((uint32_t)p_encoded_data[1] << 8)
+         | ((uint32_t)p_encoded_data[2] << 16)
+         | ((uint32_t)p_encoded_data[3] << 24);
+}
+
+#endif // APP_UTIL_H__
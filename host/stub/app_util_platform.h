@@ -0,0 +1,22 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's app_util_platform.h.
+ *
+ * @details The host programs run the producer and the consumer in one thread, one event at a
+ *          time, so a critical region only has to count how deep it is nested.
+ */
+
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+#include <stdint.h>
+#include "app_util.h"
+
+extern uint32_t host_critical_depth;    /**< Critical regions entered and not left, see host_stub.c. */
+
+#define CRITICAL_REGION_ENTER() { host_critical_depth++;
+#define CRITICAL_REGION_EXIT()    host_critical_depth--; }
+
+#define __DMB() __sync_synchronize()
+
+#endif // APP_UTIL_PLATFORM_H__
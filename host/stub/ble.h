@@ -0,0 +1,48 @@
+/**@file
+ *
+ * @brief Host stand-in for the SoftDevice's ble.h: the event the host program hands to the BLE
+ *        event handlers, GAP or GATT client.
+ */
+
+#ifndef BLE_H__
+#define BLE_H__
+
+#include <stdint.h>
+#include "ble_types.h"
+#include "ble_gap.h"
+#include "ble_gatt.h"
+#include "ble_gattc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**@brief Longest event with an attribute value of an ATT MTU, for the buffers events are built in. */
+#define BLE_EVT_LEN_MAX(ATT_MTU) (sizeof(ble_evt_t) + (ATT_MTU))
+
+/**@brief BLE event header. */
+typedef struct
+{
+    uint16_t evt_id;
+    uint16_t evt_len;
+} ble_evt_hdr_t;
+
+/**@brief Common BLE event type. */
+typedef struct
+{
+    ble_evt_hdr_t header;
+    union
+    {
+        ble_gap_evt_t   gap_evt;
+        ble_gattc_evt_t gattc_evt;
+    } evt;
+} ble_evt_t;
+
+/**@brief Function for adding a vendor specific base UUID. The stand-in hands out types in order. */
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const * p_vs_uuid, uint8_t * p_uuid_type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLE_H__
@@ -0,0 +1,53 @@
+/**@file
+ *
+ * @brief Host stand-in for the SoftDevice's ble_gap.h: the address and the connection events.
+ */
+
+#ifndef BLE_GAP_H__
+#define BLE_GAP_H__
+
+#include <stdint.h>
+#include "ble_types.h"
+
+#define BLE_GAP_EVT_BASE    0x10
+#define BLE_GAP_ADDR_LEN    6
+
+/**@brief GAP event IDs. */
+enum BLE_GAP_EVTS
+{
+    BLE_GAP_EVT_CONNECTED = BLE_GAP_EVT_BASE,
+    BLE_GAP_EVT_DISCONNECTED
+};
+
+/**@brief Bluetooth Low Energy address. */
+typedef struct
+{
+    uint8_t addr_id_peer : 1;
+    uint8_t addr_type    : 7;
+    uint8_t addr[BLE_GAP_ADDR_LEN];
+} ble_gap_addr_t;
+
+/**@brief Event structure for @ref BLE_GAP_EVT_CONNECTED. */
+typedef struct
+{
+    ble_gap_addr_t peer_addr;
+} ble_gap_evt_connected_t;
+
+/**@brief Event structure for @ref BLE_GAP_EVT_DISCONNECTED. */
+typedef struct
+{
+    uint8_t reason;
+} ble_gap_evt_disconnected_t;
+
+/**@brief GAP event structure. */
+typedef struct
+{
+    uint16_t conn_handle;
+    union
+    {
+        ble_gap_evt_connected_t    connected;
+        ble_gap_evt_disconnected_t disconnected;
+    } params;
+} ble_gap_evt_t;
+
+#endif // BLE_GAP_H__
@@ -0,0 +1,26 @@
+/**@file
+ *
+ * @brief Host stand-in for the SoftDevice's ble_gatt.h, with the same values.
+ */
+
+#ifndef BLE_GATT_H__
+#define BLE_GATT_H__
+
+#define BLE_GATT_ATT_MTU_DEFAULT                    23
+
+#define BLE_GATT_HANDLE_INVALID                     0x0000
+
+#define BLE_GATT_OP_WRITE_REQ                       0x01
+#define BLE_GATT_OP_WRITE_CMD                       0x02
+
+#define BLE_GATT_HVX_NOTIFICATION                   0x01
+
+#define BLE_GATT_STATUS_SUCCESS                     0x0000
+#define BLE_GATT_STATUS_UNKNOWN                     0x0001
+#define BLE_GATT_STATUS_ATTERR_INVALID_HANDLE       0x0101
+#define BLE_GATT_STATUS_ATTERR_READ_NOT_PERMITTED   0x0102
+#define BLE_GATT_STATUS_ATTERR_WRITE_NOT_PERMITTED  0x0103
+#define BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND  0x010A
+#define BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH 0x010D
+
+#endif // BLE_GATT_H__
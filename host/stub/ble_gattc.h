@@ -0,0 +1,225 @@
+/**@file
+ *
+ * @brief Host stand-in for the SoftDevice's ble_gattc.h: the GATT client calls the dongle makes and
+ *        the events that answer them, with the same layout.
+ *
+ * @details As the SoftDevice does, a link runs one GATT client procedure at a time: a read, a write
+ *          request, a read by UUID or an ATT MTU exchange started while another one runs is
+ *          refused with NRF_ERROR_BUSY. The host program plays the peer: it takes the procedure
+ *          in progress with @ref host_gattc_proc_take, ends it with @ref host_gattc_proc_end and
+ *          then delivers the response event, so the handlers may start the next procedure from it.
+ *          Write commands need no response: up to @ref HOST_GATTC_WRITE_CMD_QUEUE_SIZE of them wait
+ *          in the buffers of a link, and further ones are refused with NRF_ERROR_RESOURCES, until
+ *          the host program takes them with @ref host_gattc_write_cmd_take and delivers
+ *          BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE.
+ */
+
+#ifndef BLE_GATTC_H__
+#define BLE_GATTC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ble_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLE_GATTC_EVT_BASE          0x30
+#define BLE_GATTC_EVT_LAST          0x4F
+
+#define HOST_GATTC_LINK_MAX             8   /**< Connection handles the stand-in keeps procedures for. */
+#define HOST_GATTC_VALUE_MAX_LEN        2   /**< Longest value of a write request: a CCCD. */
+#define HOST_GATTC_WRITE_CMD_QUEUE_SIZE 4   /**< Write commands buffered per link, WRITE_CMD_TX_QUEUE_SIZE of src/main.c. */
+#define HOST_GATTC_WRITE_CMD_MAX_LEN    244 /**< Longest write command, at the largest ATT MTU. */
+
+/**@brief GATT client event IDs. */
+enum BLE_GATTC_EVTS
+{
+    BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP = BLE_GATTC_EVT_BASE,
+    BLE_GATTC_EVT_REL_DISC_RSP,
+    BLE_GATTC_EVT_CHAR_DISC_RSP,
+    BLE_GATTC_EVT_DESC_DISC_RSP,
+    BLE_GATTC_EVT_ATTR_INFO_DISC_RSP,
+    BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP,
+    BLE_GATTC_EVT_READ_RSP,
+    BLE_GATTC_EVT_CHAR_VALS_READ_RSP,
+    BLE_GATTC_EVT_WRITE_RSP,
+    BLE_GATTC_EVT_HVX,
+    BLE_GATTC_EVT_EXCHANGE_MTU_RSP,
+    BLE_GATTC_EVT_TIMEOUT,
+    BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE
+};
+
+/**@brief Operation handle range. */
+typedef struct
+{
+    uint16_t start_handle;
+    uint16_t end_handle;
+} ble_gattc_handle_range_t;
+
+/**@brief GATT characteristic. */
+typedef struct
+{
+    ble_uuid_t uuid;
+    uint16_t   handle_decl;
+    uint16_t   handle_value;
+} ble_gattc_char_t;
+
+/**@brief Write parameters. */
+typedef struct
+{
+    uint8_t         write_op;
+    uint8_t         flags;
+    uint16_t        handle;
+    uint16_t        offset;
+    uint16_t        len;
+    uint8_t const * p_value;
+} ble_gattc_write_params_t;
+
+/**@brief Attribute handle and value pair of a read by UUID response. */
+typedef struct
+{
+    uint16_t  handle;
+    uint8_t * p_value;
+} ble_gattc_handle_value_t;
+
+/**@brief Event structure for @ref BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP. */
+typedef struct
+{
+    uint16_t count;             /**< Handle-value pairs found. */
+    uint16_t value_len;         /**< Length of every value. */
+    uint8_t  handle_value[1];   /**< Handle-value pairs, each a little endian handle then the value. */
+} ble_gattc_evt_char_val_by_uuid_read_rsp_t;
+
+/**@brief Event structure for @ref BLE_GATTC_EVT_READ_RSP. */
+typedef struct
+{
+    uint16_t handle;
+    uint16_t offset;
+    uint16_t len;
+    uint8_t  data[1];           /**< Value, len bytes. */
+} ble_gattc_evt_read_rsp_t;
+
+/**@brief Event structure for @ref BLE_GATTC_EVT_WRITE_RSP. */
+typedef struct
+{
+    uint16_t handle;
+    uint8_t  write_op;
+    uint16_t offset;
+    uint16_t len;
+    uint8_t  data[1];
+} ble_gattc_evt_write_rsp_t;
+
+/**@brief Event structure for @ref BLE_GATTC_EVT_HVX. */
+typedef struct
+{
+    uint16_t handle;
+    uint8_t  type;
+    uint16_t len;
+    uint8_t  data[1];           /**< Value, len bytes. */
+} ble_gattc_evt_hvx_t;
+
+/**@brief Event structure for @ref BLE_GATTC_EVT_EXCHANGE_MTU_RSP. */
+typedef struct
+{
+    uint16_t server_rx_mtu;
+} ble_gattc_evt_exchange_mtu_rsp_t;
+
+/**@brief Event structure for @ref BLE_GATTC_EVT_TIMEOUT. */
+typedef struct
+{
+    uint8_t src;
+} ble_gattc_evt_timeout_t;
+
+/**@brief Event structure for @ref BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE. */
+typedef struct
+{
+    uint8_t count;
+} ble_gattc_evt_write_cmd_tx_complete_t;
+
+/**@brief GATT client event structure. */
+typedef struct
+{
+    uint16_t conn_handle;
+    uint16_t gatt_status;
+    uint16_t error_handle;
+    union
+    {
+        ble_gattc_evt_char_val_by_uuid_read_rsp_t char_val_by_uuid_read_rsp;
+        ble_gattc_evt_read_rsp_t                  read_rsp;
+        ble_gattc_evt_write_rsp_t                 write_rsp;
+        ble_gattc_evt_exchange_mtu_rsp_t          exchange_mtu_rsp;
+        ble_gattc_evt_timeout_t                   timeout;
+        ble_gattc_evt_write_cmd_tx_complete_t     write_cmd_tx_complete;
+        ble_gattc_evt_hvx_t                       hvx;
+    } params;
+} ble_gattc_evt_t;
+
+/**@brief GATT client procedure of a link, for the host program to answer. */
+typedef enum
+{
+    HOST_GATTC_PROC_NONE,
+    HOST_GATTC_PROC_READ,                   /**< @ref sd_ble_gattc_read, answered with BLE_GATTC_EVT_READ_RSP. */
+    HOST_GATTC_PROC_WRITE_REQ,              /**< Write request, answered with BLE_GATTC_EVT_WRITE_RSP. */
+    HOST_GATTC_PROC_CHAR_VALUE_BY_UUID_READ,/**< Answered with BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP. */
+    HOST_GATTC_PROC_EXCHANGE_MTU            /**< Answered with BLE_GATTC_EVT_EXCHANGE_MTU_RSP. */
+} host_gattc_proc_type_t;
+
+/**@brief GATT client procedure. */
+typedef struct
+{
+    host_gattc_proc_type_t type;
+    uint16_t               handle;                              /**< Attribute read or written. */
+    ble_uuid_t             uuid;                                /**< Characteristic of a read by UUID. */
+    uint16_t               mtu;                                 /**< Client RX MTU of an MTU exchange. */
+    uint16_t               len;                                 /**< Length of the value written. */
+    uint8_t                value[HOST_GATTC_VALUE_MAX_LEN];     /**< Value written. */
+} host_gattc_proc_t;
+
+/**@brief Write command sent by a link. */
+typedef struct
+{
+    uint16_t handle;                                /**< Attribute written. */
+    uint16_t len;                                   /**< Length of the value written. */
+    uint8_t  value[HOST_GATTC_WRITE_CMD_MAX_LEN];   /**< Value written. */
+} host_gattc_write_cmd_t;
+
+uint32_t sd_ble_gattc_read(uint16_t conn_handle, uint16_t handle, uint16_t offset);
+uint32_t sd_ble_gattc_write(uint16_t conn_handle, ble_gattc_write_params_t const * p_write_params);
+uint32_t sd_ble_gattc_char_value_by_uuid_read(uint16_t conn_handle, ble_uuid_t const * p_uuid, ble_gattc_handle_range_t const * p_handle_range);
+uint32_t sd_ble_gattc_exchange_mtu_request(uint16_t conn_handle, uint16_t client_rx_mtu);
+
+/**@brief Function for iterating through the handle-value pairs of a read by UUID response. Zero
+ *        the iterator to start.
+ */
+uint32_t sd_ble_gattc_evt_char_val_by_uuid_read_rsp_iter(ble_gattc_evt_t * p_gattc_evt, ble_gattc_handle_value_t * p_iter);
+
+/**@brief Function for forgetting the procedure and write commands of a link, as a new connection. */
+void host_gattc_reset(uint16_t conn_handle);
+
+/**@brief Function for taking the procedure in progress on a link, once.
+ *
+ * @return false if no procedure was started since the last one taken.
+ */
+bool host_gattc_proc_take(uint16_t conn_handle, host_gattc_proc_t * p_proc);
+
+/**@brief Function for ending the procedure in progress on a link, as its response arrives. */
+void host_gattc_proc_end(uint16_t conn_handle);
+
+/**@brief Function for getting the write commands a link has sent. */
+uint32_t host_gattc_write_cmds(uint16_t conn_handle);
+
+/**@brief Function for taking the oldest write command buffered on a link, as it goes over the air,
+ *        which frees its buffer. The host program then delivers
+ *        BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE with the count taken.
+ *
+ * @return false if no write command is buffered.
+ */
+bool host_gattc_write_cmd_take(uint16_t conn_handle, host_gattc_write_cmd_t * p_cmd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLE_GATTC_H__
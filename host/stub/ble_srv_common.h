@@ -0,0 +1,14 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's ble_srv_common.h.
+ */
+
+#ifndef BLE_SRV_COMMON_H__
+#define BLE_SRV_COMMON_H__
+
+#include "ble.h"
+#include "app_util.h"
+
+#define BLE_CCCD_VALUE_LEN 2
+
+#endif // BLE_SRV_COMMON_H__
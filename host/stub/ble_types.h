@@ -0,0 +1,38 @@
+/**@file
+ *
+ * @brief Host stand-in for the SoftDevice's ble_types.h: UUIDs and the byte macros, with the same
+ *        values.
+ */
+
+#ifndef BLE_TYPES_H__
+#define BLE_TYPES_H__
+
+#include <stdint.h>
+
+#define BLE_CONN_HANDLE_INVALID                 0xFFFF
+
+#define BLE_UUID_TYPE_UNKNOWN                   0x00
+#define BLE_UUID_TYPE_BLE                       0x01
+#define BLE_UUID_TYPE_VENDOR_BEGIN              0x02
+
+#define BLE_UUID_DEVICE_INFORMATION_SERVICE     0x180A
+#define BLE_UUID_FIRMWARE_REVISION_STRING_CHAR  0x2A26
+#define BLE_UUID_HARDWARE_REVISION_STRING_CHAR  0x2A27
+
+#define MSB_16(a) (((a) & 0xFF00) >> 8)
+#define LSB_16(a) ((a) & 0x00FF)
+
+/**@brief 128 bit UUID values. */
+typedef struct
+{
+    uint8_t uuid128[16];
+} ble_uuid128_t;
+
+/**@brief Bluetooth Low Energy UUID type, encapsulates both 16-bit and 128-bit UUIDs. */
+typedef struct
+{
+    uint16_t uuid;
+    uint8_t  type;
+} ble_uuid_t;
+
+#endif // BLE_TYPES_H__
@@ -0,0 +1,21 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's crc16.h. The implementation in host_stub.c is the SDK's.
+ */
+
+#ifndef CRC16_H__
+#define CRC16_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint16_t crc16_compute(uint8_t const * p_data, uint32_t size, uint16_t const * p_crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CRC16_H__
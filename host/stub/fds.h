@@ -0,0 +1,174 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's fds.h: the records, the calls the dongle makes and their
+ *        events, with the same layout and error values.
+ *
+ * @details As FDS does, writes, updates and garbage collection are queued and carried out later,
+ *          reading the data of a write only then, and each one ends with its event. The host
+ *          program carries them out one at a time with @ref host_fds_step, so it decides what
+ *          happens while one is in flight. Flash is kept across @ref host_fds_reset unless it is
+ *          erased, as across a reset of the dongle.
+ *
+ *          Flash holds @ref HOST_FDS_FLASH_WORDS by default. A record takes its data and a header
+ *          of @ref FDS_HEADER_SIZE words, and an updated record keeps its words until garbage
+ *          collection; a write that does not fit is refused with FDS_ERR_NO_SPACE_IN_FLASH.
+ */
+
+#ifndef FDS_H__
+#define FDS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdk_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FDS_HEADER_SIZE             3       /**< Words of the header of a record. */
+
+#define HOST_FDS_FLASH_WORDS        2048    /**< Words for records: FDS_VIRTUAL_PAGES of 1024 words less the swap page. */
+#define HOST_FDS_RECORD_MAX         16      /**< Records flash holds, valid or dirty. */
+#define HOST_FDS_RECORD_MAX_WORDS   32      /**< Longest record data. */
+#define HOST_FDS_QUEUE_SIZE         8       /**< Operations queued at most. */
+
+/**@brief FDS error codes. */
+enum
+{
+    FDS_ERR_OPERATION_TIMEOUT = NRF_ERROR_FDS_ERR_BASE,
+    FDS_ERR_NOT_INITIALIZED,
+    FDS_ERR_UNALIGNED_ADDR,
+    FDS_ERR_INVALID_ARG,
+    FDS_ERR_NULL_ARG,
+    FDS_ERR_NO_OPEN_RECORDS,
+    FDS_ERR_NO_SPACE_IN_FLASH,
+    FDS_ERR_NO_SPACE_IN_QUEUES,
+    FDS_ERR_RECORD_TOO_LARGE,
+    FDS_ERR_NOT_FOUND,
+    FDS_ERR_NO_PAGES,
+    FDS_ERR_USER_LIMIT_REACHED,
+    FDS_ERR_CRC_CHECK_FAILED,
+    FDS_ERR_BUSY,
+    FDS_ERR_INTERNAL,
+};
+
+/**@brief Record header. */
+typedef struct
+{
+    uint16_t record_key;
+    uint16_t length_words;
+    uint16_t file_id;
+    uint16_t crc16;
+    uint32_t record_id;
+} fds_header_t;
+
+/**@brief Record descriptor. */
+typedef struct
+{
+    uint32_t         record_id;
+    uint32_t const * p_record;
+    uint16_t         gc_run_count;
+    bool             record_is_open;
+} fds_record_desc_t;
+
+/**@brief Search token. The stand-in keeps the index of the next record to look at in page. */
+typedef struct
+{
+    uint32_t const * p_addr;
+    uint16_t         page;
+} fds_find_token_t;
+
+/**@brief Record to write. */
+typedef struct
+{
+    uint16_t file_id;
+    uint16_t key;
+    struct
+    {
+        void const * p_data;
+        uint32_t     length_words;
+    } data;
+} fds_record_t;
+
+/**@brief Record opened for reading. */
+typedef struct
+{
+    fds_header_t const * p_header;
+    void const         * p_data;
+} fds_flash_record_t;
+
+/**@brief FDS event IDs. */
+typedef enum
+{
+    FDS_EVT_INIT,
+    FDS_EVT_WRITE,
+    FDS_EVT_UPDATE,
+    FDS_EVT_DEL_RECORD,
+    FDS_EVT_DEL_FILE,
+    FDS_EVT_GC
+} fds_evt_id_t;
+
+/**@brief FDS event. */
+typedef struct
+{
+    fds_evt_id_t id;
+    ret_code_t   result;
+    union
+    {
+        struct
+        {
+            uint32_t record_id;
+            uint16_t file_id;
+            uint16_t record_key;
+            bool     is_record_updated;
+        } write;
+        struct
+        {
+            uint32_t record_id;
+            uint16_t file_id;
+            uint16_t record_key;
+        } del;
+    };
+} fds_evt_t;
+
+typedef void (* fds_cb_t)(fds_evt_t const * p_evt);
+
+ret_code_t fds_register(fds_cb_t cb);
+ret_code_t fds_init(void);
+ret_code_t fds_record_write(fds_record_desc_t * p_desc, fds_record_t const * p_record);
+ret_code_t fds_record_update(fds_record_desc_t * p_desc, fds_record_t const * p_record);
+ret_code_t fds_record_find_in_file(uint16_t file_id, fds_record_desc_t * p_desc, fds_find_token_t * p_token);
+ret_code_t fds_record_open(fds_record_desc_t * p_desc, fds_flash_record_t * p_flash_record);
+ret_code_t fds_record_close(fds_record_desc_t * p_desc);
+ret_code_t fds_gc(void);
+
+/**@brief Function for starting over as after a reset: no handler, nothing queued, not
+ *        initialized.
+ *
+ * @param[in] erase Also erase flash, as a new dongle.
+ */
+void host_fds_reset(bool erase);
+
+/**@brief Function for carrying out the oldest queued operation and delivering its event.
+ *
+ * @return false if nothing was queued.
+ */
+bool host_fds_step(void);
+
+/**@brief Function for getting the number of operations queued and not carried out yet. */
+uint32_t host_fds_queued(void);
+
+/**@brief Function for making the next write or update carried out fail with an error. */
+void host_fds_fail_next(ret_code_t result);
+
+/**@brief Function for setting the words of flash available for records. */
+void host_fds_flash_words_set(uint32_t words);
+
+/**@brief Function for getting the number of writes and updates carried out with success. */
+uint32_t host_fds_writes(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FDS_H__
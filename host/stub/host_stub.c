@@ -0,0 +1,611 @@
+/**@file
+ *
+ * @brief Implementations behind the host stand-ins of the SDK headers.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "app_usbd_cdc_acm.h"
+#include "ble.h"
+#include "crc16.h"
+#include "fds.h"
+#include "sdk_macros.h"
+
+uint32_t host_critical_depth = 0;
+
+/**@brief GATT client state of a link. */
+typedef struct
+{
+    host_gattc_proc_t      proc;            /**< Procedure in progress, type HOST_GATTC_PROC_NONE if none. */
+    bool                   taken;           /**< The host program took it. */
+    uint32_t               write_cmds;      /**< Write commands sent. */
+    host_gattc_write_cmd_t write_cmd_queue[HOST_GATTC_WRITE_CMD_QUEUE_SIZE];   /**< Write commands buffered. */
+    uint8_t                write_cmd_head;  /**< Oldest write command buffered. */
+    uint8_t                write_cmd_count; /**< Write commands buffered. */
+} host_gattc_link_t;
+
+static host_gattc_link_t m_gattc_links[HOST_GATTC_LINK_MAX];
+static uint8_t           m_uuid_types = BLE_UUID_TYPE_VENDOR_BEGIN;    /**< Next vendor specific UUID type. */
+
+/**@brief Record in the flash of the FDS stand-in. */
+typedef struct
+{
+    fds_header_t header;
+    bool         used;                                  /**< The slot holds a record, valid or dirty. */
+    bool         dirty;                                 /**< Replaced by an update, until garbage collection. */
+    uint32_t     data[HOST_FDS_RECORD_MAX_WORDS];
+} host_fds_record_t;
+
+/**@brief Operation queued by the FDS stand-in. */
+typedef struct
+{
+    fds_evt_id_t id;                /**< FDS_EVT_INIT, FDS_EVT_WRITE, FDS_EVT_UPDATE or FDS_EVT_GC. */
+    fds_record_t record;            /**< Record of a write or update, its data read when carried out. */
+    uint32_t     record_id;         /**< Record a write or update creates. */
+    uint32_t     old_record_id;     /**< Record an update replaces. */
+} host_fds_op_t;
+
+/**@brief State of the FDS stand-in. Flash survives a reset, the rest does not. */
+static struct
+{
+    host_fds_record_t flash[HOST_FDS_RECORD_MAX];
+    uint32_t          flash_words;                      /**< Words available for records. */
+    uint32_t          next_record_id;
+    fds_cb_t          cb;
+    bool              initialized;
+    host_fds_op_t     queue[HOST_FDS_QUEUE_SIZE];
+    uint32_t          queue_head;
+    uint32_t          queue_count;
+    uint32_t          reserved_words;                   /**< Words of the writes queued. */
+    ret_code_t        fail_next;                        /**< Result of the next write or update, NRF_SUCCESS for none. */
+    uint32_t          writes;
+} m_fds = {.flash_words = HOST_FDS_FLASH_WORDS, .next_record_id = 1};
+
+static uint64_t m_time_us = 0;   /**< Time since the start of the program. */
+
+
+uint32_t app_timer_cnt_get(void)
+{
+    return (uint32_t)((m_time_us * APP_TIMER_CLOCK_FREQ) / 1000000) & APP_TIMER_MAX_CNT_VAL;
+}
+
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from)
+{
+    return (ticks_to - ticks_from) & APP_TIMER_MAX_CNT_VAL;
+}
+
+
+void host_timer_advance_us(uint64_t us)
+{
+    m_time_us += us;
+}
+
+
+// CRC-16/CCITT-FALSE, as components/libraries/crc16/crc16.c of the SDK computes it.
+uint16_t crc16_compute(uint8_t const * p_data, uint32_t size, uint16_t const * p_crc)
+{
+    uint16_t crc = (p_crc == NULL) ? 0xFFFF : *p_crc;
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc  = (uint8_t)(crc >> 8) | (crc << 8);
+        crc ^= p_data[i];
+        crc ^= (uint8_t)(crc & 0xFF) >> 4;
+        crc ^= (crc << 8) << 4;
+        crc ^= ((crc & 0xFF) << 4) << 1;
+    }
+
+    return crc;
+}
+
+
+ret_code_t app_usbd_cdc_acm_write(app_usbd_cdc_acm_t const * p_cdc_acm, void const * p_buf, size_t length)
+{
+    // The class keeps its transfer state in RAM behind the const instance; so does the stand-in.
+    app_usbd_cdc_acm_t * p_port = (app_usbd_cdc_acm_t *)p_cdc_acm;
+
+    if (!p_port->port_open)
+    {
+        p_port->refused++;
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (p_port->busy)
+    {
+        p_port->refused++;
+        return NRF_ERROR_BUSY;
+    }
+    p_port->busy   = true;
+    p_port->taken  = false;
+    p_port->p_tx   = p_buf;
+    p_port->tx_len = length;
+    return NRF_SUCCESS;
+}
+
+
+void host_cdc_acm_port_set(app_usbd_cdc_acm_t * p_cdc_acm, bool open)
+{
+    p_cdc_acm->port_open = open;
+    if (!open)
+    {
+        p_cdc_acm->busy = false;
+    }
+}
+
+
+bool host_cdc_acm_tx_take(app_usbd_cdc_acm_t * p_cdc_acm, uint8_t const ** pp_data, size_t * p_len)
+{
+    if (!p_cdc_acm->busy || p_cdc_acm->taken)
+    {
+        return false;
+    }
+    p_cdc_acm->taken = true;
+    *pp_data = p_cdc_acm->p_tx;
+    *p_len   = p_cdc_acm->tx_len;
+    return true;
+}
+
+
+void host_cdc_acm_tx_end(app_usbd_cdc_acm_t * p_cdc_acm)
+{
+    p_cdc_acm->busy = false;
+}
+
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const * p_vs_uuid, uint8_t * p_uuid_type)
+{
+    (void)p_vs_uuid;
+    *p_uuid_type = m_uuid_types++;
+    return NRF_SUCCESS;
+}
+
+
+/**@brief Function for starting a procedure on a link, unless one is in progress. */
+static uint32_t gattc_proc_start(uint16_t conn_handle, host_gattc_proc_t const * p_proc)
+{
+    host_gattc_link_t * p_link;
+
+    if (conn_handle >= HOST_GATTC_LINK_MAX)
+    {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    p_link = &m_gattc_links[conn_handle];
+    if (p_link->proc.type != HOST_GATTC_PROC_NONE)
+    {
+        return NRF_ERROR_BUSY;
+    }
+    p_link->proc  = *p_proc;
+    p_link->taken = false;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gattc_read(uint16_t conn_handle, uint16_t handle, uint16_t offset)
+{
+    host_gattc_proc_t proc = {.type = HOST_GATTC_PROC_READ, .handle = handle};
+
+    (void)offset;
+    return gattc_proc_start(conn_handle, &proc);
+}
+
+
+uint32_t sd_ble_gattc_write(uint16_t conn_handle, ble_gattc_write_params_t const * p_write_params)
+{
+    host_gattc_proc_t proc = {.type = HOST_GATTC_PROC_WRITE_REQ, .handle = p_write_params->handle};
+
+    if (conn_handle >= HOST_GATTC_LINK_MAX)
+    {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    if (p_write_params->write_op == BLE_GATT_OP_WRITE_CMD)
+    {
+        host_gattc_link_t      * p_link = &m_gattc_links[conn_handle];
+        host_gattc_write_cmd_t * p_cmd;
+
+        if (p_write_params->len > HOST_GATTC_WRITE_CMD_MAX_LEN)
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        if (p_link->write_cmd_count >= HOST_GATTC_WRITE_CMD_QUEUE_SIZE)
+        {
+            return NRF_ERROR_RESOURCES;
+        }
+        p_cmd = &p_link->write_cmd_queue[(p_link->write_cmd_head + p_link->write_cmd_count) % HOST_GATTC_WRITE_CMD_QUEUE_SIZE];
+        p_cmd->handle = p_write_params->handle;
+        p_cmd->len    = p_write_params->len;
+        memcpy(p_cmd->value, p_write_params->p_value, p_cmd->len);
+        p_link->write_cmd_count++;
+        p_link->write_cmds++;
+        return NRF_SUCCESS;
+    }
+    if (p_write_params->len > sizeof(proc.value))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    proc.len = p_write_params->len;
+    memcpy(proc.value, p_write_params->p_value, proc.len);
+    return gattc_proc_start(conn_handle, &proc);
+}
+
+
+uint32_t sd_ble_gattc_char_value_by_uuid_read(uint16_t conn_handle, ble_uuid_t const * p_uuid, ble_gattc_handle_range_t const * p_handle_range)
+{
+    host_gattc_proc_t proc = {.type = HOST_GATTC_PROC_CHAR_VALUE_BY_UUID_READ, .uuid = *p_uuid};
+
+    (void)p_handle_range;
+    return gattc_proc_start(conn_handle, &proc);
+}
+
+
+uint32_t sd_ble_gattc_exchange_mtu_request(uint16_t conn_handle, uint16_t client_rx_mtu)
+{
+    host_gattc_proc_t proc = {.type = HOST_GATTC_PROC_EXCHANGE_MTU, .mtu = client_rx_mtu};
+
+    return gattc_proc_start(conn_handle, &proc);
+}
+
+
+// As the inline function of the SoftDevice header.
+uint32_t sd_ble_gattc_evt_char_val_by_uuid_read_rsp_iter(ble_gattc_evt_t * p_gattc_evt, ble_gattc_handle_value_t * p_iter)
+{
+    uint32_t  value_len = p_gattc_evt->params.char_val_by_uuid_read_rsp.value_len;
+    uint8_t * p_first   = p_gattc_evt->params.char_val_by_uuid_read_rsp.handle_value;
+    uint8_t * p_next    = (p_iter->p_value != NULL) ? (p_iter->p_value + value_len) : p_first;
+
+    if ((uint32_t)(p_next - p_first) / (sizeof(uint16_t) + value_len) < p_gattc_evt->params.char_val_by_uuid_read_rsp.count)
+    {
+        p_iter->handle  = (uint16_t)(p_next[1] << 8 | p_next[0]);
+        p_iter->p_value = p_next + sizeof(uint16_t);
+        return NRF_SUCCESS;
+    }
+    return NRF_ERROR_NOT_FOUND;
+}
+
+
+void host_gattc_reset(uint16_t conn_handle)
+{
+    memset(&m_gattc_links[conn_handle], 0, sizeof(m_gattc_links[conn_handle]));
+}
+
+
+bool host_gattc_proc_take(uint16_t conn_handle, host_gattc_proc_t * p_proc)
+{
+    host_gattc_link_t * p_link = &m_gattc_links[conn_handle];
+
+    if ((p_link->proc.type == HOST_GATTC_PROC_NONE) || p_link->taken)
+    {
+        return false;
+    }
+    p_link->taken = true;
+    *p_proc = p_link->proc;
+    return true;
+}
+
+
+void host_gattc_proc_end(uint16_t conn_handle)
+{
+    m_gattc_links[conn_handle].proc.type = HOST_GATTC_PROC_NONE;
+}
+
+
+uint32_t host_gattc_write_cmds(uint16_t conn_handle)
+{
+    return m_gattc_links[conn_handle].write_cmds;
+}
+
+
+bool host_gattc_write_cmd_take(uint16_t conn_handle, host_gattc_write_cmd_t * p_cmd)
+{
+    host_gattc_link_t * p_link = &m_gattc_links[conn_handle];
+
+    if (p_link->write_cmd_count == 0)
+    {
+        return false;
+    }
+    *p_cmd = p_link->write_cmd_queue[p_link->write_cmd_head];
+    p_link->write_cmd_head = (p_link->write_cmd_head + 1) % HOST_GATTC_WRITE_CMD_QUEUE_SIZE;
+    p_link->write_cmd_count--;
+    return true;
+}
+
+
+/**@brief Function for getting the words of flash taken by records, valid or dirty. */
+static uint32_t fds_words_used(void)
+{
+    uint32_t words = 0;
+
+    for (uint32_t i = 0; i < HOST_FDS_RECORD_MAX; i++)
+    {
+        if (m_fds.flash[i].used)
+        {
+            words += FDS_HEADER_SIZE + m_fds.flash[i].header.length_words;
+        }
+    }
+    return words;
+}
+
+
+/**@brief Function for finding a record of flash by its id. */
+static host_fds_record_t * fds_record_get(uint32_t record_id)
+{
+    for (uint32_t i = 0; i < HOST_FDS_RECORD_MAX; i++)
+    {
+        if (m_fds.flash[i].used && (m_fds.flash[i].header.record_id == record_id))
+        {
+            return &m_fds.flash[i];
+        }
+    }
+    return NULL;
+}
+
+
+/**@brief Function for queueing an operation. */
+static ret_code_t fds_op_push(host_fds_op_t const * p_op)
+{
+    if (m_fds.queue_count == HOST_FDS_QUEUE_SIZE)
+    {
+        return FDS_ERR_NO_SPACE_IN_QUEUES;
+    }
+    m_fds.queue[(m_fds.queue_head + m_fds.queue_count) % HOST_FDS_QUEUE_SIZE] = *p_op;
+    m_fds.queue_count++;
+    return NRF_SUCCESS;
+}
+
+
+/**@brief Function for queueing a write or an update, with room for it set aside in flash. */
+static ret_code_t fds_write_push(fds_evt_id_t id, fds_record_desc_t * p_desc, fds_record_t const * p_record)
+{
+    host_fds_op_t op = {.id = id, .record = *p_record};
+    uint32_t      words;
+    ret_code_t    err_code;
+
+    if (!m_fds.initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+    if ((p_desc == NULL) || (p_record == NULL) || (p_record->data.p_data == NULL))
+    {
+        return FDS_ERR_NULL_ARG;
+    }
+    if (p_record->data.length_words > HOST_FDS_RECORD_MAX_WORDS)
+    {
+        return FDS_ERR_RECORD_TOO_LARGE;
+    }
+    words = FDS_HEADER_SIZE + p_record->data.length_words;
+    if (fds_words_used() + m_fds.reserved_words + words > m_fds.flash_words)
+    {
+        return FDS_ERR_NO_SPACE_IN_FLASH;
+    }
+
+    op.record_id     = m_fds.next_record_id;
+    op.old_record_id = p_desc->record_id;
+    err_code = fds_op_push(&op);
+    VERIFY_SUCCESS(err_code);
+
+    m_fds.next_record_id++;
+    m_fds.reserved_words += words;
+    p_desc->record_id     = op.record_id;
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t fds_register(fds_cb_t cb)
+{
+    m_fds.cb = cb;
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t fds_init(void)
+{
+    host_fds_op_t const op = {.id = FDS_EVT_INIT};
+
+    return fds_op_push(&op);
+}
+
+
+ret_code_t fds_record_write(fds_record_desc_t * p_desc, fds_record_t const * p_record)
+{
+    if (p_desc != NULL)
+    {
+        p_desc->record_id = 0;
+    }
+    return fds_write_push(FDS_EVT_WRITE, p_desc, p_record);
+}
+
+
+ret_code_t fds_record_update(fds_record_desc_t * p_desc, fds_record_t const * p_record)
+{
+    return fds_write_push(FDS_EVT_UPDATE, p_desc, p_record);
+}
+
+
+ret_code_t fds_record_find_in_file(uint16_t file_id, fds_record_desc_t * p_desc, fds_find_token_t * p_token)
+{
+    if (!m_fds.initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+    while (p_token->page < HOST_FDS_RECORD_MAX)
+    {
+        host_fds_record_t const * p_record = &m_fds.flash[p_token->page++];
+
+        if (p_record->used && !p_record->dirty && (p_record->header.file_id == file_id))
+        {
+            p_desc->record_id = p_record->header.record_id;
+            return NRF_SUCCESS;
+        }
+    }
+    return FDS_ERR_NOT_FOUND;
+}
+
+
+ret_code_t fds_record_open(fds_record_desc_t * p_desc, fds_flash_record_t * p_flash_record)
+{
+    host_fds_record_t const * p_record = fds_record_get(p_desc->record_id);
+
+    if ((p_record == NULL) || p_record->dirty)
+    {
+        return FDS_ERR_NOT_FOUND;
+    }
+    p_desc->record_is_open   = true;
+    p_flash_record->p_header = &p_record->header;
+    p_flash_record->p_data   = p_record->data;
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t fds_record_close(fds_record_desc_t * p_desc)
+{
+    p_desc->record_is_open = false;
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t fds_gc(void)
+{
+    host_fds_op_t const op = {.id = FDS_EVT_GC};
+
+    if (!m_fds.initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+    return fds_op_push(&op);
+}
+
+
+/**@brief Function for carrying out a write or an update. */
+static void fds_write_run(host_fds_op_t const * p_op, fds_evt_t * p_evt)
+{
+    host_fds_record_t * p_old = fds_record_get(p_op->old_record_id);
+
+    m_fds.reserved_words -= FDS_HEADER_SIZE + p_op->record.data.length_words;
+    p_evt->write.record_id         = p_op->record_id;
+    p_evt->write.file_id           = p_op->record.file_id;
+    p_evt->write.record_key        = p_op->record.key;
+    p_evt->write.is_record_updated = (p_op->id == FDS_EVT_UPDATE);
+
+    p_evt->result   = m_fds.fail_next;
+    m_fds.fail_next = NRF_SUCCESS;
+    if (p_evt->result != NRF_SUCCESS)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < HOST_FDS_RECORD_MAX; i++)
+    {
+        host_fds_record_t * p_record = &m_fds.flash[i];
+
+        if (!p_record->used)
+        {
+            memset(p_record, 0, sizeof(*p_record));
+            p_record->used                = true;
+            p_record->header.record_key   = p_op->record.key;
+            p_record->header.length_words = (uint16_t)p_op->record.data.length_words;
+            p_record->header.file_id      = p_op->record.file_id;
+            p_record->header.record_id    = p_op->record_id;
+            // Read only now, as FDS does.
+            memcpy(p_record->data, p_op->record.data.p_data, p_op->record.data.length_words * sizeof(uint32_t));
+            if ((p_op->id == FDS_EVT_UPDATE) && (p_old != NULL))
+            {
+                p_old->dirty = true;
+            }
+            m_fds.writes++;
+            return;
+        }
+    }
+    p_evt->result = FDS_ERR_NO_SPACE_IN_FLASH;
+}
+
+
+void host_fds_reset(bool erase)
+{
+    if (erase)
+    {
+        memset(m_fds.flash, 0, sizeof(m_fds.flash));
+        m_fds.next_record_id = 1;
+    }
+    m_fds.flash_words    = HOST_FDS_FLASH_WORDS;
+    m_fds.cb             = NULL;
+    m_fds.initialized    = false;
+    m_fds.queue_head     = 0;
+    m_fds.queue_count    = 0;
+    m_fds.reserved_words = 0;
+    m_fds.fail_next      = NRF_SUCCESS;
+    m_fds.writes         = 0;
+}
+
+
+bool host_fds_step(void)
+{
+    host_fds_op_t op;
+    fds_evt_t     evt;
+
+    if (m_fds.queue_count == 0)
+    {
+        return false;
+    }
+    op = m_fds.queue[m_fds.queue_head];
+    m_fds.queue_head = (m_fds.queue_head + 1) % HOST_FDS_QUEUE_SIZE;
+    m_fds.queue_count--;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.id     = op.id;
+    evt.result = NRF_SUCCESS;
+    switch (op.id)
+    {
+        case FDS_EVT_INIT:
+            m_fds.initialized = true;
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            fds_write_run(&op, &evt);
+            break;
+
+        case FDS_EVT_GC:
+            for (uint32_t i = 0; i < HOST_FDS_RECORD_MAX; i++)
+            {
+                if (m_fds.flash[i].dirty)
+                {
+                    memset(&m_fds.flash[i], 0, sizeof(m_fds.flash[i]));
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (m_fds.cb != NULL)
+    {
+        m_fds.cb(&evt);
+    }
+    return true;
+}
+
+
+uint32_t host_fds_queued(void)
+{
+    return m_fds.queue_count;
+}
+
+
+void host_fds_fail_next(ret_code_t result)
+{
+    m_fds.fail_next = result;
+}
+
+
+void host_fds_flash_words_set(uint32_t words)
+{
+    m_fds.flash_words = words;
+}
+
+
+uint32_t host_fds_writes(void)
+{
+    return m_fds.writes;
+}
@@ -0,0 +1,14 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's nordic_common.h: the macros the data path modules use.
+ */
+
+#ifndef NORDIC_COMMON_H__
+#define NORDIC_COMMON_H__
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define UNUSED_PARAMETER(X) ((void)(X))
+#define UNUSED_VARIABLE(X)  ((void)(X))
+
+#endif // NORDIC_COMMON_H__
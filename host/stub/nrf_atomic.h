@@ -0,0 +1,23 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's nrf_atomic.h, on the GCC atomic builtins.
+ */
+
+#ifndef NRF_ATOMIC_H__
+#define NRF_ATOMIC_H__
+
+#include <stdint.h>
+
+typedef volatile uint32_t nrf_atomic_u32_t;
+
+static inline uint32_t nrf_atomic_u32_or(nrf_atomic_u32_t * p_data, uint32_t value)
+{
+    return __atomic_or_fetch(p_data, value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t nrf_atomic_u32_and(nrf_atomic_u32_t * p_data, uint32_t value)
+{
+    return __atomic_and_fetch(p_data, value, __ATOMIC_SEQ_CST);
+}
+
+#endif // NRF_ATOMIC_H__
@@ -0,0 +1,11 @@
+/**@file
+ *
+ * @brief Host stand-in for the SoftDevice's nrf_error.h, see sdk_errors.h.
+ */
+
+#ifndef NRF_ERROR_H__
+#define NRF_ERROR_H__
+
+#include "sdk_errors.h"
+
+#endif // NRF_ERROR_H__
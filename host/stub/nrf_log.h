@@ -0,0 +1,24 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's nrf_log.h. Errors and warnings go to stderr; build with
+ *        HOST_LOG_VERBOSE defined to see the info and debug lines as well.
+ */
+
+#ifndef NRF_LOG_H__
+#define NRF_LOG_H__
+
+#include <stdio.h>
+
+#define NRF_LOG_MODULE_REGISTER() struct host_log_unused_
+
+#define NRF_LOG_ERROR(...)   (fprintf(stderr, "<error> " __VA_ARGS__), fputc('\n', stderr))
+#define NRF_LOG_WARNING(...) (fprintf(stderr, "<warning> " __VA_ARGS__), fputc('\n', stderr))
+#ifdef HOST_LOG_VERBOSE
+#define NRF_LOG_INFO(...)    (fprintf(stderr, "<info> " __VA_ARGS__), fputc('\n', stderr))
+#define NRF_LOG_DEBUG(...)   (fprintf(stderr, "<debug> " __VA_ARGS__), fputc('\n', stderr))
+#else
+#define NRF_LOG_INFO(...)    do {} while (0)
+#define NRF_LOG_DEBUG(...)   do {} while (0)
+#endif
+
+#endif // NRF_LOG_H__
@@ -0,0 +1,18 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's nrf_sdh_ble.h. There is no observer section on the host: the
+ *        host program hands every event to the handlers itself.
+ */
+
+#ifndef NRF_SDH_BLE_H__
+#define NRF_SDH_BLE_H__
+
+#include "ble.h"
+
+#define NRF_SDH_BLE_OBSERVER(_name, _prio, _handler, _context) \
+    struct host_observer_unused_ ## _name
+
+#define NRF_SDH_BLE_OBSERVERS(_name, _prio, _handler, _context, _cnt) \
+    struct host_observer_unused_ ## _name
+
+#endif // NRF_SDH_BLE_H__
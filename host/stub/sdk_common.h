@@ -0,0 +1,21 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's sdk_common.h. The modules are enabled in config/sdk_config.h,
+ *        as on the dongle.
+ */
+
+#ifndef SDK_COMMON_H__
+#define SDK_COMMON_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "sdk_config.h"
+#include "nordic_common.h"
+#include "sdk_errors.h"
+#include "sdk_macros.h"
+#include "app_util.h"
+
+#define NRF_MODULE_ENABLED(module) ((module ## _ENABLED) ? 1 : 0)
+
+#endif // SDK_COMMON_H__
@@ -0,0 +1,32 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's sdk_errors.h and nrf_error.h, with the same error values.
+ */
+
+#ifndef SDK_ERRORS_H__
+#define SDK_ERRORS_H__
+
+#include <stdint.h>
+
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS                 0
+#define NRF_ERROR_INTERNAL          3
+#define NRF_ERROR_NO_MEM            4
+#define NRF_ERROR_NOT_FOUND         5
+#define NRF_ERROR_NOT_SUPPORTED     6
+#define NRF_ERROR_INVALID_PARAM     7
+#define NRF_ERROR_INVALID_STATE     8
+#define NRF_ERROR_INVALID_LENGTH    9
+#define NRF_ERROR_INVALID_DATA      11
+#define NRF_ERROR_DATA_SIZE         12
+#define NRF_ERROR_TIMEOUT           13
+#define NRF_ERROR_NULL              14
+#define NRF_ERROR_BUSY              17
+#define NRF_ERROR_RESOURCES         19
+
+#define NRF_ERROR_FDS_ERR_BASE      0x8600
+
+#define BLE_ERROR_INVALID_CONN_HANDLE 0x3002
+
+#endif // SDK_ERRORS_H__
@@ -0,0 +1,41 @@
+/**@file
+ *
+ * @brief Host stand-in for the SDK's sdk_macros.h: the argument checks that return early.
+ */
+
+#ifndef SDK_MACROS_H__
+#define SDK_MACROS_H__
+
+#include "sdk_errors.h"
+
+#define VERIFY_SUCCESS(statement)                   \
+    do                                              \
+    {                                               \
+        uint32_t _err_code = (uint32_t)(statement); \
+        if (_err_code != NRF_SUCCESS)               \
+        {                                           \
+            return _err_code;                       \
+        }                                           \
+    } while (0)
+
+#define VERIFY_TRUE(statement, err_code)    \
+    do                                      \
+    {                                       \
+        if (!(statement))                   \
+        {                                   \
+            return err_code;                \
+        }                                   \
+    } while (0)
+
+#define VERIFY_FALSE(statement, err_code)   \
+    do                                      \
+    {                                       \
+        if ((statement))                    \
+        {                                   \
+            return err_code;                \
+        }                                   \
+    } while (0)
+
+#define VERIFY_PARAM_NOT_NULL(param) VERIFY_FALSE(((param) == NULL), NRF_ERROR_NULL)
+
+#endif // SDK_MACROS_H__
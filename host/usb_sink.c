@@ -0,0 +1,85 @@
+/**@file
+ *
+ * @brief USB sink on the host, implementation.
+ */
+
+#include <string.h>
+#include "app_util.h"
+#include "crc16.h"
+#include "usb_sink.h"
+
+static char const * const m_v1_tags[] = {"EEG", "PPG", "ACC"};   // Stream ids 0 to 2; the last character is '_' or 'R'
+
+
+void usb_sink_init(usb_sink_t * p_sink, usb_frame_format_t format)
+{
+    memset(p_sink, 0, sizeof(*p_sink));
+    p_sink->format = format;
+}
+
+
+/**@brief Function for counting a good packet of a stream. */
+static void stream_count(usb_sink_stream_t * p_stream, uint16_t seq, bool has_seq, uint16_t payload_len)
+{
+    if (has_seq)
+    {
+        if (p_stream->seq_valid && (seq != p_stream->next_seq))
+        {
+            p_stream->seq_gaps += (uint16_t)(seq - p_stream->next_seq);
+        }
+        p_stream->seq_valid = true;
+        p_stream->next_seq  = (uint16_t)(seq + 1);
+    }
+    p_stream->packets++;
+    p_stream->bytes += payload_len;
+}
+
+
+bool usb_sink_packet(usb_sink_t * p_sink, uint8_t const * p_data, uint16_t len)
+{
+    if (p_sink->format == USB_FRAME_FORMAT_V1)
+    {
+        if ((len < USB_FRAME_V1_HEADER_LEN)
+                || (uint16_decode(&p_data[USB_FRAME_TAG_LEN]) != len - USB_FRAME_V1_HEADER_LEN))
+        {
+            p_sink->bad_headers++;
+            return false;
+        }
+        for (uint8_t i = 0; i < ARRAY_SIZE(m_v1_tags); i++)
+        {
+            if ((memcmp(p_data, m_v1_tags[i], USB_FRAME_TAG_LEN - 1) == 0)
+                    && ((p_data[USB_FRAME_TAG_LEN - 1] == '_') || (p_data[USB_FRAME_TAG_LEN - 1] == 'R')))
+            {
+                stream_count(&p_sink->streams[0][i], 0, false, len - USB_FRAME_V1_HEADER_LEN);
+                return true;
+            }
+        }
+        p_sink->bad_headers++;
+        return false;
+    }
+
+    {
+        uint16_t crc;
+        uint8_t  link;
+        uint8_t  stream_id;
+
+        if ((len < USB_FRAME_V2_HEADER_LEN) || (uint16_decode(&p_data[0]) != USB_FRAME_V2_MAGIC) || (p_data[2] != 2)
+                || (uint16_decode(&p_data[6]) != len - USB_FRAME_V2_HEADER_LEN))
+        {
+            p_sink->bad_headers++;
+            return false;
+        }
+        crc = crc16_compute(p_data, 12, NULL);
+        crc = crc16_compute(&p_data[USB_FRAME_V2_HEADER_LEN], len - USB_FRAME_V2_HEADER_LEN, &crc);
+        if (crc != uint16_decode(&p_data[12]))
+        {
+            p_sink->crc_errors++;
+            return false;
+        }
+
+        link      = (p_data[3] >> USB_FRAME_LINK_POS) & (USB_FRAME_LINK_MAX - 1);
+        stream_id = p_data[3] & USB_FRAME_STREAM_ID_MASK;
+        stream_count(&p_sink->streams[link][stream_id], uint16_decode(&p_data[4]), true, len - USB_FRAME_V2_HEADER_LEN);
+        return true;
+    }
+}
@@ -0,0 +1,63 @@
+/**@file
+ *
+ * @defgroup usb_sink USB sink on the host
+ * @{
+ *
+ * @brief    Checks and counts the packets a host program takes from the dongle data path.
+ *
+ * @details  Each packet is checked as the host splitters read it: a version 2 header needs its
+ *           magic, version and CRC, and its sequence number is checked for gaps per stream of each
+ *           link. A version 1 header needs a known tag.
+ */
+
+#ifndef USB_SINK_H__
+#define USB_SINK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "usb_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define USB_SINK_STREAMS 16     /**< Stream ids counted per link. */
+
+/**@brief Counters of one stream of one link. */
+typedef struct
+{
+    uint32_t packets;       /**< Good packets. */
+    uint64_t bytes;         /**< Payload bytes of the good packets. */
+    uint32_t seq_gaps;      /**< Packets missing according to the sequence numbers. */
+    bool     seq_valid;     /**< next_seq holds the number expected next. */
+    uint16_t next_seq;      /**< Sequence number expected next. */
+} usb_sink_stream_t;
+
+/**@brief Sink instance. */
+typedef struct
+{
+    usb_frame_format_t format;                                          /**< Header format expected. */
+    usb_sink_stream_t  streams[USB_FRAME_LINK_MAX][USB_SINK_STREAMS];   /**< Counters per link and stream id. */
+    uint32_t           bad_headers;                                     /**< Packets with a bad magic, version, tag or length. */
+    uint32_t           crc_errors;                                      /**< Packets failing their CRC. */
+} usb_sink_t;
+
+
+/**@brief Function for setting up a sink with cleared counters. */
+void usb_sink_init(usb_sink_t * p_sink, usb_frame_format_t format);
+
+
+/**@brief Function for checking and counting one packet, as written to USB.
+ *
+ * @return true if the packet is good.
+ */
+bool usb_sink_packet(usb_sink_t * p_sink, uint8_t const * p_data, uint16_t len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USB_SINK_H__
+
+/** @} */
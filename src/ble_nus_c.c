@@ -47,82 +47,195 @@
 #include "ble_gattc.h"
 #include "ble_srv_common.h"
 #include "app_error.h"
+#include "app_util_platform.h"
 
 #define NRF_LOG_MODULE_NAME ble_nus
 #include "nrf_log.h"
 NRF_LOG_MODULE_REGISTER();
 
-#define TX_BUFFER_MASK         0x07                  /**< TX Buffer mask, must be a mask of continuous zeroes, followed by continuous sequence of ones: 000...111. */
-#define TX_BUFFER_SIZE         (TX_BUFFER_MASK + 1)  /**< Size of send buffer, which is 1 higher than the mask. */
+/**@brief Function for completing the oldest request of a link and calling its callback. */
+static void req_complete(ble_nus_c_t * p_ble_nus_c, uint16_t gatt_status)
+{
+    ble_nus_c_req_t const * p_req  = &p_ble_nus_c->req[p_ble_nus_c->req_head];
+    ble_nus_c_req_done_t    done   = p_req->done;
+    uint16_t                handle = p_req->handle;
 
-#define WRITE_MESSAGE_LENGTH   BLE_CCCD_VALUE_LEN    /**< Length of the write message for CCCD. */
-#define WRITE_MESSAGE_LENGTH   BLE_CCCD_VALUE_LEN    /**< Length of the write message for CCCD. */
+    p_ble_nus_c->req_head      = (p_ble_nus_c->req_head + 1) % BLE_NUS_C_REQ_QUEUE_SIZE;
+    p_ble_nus_c->req_count--;
+    p_ble_nus_c->req_in_flight = false;
+    p_ble_nus_c->req_wait_ms   = 0;
+
+    if (done != NULL)
+    {
+        done(p_ble_nus_c, handle, gatt_status);
+    }
+}
 
-typedef enum
-{
-    READ_REQ,  /**< Type identifying that this tx_message is a read request. */
-    WRITE_REQ  /**< Type identifying that this tx_message is a write request. */
-} tx_request_t;
 
-/**@brief Structure for writing a message to the peer, i.e. CCCD.
+/**@brief Function for passing the oldest request of a link to the SoftDevice, unless one is in flight.
+ *
+ * @details A request refused as busy stays queued for the next attempt. One refused for another
+ *          reason is completed as failed, and the next one is tried.
  */
-typedef struct
+static void req_process(ble_nus_c_t * p_ble_nus_c)
 {
-    uint8_t                  gattc_value[WRITE_MESSAGE_LENGTH];  /**< The message to write. */
-    ble_gattc_write_params_t gattc_params;                       /**< GATTC parameters for this message. */
-} write_params_t;
+    while ((p_ble_nus_c->req_count > 0) && !p_ble_nus_c->req_in_flight)
+    {
+        ble_nus_c_req_t * p_req = &p_ble_nus_c->req[p_ble_nus_c->req_head];
+        uint32_t          err_code;
+
+        if (p_req->type == BLE_NUS_C_REQ_READ)
+        {
+            err_code = sd_ble_gattc_read(p_ble_nus_c->conn_handle, p_req->handle, 0);
+        }
+        else
+        {
+            ble_gattc_write_params_t const write_params =
+            {
+                .write_op = BLE_GATT_OP_WRITE_REQ,
+                .flags    = 0,
+                .handle   = p_req->handle,
+                .offset   = 0,
+                .len      = sizeof(p_req->value),
+                .p_value  = p_req->value
+            };
+
+            err_code = sd_ble_gattc_write(p_ble_nus_c->conn_handle, &write_params);
+        }
+
+        if (err_code == NRF_SUCCESS)
+        {
+            p_ble_nus_c->req_in_flight = true;
+        }
+        else if (err_code == NRF_ERROR_BUSY)
+        {
+            // Another client procedure runs on the link; retried on its next event.
+            return;
+        }
+        else
+        {
+            NRF_LOG_WARNING("Request on handle 0x%x refused, error 0x%x.", p_req->handle, err_code);
+            req_complete(p_ble_nus_c, BLE_NUS_C_REQ_STATUS_FAILED);
+        }
+    }
+}
+
 
-/**@brief Structure for holding data to be transmitted to the connected central.
+/**@brief Function for queueing a request on a link and issuing it if the link is idle.
+ *
+ * @details The queue is also worked from the BLE event handler, so it is only touched with
+ *          interrupts held off.
  */
-typedef struct
+static uint32_t req_push(ble_nus_c_t * p_ble_nus_c, ble_nus_c_req_t const * p_req)
 {
-    uint16_t     conn_handle;  /**< Connection handle to be used when transmitting this message. */
-    tx_request_t type;         /**< Type of this message, i.e. read or write message. */
-    union
+    uint32_t err_code = NRF_SUCCESS;
+
+    CRITICAL_REGION_ENTER();
+
+    if (p_ble_nus_c->conn_handle == BLE_CONN_HANDLE_INVALID)
     {
-        uint16_t       read_handle;  /**< Read request message. */
-        write_params_t write_req;    /**< Write request message. */
-    } req;
-} tx_message_t;
+        err_code = NRF_ERROR_INVALID_STATE;
+    }
+    else if (p_ble_nus_c->req_count == BLE_NUS_C_REQ_QUEUE_SIZE)
+    {
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    else
+    {
+        p_ble_nus_c->req[(p_ble_nus_c->req_head + p_ble_nus_c->req_count) % BLE_NUS_C_REQ_QUEUE_SIZE] = *p_req;
+        p_ble_nus_c->req_count++;
+        req_process(p_ble_nus_c);
+    }
+
+    CRITICAL_REGION_EXIT();
+
+    return err_code;
+}
+
 
+/**@brief Function for dropping every queued request of a link, without calling their callbacks. */
+static void req_flush(ble_nus_c_t * p_ble_nus_c)
+{
+    p_ble_nus_c->req_head      = 0;
+    p_ble_nus_c->req_count     = 0;
+    p_ble_nus_c->req_in_flight = false;
+    p_ble_nus_c->req_wait_ms   = 0;
+}
 
-static tx_message_t  m_tx_buffer[TX_BUFFER_SIZE];  /**< Transmit buffer for messages to be transmitted to the central. */
-static uint32_t      m_tx_insert_index = 0;        /**< Current index in the transmit buffer where the next message should be inserted. */
-static uint32_t      m_tx_index = 0;               /**< Current index in the transmit buffer from where the next message to be transmitted resides. */
 
+/**@brief Function for completing the request in flight if a response is the one it waits for. */
+static void req_on_rsp(ble_nus_c_t * p_ble_nus_c, ble_nus_c_req_type_t type, uint16_t handle, uint16_t gatt_status)
+{
+    ble_nus_c_req_t const * p_req = &p_ble_nus_c->req[p_ble_nus_c->req_head];
+
+    if (p_ble_nus_c->req_in_flight && (p_req->type == type) && (p_req->handle == handle))
+    {
+        req_complete(p_ble_nus_c, gatt_status);
+    }
+}
+
+
+/**@brief Function for dropping every queued write command of a link. */
+static void cmd_flush(ble_nus_c_t * p_ble_nus_c)
+{
+    ringbuf_init(&p_ble_nus_c->cmd_queue, p_ble_nus_c->cmd_queue_data, sizeof(p_ble_nus_c->cmd_queue_data));
+    p_ble_nus_c->cmd_len       = 0;
+    p_ble_nus_c->cmd_chunk_len = BLE_GATT_ATT_MTU_DEFAULT - OPCODE_LENGTH - HANDLE_LENGTH;
+}
 
-/**@brief Function for passing any pending request from the buffer to the stack.
+
+/**@brief Function for handing queued write commands to the SoftDevice until its buffers are full.
+ *
+ * @details A chunk the SoftDevice has no buffer for is kept aside and offered again on the next
+ *          BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE. Must be called with interrupts held off or from
+ *          the BLE event handler.
  */
-static void tx_buffer_process(void)
+static void cmd_pump(ble_nus_c_t * p_ble_nus_c)
 {
-    if (m_tx_index != m_tx_insert_index)
+    for (;;)
     {
         uint32_t err_code;
 
-        if (m_tx_buffer[m_tx_index].type == READ_REQ)
+        if (p_ble_nus_c->cmd_len == 0)
         {
-            err_code = sd_ble_gattc_read(m_tx_buffer[m_tx_index].conn_handle,
-                                         m_tx_buffer[m_tx_index].req.read_handle,
-                                         0);
+            uint8_t header[BLE_NUS_C_CMD_HEADER_LEN];
+
+            if (ringbuf_get_block(&p_ble_nus_c->cmd_queue, header, sizeof(header)) < (int)sizeof(header))
+            {
+                return;
+            }
+            p_ble_nus_c->cmd_handle = uint16_decode(&header[0]);
+            p_ble_nus_c->cmd_len    = uint16_decode(&header[2]);
+            (void)ringbuf_get_block(&p_ble_nus_c->cmd_queue, p_ble_nus_c->cmd_chunk, p_ble_nus_c->cmd_len);
         }
-        else
+
+        ble_gattc_write_params_t const write_params =
         {
-            err_code = sd_ble_gattc_write(m_tx_buffer[m_tx_index].conn_handle,
-                                          &m_tx_buffer[m_tx_index].req.write_req.gattc_params);
+            .write_op = BLE_GATT_OP_WRITE_CMD,
+            .flags    = 0,
+            .handle   = p_ble_nus_c->cmd_handle,
+            .offset   = 0,
+            .len      = p_ble_nus_c->cmd_len,
+            .p_value  = p_ble_nus_c->cmd_chunk
+        };
+
+        err_code = sd_ble_gattc_write(p_ble_nus_c->conn_handle, &write_params);
+        if (err_code == NRF_ERROR_RESOURCES)
+        {
+            return;
         }
-
         if (err_code != NRF_SUCCESS)
         {
-            NRF_LOG_DEBUG("SD Read/Write API returns error. This message sending will be "
-                          "attempted again..");
+            NRF_LOG_WARNING("Write command on handle 0x%x dropped, error 0x%x.", p_ble_nus_c->cmd_handle, err_code);
         }
+        p_ble_nus_c->cmd_len = 0;
     }
 }
 
 
 /**@brief     Function for handling write response events.
  *
- * @param[in] p_ble_nus_c Pointer to the Heart Rate Client structure.
+ * @param[in] p_ble_nus_c Pointer to the NUS Client structure.
  * @param[in] p_ble_evt   Pointer to the BLE event received.
  */
 static void on_write_rsp(ble_nus_c_t * p_ble_nus_c, const ble_evt_t * p_ble_evt)
@@ -133,19 +246,29 @@ static void on_write_rsp(ble_nus_c_t * p_ble_nus_c, const ble_evt_t * p_ble_evt)
         return;
     }
 
-    if ((p_ble_evt->evt.gattc_evt.gatt_status == BLE_GATT_STATUS_ATTERR_INSUF_AUTHENTICATION) ||
-        (p_ble_evt->evt.gattc_evt.gatt_status == BLE_GATT_STATUS_ATTERR_INSUF_ENCRYPTION))
-    {
-        // Do nothing to reattempt write.
-    }
-    else
+    req_on_rsp(p_ble_nus_c,
+               BLE_NUS_C_REQ_WRITE,
+               p_ble_evt->evt.gattc_evt.params.write_rsp.handle,
+               p_ble_evt->evt.gattc_evt.gatt_status);
+}
+
+
+/**@brief     Function for finding the descriptor table entry of a value handle.
+ *
+ * @return    Index of the entry, or char_count if the handle is not one of the table.
+ */
+static uint8_t char_index_get(ble_nus_c_t const * p_ble_nus_c, uint16_t handle)
+{
+    uint8_t i;
+
+    for (i = 0; i < p_ble_nus_c->char_count; i++)
     {
-        m_tx_index++;
-        m_tx_index &= TX_BUFFER_MASK;
+        if (p_ble_nus_c->handles.value[i] == handle)
+        {
+            break;
+        }
     }
-
-    // Check if there is any message to be sent across to the peer and send it.
-    tx_buffer_process();
+    return i;
 }
 
 
@@ -160,6 +283,7 @@ static void on_write_rsp(ble_nus_c_t * p_ble_nus_c, const ble_evt_t * p_ble_evt)
 static void on_read_rsp(ble_nus_c_t * p_ble_nus_c, const ble_evt_t * p_ble_evt)
 {
     const ble_gattc_evt_read_rsp_t * p_response;
+    uint8_t                          idx;
 
     // Check if the event if on the link for this instance
     if (p_ble_nus_c->conn_handle != p_ble_evt->evt.gattc_evt.conn_handle)
@@ -168,103 +292,73 @@ static void on_read_rsp(ble_nus_c_t * p_ble_nus_c, const ble_evt_t * p_ble_evt)
     }
 
     p_response = &p_ble_evt->evt.gattc_evt.params.read_rsp;
-    //&p_ble_evt->evt.gattc_evt.params.char_vals_read_rsp
+    idx        = char_index_get(p_ble_nus_c, p_response->handle);
 
-    if (p_response->handle == p_ble_nus_c->handles.nus_dis_hw_rev_handle)  //peer_nus_db.bl_handle
+    if ((idx < p_ble_nus_c->char_count) && (p_ble_nus_c->p_chars[idx].role == BLE_NUS_C_CHAR_READ))
     {
         ble_nus_c_evt_t evt;
 
         evt.conn_handle = p_ble_evt->evt.gattc_evt.conn_handle;
-        evt.evt_type = BLE_NUS_C_EVT_DIS_READ_RESP;
+        evt.evt_type = BLE_NUS_C_EVT_READ_RESP;
+        evt.char_uuid = p_ble_nus_c->p_chars[idx].char_uuid;
         evt.data_len = p_response->len;
         evt.p_data = (uint8_t *)p_response->data; // @suppress("Type cannot be resolved")
-        //NRF_LOG_INFO("Characteristic read");
-
 
         p_ble_nus_c->evt_handler(p_ble_nus_c, &evt);
     }
-    // Check if there is any buffered transmissions and send them.
-//    tx_buffer_process();
+
+    req_on_rsp(p_ble_nus_c, BLE_NUS_C_REQ_READ, p_response->handle, p_ble_evt->evt.gattc_evt.gatt_status);
 }
 
 
 void ble_nus_c_on_db_disc_evt(ble_nus_c_t * p_ble_nus_c, ble_db_discovery_evt_t * p_evt)
 {
     ble_nus_c_evt_t nus_c_evt;
-    memset(&nus_c_evt,0,sizeof(ble_nus_c_evt_t));
+    bool            srv_used = false;
 
-    ble_gatt_db_char_t * p_chars = p_evt->params.discovered_db.charateristics;
+    memset(&nus_c_evt,0,sizeof(ble_nus_c_evt_t));
 
-    // Check if the NUS was discovered.
-    if (    (p_evt->evt_type == BLE_DB_DISCOVERY_COMPLETE)
-        &&  (
-        		(p_evt->params.discovered_db.srv_uuid.uuid == BLE_UUID_EEG_NUS_SERVICE)
-        		|| (p_evt->params.discovered_db.srv_uuid.uuid == BLE_UUID_PPG_NUS_SERVICE)
-				|| (p_evt->params.discovered_db.srv_uuid.uuid == BLE_UUID_ACC_NUS_SERVICE)
-				|| (p_evt->params.discovered_db.srv_uuid.uuid == BLE_UUID_DEV_NUS_SERVICE)
-				|| (p_evt->params.discovered_db.srv_uuid.uuid == BLE_UUID_DEVICE_INFORMATION_SERVICE)
-			)
-		)
+    if (p_evt->evt_type == BLE_DB_DISCOVERY_COMPLETE)
     {
-        for (uint32_t i = 0; i < p_evt->params.discovered_db.char_count; i++)
+        ble_gatt_db_char_t const * p_chars = p_evt->params.discovered_db.charateristics;
+
+        for (uint8_t i = 0; i < p_ble_nus_c->char_count; i++)
         {
-            switch (p_chars[i].characteristic.uuid.uuid)
-            {
-                case BLE_UUID_NUS_EEG_RX_CHARACTERISTIC:
-                    nus_c_evt.handles.nus_eeg_rx_handle = p_chars[i].characteristic.handle_value;
-                    break;
+            ble_nus_c_char_desc_t const * p_desc = &p_ble_nus_c->p_chars[i];
 
-                case BLE_UUID_NUS_EEG_TX_CHARACTERISTIC:
-                    nus_c_evt.handles.nus_eeg_tx_handle = p_chars[i].characteristic.handle_value;
-                    nus_c_evt.handles.nus_eeg_tx_cccd_handle = p_chars[i].cccd_handle;
-                    break;
+            nus_c_evt.handles.value[i] = BLE_GATT_HANDLE_INVALID;
+            nus_c_evt.handles.cccd[i]  = BLE_GATT_HANDLE_INVALID;
 
-                case BLE_UUID_NUS_PPG_RX_CHARACTERISTIC:
-					nus_c_evt.handles.nus_ppg_rx_handle = p_chars[i].characteristic.handle_value;
-					break;
-
-                case BLE_UUID_NUS_PPG_TX_CHARACTERISTIC:
-					nus_c_evt.handles.nus_ppg_tx_handle = p_chars[i].characteristic.handle_value;
-					nus_c_evt.handles.nus_ppg_tx_cccd_handle = p_chars[i].cccd_handle;
-					break;
-
-                case BLE_UUID_NUS_ACC_RX_CHARACTERISTIC:
-					nus_c_evt.handles.nus_acc_rx_handle = p_chars[i].characteristic.handle_value;
-					break;
-
-				case BLE_UUID_NUS_ACC_TX_CHARACTERISTIC:
-					nus_c_evt.handles.nus_acc_tx_handle = p_chars[i].characteristic.handle_value;
-					nus_c_evt.handles.nus_acc_tx_cccd_handle = p_chars[i].cccd_handle;
-					break;
-
-                case BLE_UUID_DEV_CTRL_RX_CHARACTERISTIC:
-					nus_c_evt.handles.nus_dev_ctrl_rx_handle = p_chars[i].characteristic.handle_value;
-					break;
-
-				case BLE_UUID_DEV_STATUS_TX_CHARACTERISTIC:
-					nus_c_evt.handles.nus_dev_status_tx_handle = p_chars[i].characteristic.handle_value;
-					nus_c_evt.handles.nus_dev_status_tx_cccd_handle = p_chars[i].cccd_handle;
-					break;
-
-				case BLE_UUID_DEV_TSTART_TX_CHARACTERISTIC:
-					nus_c_evt.handles.nus_dev_tstart_tx_handle = p_chars[i].characteristic.handle_value;
-					nus_c_evt.handles.nus_dev_tstart_tx_cccd_handle = p_chars[i].cccd_handle;
-					break;
-
-				case BLE_UUID_HARDWARE_REVISION_STRING_CHAR:
-					nus_c_evt.handles.nus_dis_hw_rev_handle = p_chars[i].characteristic.handle_value;
-					break;
-                default:
+            if (p_desc->srv_uuid != p_evt->params.discovered_db.srv_uuid.uuid)
+            {
+                continue;
+            }
+            srv_used = true;
+
+            for (uint32_t j = 0; j < p_evt->params.discovered_db.char_count; j++)
+            {
+                if (p_chars[j].characteristic.uuid.uuid == p_desc->char_uuid)
+                {
+                    nus_c_evt.handles.value[i] = p_chars[j].characteristic.handle_value;
+                    nus_c_evt.handles.cccd[i]  = p_chars[j].cccd_handle;
                     break;
+                }
+            }
+            if (nus_c_evt.handles.value[i] == BLE_GATT_HANDLE_INVALID)
+            {
+                NRF_LOG_WARNING("Characteristic 0x%x not found in service 0x%x.",
+                                p_desc->char_uuid, p_desc->srv_uuid);
             }
         }
-        if (p_ble_nus_c->evt_handler != NULL)
-        {
-        	nus_c_evt.srv_uuid = p_evt->params.discovered_db.srv_uuid.uuid;
-            nus_c_evt.conn_handle = p_evt->conn_handle;
-            nus_c_evt.evt_type    = BLE_NUS_C_EVT_DISCOVERY_COMPLETE;
-            p_ble_nus_c->evt_handler(p_ble_nus_c, &nus_c_evt);
-        }
+    }
+
+    // Check if a service of the descriptor table was discovered.
+    if (srv_used && (p_ble_nus_c->evt_handler != NULL))
+    {
+        nus_c_evt.srv_uuid    = p_evt->params.discovered_db.srv_uuid.uuid;
+        nus_c_evt.conn_handle = p_evt->conn_handle;
+        nus_c_evt.evt_type    = BLE_NUS_C_EVT_DISCOVERY_COMPLETE;
+        p_ble_nus_c->evt_handler(p_ble_nus_c, &nus_c_evt);
     }
     else if (p_evt->evt_type == BLE_DB_DISCOVERY_AVAILABLE)
     {
@@ -276,118 +370,111 @@ void ble_nus_c_on_db_disc_evt(ble_nus_c_t * p_ble_nus_c, ble_db_discovery_evt_t
 
 /**@brief     Function for handling Handle Value Notification received from the SoftDevice.
  *
- * @details   This function will uses the Handle Value Notification received from the SoftDevice
- *            and checks if it is a notification of the NUS TX characteristic from the peer. If
- *            it is, this function will decode the data and send it to the
- *            application.
+ * @details   The characteristic is found with one lookup of the value handle. Notifications of
+ *            a characteristic that feeds a stream go straight to the sink; those of other
+ *            characteristics are sent to the application as an event.
  *
  * @param[in] p_ble_nus_c Pointer to the NUS Client structure.
  * @param[in] p_ble_evt   Pointer to the BLE event received.
  */
 static void on_hvx(ble_nus_c_t * p_ble_nus_c, ble_evt_t const * p_ble_evt)
 {
+    ble_gattc_evt_hvx_t const   * p_hvx = &p_ble_evt->evt.gattc_evt.params.hvx;
+    ble_nus_c_char_desc_t const * p_desc;
+    uint8_t                       idx;
+
     // HVX can only occur from client sending.
-    if (   (p_ble_nus_c->handles.nus_eeg_tx_handle != BLE_GATT_HANDLE_INVALID)
-        && (p_ble_evt->evt.gattc_evt.params.hvx.handle == p_ble_nus_c->handles.nus_eeg_tx_handle)
-        && (p_ble_nus_c->evt_handler != NULL))
+    if (p_hvx->handle < BLE_NUS_C_HVX_HANDLE_MAX)
+    {
+        if (p_ble_nus_c->hvx_char[p_hvx->handle] == 0)
+        {
+            return;
+        }
+        idx = p_ble_nus_c->hvx_char[p_hvx->handle] - 1;
+    }
+    else
+    {
+        // Beyond the lookup table: a search of the descriptor table, as slow as the table is long.
+        idx = char_index_get(p_ble_nus_c, p_hvx->handle);
+        if ((idx == p_ble_nus_c->char_count) || (p_ble_nus_c->p_chars[idx].role != BLE_NUS_C_CHAR_NOTIFY))
+        {
+            return;
+        }
+    }
+    p_desc = &p_ble_nus_c->p_chars[idx];
+
+    if (p_desc->stream_id != BLE_NUS_C_NO_STREAM)
+    {
+        p_ble_nus_c->sink(p_ble_nus_c->p_sink_context, p_desc->stream_id, p_hvx->data, p_hvx->len);
+    }
+    else if (p_ble_nus_c->evt_handler != NULL)
     {
         ble_nus_c_evt_t ble_nus_c_evt;
 
-        ble_nus_c_evt.evt_type = BLE_NUS_C_EVT_NUS_EEG_TX_EVT;
-        ble_nus_c_evt.p_data   = (uint8_t *)p_ble_evt->evt.gattc_evt.params.hvx.data;
-        ble_nus_c_evt.data_len = p_ble_evt->evt.gattc_evt.params.hvx.len;
+        ble_nus_c_evt.evt_type    = BLE_NUS_C_EVT_HVX;
+        ble_nus_c_evt.conn_handle = p_ble_nus_c->conn_handle;
+        ble_nus_c_evt.char_uuid   = p_desc->char_uuid;
+        ble_nus_c_evt.p_data      = (uint8_t *)p_hvx->data;
+        ble_nus_c_evt.data_len    = p_hvx->len;
 
         p_ble_nus_c->evt_handler(p_ble_nus_c, &ble_nus_c_evt);
-        NRF_LOG_DEBUG("Client sending EEG data.");
     }
-    else if (   (p_ble_nus_c->handles.nus_ppg_tx_handle != BLE_GATT_HANDLE_INVALID)
-            && (p_ble_evt->evt.gattc_evt.params.hvx.handle == p_ble_nus_c->handles.nus_ppg_tx_handle)
-            && (p_ble_nus_c->evt_handler != NULL))
-        {
-            ble_nus_c_evt_t ble_nus_c_evt;
-
-            ble_nus_c_evt.evt_type = BLE_NUS_C_EVT_NUS_PPG_TX_EVT;
-            ble_nus_c_evt.p_data   = (uint8_t *)p_ble_evt->evt.gattc_evt.params.hvx.data;
-            ble_nus_c_evt.data_len = p_ble_evt->evt.gattc_evt.params.hvx.len;
-
-            p_ble_nus_c->evt_handler(p_ble_nus_c, &ble_nus_c_evt);
-            NRF_LOG_DEBUG("Client sending PPG data.");
-        }
-    else if (   (p_ble_nus_c->handles.nus_acc_tx_handle != BLE_GATT_HANDLE_INVALID)
-			&& (p_ble_evt->evt.gattc_evt.params.hvx.handle == p_ble_nus_c->handles.nus_acc_tx_handle)
-			&& (p_ble_nus_c->evt_handler != NULL))
-		{
-			ble_nus_c_evt_t ble_nus_c_evt;
+}
 
-			ble_nus_c_evt.evt_type = BLE_NUS_C_EVT_NUS_ACC_TX_EVT;
-			ble_nus_c_evt.p_data   = (uint8_t *)p_ble_evt->evt.gattc_evt.params.hvx.data;
-			ble_nus_c_evt.data_len = p_ble_evt->evt.gattc_evt.params.hvx.len;
 
-			p_ble_nus_c->evt_handler(p_ble_nus_c, &ble_nus_c_evt);
-			NRF_LOG_DEBUG("Client sending ACCEL data.");
-		}
-    else if ((p_ble_nus_c->handles.nus_dev_tstart_tx_handle != BLE_GATT_HANDLE_INVALID)
-			&& (p_ble_evt->evt.gattc_evt.params.hvx.handle == p_ble_nus_c->handles.nus_dev_tstart_tx_handle)
-			&& (p_ble_nus_c->evt_handler != NULL))
+/**@brief     Function for clearing all handles of an instance. */
+static void handles_clear(ble_nus_c_t * p_ble_nus_c)
+{
+    for (uint8_t i = 0; i < BLE_NUS_C_CHAR_MAX; i++)
     {
-    	ble_nus_c_evt_t ble_nus_c_evt;
-
-		ble_nus_c_evt.evt_type = BLE_NUS_C_EVT_NUS_DEV_TX_EVT;
-		ble_nus_c_evt.p_data   = (uint8_t *)p_ble_evt->evt.gattc_evt.params.hvx.data;
-		ble_nus_c_evt.data_len = p_ble_evt->evt.gattc_evt.params.hvx.len;
-
-		p_ble_nus_c->evt_handler(p_ble_nus_c, &ble_nus_c_evt);
-		NRF_LOG_DEBUG("Client sending DEV data.");
+        p_ble_nus_c->handles.value[i] = BLE_GATT_HANDLE_INVALID;
+        p_ble_nus_c->handles.cccd[i]  = BLE_GATT_HANDLE_INVALID;
     }
+    memset(p_ble_nus_c->hvx_char, 0, sizeof(p_ble_nus_c->hvx_char));
 }
 
+
 uint32_t ble_nus_c_init(ble_nus_c_t * p_ble_nus_c, ble_nus_c_init_t * p_ble_nus_c_init)
 {
     uint32_t      err_code;
-    ble_uuid_t    eeg_uuid,ppg_uuid, acc_uuid, dev_uuid,dis_uuid;
     ble_uuid128_t nus_base_uuid = HEARABLES_BASE_UUID;
 
     VERIFY_PARAM_NOT_NULL(p_ble_nus_c);
     VERIFY_PARAM_NOT_NULL(p_ble_nus_c_init);
+    VERIFY_PARAM_NOT_NULL(p_ble_nus_c_init->p_chars);
+    VERIFY_PARAM_NOT_NULL(p_ble_nus_c_init->sink);
+
+    if (p_ble_nus_c_init->char_count > BLE_NUS_C_CHAR_MAX)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
 
     err_code = sd_ble_uuid_vs_add(&nus_base_uuid, &p_ble_nus_c->uuid_type);
     VERIFY_SUCCESS(err_code);
-    err_code = sd_ble_uuid_vs_add(&nus_base_uuid, &p_ble_nus_c->uuid_type);
-	VERIFY_SUCCESS(err_code); //TODO test whetehr i need this twice...
-
-    eeg_uuid.type = p_ble_nus_c->uuid_type;
-    eeg_uuid.uuid = BLE_UUID_EEG_NUS_SERVICE;
-    ppg_uuid.type = p_ble_nus_c->uuid_type;
-    ppg_uuid.uuid = BLE_UUID_PPG_NUS_SERVICE;
-    acc_uuid.type = p_ble_nus_c->uuid_type;
-	acc_uuid.uuid = BLE_UUID_ACC_NUS_SERVICE;
-	dev_uuid.type = p_ble_nus_c->uuid_type;
-	dev_uuid.uuid = BLE_UUID_DEV_NUS_SERVICE;
-	dis_uuid.type = BLE_UUID_TYPE_BLE;
-	dis_uuid.uuid = BLE_UUID_DEVICE_INFORMATION_SERVICE;
 
     p_ble_nus_c->conn_handle           = BLE_CONN_HANDLE_INVALID;
     p_ble_nus_c->evt_handler           = p_ble_nus_c_init->evt_handler;
-    p_ble_nus_c->handles.nus_eeg_tx_handle = BLE_GATT_HANDLE_INVALID;
-    p_ble_nus_c->handles.nus_eeg_rx_handle = BLE_GATT_HANDLE_INVALID;
-    p_ble_nus_c->handles.nus_ppg_tx_handle = BLE_GATT_HANDLE_INVALID;
-    p_ble_nus_c->handles.nus_ppg_rx_handle = BLE_GATT_HANDLE_INVALID;
-    p_ble_nus_c->handles.nus_acc_tx_handle = BLE_GATT_HANDLE_INVALID;
-	p_ble_nus_c->handles.nus_acc_rx_handle = BLE_GATT_HANDLE_INVALID;
-	p_ble_nus_c->handles.nus_dev_status_tx_handle = BLE_GATT_HANDLE_INVALID;
-	p_ble_nus_c->handles.nus_dev_ctrl_rx_handle = BLE_GATT_HANDLE_INVALID;
-	p_ble_nus_c->handles.nus_dev_tstart_tx_handle = BLE_GATT_HANDLE_INVALID;
-	p_ble_nus_c->handles.nus_dis_hw_rev_handle = BLE_GATT_HANDLE_INVALID;
-
+    p_ble_nus_c->p_chars               = p_ble_nus_c_init->p_chars;
+    p_ble_nus_c->char_count            = p_ble_nus_c_init->char_count;
+    p_ble_nus_c->sink                  = p_ble_nus_c_init->sink;
+    p_ble_nus_c->p_sink_context        = p_ble_nus_c_init->p_sink_context;
+    handles_clear(p_ble_nus_c);
+    req_flush(p_ble_nus_c);
+    cmd_flush(p_ble_nus_c);
+
+    // Registering a service twice is harmless, so every entry registers its own.
+    for (uint8_t i = 0; i < p_ble_nus_c->char_count; i++)
+    {
+        ble_uuid_t srv_uuid;
 
+        srv_uuid.uuid = p_ble_nus_c->p_chars[i].srv_uuid;
+        srv_uuid.type = p_ble_nus_c->p_chars[i].sig_uuid ? BLE_UUID_TYPE_BLE : p_ble_nus_c->uuid_type;
 
-    err_code = ble_db_discovery_evt_register(&eeg_uuid);
-    err_code = ble_db_discovery_evt_register(&ppg_uuid);
-    err_code = ble_db_discovery_evt_register(&acc_uuid);
-    err_code = ble_db_discovery_evt_register(&dev_uuid);
-    err_code = ble_db_discovery_evt_register(&dis_uuid);
+        err_code = ble_db_discovery_evt_register(&srv_uuid);
+        VERIFY_SUCCESS(err_code);
+    }
 
-    return err_code;
+    return NRF_SUCCESS;
 }
 
 void ble_nus_c_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
@@ -424,6 +511,10 @@ void ble_nus_c_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
 
                 nus_c_evt.evt_type = BLE_NUS_C_EVT_DISCONNECTED;
 
+                // The next peer on this instance may have its characteristics at other handles.
+                handles_clear(p_ble_nus_c);
+                req_flush(p_ble_nus_c);
+                cmd_flush(p_ble_nus_c);
                 p_ble_nus_c->conn_handle = BLE_CONN_HANDLE_INVALID;
                 p_ble_nus_c->evt_handler(p_ble_nus_c, &nus_c_evt);
             }
@@ -432,123 +523,219 @@ void ble_nus_c_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
         	on_read_rsp(p_ble_nus_c, p_ble_evt);
         	break;
 
+        case BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE:
+            if (p_ble_evt->evt.gattc_evt.conn_handle == p_ble_nus_c->conn_handle)
+            {
+                cmd_pump(p_ble_nus_c);
+            }
+            break;
+
+        case BLE_GATTC_EVT_TIMEOUT:
+            // No further request can be made on the link, which is about to be dropped.
+            if (p_ble_evt->evt.gattc_evt.conn_handle == p_ble_nus_c->conn_handle)
+            {
+                while (p_ble_nus_c->req_count > 0)
+                {
+                    req_complete(p_ble_nus_c, BLE_NUS_C_REQ_STATUS_FAILED);
+                }
+            }
+            return;
+
         default:
             // No implementation needed.
             break;
     }
+
+    // Any response frees the link for a request refused as busy.
+    if ((p_ble_evt->header.evt_id >= BLE_GATTC_EVT_BASE) && (p_ble_evt->header.evt_id <= BLE_GATTC_EVT_LAST)
+            && (p_ble_evt->evt.gattc_evt.conn_handle == p_ble_nus_c->conn_handle))
+    {
+        req_process(p_ble_nus_c);
+    }
 }
 
-/**@brief Function for creating a message for writing to the CCCD.
+/**@brief Function for queueing a write of a CCCD.
  */
-static uint32_t cccd_configure(uint16_t conn_handle, uint16_t handle_cccd, bool enable)
+static uint32_t cccd_configure(ble_nus_c_t * p_ble_nus_c, uint16_t handle_cccd, bool enable, ble_nus_c_req_done_t done)
 {
+    ble_nus_c_req_t req;
+    uint16_t        cccd_val = enable ? BLE_GATT_HVX_NOTIFICATION : 0;
+
     NRF_LOG_DEBUG("Configuring CCCD. CCCD Handle = %d, Connection Handle = %d",
-        handle_cccd,conn_handle);
+        handle_cccd, p_ble_nus_c->conn_handle);
+
+    req.type     = BLE_NUS_C_REQ_WRITE;
+    req.handle   = handle_cccd;
+    req.value[0] = LSB_16(cccd_val);
+    req.value[1] = MSB_16(cccd_val);
+    req.done     = done;
 
-    tx_message_t * p_msg;
-    uint16_t       cccd_val = enable ? BLE_GATT_HVX_NOTIFICATION : 0;
+    return req_push(p_ble_nus_c, &req);
+}
 
-    p_msg              = &m_tx_buffer[m_tx_insert_index++];
-    m_tx_insert_index &= TX_BUFFER_MASK;
 
-    p_msg->req.write_req.gattc_params.handle   = handle_cccd;
-    p_msg->req.write_req.gattc_params.len      = WRITE_MESSAGE_LENGTH;
-    p_msg->req.write_req.gattc_params.p_value  = p_msg->req.write_req.gattc_value;
-    p_msg->req.write_req.gattc_params.offset   = 0;
-    p_msg->req.write_req.gattc_params.write_op = BLE_GATT_OP_WRITE_REQ;
-    p_msg->req.write_req.gattc_value[0]        = LSB_16(cccd_val);
-    p_msg->req.write_req.gattc_value[1]        = MSB_16(cccd_val);
-    p_msg->conn_handle                         = conn_handle;
-    p_msg->type                                = WRITE_REQ;
+uint32_t ble_nus_c_notif_enable_all(ble_nus_c_t * p_ble_nus_c, uint8_t * p_enabled, ble_nus_c_req_done_t done)
+{
+    uint32_t err_code;
 
-    tx_buffer_process();
+    VERIFY_PARAM_NOT_NULL(p_ble_nus_c);
+    VERIFY_PARAM_NOT_NULL(p_enabled);
+
+    *p_enabled = 0;
+    if (p_ble_nus_c->conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    for (uint8_t i = 0; i < p_ble_nus_c->char_count; i++)
+    {
+        ble_nus_c_char_desc_t const * p_desc = &p_ble_nus_c->p_chars[i];
+
+        if ((p_desc->role != BLE_NUS_C_CHAR_NOTIFY) || !p_desc->cccd)
+        {
+            continue;
+        }
+        if (p_ble_nus_c->handles.cccd[i] == BLE_GATT_HANDLE_INVALID)
+        {
+            // Enable the streams that are there rather than refusing the whole device.
+            NRF_LOG_WARNING("Characteristic 0x%x missing, its notifications stay off.", p_desc->char_uuid);
+            continue;
+        }
+        err_code = cccd_configure(p_ble_nus_c, p_ble_nus_c->handles.cccd[i], true, done);
+        VERIFY_SUCCESS(err_code);
+        (*p_enabled)++;
+    }
     return NRF_SUCCESS;
 }
 
 
-uint32_t ble_nus_c_tx_notif_enable(ble_nus_c_t * p_ble_nus_c, uint16_t * char_handle)
+uint32_t ble_nus_c_read(ble_nus_c_t * p_ble_nus_c, uint16_t handle, ble_nus_c_req_done_t done)
 {
+    ble_nus_c_req_t req;
+
     VERIFY_PARAM_NOT_NULL(p_ble_nus_c);
 
-    if ( (p_ble_nus_c->conn_handle == BLE_CONN_HANDLE_INVALID)
-       ||((*char_handle) == BLE_GATT_HANDLE_INVALID)
-       )
+    memset(&req, 0, sizeof(req));
+    req.type   = BLE_NUS_C_REQ_READ;
+    req.handle = handle;
+    req.done   = done;
+
+    return req_push(p_ble_nus_c, &req);
+}
+
+
+void ble_nus_c_req_tick(ble_nus_c_t * p_ble_nus_c, uint16_t elapsed_ms)
+{
+    // A request in flight is bounded by the SoftDevice, which raises BLE_GATTC_EVT_TIMEOUT.
+    if ((p_ble_nus_c->req_count == 0) || p_ble_nus_c->req_in_flight)
     {
-        return NRF_ERROR_INVALID_STATE;
+        return;
+    }
+
+    p_ble_nus_c->req_wait_ms += elapsed_ms;
+    if (p_ble_nus_c->req_wait_ms >= BLE_NUS_C_REQ_TIMEOUT_MS)
+    {
+        NRF_LOG_WARNING("Request on handle 0x%x timed out.", p_ble_nus_c->req[p_ble_nus_c->req_head].handle);
+        req_complete(p_ble_nus_c, BLE_NUS_C_REQ_STATUS_FAILED);
     }
-    return cccd_configure(p_ble_nus_c->conn_handle,*char_handle, true);
+    req_process(p_ble_nus_c);
+}
+
+
+uint16_t ble_nus_c_handle_get(ble_nus_c_t const * p_ble_nus_c, uint16_t char_uuid)
+{
+    for (uint8_t i = 0; i < p_ble_nus_c->char_count; i++)
+    {
+        if (p_ble_nus_c->p_chars[i].char_uuid == char_uuid)
+        {
+            return p_ble_nus_c->handles.value[i];
+        }
+    }
+    return BLE_GATT_HANDLE_INVALID;
 }
 
 
 uint32_t ble_nus_c_string_send(ble_nus_c_t * p_ble_nus_c, uint8_t   * p_data, uint16_t  length, uint16_t    write_handle)
 {
+    uint32_t err_code = NRF_SUCCESS;
+
     VERIFY_PARAM_NOT_NULL(p_ble_nus_c);
 
-    if (length > BLE_NUS_MAX_DATA_LEN)
-    {
-        NRF_LOG_WARNING("Content too long.");
-        return NRF_ERROR_INVALID_PARAM;
-    }
+    CRITICAL_REGION_ENTER();
+
+    uint16_t chunk_len = p_ble_nus_c->cmd_chunk_len;
+    uint32_t needed    = length + ((length + chunk_len - 1) / chunk_len) * BLE_NUS_C_CMD_HEADER_LEN;
+
     if (p_ble_nus_c->conn_handle == BLE_CONN_HANDLE_INVALID)
     {
         NRF_LOG_WARNING("Connection handle invalid.");
-        return NRF_ERROR_INVALID_STATE;
+        err_code = NRF_ERROR_INVALID_STATE;
     }
-
-    ble_gattc_write_params_t const write_params =
+    else if (needed > (uint32_t)ringbuf_space(&p_ble_nus_c->cmd_queue))
     {
-        .write_op = BLE_GATT_OP_WRITE_CMD,
-        .flags    = BLE_GATT_EXEC_WRITE_FLAG_PREPARED_WRITE,
-        .handle   = write_handle,
-        .offset   = 0,
-        .len      = length,
-        .p_value  = p_data
-    };
+        NRF_LOG_WARNING("Command queue full.");
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    else
+    {
+        while (length > 0)
+        {
+            uint8_t  header[BLE_NUS_C_CMD_HEADER_LEN];
+            uint16_t len = MIN(length, chunk_len);
+
+            (void)uint16_encode(write_handle, &header[0]);
+            (void)uint16_encode(len, &header[2]);
+            (void)ringbuf_put_block(&p_ble_nus_c->cmd_queue, header, sizeof(header));
+            (void)ringbuf_put_block(&p_ble_nus_c->cmd_queue, p_data, len);
+            p_data += len;
+            length -= len;
+        }
+        cmd_pump(p_ble_nus_c);
+    }
+
+    CRITICAL_REGION_EXIT();
 
-    return sd_ble_gattc_write(p_ble_nus_c->conn_handle, &write_params);
+    return err_code;
+}
+
+
+void ble_nus_c_att_mtu_set(ble_nus_c_t * p_ble_nus_c, uint16_t att_mtu)
+{
+    p_ble_nus_c->cmd_chunk_len = MIN(att_mtu - OPCODE_LENGTH - HANDLE_LENGTH, BLE_NUS_MAX_DATA_LEN);
 }
 
 
 uint32_t ble_nus_c_handles_assign(ble_nus_c_t               * p_ble_nus,
                                   uint16_t                    conn_handle,
-								  uint16_t                    srv_uuid,
                                   ble_nus_c_handles_t const * p_peer_handles)
 {
     VERIFY_PARAM_NOT_NULL(p_ble_nus);
 
     p_ble_nus->conn_handle = conn_handle;
-    if (p_peer_handles != NULL)
-    {
-    	if (srv_uuid == BLE_UUID_EEG_NUS_SERVICE)
-    	{
-        p_ble_nus->handles.nus_eeg_tx_cccd_handle = p_peer_handles->nus_eeg_tx_cccd_handle;
-        p_ble_nus->handles.nus_eeg_tx_handle      = p_peer_handles->nus_eeg_tx_handle;
-        p_ble_nus->handles.nus_eeg_rx_handle      = p_peer_handles->nus_eeg_rx_handle;
-    	}
-    	else if (srv_uuid == BLE_UUID_PPG_NUS_SERVICE)
-    	{
-			p_ble_nus->handles.nus_ppg_tx_cccd_handle = p_peer_handles->nus_ppg_tx_cccd_handle;
-			p_ble_nus->handles.nus_ppg_tx_handle      = p_peer_handles->nus_ppg_tx_handle;
-			p_ble_nus->handles.nus_ppg_rx_handle      = p_peer_handles->nus_ppg_rx_handle;
-		}
-    	else if (srv_uuid == BLE_UUID_ACC_NUS_SERVICE)
-		{
-			p_ble_nus->handles.nus_acc_tx_cccd_handle = p_peer_handles->nus_acc_tx_cccd_handle;
-			p_ble_nus->handles.nus_acc_tx_handle      = p_peer_handles->nus_acc_tx_handle;
-			p_ble_nus->handles.nus_acc_rx_handle      = p_peer_handles->nus_acc_rx_handle;
-		}
-    	else if (srv_uuid == BLE_UUID_DEV_NUS_SERVICE)
-    	{
-    		p_ble_nus->handles.nus_dev_status_tx_handle = p_peer_handles->nus_dev_status_tx_handle;
-    		p_ble_nus->handles.nus_dev_status_tx_cccd_handle = p_peer_handles->nus_dev_status_tx_cccd_handle;
-    		p_ble_nus->handles.nus_dev_ctrl_rx_handle      = p_peer_handles->nus_dev_ctrl_rx_handle;
-			p_ble_nus->handles.nus_dev_tstart_tx_handle      = p_peer_handles->nus_dev_tstart_tx_handle;
-			p_ble_nus->handles.nus_dev_tstart_tx_cccd_handle      = p_peer_handles->nus_dev_tstart_tx_cccd_handle;
-    	}
-    	else if (srv_uuid == BLE_UUID_DEVICE_INFORMATION_SERVICE)
-    	{
-    		p_ble_nus->handles.nus_dis_hw_rev_handle =  p_peer_handles->nus_dis_hw_rev_handle;
-    	}
+    if (p_peer_handles == NULL)
+    {
+        handles_clear(p_ble_nus);
+        req_flush(p_ble_nus);
+        return NRF_SUCCESS;
+    }
+
+    // Services are discovered one by one, so only the handles found are taken over.
+    for (uint8_t i = 0; i < p_ble_nus->char_count; i++)
+    {
+        uint16_t value = p_peer_handles->value[i];
+
+        if (value == BLE_GATT_HANDLE_INVALID)
+        {
+            continue;
+        }
+        p_ble_nus->handles.value[i] = value;
+        p_ble_nus->handles.cccd[i]  = p_peer_handles->cccd[i];
+
+        // A notifying handle beyond the lookup table is found by on_hvx in the descriptor table.
+        if ((p_ble_nus->p_chars[i].role == BLE_NUS_C_CHAR_NOTIFY) && (value < BLE_NUS_C_HVX_HANDLE_MAX))
+        {
+            p_ble_nus->hvx_char[value] = i + 1;
+        }
     }
     return NRF_SUCCESS;
 }
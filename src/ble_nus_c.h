@@ -66,8 +66,10 @@
 #include <stdbool.h>
 #include "ble.h"
 #include "ble_gatt.h"
+#include "ble_srv_common.h"
 #include "ble_db_discovery.h"
 #include "nrf_sdh_ble.h"
+#include "ringbuf.h"
 
 #include "sdk_config.h"
 
@@ -121,6 +123,15 @@ NRF_SDH_BLE_OBSERVERS(_name ## _obs,                     \
 #define OPCODE_LENGTH 1
 #define HANDLE_LENGTH 2
 
+#define BLE_NUS_C_CHAR_MAX          16      /**< Characteristics a descriptor table may list. */
+#define BLE_NUS_C_HVX_HANDLE_MAX    128     /**< Attribute handles covered by the notification lookup table. Notifications of higher handles are dispatched through a search of the descriptor table. */
+#define BLE_NUS_C_NO_STREAM         0xFF    /**< Stream id of a notifying characteristic that feeds no stream. */
+#define BLE_NUS_C_REQ_QUEUE_SIZE    8       /**< GATT requests (reads and CCCD writes) queued per link. */
+#define BLE_NUS_C_REQ_TIMEOUT_MS    2000    /**< Longest a queued request may wait for the SoftDevice to take it. */
+#define BLE_NUS_C_REQ_STATUS_FAILED BLE_GATT_STATUS_UNKNOWN /**< Status of a request that timed out or that the SoftDevice refused. */
+#define BLE_NUS_C_CMD_QUEUE_SIZE    1024    /**< Bytes of commands queued per link, chunk headers included. Must be a power of two. */
+#define BLE_NUS_C_CMD_HEADER_LEN    4       /**< Handle and length in front of every queued chunk. */
+
 /**@brief   Maximum length of data (in bytes) that can be transmitted to the peer by the Nordic UART service module. */
 #if defined(NRF_SDH_BLE_GATT_MAX_MTU_SIZE) && (NRF_SDH_BLE_GATT_MAX_MTU_SIZE != 0)
     #define BLE_NUS_MAX_DATA_LEN (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - OPCODE_LENGTH - HANDLE_LENGTH)
@@ -133,34 +144,37 @@ NRF_SDH_BLE_OBSERVERS(_name ## _obs,                     \
 /**@brief NUS Client event type. */
 typedef enum
 {
-	BLE_NUS_C_EVT_DISCOVERY_AVAILABLE,	/**< Event indicating that a service and its characteristics was found. */
-    BLE_NUS_C_EVT_DISCOVERY_COMPLETE,   /**< Event indicating that all the services and handles were found. */
-    BLE_NUS_C_EVT_NUS_EEG_TX_EVT,           /**< Event indicating that the central has received EEG data from a peer. */
-	BLE_NUS_C_EVT_NUS_PPG_TX_EVT,           /**< Event indicating that the central has received PPG data from a peer. */
-	BLE_NUS_C_EVT_NUS_ACC_TX_EVT,           /**< Event indicating that the central has received ACC data from a peer. */
-	BLE_NUS_C_EVT_NUS_DEV_TX_EVT,           /**< Event indicating that the central has received ACC data from a peer. */
+	BLE_NUS_C_EVT_DISCOVERY_AVAILABLE,	/**< Event indicating that discovery of all services has finished. */
+    BLE_NUS_C_EVT_DISCOVERY_COMPLETE,   /**< Event indicating that a service and its characteristics were found. */
+	BLE_NUS_C_EVT_HVX,                  /**< Event indicating a notification of a characteristic that feeds no stream. */
     BLE_NUS_C_EVT_DISCONNECTED,          /**< Event indicating that the NUS server has disconnected. */
-	BLE_NUS_C_EVT_DIS_READ_RESP
+	BLE_NUS_C_EVT_READ_RESP              /**< Event indicating the value of a characteristic that was read. */
 } ble_nus_c_evt_type_t;
 
-/**@brief Handles on the connected peer device needed to interact with it. */
+/**@brief What the client does with a characteristic. */
+typedef enum
+{
+    BLE_NUS_C_CHAR_NOTIFY,  /**< The peer notifies values, which are passed to the stream sink or as @ref BLE_NUS_C_EVT_HVX. */
+    BLE_NUS_C_CHAR_WRITE,   /**< Commands are written to it. */
+    BLE_NUS_C_CHAR_READ     /**< Its value is read on request and passed as @ref BLE_NUS_C_EVT_READ_RESP. */
+} ble_nus_c_char_role_t;
+
+/**@brief Entry of the table describing the characteristics the client uses. */
+typedef struct
+{
+    uint16_t              srv_uuid;     /**< 16-bit UUID of the service holding the characteristic. */
+    uint16_t              char_uuid;    /**< 16-bit UUID of the characteristic. */
+    bool                  sig_uuid;     /**< The service UUID is a Bluetooth SIG one rather than on the Hearables base UUID. */
+    ble_nus_c_char_role_t role;         /**< What the client does with the characteristic. */
+    uint8_t               stream_id;    /**< Stream a notifying characteristic feeds, or @ref BLE_NUS_C_NO_STREAM. */
+    bool                  cccd;         /**< Notifications are enabled through the CCCD once discovery has finished. */
+} ble_nus_c_char_desc_t;
+
+/**@brief Handles on the connected peer device needed to interact with it, indexed like the descriptor table. */
 typedef struct
 {
-    uint16_t nus_eeg_tx_handle;      /**< Handle of the NUS TX characteristic as provided by a discovery. */
-    uint16_t nus_eeg_tx_cccd_handle; /**< Handle of the CCCD of the NUS TX characteristic as provided by a discovery. */
-    uint16_t nus_eeg_rx_handle;      /**< Handle of the NUS RX characteristic as provided by a discovery. */
-    uint16_t nus_ppg_tx_handle;      /**< Handle of the NUS TX characteristic as provided by a discovery. */
-    uint16_t nus_ppg_tx_cccd_handle; /**< Handle of the CCCD of the NUS TX characteristic as provided by a discovery. */
-    uint16_t nus_ppg_rx_handle;      /**< Handle of the NUS RX characteristic as provided by a discovery. */
-    uint16_t nus_acc_tx_handle;      /**< Handle of the NUS TX characteristic as provided by a discovery. */
-	uint16_t nus_acc_tx_cccd_handle; /**< Handle of the CCCD of the NUS TX characteristic as provided by a discovery. */
-	uint16_t nus_acc_rx_handle;      /**< Handle of the NUS RX characteristic as provided by a discovery. */
-    uint16_t nus_dev_status_tx_handle;      /**< Handle of the NUS TX characteristic as provided by a discovery. */
-    uint16_t nus_dev_status_tx_cccd_handle;      /**< Handle of the NUS TX characteristic as provided by a discovery. */
-	uint16_t nus_dev_ctrl_rx_handle; /**< Handle of the CCCD of the NUS TX characteristic as provided by a discovery. */
-	uint16_t nus_dev_tstart_tx_handle;      /**< Handle of the NUS RX characteristic as provided by a discovery. */
-	uint16_t nus_dev_tstart_tx_cccd_handle;      /**< Handle of the NUS RX characteristic as provided by a discovery. */
-	uint16_t  nus_dis_hw_rev_handle; /*Handle of the DIS hardware revision characteristic*/
+    uint16_t value[BLE_NUS_C_CHAR_MAX];    /**< Value handle of each characteristic, or BLE_GATT_HANDLE_INVALID if not found. */
+    uint16_t cccd[BLE_NUS_C_CHAR_MAX];     /**< CCCD handle of each characteristic, or BLE_GATT_HANDLE_INVALID. */
 } ble_nus_c_handles_t;
 
 /**@brief Structure containing the NUS event data received from the peer. */
@@ -172,7 +186,8 @@ typedef struct
     uint8_t            * p_data;
     uint8_t              data_len;
     uint16_t           srv_uuid;
-    ble_nus_c_handles_t  handles;     /**< Handles on which the Nordic Uart service characteristics was discovered on the peer device. This will be filled if the evt_type is @ref BLE_NUS_C_EVT_DISCOVERY_COMPLETE.*/
+    uint16_t             char_uuid;   /**< Characteristic of a @ref BLE_NUS_C_EVT_HVX or @ref BLE_NUS_C_EVT_READ_RESP event. */
+    ble_nus_c_handles_t  handles;     /**< Handles of the characteristics found in the service. This will be filled if the evt_type is @ref BLE_NUS_C_EVT_DISCOVERY_COMPLETE.*/
 } ble_nus_c_evt_t;
 
 // Forward declaration of the ble_nus_t type.
@@ -185,6 +200,40 @@ typedef struct ble_nus_c_s ble_nus_c_t;
  */
 typedef void (* ble_nus_c_evt_handler_t)(ble_nus_c_t * p_ble_nus_c, ble_nus_c_evt_t const * p_evt);
 
+/**@brief   Request completion callback type.
+ *
+ * @details Called from the BLE event handler when the peer has answered a queued request, or
+ *          when the request was given up.
+ *
+ * @param[in] p_ble_nus_c NUS client the request was queued on.
+ * @param[in] handle      Attribute handle of the request.
+ * @param[in] gatt_status Status of the response, or @ref BLE_NUS_C_REQ_STATUS_FAILED.
+ */
+typedef void (* ble_nus_c_req_done_t)(ble_nus_c_t * p_ble_nus_c, uint16_t handle, uint16_t gatt_status);
+
+/**@brief GATT request types. */
+typedef enum
+{
+    BLE_NUS_C_REQ_READ,     /**< Read the attribute. */
+    BLE_NUS_C_REQ_WRITE     /**< Write the value with a write request. */
+} ble_nus_c_req_type_t;
+
+/**@brief Queued GATT request. */
+typedef struct
+{
+    ble_nus_c_req_type_t type;                      /**< What to do with the attribute. */
+    uint16_t             handle;                    /**< Attribute handle. */
+    uint8_t              value[BLE_CCCD_VALUE_LEN]; /**< Value of a write. Requests only write CCCDs. */
+    ble_nus_c_req_done_t done;                      /**< Called once the request is completed, or NULL. */
+} ble_nus_c_req_t;
+
+/**@brief   Stream sink type.
+ *
+ * @details Called from the BLE event handler with the value of every notification of a
+ *          characteristic that feeds a stream.
+ */
+typedef void (* ble_nus_c_sink_t)(void * p_context, uint8_t stream_id, uint8_t const * p_data, uint16_t len);
+
 /**@brief NUS Client structure. */
 struct ble_nus_c_s
 {
@@ -192,21 +241,41 @@ struct ble_nus_c_s
     uint16_t                conn_handle;    /**< Handle of the current connection. Set with @ref ble_nus_c_handles_assign when connected. */
     ble_nus_c_handles_t     handles;        /**< Handles on the connected peer device needed to interact with it. */
     ble_nus_c_evt_handler_t evt_handler;    /**< Application event handler to be called when there is an event related to the NUS. */
+    ble_nus_c_char_desc_t const * p_chars;  /**< Characteristics the client uses. */
+    uint8_t                 char_count;     /**< Number of entries in p_chars. */
+    ble_nus_c_sink_t        sink;           /**< Function the notifications of stream characteristics are passed to. */
+    void                  * p_sink_context; /**< Context passed to the sink. */
+    uint8_t                 hvx_char[BLE_NUS_C_HVX_HANDLE_MAX]; /**< Descriptor index of each notifying value handle, plus one; 0 for none. */
+    ble_nus_c_req_t         req[BLE_NUS_C_REQ_QUEUE_SIZE];      /**< GATT requests of the link, oldest first from req_head. */
+    uint8_t                 req_head;       /**< Index of the oldest request. */
+    uint8_t                 req_count;      /**< Number of queued requests. */
+    bool                    req_in_flight;  /**< The oldest request was taken by the SoftDevice and awaits its response. */
+    uint16_t                req_wait_ms;    /**< Time the oldest request has waited for the SoftDevice to take it. */
+    uint16_t                cmd_chunk_len;  /**< Longest write command the ATT MTU allows. */
+    struct ringbuf          cmd_queue;      /**< Write command chunks waiting for a SoftDevice buffer, each behind its handle and length. */
+    uint8_t                 cmd_queue_data[BLE_NUS_C_CMD_QUEUE_SIZE];   /**< Storage for cmd_queue. */
+    uint16_t                cmd_handle;     /**< Handle of the chunk taken from the queue but not accepted by the SoftDevice yet. */
+    uint16_t                cmd_len;        /**< Length of that chunk, 0 for none. */
+    uint8_t                 cmd_chunk[BLE_NUS_MAX_DATA_LEN];            /**< That chunk. */
 };
 
 /**@brief NUS Client initialization structure. */
 typedef struct
 {
-    ble_nus_c_evt_handler_t evt_handler;
+    ble_nus_c_evt_handler_t       evt_handler;
+    ble_nus_c_char_desc_t const * p_chars;          /**< Characteristics to discover and use, at most @ref BLE_NUS_C_CHAR_MAX. Must stay valid. */
+    uint8_t                       char_count;       /**< Number of entries in p_chars. */
+    ble_nus_c_sink_t              sink;             /**< Function the notifications of stream characteristics are passed to. */
+    void                        * p_sink_context;   /**< Context passed to the sink. */
 } ble_nus_c_init_t;
 
 
 /**@brief     Function for initializing the Nordic UART client module.
  *
- * @details   This function registers with the Database Discovery module
- *            for the NUS. Doing so will make the Database Discovery
- *            module look for the presence of a NUS instance at the peer when a
- *            discovery is started.
+ * @details   This function registers every service of the descriptor table with the Database
+ *            Discovery module. Doing so will make the Database Discovery module look for these
+ *            services at the peer when a discovery is started. The Database Discovery module
+ *            handles at most @ref BLE_DB_DISCOVERY_MAX_SRV services.
  *
  * @param[in] p_ble_nus_c      Pointer to the NUS client structure.
  * @param[in] p_ble_nus_c_init Pointer to the NUS initialization structure containing the
@@ -223,10 +292,9 @@ uint32_t ble_nus_c_init(ble_nus_c_t * p_ble_nus_c, ble_nus_c_init_t * p_ble_nus_
 /**@brief Function for handling events from the database discovery module.
  *
  * @details This function will handle an event from the database discovery module, and determine
- *          if it relates to the discovery of NUS at the peer. If so, it will
- *          call the application's event handler indicating that NUS has been
- *          discovered at the peer. It also populates the event with the service related
- *          information before providing it to the application.
+ *          if it relates to a service of the descriptor table. If so, it will call the
+ *          application's event handler with the handles of the characteristics of the table
+ *          found in the service.
  *
  * @param[in] p_ble_nus_c Pointer to the NUS client structure.
  * @param[in] p_evt       Pointer to the event received from the database discovery module.
@@ -246,54 +314,116 @@ uint32_t ble_nus_c_init(ble_nus_c_t * p_ble_nus_c, ble_nus_c_init_t * p_ble_nus_
 void ble_nus_c_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context);
 
 
-/**@brief   Function for requesting the peer to start sending notification of TX characteristic.
+/**@brief   Function for requesting the peer to start notifying every characteristic that needs it.
  *
- * @details This function enables notifications of the NUS TX characteristic at the peer
- *          by writing to the CCCD of the NUS TX characteristic.
+ * @details Queues a write of the CCCD of every notifying characteristic of the descriptor table
+ *          with cccd set. Characteristics the peer does not have are skipped, so the streams that
+ *          are there are enabled even if others are missing. The writes are issued back to back,
+ *          each one from the response to the previous one.
  *
- * @param   p_ble_nus_c Pointer to the NUS client structure.
+ * @param[in]  p_ble_nus_c Pointer to the NUS client structure.
+ * @param[out] p_enabled   Number of CCCD writes queued.
+ * @param[in]  done        Called as each write completes, or NULL.
  *
- * @retval  NRF_SUCCESS If the SoftDevice has been requested to write to the CCCD of the peer.
- *                      Otherwise, an error code is returned. This function propagates the error
- *                      code returned by the SoftDevice API @ref sd_ble_gattc_write.
+ * @retval  NRF_SUCCESS If a write was queued for every CCCD found.
+ * @retval  NRF_ERROR_INVALID_STATE If the instance is not connected.
+ * @retval  NRF_ERROR_NO_MEM If the request queue is full; the writes queued so far are counted.
  */
-uint32_t ble_nus_c_tx_notif_enable(ble_nus_c_t * p_ble_nus_c,uint16_t * char_handle);
+uint32_t ble_nus_c_notif_enable_all(ble_nus_c_t * p_ble_nus_c, uint8_t * p_enabled, ble_nus_c_req_done_t done);
 
 
-/**@brief Function for sending a string to the server.
+/**@brief   Function for queueing a read of an attribute of the peer.
  *
- * @details This function writes the RX characteristic of the server.
+ * @details The value of a characteristic with the read role is passed as
+ *          @ref BLE_NUS_C_EVT_READ_RESP. May be called from any context.
  *
  * @param[in] p_ble_nus_c Pointer to the NUS client structure.
- * @param[in] p_string    String to be sent.
- * @param[in] length      Length of the string.
- * @param[in] conn_handle    Connection handle to associated with the given NUS Instance.
+ * @param[in] handle      Attribute handle to read.
+ * @param[in] done        Called once the read completes, or NULL.
+ *
+ * @retval  NRF_SUCCESS If the read was queued.
+ * @retval  NRF_ERROR_INVALID_STATE If the instance is not connected.
+ * @retval  NRF_ERROR_NO_MEM If the request queue is full.
+ */
+uint32_t ble_nus_c_read(ble_nus_c_t * p_ble_nus_c, uint16_t handle, ble_nus_c_req_done_t done);
+
+
+/**@brief   Function for retrying and timing out the queued requests of a link.
+ *
+ * @details A request the SoftDevice refuses as busy is retried on every GATT client event of the
+ *          link and on every call of this function. One that has not been taken after
+ *          @ref BLE_NUS_C_REQ_TIMEOUT_MS is completed with @ref BLE_NUS_C_REQ_STATUS_FAILED. A
+ *          request the SoftDevice has taken is bounded by its own GATT timeout. Call periodically
+ *          from the BLE event priority.
+ *
+ * @param[in] p_ble_nus_c Pointer to the NUS client structure.
+ * @param[in] elapsed_ms  Time since the previous call.
+ */
+void ble_nus_c_req_tick(ble_nus_c_t * p_ble_nus_c, uint16_t elapsed_ms);
+
+
+/**@brief Function for getting the value handle of a characteristic of the descriptor table.
+ *
+ * @param[in] p_ble_nus_c Pointer to the NUS client structure.
+ * @param[in] char_uuid   16-bit UUID of the characteristic.
  *
- * @retval NRF_SUCCESS If the string was sent successfully. Otherwise, an error code is returned.
+ * @return The value handle, or BLE_GATT_HANDLE_INVALID if the peer does not have it.
+ */
+uint16_t ble_nus_c_handle_get(ble_nus_c_t const * p_ble_nus_c, uint16_t char_uuid);
+
+
+/**@brief Function for sending a string to the server.
+ *
+ * @details The string is queued to be written to a characteristic of the server without
+ *          response. A string longer than the ATT MTU allows is split into consecutive writes.
+ *          As many writes are handed to the SoftDevice as it has buffers for; the rest follow
+ *          as it reports writes sent. May be called from any context.
+ *
+ * @param[in] p_ble_nus_c  Pointer to the NUS client structure.
+ * @param[in] p_data       String to be sent. It is copied.
+ * @param[in] length       Length of the string.
+ * @param[in] write_handle Value handle of the characteristic to write.
+ *
+ * @retval NRF_SUCCESS             If the whole string was queued.
+ * @retval NRF_ERROR_INVALID_STATE If the instance is not connected.
+ * @retval NRF_ERROR_NO_MEM        If the queue has no room for the whole string; none of it is sent.
  */
 uint32_t ble_nus_c_string_send(ble_nus_c_t * p_nus, uint8_t   * p_data, uint16_t length, uint16_t    write_handle);
 
 
+/**@brief Function for setting the ATT MTU of the link, which bounds the length of every write.
+ *
+ * @details Strings queued afterwards are split to fit. The MTU is back to the default after a
+ *          disconnect.
+ *
+ * @param[in] p_ble_nus_c Pointer to the NUS client structure.
+ * @param[in] att_mtu     Effective ATT MTU.
+ */
+void ble_nus_c_att_mtu_set(ble_nus_c_t * p_ble_nus_c, uint16_t att_mtu);
+
+
 /**@brief Function for assigning handles to a this instance of nus_c.
  *
  * @details Call this function when a link has been established with a peer to
- *          associate this link to this instance of the module. This makes it
+ *          associate this link to this instance of the module, without handles. This makes it
  *          possible to handle several link and associate each link to a particular
- *          instance of this module. The connection handle and attribute handles will be
- *          provided from the discovery event @ref BLE_NUS_C_EVT_DISCOVERY_COMPLETE.
+ *          instance of this module. The attribute handles will be provided from the discovery
+ *          event @ref BLE_NUS_C_EVT_DISCOVERY_COMPLETE of each service; the valid handles given
+ *          are added to those already assigned.
  *
  * @param[in] p_ble_nus_c    Pointer to the NUS client structure instance to associate with these
  *                           handles.
  * @param[in] conn_handle    Connection handle to associated with the given NUS Instance.
  * @param[in] p_peer_handles Attribute handles on the NUS server that you want this NUS client to
- *                           interact with.
+ *                           interact with, or NULL to clear all handles for a new connection,
+ *                           or for a new discovery of the link. The requests queued on the
+ *                           handles are dropped with them, without calling their callbacks.
  *
  * @retval    NRF_SUCCESS    If the operation was successful.
  * @retval    NRF_ERROR_NULL If a p_nus was a NULL pointer.
  */
 uint32_t ble_nus_c_handles_assign(ble_nus_c_t *               p_ble_nus_c,
                                   uint16_t                    conn_handle,
-								  uint16_t                    srv_uuid,
                                   ble_nus_c_handles_t const * p_peer_handles);
 
 
@@ -0,0 +1,123 @@
+/**@file
+ *
+ * @brief Device clock tracking implementation.
+ */
+
+#include <string.h>
+#include "app_timer.h"
+#include "clock_sync.h"
+
+
+/**@brief Function for advancing the dongle time elapsed since the anchor to a new time.
+ *
+ * @details A time slightly older than the latest one, such as a report time read just before a
+ *          sample came in, leaves the elapsed time as it is.
+ */
+static void rx_advance(clock_sync_t * p_sync, uint32_t rx_time)
+{
+    uint32_t diff = app_timer_cnt_diff_compute(rx_time, p_sync->rx_last);
+
+    if (diff <= APP_TIMER_MAX_CNT_VAL / 2)
+    {
+        p_sync->rx_elapsed += diff;
+        p_sync->rx_last     = rx_time;
+    }
+}
+
+
+void clock_sync_reset(clock_sync_t * p_sync)
+{
+    memset(p_sync, 0, sizeof(clock_sync_t));
+    p_sync->state = CLOCK_SYNC_STATE_NONE;
+}
+
+
+void clock_sync_anchor(clock_sync_t * p_sync, uint32_t dev_time, uint32_t rx_time)
+{
+    clock_sync_reset(p_sync);
+    p_sync->state      = CLOCK_SYNC_STATE_ANCHORED;
+    p_sync->dev_anchor = dev_time;
+    p_sync->rx_anchor  = rx_time;
+    p_sync->rx_last    = rx_time;
+}
+
+
+void clock_sync_sample(clock_sync_t * p_sync, uint32_t dev_time, uint32_t rx_time)
+{
+    int64_t dev_us;
+    int64_t residual_us;
+    int64_t ref_us = 0;
+
+    if (p_sync->state == CLOCK_SYNC_STATE_NONE)
+    {
+        return;
+    }
+
+    rx_advance(p_sync, rx_time);
+    dev_us      = ((int64_t)(uint32_t)(dev_time - p_sync->dev_anchor) * 1000000) / CLOCK_SYNC_DEVICE_FREQ;
+    residual_us = ((int64_t)p_sync->rx_elapsed * 1000000) / APP_TIMER_CLOCK_FREQ - dev_us;
+
+    // The anchor itself has a residual of 0.
+    if (p_sync->win_valid)
+    {
+        ref_us = p_sync->win_us;
+    }
+    else if (p_sync->first_valid)
+    {
+        ref_us = p_sync->last_us;
+    }
+    if ((residual_us > ref_us + CLOCK_SYNC_MAX_JUMP_US) || (residual_us < ref_us - CLOCK_SYNC_MAX_JUMP_US))
+    {
+        p_sync->rejected++;
+        return;
+    }
+
+    p_sync->samples++;
+    if (!p_sync->win_valid || (residual_us < p_sync->win_us))
+    {
+        p_sync->win_valid  = true;
+        p_sync->win_us     = residual_us;
+        p_sync->win_dev_us = dev_us;
+    }
+}
+
+
+void clock_sync_report(clock_sync_t * p_sync, uint32_t now, clock_sync_report_t * p_report)
+{
+    if (p_sync->state != CLOCK_SYNC_STATE_NONE)
+    {
+        // Keeps the elapsed time right across app_timer wraps while no samples come in.
+        rx_advance(p_sync, now);
+    }
+
+    if (p_sync->win_valid)
+    {
+        if (!p_sync->first_valid)
+        {
+            p_sync->first_valid  = true;
+            p_sync->first_us     = p_sync->win_us;
+            p_sync->first_dev_us = p_sync->win_dev_us;
+        }
+        p_sync->last_us     = p_sync->win_us;
+        p_sync->last_dev_us = p_sync->win_dev_us;
+        p_sync->win_valid   = false;
+
+        if (p_sync->last_dev_us - p_sync->first_dev_us >= (int64_t)CLOCK_SYNC_MIN_SPAN_S * 1000000)
+        {
+            p_sync->state     = CLOCK_SYNC_STATE_TRACKING;
+            p_sync->drift_ppb = (int32_t)(((p_sync->last_us - p_sync->first_us) * 1000000000)
+                                          / (p_sync->last_dev_us - p_sync->first_dev_us));
+        }
+    }
+
+    p_report->state      = p_sync->state;
+    p_report->dev_anchor = p_sync->dev_anchor;
+    p_report->rx_anchor  = p_sync->rx_anchor;
+    p_report->offset_us  = (int32_t)p_sync->last_us;
+    p_report->drift_ppb  = p_sync->drift_ppb;
+    p_report->samples    = p_sync->samples;
+    p_report->rejected   = p_sync->rejected;
+
+    p_sync->samples  = 0;
+    p_sync->rejected = 0;
+}
@@ -0,0 +1,127 @@
+/**@file
+ *
+ * @defgroup clock_sync Device clock tracking
+ * @{
+ *
+ * @brief    Offset and drift of the clock of a Hearable against the clock of the dongle.
+ *
+ * @details  A Hearable stamps its data with its own counter, running at
+ *           @ref CLOCK_SYNC_DEVICE_FREQ. The dongle stamps every notification with its RTC, in
+ *           app_timer ticks. The start time notification of the Hearable anchors the two clocks
+ *           to each other, and every later notification carrying a device time gives a sample of
+ *           the residual: the dongle time elapsed since the anchor minus the device time elapsed.
+ *
+ *           The residual is the offset between the clocks, growing with their drift, plus the
+ *           delay of the radio link, which is never negative but varies from one connection event
+ *           to the next. Only the smallest residual of each report period is kept, as the one
+ *           least delayed, and the drift is the slope of these minima since the first period.
+ *
+ *           A sample too far from the current estimate is counted as rejected rather than used,
+ *           so data that only looks like a device time does not disturb the estimate.
+ *
+ *           Samples are added from the BLE event context. @ref clock_sync_report must not be
+ *           interrupted by them.
+ */
+
+#ifndef CLOCK_SYNC_H__
+#define CLOCK_SYNC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CLOCK_SYNC_DEVICE_FREQ      31250   /**< Frequency of the device counter, in Hz. */
+#define CLOCK_SYNC_MAX_JUMP_US      250000  /**< Largest change of the residual a sample may bring, in microseconds. */
+#define CLOCK_SYNC_MIN_SPAN_S       10      /**< Device time between the first and the latest minimum before the drift is reported. */
+
+/**@brief Estimate states. */
+typedef enum
+{
+    CLOCK_SYNC_STATE_NONE,          /**< No start time received yet. */
+    CLOCK_SYNC_STATE_ANCHORED,      /**< Start time received, the offset is known. */
+    CLOCK_SYNC_STATE_TRACKING,      /**< The drift is known as well. */
+} clock_sync_state_t;
+
+/**@brief Estimate handed out at the end of a report period. */
+typedef struct
+{
+    clock_sync_state_t state;       /**< What the estimate holds. */
+    uint32_t           dev_anchor;  /**< Device time of the anchor, in device ticks. */
+    uint32_t           rx_anchor;   /**< Dongle time the anchor was received, in app_timer ticks. */
+    int32_t            offset_us;   /**< Smallest residual of the latest period that had samples, in microseconds. */
+    int32_t            drift_ppb;   /**< Dongle clock rate minus device clock rate, in parts per billion. */
+    uint16_t           samples;     /**< Samples used in the period. */
+    uint16_t           rejected;    /**< Samples rejected in the period. */
+} clock_sync_report_t;
+
+/**@brief Clock tracking state of one Hearable. */
+typedef struct
+{
+    clock_sync_state_t state;
+    uint32_t           dev_anchor;      /**< Device time of the anchor. */
+    uint32_t           rx_anchor;       /**< Dongle time of the anchor. */
+    uint32_t           rx_last;         /**< Dongle time of the latest sample or report. */
+    uint32_t           rx_elapsed;      /**< Dongle ticks from the anchor to rx_last, past the app_timer wrap. */
+    bool               first_valid;     /**< first_* hold the minimum of the first period with samples. */
+    int64_t            first_us;        /**< Smallest residual of that period. */
+    int64_t            first_dev_us;    /**< Device time of it since the anchor. */
+    int64_t            last_us;         /**< Smallest residual of the latest period with samples. */
+    int64_t            last_dev_us;     /**< Device time of it since the anchor. */
+    bool               win_valid;       /**< win_* hold the minimum of the current period. */
+    int64_t            win_us;          /**< Smallest residual of the current period. */
+    int64_t            win_dev_us;      /**< Device time of it since the anchor. */
+    int32_t            drift_ppb;       /**< Latest drift estimate. */
+    uint16_t           samples;         /**< Samples used in the current period. */
+    uint16_t           rejected;        /**< Samples rejected in the current period. */
+} clock_sync_t;
+
+
+/**@brief Function for forgetting the estimate, such as when the Hearable disconnects.
+ *
+ * @param[out] p_sync Clock tracking state.
+ */
+void clock_sync_reset(clock_sync_t * p_sync);
+
+
+/**@brief Function for anchoring the device clock to the dongle clock.
+ *
+ * @details Restarts the estimate, as the device counter may have restarted.
+ *
+ * @param[in] p_sync   Clock tracking state.
+ * @param[in] dev_time Start time sent by the Hearable, in device ticks.
+ * @param[in] rx_time  Time the start time was received, in app_timer ticks.
+ */
+void clock_sync_anchor(clock_sync_t * p_sync, uint32_t dev_time, uint32_t rx_time);
+
+
+/**@brief Function for adding a device time received from the Hearable.
+ *
+ * @details Ignored until the clocks are anchored. Samples must come at least once per app_timer
+ *          wrap, or @ref clock_sync_report must be called that often.
+ *
+ * @param[in] p_sync   Clock tracking state.
+ * @param[in] dev_time Device time carried by the notification, in device ticks.
+ * @param[in] rx_time  Time the notification was received, in app_timer ticks.
+ */
+void clock_sync_sample(clock_sync_t * p_sync, uint32_t dev_time, uint32_t rx_time);
+
+
+/**@brief Function for ending a report period and getting the estimate.
+ *
+ * @param[in]  p_sync   Clock tracking state.
+ * @param[in]  now      Current time, in app_timer ticks.
+ * @param[out] p_report Estimate at the end of the period.
+ */
+void clock_sync_report(clock_sync_t * p_sync, uint32_t now, clock_sync_report_t * p_report);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CLOCK_SYNC_H__
+
+/** @} */
@@ -0,0 +1,325 @@
+/**@file
+ *
+ * @brief Stream data path implementation.
+ */
+
+#include <string.h>
+#include "nordic_common.h"
+#include "sdk_macros.h"
+#include "data_path.h"
+
+#define NRF_LOG_MODULE_NAME data_path
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+static char const * const m_stream_prefix[STREAM_COUNT] = {"EEG_", "PPG_", "ACC_"};
+
+
+void data_path_cfg_default(data_path_cfg_t * p_cfg, uint8_t link_count)
+{
+    static uint8_t const  reserved[STREAM_COUNT]       = {EEG_PACKETS_RESERVED, PPG_PACKETS_RESERVED, ACC_PACKETS_RESERVED};
+    static uint8_t const  limit[STREAM_COUNT]          = {EEG_PACKETS_LIMIT, PPG_PACKETS_LIMIT, ACC_PACKETS_LIMIT};
+    static uint8_t const  weight[STREAM_COUNT]         = {EEG_WEIGHT, PPG_WEIGHT, ACC_WEIGHT};
+    static uint16_t const max_latency_ms[STREAM_COUNT] = {EEG_MAX_LATENCY_MS, PPG_MAX_LATENCY_MS, ACC_MAX_LATENCY_MS};
+
+    memset(p_cfg, 0, sizeof(*p_cfg));
+    p_cfg->link_count     = link_count;
+    p_cfg->frame_count    = (uint8_t)(DATA_PATH_FRAMES_PER_LINK * link_count);
+    p_cfg->frame_size     = DATA_PATH_FRAME_SIZE;
+    p_cfg->urgent_percent = STREAM_URGENT_PERCENT;
+    p_cfg->urgent_max     = STREAM_URGENT_MAX;
+    p_cfg->sched          = DATA_PATH_SCHED_WRR;
+    memcpy(p_cfg->reserved, reserved, sizeof(reserved));
+    memcpy(p_cfg->limit, limit, sizeof(limit));
+    memcpy(p_cfg->weight, weight, sizeof(weight));
+    memcpy(p_cfg->max_latency_ms, max_latency_ms, sizeof(max_latency_ms));
+}
+
+
+ret_code_t data_path_init(data_path_t                * p_path,
+                          data_path_cfg_t const      * p_cfg,
+                          uint8_t                    * p_storage,
+                          uint32_t                     storage_size,
+                          app_usbd_cdc_acm_t const   * p_cdc_acm)
+{
+    ret_code_t ret;
+    int16_t    weights = 0;
+
+    if ((p_cfg->link_count == 0) || (p_cfg->link_count > DATA_PATH_LINK_MAX)
+            || (p_cfg->frame_count > PKTBUF_MAX_FRAMES) || (p_cfg->frame_size <= USB_FRAME_HEADER_MAX_LEN)
+            || ((uint32_t)p_cfg->frame_count * p_cfg->frame_size > storage_size))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    memset(p_path, 0, sizeof(*p_path));
+    p_path->cfg       = *p_cfg;
+    p_path->p_cdc_acm = p_cdc_acm;
+    // Format 1 carries no link id, so it is only the default with a single link.
+    p_path->format    = (p_cfg->link_count > 1) ? USB_FRAME_FORMAT_V2 : USB_FRAME_FORMAT_V1;
+    p_path->records   = false;
+
+    pktbuf_pool_init(&p_path->pool, p_storage, p_cfg->frame_count, p_cfg->frame_size, USB_FRAME_HEADER_MAX_LEN);
+    for (uint8_t link = 0; link < p_cfg->link_count; link++)
+    {
+        for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+        {
+            ret = pktbuf_init(&p_path->ring[link][stream], &p_path->pool, RING_ID(link, stream),
+                              p_cfg->reserved[stream], p_cfg->limit[stream]);
+            VERIFY_SUCCESS(ret);
+        }
+    }
+
+    for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+    {
+        weights += p_cfg->weight[stream];
+    }
+    // Twice the weights of a round over all streams bounds a credit either way.
+    stream_sched_init(&p_path->sched, p_cfg->urgent_percent, p_cfg->urgent_max, (int16_t)(2 * p_cfg->link_count * weights));
+    for (uint8_t link = 0; link < p_cfg->link_count; link++)
+    {
+        for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+        {
+            ret = stream_sched_add(&p_path->sched, &p_path->ring[link][stream], p_cfg->weight[stream]);
+            VERIFY_SUCCESS(ret);
+        }
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t data_path_put(data_path_t * p_path, uint8_t link, uint8_t stream_id, uint8_t const * p_data, uint16_t len, uint32_t timestamp)
+{
+    pktbuf_t * p_ring = &p_path->ring[link][stream_id];
+
+    if (p_path->records)
+    {
+        return pktbuf_put_record(p_ring, p_data, len, timestamp);
+    }
+    return pktbuf_put(p_ring, p_data, len, timestamp);
+}
+
+
+void data_path_flush(data_path_t * p_path)
+{
+    // From the consumer side; re-initialising would race with the producer.
+    for (uint8_t link = 0; link < p_path->cfg.link_count; link++)
+    {
+        for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+        {
+            pktbuf_flush(&p_path->ring[link][stream]);
+        }
+    }
+}
+
+
+void data_path_tick(data_path_t * p_path)
+{
+    for (uint8_t link = 0; link < p_path->cfg.link_count; link++)
+    {
+        for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+        {
+            uint16_t max_latency_ms = p_path->cfg.max_latency_ms[stream];
+
+            if (max_latency_ms == 0)
+            {
+                continue;
+            }
+            p_path->flush_elapsed_ms[link][stream] += DATA_PATH_TICK_MS;
+            if (p_path->flush_elapsed_ms[link][stream] >= max_latency_ms / 2)
+            {
+                p_path->flush_elapsed_ms[link][stream] = 0;
+                (void)pktbuf_commit_aged(&p_path->ring[link][stream]);
+            }
+        }
+    }
+}
+
+
+bool data_path_tx_room(data_path_t const * p_path)
+{
+    return p_path->tx_count < DATA_PATH_TX_QUEUE_SIZE;
+}
+
+
+/**@brief Function for adding a packet to the tail of the USB transmit queue. */
+static void tx_queue_push(data_path_t   * p_path,
+                          pktbuf_t      * p_ring,
+                          bool          * p_queued,
+                          uint8_t const * p_data,
+                          uint16_t        len,
+                          uint16_t        payload_len)
+{
+    data_path_tx_entry_t * p_entry = &p_path->tx_queue[(p_path->tx_head + p_path->tx_count) % DATA_PATH_TX_QUEUE_SIZE];
+
+    p_entry->p_ring      = p_ring;
+    p_entry->p_queued    = p_queued;
+    p_entry->p_data      = p_data;
+    p_entry->len         = len;
+    p_entry->payload_len = payload_len;
+    p_entry->failed      = false;
+    p_path->tx_count++;
+
+    if (p_queued != NULL)
+    {
+        *p_queued = true;
+    }
+}
+
+
+void data_path_tx_push(data_path_t            * p_path,
+                       usb_frame_info_t const * p_info,
+                       uint8_t                * p_payload,
+                       uint16_t                 len,
+                       bool                   * p_queued)
+{
+    uint8_t  * p_packet;
+    uint16_t   size;
+
+    p_packet = usb_frame_header_write(p_path->format, p_info, p_payload, len, &size);
+    tx_queue_push(p_path, NULL, p_queued, p_packet, size, len);
+}
+
+
+/**@brief Function for picking the ring to write next the way the main loop did before the
+ *        scheduler: the first stream with a packet ready, EEG first, link 0 first.
+ */
+static pktbuf_t * drain_next(data_path_t * p_path)
+{
+    for (uint8_t link = 0; link < p_path->cfg.link_count; link++)
+    {
+        for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+        {
+            if (pktbuf_frames_ready(&p_path->ring[link][stream]) > 0)
+            {
+                return &p_path->ring[link][stream];
+            }
+        }
+    }
+    return NULL;
+}
+
+
+/**@brief Function for queueing the next packet of the stream whose turn it is, over all links,
+ *        header included.
+ *
+ * @return false if no stream has a packet ready.
+ */
+static bool tx_queue_next(data_path_t * p_path)
+{
+    pktbuf_t       * p_ring;
+    pktbuf_frame_t   frame;
+    usb_frame_info_t info;
+    uint8_t        * p_packet;
+    uint16_t         size;
+
+    p_ring = (p_path->cfg.sched == DATA_PATH_SCHED_WRR) ? stream_sched_next(&p_path->sched) : drain_next(p_path);
+    if ((p_ring == NULL) || !pktbuf_frame_get(p_ring, &frame))
+    {
+        return false;
+    }
+    info.p_tag     = m_stream_prefix[RING_STREAM(p_ring->stream_id)];
+    info.stream_id = RING_STREAM(p_ring->stream_id);
+    info.link      = RING_LINK(p_ring->stream_id);
+    info.seq       = p_path->seq[info.link][info.stream_id]++;
+    info.timestamp = frame.timestamp;
+    info.records   = frame.records;
+
+    p_packet = usb_frame_header_write(p_path->format, &info, frame.p_frame + USB_FRAME_HEADER_MAX_LEN, frame.len, &size);
+    tx_queue_push(p_path, p_ring, NULL, p_packet, size, frame.len);
+    return true;
+}
+
+
+void data_path_tx_fill(data_path_t * p_path)
+{
+    while (data_path_tx_room(p_path) && tx_queue_next(p_path))
+    {
+    }
+}
+
+
+void data_path_tx_start(data_path_t * p_path)
+{
+    ret_code_t             ret;
+    data_path_tx_entry_t * p_entry = &p_path->tx_queue[p_path->tx_head];
+
+    if (p_path->tx_in_flight || (p_path->tx_count == 0))
+    {
+        return;
+    }
+
+    ret = app_usbd_cdc_acm_write(p_path->p_cdc_acm, p_entry->p_data, p_entry->len);
+    if (ret == NRF_SUCCESS)
+    {
+        p_path->tx_in_flight = true;
+    }
+    else
+    {
+        // Count each refused packet once, not every retry.
+        if (!p_entry->failed && (p_entry->p_ring != NULL))
+        {
+            p_path->stats[RING_LINK(p_entry->p_ring->stream_id)][RING_STREAM(p_entry->p_ring->stream_id)].usb_write_failures++;
+        }
+        p_entry->failed = true;
+        NRF_LOG_DEBUG("CDC ACM unavailable (0x%x), packet kept for retry", ret);
+    }
+}
+
+
+void data_path_tx_done(data_path_t * p_path)
+{
+    data_path_tx_entry_t * p_entry;
+
+    if (p_path->tx_count == 0)
+    {
+        return;
+    }
+
+    p_entry = &p_path->tx_queue[p_path->tx_head];
+    if (p_entry->p_ring != NULL)
+    {
+        data_path_stats_t * p_stats = &p_path->stats[RING_LINK(p_entry->p_ring->stream_id)][RING_STREAM(p_entry->p_ring->stream_id)];
+
+        p_stats->packets_out++;
+        p_stats->bytes_out += p_entry->payload_len;
+        pktbuf_frame_release(p_entry->p_ring, p_entry->p_data);
+    }
+    else
+    {
+        *p_entry->p_queued = false;
+    }
+    p_path->tx_head = (p_path->tx_head + 1) % DATA_PATH_TX_QUEUE_SIZE;
+    p_path->tx_count--;
+    p_path->tx_in_flight = false;
+
+    // Keep the endpoint busy: the next packet is already prefixed and waiting.
+    data_path_tx_start(p_path);
+}
+
+
+void data_path_tx_abort(data_path_t * p_path)
+{
+    p_path->tx_in_flight = false;
+}
+
+
+bool data_path_busy(data_path_t * p_path)
+{
+    if (p_path->tx_count > 0)
+    {
+        return true;
+    }
+    for (uint8_t link = 0; link < p_path->cfg.link_count; link++)
+    {
+        for (uint8_t stream = 0; stream < STREAM_COUNT; stream++)
+        {
+            if (pktbuf_frames_ready(&p_path->ring[link][stream]) > 0)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
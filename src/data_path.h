@@ -0,0 +1,273 @@
+/**@file
+ *
+ * @defgroup data_path Stream data path
+ * @{
+ *
+ * @brief    Stream data of every link from notification to USB write.
+ *
+ * @details  Notifications go into the stream rings of one shared packet pool (@ref pktbuf), the
+ *           stream scheduler (@ref stream_sched) picks the packet to write next, and its header is
+ *           written in front of it (@ref usb_frame). Packets wait in a short USB transmit queue,
+ *           whose head alone is handed to the CDC ACM class; the next one is started as soon as
+ *           the previous one is done. Packets other than stream data (name, statistics, responses)
+ *           are queued ahead of the stream packets by the application with @ref data_path_tx_push.
+ *
+ *           Partial packets of streams with a maximum latency are committed on the flush timer
+ *           tick, @ref data_path_tick, so low-rate data does not wait for a full packet.
+ *
+ *           @ref data_path_put runs on the producer side, typically the BLE event handler, and
+ *           everything else on the consumer side, the main loop. The same code runs on the dongle
+ *           and in the host programs of host/, with the CDC ACM class replaced by a stand-in.
+ */
+
+#ifndef DATA_PATH_H__
+#define DATA_PATH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+#include "app_usbd_cdc_acm.h"
+#include "pktbuf.h"
+#include "stream_sched.h"
+#include "usb_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DATA_PATH_FRAME_SIZE        2048    /**< Largest packet slot, header included; a packet flushed early is shorter. */
+#define DATA_PATH_FRAMES_PER_LINK   9       /**< Packets of the pool per link. */
+#define DATA_PATH_LINK_MAX          4       /**< Links a data path can have. */
+#define DATA_PATH_TX_QUEUE_SIZE     3       /**< Packets queued for writing; only the head one is handed to the driver. */
+#define DATA_PATH_TICK_MS           10      /**< Period of @ref data_path_tick. */
+
+// Packets each stream of a link can always get, and the most it may hold by borrowing from quieter
+// streams. The reservations of all links must not add up to more than the packets of the pool. A stream
+// whose part full packets are committed after its latency needs two: one waiting for USB, one filling.
+#define EEG_PACKETS_RESERVED 3
+#define EEG_PACKETS_LIMIT 10
+#define PPG_PACKETS_RESERVED 2
+#define PPG_PACKETS_LIMIT 8
+#define ACC_PACKETS_RESERVED 2
+#define ACC_PACKETS_LIMIT 4
+
+// Share of the USB writes each stream gets while several have packets ready, by smooth weighted
+// round robin over the streams of all links. A stream holding STREAM_URGENT_PERCENT of the packets it
+// can reach or more goes first whatever its weight, the fullest first, before it has to drop data, for
+// at most STREAM_URGENT_MAX turns in a row so a stream overloaded for good cannot starve the others.
+#define EEG_WEIGHT 4
+#define PPG_WEIGHT 2
+#define ACC_WEIGHT 1
+#define STREAM_URGENT_PERCENT 75
+#define STREAM_URGENT_MAX 2
+
+// Longest time data of a stream may wait for its packet to fill up before a shorter packet is sent.
+// 0 always waits for a full packet. A busy stream fills its packets well within this time.
+#define EEG_MAX_LATENCY_MS 0
+#define PPG_MAX_LATENCY_MS 200
+#define ACC_MAX_LATENCY_MS 200
+
+/**@brief Data streams forwarded from the Hearable to USB. */
+typedef enum
+{
+    STREAM_EEG,
+    STREAM_PPG,
+    STREAM_ACC,
+    STREAM_COUNT
+} stream_id_t;
+
+// The rings of all links share one pool; a ring is identified by its link and stream.
+#define RING_ID(link, stream) ((link)*STREAM_COUNT + (stream))
+#define RING_LINK(ring_id) ((ring_id)/STREAM_COUNT)
+#define RING_STREAM(ring_id) ((ring_id)%STREAM_COUNT)
+
+#if (DATA_PATH_LINK_MAX*STREAM_COUNT > PKTBUF_MAX_STREAMS)
+#error Too many streams for the packet pool.
+#endif
+
+/**@brief Ways of choosing the next stream to write. */
+typedef enum
+{
+    DATA_PATH_SCHED_WRR,    /**< The stream scheduler. */
+    DATA_PATH_SCHED_DRAIN   /**< Link by link, each stream drained before the next, EEG first: the loop the scheduler replaced, kept for comparison. */
+} data_path_sched_t;
+
+/**@brief Configuration of a data path. @ref data_path_cfg_default gives the one of the dongle. */
+typedef struct
+{
+    uint8_t           link_count;                       /**< Links, up to @ref DATA_PATH_LINK_MAX. */
+    uint8_t           frame_count;                      /**< Packets in the pool, up to @ref PKTBUF_MAX_FRAMES. */
+    uint16_t          frame_size;                       /**< Size of a packet, header included. */
+    uint8_t           reserved[STREAM_COUNT];           /**< Packets each stream of a link can always get. */
+    uint8_t           limit[STREAM_COUNT];              /**< Packets each stream of a link may hold at most. */
+    uint8_t           weight[STREAM_COUNT];             /**< Scheduler weight of each stream. */
+    uint16_t          max_latency_ms[STREAM_COUNT];     /**< Longest wait for a partial packet, 0 for none. */
+    uint8_t           urgent_percent;                   /**< Share of the packets it can reach making a stream urgent. */
+    uint8_t           urgent_max;                       /**< Urgent turns in a row before a turn of the round. */
+    data_path_sched_t sched;                            /**< How the next stream is chosen. */
+} data_path_cfg_t;
+
+/**@brief Counters of a stream kept on the USB side. The BLE side ones are kept by its ring. */
+typedef struct
+{
+    uint32_t packets_out;           /**< Packets written to the host. */
+    uint32_t bytes_out;             /**< Payload bytes written to the host. */
+    uint32_t usb_write_failures;    /**< Packets whose first write attempt was refused. */
+} data_path_stats_t;
+
+/**@brief USB packet waiting to be written, or being written. */
+typedef struct
+{
+    pktbuf_t      * p_ring;       /**< Ring owning the packet, or NULL for a packet queued with @ref data_path_tx_push. */
+    bool          * p_queued;     /**< Flag to clear once a packet not owned by a ring is written. */
+    uint8_t const * p_data;       /**< Packet including its header. */
+    uint16_t        len;          /**< Length of the packet including its header. */
+    uint16_t        payload_len;  /**< Length of the payload. */
+    bool            failed;       /**< A write of the packet was refused already. */
+} data_path_tx_entry_t;
+
+/**@brief Data path instance. */
+typedef struct
+{
+    data_path_cfg_t            cfg;                                                 /**< Configuration. */
+    app_usbd_cdc_acm_t const * p_cdc_acm;                                           /**< Port the packets are written to. */
+    pktbuf_pool_t              pool;                                                /**< Packet pool of all streams. */
+    pktbuf_t                   ring[DATA_PATH_LINK_MAX][STREAM_COUNT];              /**< Stream data waiting for USB. */
+    uint16_t                   seq[DATA_PATH_LINK_MAX][STREAM_COUNT];               /**< Sequence number of the next packet of each stream. */
+    uint16_t                   flush_elapsed_ms[DATA_PATH_LINK_MAX][STREAM_COUNT];  /**< Time since each stream was last checked for a partial packet. */
+    data_path_stats_t          stats[DATA_PATH_LINK_MAX][STREAM_COUNT];             /**< USB side counters of each stream. */
+    stream_sched_t             sched;                                               /**< Share of the USB writes of the streams of all links. */
+    data_path_tx_entry_t       tx_queue[DATA_PATH_TX_QUEUE_SIZE];                   /**< USB transmit queue. */
+    uint8_t                    tx_head;                                             /**< Index of the oldest queued packet. */
+    uint8_t                    tx_count;                                            /**< Number of queued packets. */
+    bool                       tx_in_flight;                                        /**< The head packet has been handed to the driver. */
+    usb_frame_format_t         format;                                              /**< Header format, applied from the next packet queued. */
+    volatile bool              records;                                             /**< Keep each notification whole, as a record, from the next one put. */
+} data_path_t;
+
+
+/**@brief Function for getting the configuration of the dongle, for a number of links.
+ *
+ * @param[out] p_cfg      Configuration.
+ * @param[in]  link_count Links.
+ */
+void data_path_cfg_default(data_path_cfg_t * p_cfg, uint8_t link_count);
+
+
+/**@brief Function for setting up a data path.
+ *
+ * @details The header format starts as version 2 with more than one link, version 1 otherwise,
+ *          and record mode off.
+ *
+ * @param[out] p_path       Data path instance.
+ * @param[in]  p_cfg        Configuration.
+ * @param[in]  p_storage    Pool storage of at least frame_count * frame_size bytes.
+ * @param[in]  storage_size Size of the pool storage.
+ * @param[in]  p_cdc_acm    Port to write the packets to.
+ *
+ * @retval NRF_SUCCESS             If the data path was set up.
+ * @retval NRF_ERROR_INVALID_PARAM If the configuration does not fit the storage, the pool or the links.
+ * @retval NRF_ERROR_NO_MEM        If the pool or the scheduler cannot take all streams.
+ */
+ret_code_t data_path_init(data_path_t                * p_path,
+                          data_path_cfg_t const      * p_cfg,
+                          uint8_t                    * p_storage,
+                          uint32_t                     storage_size,
+                          app_usbd_cdc_acm_t const   * p_cdc_acm);
+
+
+/**@brief Function for storing data of a stream, as a record when record mode is on.
+ *
+ * @param[in] p_path    Data path instance.
+ * @param[in] link      Link of the stream.
+ * @param[in] stream_id Stream of the data.
+ * @param[in] p_data    Data.
+ * @param[in] len       Length of the data.
+ * @param[in] timestamp Time the data arrived.
+ *
+ * @retval NRF_SUCCESS              If the data was stored.
+ * @retval NRF_ERROR_NO_MEM         If it was dropped for lack of packets.
+ * @retval NRF_ERROR_INVALID_LENGTH If a record does not fit in a packet.
+ */
+ret_code_t data_path_put(data_path_t * p_path, uint8_t link, uint8_t stream_id, uint8_t const * p_data, uint16_t len, uint32_t timestamp);
+
+
+/**@brief Function for discarding the data of every stream not queued for USB yet. Consumer side. */
+void data_path_flush(data_path_t * p_path);
+
+
+/**@brief Function for committing the partial packets of streams whose data has waited too long.
+ *        Called every @ref DATA_PATH_TICK_MS, from the consumer side.
+ *
+ * @details A partial packet is committed on the second check that finds it still open, so each
+ *          stream is checked every half of its maximum latency.
+ */
+void data_path_tick(data_path_t * p_path);
+
+
+/**@brief Function for checking whether the USB transmit queue has room for another packet. */
+bool data_path_tx_room(data_path_t const * p_path);
+
+
+/**@brief Function for queueing a packet that is not stream data, ahead of the stream packets
+ *        queued later.
+ *
+ * @details The header is written in front of the payload, which must be preceded by
+ *          @ref USB_FRAME_HEADER_MAX_LEN bytes of free space. The caller checks for room with
+ *          @ref data_path_tx_room first.
+ *
+ * @param[in] p_path    Data path instance.
+ * @param[in] p_info    Header fields.
+ * @param[in] p_payload Payload.
+ * @param[in] len       Length of the payload.
+ * @param[in] p_queued  Flag set until the packet is written, so its buffer is not rewritten meanwhile.
+ */
+void data_path_tx_push(data_path_t            * p_path,
+                       usb_frame_info_t const * p_info,
+                       uint8_t                * p_payload,
+                       uint16_t                 len,
+                       bool                   * p_queued);
+
+
+/**@brief Function for topping up the USB transmit queue with the packets of the streams whose
+ *        turn it is.
+ */
+void data_path_tx_fill(data_path_t * p_path);
+
+
+/**@brief Function for handing the head of the USB transmit queue to the driver.
+ *
+ * @details If the write is refused (port not open, endpoint busy) the packet stays at the head of
+ *          the queue and in its ring, and the write is retried on the next call.
+ */
+void data_path_tx_start(data_path_t * p_path);
+
+
+/**@brief Function for retiring the head packet once the host has taken it, on TX_DONE, and
+ *        starting the next.
+ */
+void data_path_tx_done(data_path_t * p_path);
+
+
+/**@brief Function for handling a write that was abandoned without TX_DONE (port closed, USB stopped).
+ *
+ * @details The packet is still queued and is written again once the host is back.
+ */
+void data_path_tx_abort(data_path_t * p_path);
+
+
+/**@brief Function for checking whether committed packets are still waiting or being written.
+ *
+ * @details A partial packet of a stream without a maximum latency waits for more data, so it does
+ *          not count.
+ */
+bool data_path_busy(data_path_t * p_path);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DATA_PATH_H__
+
+/** @} */
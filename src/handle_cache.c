@@ -0,0 +1,341 @@
+/**@file
+ *
+ * @brief GATT handle cache implementation.
+ */
+
+#include <string.h>
+#include "nordic_common.h"
+#include "app_util.h"
+#include "sdk_macros.h"
+#include "fds.h"
+#include "handle_cache.h"
+
+#define NRF_LOG_MODULE_NAME handle_cache
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+#define NO_RECORD   0       /**< record_id of a slot that has no record in flash. FDS never uses 0. */
+#define WRITE_TRIES 3       /**< Writes of an entry that FDS may fail before it is kept in RAM only. */
+
+
+/**@brief Entry as stored in flash. Its size is a whole number of words, as FDS requires. */
+typedef struct
+{
+    ble_gap_addr_t      peer_addr;                                  /**< Peer the handles were discovered on. */
+    uint8_t             rev_len;                                    /**< Length of rev. 0 if the slot is unused. */
+    uint8_t             rev[HANDLE_CACHE_REVISION_MAX_LEN];         /**< Revision of the peer's attribute database. */
+    uint16_t            layout;                                     /**< Descriptor table layout the handles are indexed by. */
+    uint16_t            reserved;                                   /**< Pads the entry to a whole number of words. */
+    ble_nus_c_handles_t handles;                                    /**< Handles found by discovery. */
+} cache_entry_t;
+
+STATIC_ASSERT(sizeof(cache_entry_t) % sizeof(uint32_t) == 0);
+
+/**@brief Slot of the RAM cache. */
+typedef struct
+{
+    cache_entry_t entry;            /**< Entry, as looked up. */
+    cache_entry_t flash_entry;      /**< Copy of the entry being written, read by FDS until the write is done. */
+    uint32_t      record_id;        /**< FDS record holding the entry, or @ref NO_RECORD. */
+    uint32_t      used;             /**< Value of m_use_count when the entry was last used. */
+    bool          write_pending;    /**< The entry still has to be written, once FDS is ready, has room again or is done with the previous write. */
+    bool          write_in_flight;  /**< FDS has queued a write of flash_entry and not reported it done. */
+    uint8_t       write_failures;   /**< Writes of the entry FDS reported as failed in a row. */
+} cache_slot_t;
+
+static cache_slot_t m_slots[HANDLE_CACHE_SIZE];
+static uint32_t     m_use_count;
+static uint16_t     m_layout;
+static bool         m_fds_ready;
+
+
+/**@brief Function for checking whether two peer addresses are the same. */
+static bool addr_equal(ble_gap_addr_t const * p_a, ble_gap_addr_t const * p_b)
+{
+    return (p_a->addr_type == p_b->addr_type) && (memcmp(p_a->addr, p_b->addr, BLE_GAP_ADDR_LEN) == 0);
+}
+
+
+/**@brief Function for writing the entry of a slot to flash.
+ *
+ * @details The write is queued by FDS and reads its source when it is carried out, so it is made
+ *          from a copy of the entry that is left alone until FDS reports the write as done. An
+ *          entry changed meanwhile is written once that report comes in. A write that does not
+ *          fit is retried after garbage collection.
+ */
+static void slot_write(uint8_t idx)
+{
+    cache_slot_t    * p_slot = &m_slots[idx];
+    fds_record_desc_t desc   = {0};
+    fds_record_t      record =
+    {
+        .file_id           = HANDLE_CACHE_FILE_ID,
+        .key               = idx + 1,
+        .data.p_data       = &p_slot->flash_entry,
+        .data.length_words = BYTES_TO_WORDS(sizeof(cache_entry_t)),
+    };
+    ret_code_t        err_code;
+
+    if (!m_fds_ready || p_slot->write_in_flight)
+    {
+        p_slot->write_pending = true;
+        return;
+    }
+    p_slot->flash_entry = p_slot->entry;
+
+    if (p_slot->record_id != NO_RECORD)
+    {
+        desc.record_id = p_slot->record_id;
+        err_code = fds_record_update(&desc, &record);
+    }
+    else
+    {
+        err_code = fds_record_write(&desc, &record);
+    }
+
+    p_slot->write_pending = false;
+    switch (err_code)
+    {
+        case NRF_SUCCESS:
+            // record_id follows once the write is done: a failed update leaves the old record.
+            p_slot->write_in_flight = true;
+            break;
+
+        case FDS_ERR_NO_SPACE_IN_FLASH:
+            p_slot->write_pending = true;
+            (void)fds_gc();
+            break;
+
+        default:
+            // The entry stays usable from RAM until the next reset.
+            NRF_LOG_WARNING("Flash write failed, error 0x%x.", err_code);
+            break;
+    }
+}
+
+
+/**@brief Function for loading the entries stored in flash into the RAM cache. */
+static void slots_load(void)
+{
+    fds_record_desc_t desc  = {0};
+    fds_find_token_t  token = {0};
+    fds_flash_record_t record;
+    uint8_t            loaded = 0;
+
+    while (fds_record_find_in_file(HANDLE_CACHE_FILE_ID, &desc, &token) == NRF_SUCCESS)
+    {
+        if (fds_record_open(&desc, &record) != NRF_SUCCESS)
+        {
+            continue;
+        }
+
+        uint16_t key = record.p_header->record_key;
+
+        // A slot already filled since reset holds newer handles than flash.
+        if ((key >= 1) && (key <= HANDLE_CACHE_SIZE)
+                && (record.p_header->length_words == BYTES_TO_WORDS(sizeof(cache_entry_t)))
+                && (m_slots[key - 1].entry.rev_len == 0))
+        {
+            cache_slot_t * p_slot = &m_slots[key - 1];
+
+            memcpy(&p_slot->entry, record.p_data, sizeof(cache_entry_t));
+            p_slot->record_id = desc.record_id;
+            loaded++;
+        }
+
+        (void)fds_record_close(&desc);
+    }
+
+    NRF_LOG_INFO("%d peers loaded.", loaded);
+}
+
+
+/**@brief Function for writing every slot whose entry still has to be written. */
+static void slots_write_pending(void)
+{
+    for (uint8_t i = 0; i < HANDLE_CACHE_SIZE; i++)
+    {
+        if (m_slots[i].write_pending)
+        {
+            slot_write(i);
+        }
+    }
+}
+
+
+/**@brief Function for handling the end of a write or update of a slot's record. */
+static void on_write_done(fds_evt_t const * p_evt)
+{
+    uint16_t       key = p_evt->write.record_key;
+    cache_slot_t * p_slot;
+
+    if ((p_evt->write.file_id != HANDLE_CACHE_FILE_ID) || (key < 1) || (key > HANDLE_CACHE_SIZE))
+    {
+        return;
+    }
+    p_slot = &m_slots[key - 1];
+    p_slot->write_in_flight = false;
+
+    if (p_evt->result == NRF_SUCCESS)
+    {
+        p_slot->record_id      = p_evt->write.record_id;
+        p_slot->write_failures = 0;
+    }
+    else if (++p_slot->write_failures < WRITE_TRIES)
+    {
+        // Tried again once garbage collection has made room, which may be what it lacked.
+        NRF_LOG_WARNING("Flash write of slot %d failed, error 0x%x.", key - 1, p_evt->result);
+        p_slot->write_pending = true;
+        (void)fds_gc();
+        return;
+    }
+    else
+    {
+        // The entry stays usable from RAM until the next reset.
+        NRF_LOG_WARNING("Flash write of slot %d failed, error 0x%x. Given up.", key - 1, p_evt->result);
+        p_slot->write_failures = 0;
+    }
+
+    // The entry changed while its previous version was being written.
+    if (p_slot->write_pending)
+    {
+        slot_write(key - 1);
+    }
+}
+
+
+/**@brief Function for handling FDS events. */
+static void fds_evt_handler(fds_evt_t const * p_evt)
+{
+    switch (p_evt->id)
+    {
+        case FDS_EVT_INIT:
+            if (p_evt->result != NRF_SUCCESS)
+            {
+                NRF_LOG_WARNING("FDS init failed, error 0x%x. Handles are kept in RAM only.", p_evt->result);
+                break;
+            }
+            m_fds_ready = true;
+            slots_load();
+            // Entries stored before FDS was ready.
+            slots_write_pending();
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            on_write_done(p_evt);
+            break;
+
+        case FDS_EVT_GC:
+            slots_write_pending();
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+ret_code_t handle_cache_init(uint16_t layout)
+{
+    ret_code_t err_code;
+
+    memset(m_slots, 0, sizeof(m_slots));
+    m_use_count = 0;
+    m_layout    = layout;
+    m_fds_ready = false;
+
+    err_code = fds_register(fds_evt_handler);
+    VERIFY_SUCCESS(err_code);
+
+    return fds_init();
+}
+
+
+bool handle_cache_find(ble_gap_addr_t const * p_addr,
+                       uint8_t const        * p_rev,
+                       uint8_t                rev_len,
+                       ble_nus_c_handles_t  * p_handles)
+{
+    for (uint8_t i = 0; i < HANDLE_CACHE_SIZE; i++)
+    {
+        cache_entry_t const * p_entry = &m_slots[i].entry;
+
+        if ((p_entry->rev_len != 0) && addr_equal(&p_entry->peer_addr, p_addr))
+        {
+            if ((rev_len == 0)
+                    || (p_entry->layout != m_layout)
+                    || (p_entry->rev_len != rev_len)
+                    || (memcmp(p_entry->rev, p_rev, rev_len) != 0))
+            {
+                return false;
+            }
+
+            m_slots[i].used = ++m_use_count;
+            *p_handles = p_entry->handles;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void handle_cache_store(ble_gap_addr_t const      * p_addr,
+                        uint8_t const             * p_rev,
+                        uint8_t                     rev_len,
+                        ble_nus_c_handles_t const * p_handles)
+{
+    uint8_t idx = 0;
+
+    if ((rev_len == 0) || (rev_len > HANDLE_CACHE_REVISION_MAX_LEN))
+    {
+        return;
+    }
+
+    // The slot of the same peer, else a free one, else the least recently used one.
+    for (uint8_t i = 0; i < HANDLE_CACHE_SIZE; i++)
+    {
+        cache_entry_t const * p_entry = &m_slots[i].entry;
+
+        if ((p_entry->rev_len != 0) && addr_equal(&p_entry->peer_addr, p_addr))
+        {
+            idx = i;
+            break;
+        }
+        if ((m_slots[idx].entry.rev_len != 0)
+                && ((p_entry->rev_len == 0) || (m_slots[i].used < m_slots[idx].used)))
+        {
+            idx = i;
+        }
+    }
+
+    cache_entry_t * p_entry = &m_slots[idx].entry;
+
+    memset(p_entry, 0, sizeof(cache_entry_t));
+    p_entry->peer_addr = *p_addr;
+    p_entry->rev_len   = rev_len;
+    memcpy(p_entry->rev, p_rev, rev_len);
+    p_entry->layout    = m_layout;
+    p_entry->handles   = *p_handles;
+    m_slots[idx].used  = ++m_use_count;
+
+    slot_write(idx);
+}
+
+
+void handle_cache_remove(ble_gap_addr_t const * p_addr)
+{
+    for (uint8_t i = 0; i < HANDLE_CACHE_SIZE; i++)
+    {
+        cache_entry_t * p_entry = &m_slots[i].entry;
+
+        if ((p_entry->rev_len != 0) && addr_equal(&p_entry->peer_addr, p_addr))
+        {
+            // An unused entry takes the place of the record, so the slot stays empty after a reset.
+            memset(p_entry, 0, sizeof(cache_entry_t));
+            slot_write(i);
+            return;
+        }
+    }
+}
@@ -0,0 +1,98 @@
+/**@file
+ *
+ * @defgroup handle_cache GATT handle cache
+ * @{
+ *
+ * @brief    Handles of the characteristics of known Hearables, kept across connections and resets.
+ *
+ * @details  Service discovery takes one ATT round trip per service, characteristic and descriptor
+ *           before any data can flow, which dominates the time from a reconnect to the first
+ *           sample. The handles found by discovery are therefore kept per peer address, in RAM
+ *           and in flash through FDS, and are reused on the next connection to the same peer.
+ *
+ *           Every entry carries the revision the peer reported for its attribute database (its
+ *           Database Hash, or failing that its firmware revision string) and the layout of the
+ *           descriptor table the handles are indexed by. An entry is only used while both still
+ *           match, so a peer whose database changed is discovered again.
+ *
+ *           The functions must be called from the BLE event context, which is also where the FDS
+ *           events are delivered.
+ */
+
+#ifndef HANDLE_CACHE_H__
+#define HANDLE_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+#include "ble_gap.h"
+#include "ble_nus_c.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HANDLE_CACHE_SIZE               4       /**< Peers whose handles are kept. The least recently used one is replaced. */
+#define HANDLE_CACHE_REVISION_MAX_LEN   20      /**< Longest revision value kept, in bytes. */
+#define HANDLE_CACHE_FILE_ID            0x4843  /**< FDS file holding the entries, one record per slot. */
+
+
+/**@brief Function for initializing the cache and starting to load it from flash.
+ *
+ * @details Must be called once the SoftDevice is enabled. Entries become available once FDS has
+ *          finished initializing; until then every lookup misses.
+ *
+ * @param[in] layout Identifier of the descriptor table layout, such as a CRC of the table.
+ *                   Entries stored with another layout are never used.
+ *
+ * @retval NRF_SUCCESS If FDS initialization was started. Otherwise the FDS error is returned.
+ */
+ret_code_t handle_cache_init(uint16_t layout);
+
+
+/**@brief Function for looking up the handles of a peer.
+ *
+ * @param[in]  p_addr    Peer address.
+ * @param[in]  p_rev     Revision the peer reports for its attribute database.
+ * @param[in]  rev_len   Length of the revision. 0 never matches.
+ * @param[out] p_handles Cached handles, if found.
+ *
+ * @return true if the peer is cached with the same revision and layout.
+ */
+bool handle_cache_find(ble_gap_addr_t const * p_addr,
+                       uint8_t const        * p_rev,
+                       uint8_t                rev_len,
+                       ble_nus_c_handles_t  * p_handles);
+
+
+/**@brief Function for storing the handles discovered on a peer, in RAM and in flash.
+ *
+ * @param[in] p_addr    Peer address.
+ * @param[in] p_rev     Revision the peer reports for its attribute database.
+ * @param[in] rev_len   Length of the revision, at most @ref HANDLE_CACHE_REVISION_MAX_LEN.
+ * @param[in] p_handles Handles found by discovery.
+ */
+void handle_cache_store(ble_gap_addr_t const      * p_addr,
+                        uint8_t const             * p_rev,
+                        uint8_t                     rev_len,
+                        ble_nus_c_handles_t const * p_handles);
+
+
+/**@brief Function for dropping the handles of a peer, in RAM and in flash, so that the next
+ *        connection to it discovers its database.
+ *
+ * @details For handles that turned out stale although the revision matched, such as on a peer
+ *          whose database changed without a new revision.
+ *
+ * @param[in] p_addr Peer address.
+ */
+void handle_cache_remove(ble_gap_addr_t const * p_addr);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HANDLE_CACHE_H__
+
+/** @} */
@@ -0,0 +1,175 @@
+/**@file
+ *
+ * @brief Hearable GATT database implementation.
+ */
+
+#include <string.h>
+#include "nordic_common.h"
+#include "app_util.h"
+#include "sdk_macros.h"
+#include "data_path.h"
+#include "hearable_gatt.h"
+
+#define NRF_LOG_MODULE_NAME hearable_gatt
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+ble_nus_c_char_desc_t const hearable_gatt_chars[] =
+{
+    // Service                             Characteristic                          SIG    Role                   Stream               CCCD
+    {BLE_UUID_EEG_NUS_SERVICE,            BLE_UUID_NUS_EEG_TX_CHARACTERISTIC,     false, BLE_NUS_C_CHAR_NOTIFY, STREAM_EEG,          true},
+    {BLE_UUID_EEG_NUS_SERVICE,            BLE_UUID_NUS_EEG_RX_CHARACTERISTIC,     false, BLE_NUS_C_CHAR_WRITE,  BLE_NUS_C_NO_STREAM, false},
+    {BLE_UUID_PPG_NUS_SERVICE,            BLE_UUID_NUS_PPG_TX_CHARACTERISTIC,     false, BLE_NUS_C_CHAR_NOTIFY, STREAM_PPG,          true},
+    {BLE_UUID_PPG_NUS_SERVICE,            BLE_UUID_NUS_PPG_RX_CHARACTERISTIC,     false, BLE_NUS_C_CHAR_WRITE,  BLE_NUS_C_NO_STREAM, false},
+    {BLE_UUID_ACC_NUS_SERVICE,            BLE_UUID_NUS_ACC_TX_CHARACTERISTIC,     false, BLE_NUS_C_CHAR_NOTIFY, STREAM_ACC,          true},
+    {BLE_UUID_ACC_NUS_SERVICE,            BLE_UUID_NUS_ACC_RX_CHARACTERISTIC,     false, BLE_NUS_C_CHAR_WRITE,  BLE_NUS_C_NO_STREAM, false},
+    {BLE_UUID_DEV_NUS_SERVICE,            BLE_UUID_DEV_STATUS_TX_CHARACTERISTIC,  false, BLE_NUS_C_CHAR_NOTIFY, BLE_NUS_C_NO_STREAM, false},
+    {BLE_UUID_DEV_NUS_SERVICE,            BLE_UUID_DEV_CTRL_RX_CHARACTERISTIC,    false, BLE_NUS_C_CHAR_WRITE,  BLE_NUS_C_NO_STREAM, false},
+    {BLE_UUID_DEV_NUS_SERVICE,            BLE_UUID_DEV_TSTART_TX_CHARACTERISTIC,  false, BLE_NUS_C_CHAR_NOTIFY, BLE_NUS_C_NO_STREAM, true},
+    {BLE_UUID_DEVICE_INFORMATION_SERVICE, BLE_UUID_HARDWARE_REVISION_STRING_CHAR, true,  BLE_NUS_C_CHAR_READ,   BLE_NUS_C_NO_STREAM, false},
+};
+
+uint8_t const hearable_gatt_char_count = ARRAY_SIZE(hearable_gatt_chars);
+
+/**@brief Characteristics read to tell whether the cached handles of a Hearable still hold, best
+ *        first. The first one the Hearable has is the revision of its database.
+ */
+static uint16_t const m_revision_uuids[] = {BLE_UUID_DATABASE_HASH_CHAR, BLE_UUID_FIRMWARE_REVISION_STRING_CHAR};
+
+
+/**@brief Function for reading the next revision characteristic of a link, or for ending the read
+ *        once there is none left to read.
+ */
+static void rev_read_next(hearable_gatt_rev_t * p_rev)
+{
+    if ((p_rev->len == 0) && (p_rev->step < ARRAY_SIZE(m_revision_uuids)))
+    {
+        ble_uuid_t const               uuid  = {.uuid = m_revision_uuids[p_rev->step], .type = BLE_UUID_TYPE_BLE};
+        ble_gattc_handle_range_t const range = {.start_handle = 0x0001, .end_handle = 0xFFFF};
+        uint32_t                       err_code;
+
+        err_code = sd_ble_gattc_char_value_by_uuid_read(p_rev->conn_handle, &uuid, &range);
+        if (err_code == NRF_SUCCESS)
+        {
+            p_rev->reading = true;
+            return;
+        }
+        if (err_code == NRF_ERROR_BUSY)
+        {
+            // Retried once a GATT client procedure of the link completes.
+            p_rev->busy = true;
+            return;
+        }
+        // Without a revision the Hearable is simply discovered.
+        NRF_LOG_WARNING("Revision read failed, error 0x%x.", err_code);
+    }
+
+    p_rev->done(p_rev);
+}
+
+
+/**@brief Function for handling the response to a revision read. */
+static void rev_on_read_rsp(hearable_gatt_rev_t * p_rev, ble_gattc_evt_t const * p_gattc_evt)
+{
+    ble_gattc_evt_char_val_by_uuid_read_rsp_t const * p_rsp = &p_gattc_evt->params.char_val_by_uuid_read_rsp;
+    // The iterator starts from a zeroed pair.
+    ble_gattc_handle_value_t                          value = {0};
+
+    p_rev->reading = false;
+    if ((p_gattc_evt->gatt_status == BLE_GATT_STATUS_SUCCESS)
+            && (sd_ble_gattc_evt_char_val_by_uuid_read_rsp_iter((ble_gattc_evt_t *)p_gattc_evt, &value) == NRF_SUCCESS))
+    {
+        p_rev->len = (uint8_t)MIN(p_rsp->value_len, sizeof(p_rev->value));
+        memcpy(p_rev->value, value.p_value, p_rev->len);
+    }
+    else
+    {
+        // Typically attribute not found: try the next revision characteristic.
+        p_rev->step++;
+    }
+
+    rev_read_next(p_rev);
+}
+
+
+void hearable_gatt_rev_read(hearable_gatt_rev_t * p_rev, uint16_t conn_handle, hearable_gatt_rev_done_t done)
+{
+    memset(p_rev, 0, sizeof(*p_rev));
+    p_rev->conn_handle = conn_handle;
+    p_rev->done        = done;
+    rev_read_next(p_rev);
+}
+
+
+void hearable_gatt_rev_on_ble_evt(hearable_gatt_rev_t * p_rev, ble_evt_t const * p_ble_evt)
+{
+    uint16_t evt_id = p_ble_evt->header.evt_id;
+
+    if ((evt_id < BLE_GATTC_EVT_BASE) || (evt_id > BLE_GATTC_EVT_LAST)
+            || (p_ble_evt->evt.gattc_evt.conn_handle != p_rev->conn_handle))
+    {
+        return;
+    }
+
+    if ((evt_id == BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP) && p_rev->reading)
+    {
+        rev_on_read_rsp(p_rev, &p_ble_evt->evt.gattc_evt);
+    }
+    else if (p_rev->busy && (evt_id != BLE_GATTC_EVT_TIMEOUT))
+    {
+        // Any other GATT client event, such as the ATT MTU exchange response, ends the procedure
+        // that kept the read busy. A timeout disconnects instead.
+        p_rev->busy = false;
+        rev_read_next(p_rev);
+    }
+}
+
+
+ret_code_t hearable_gatt_handles_get(hearable_gatt_rev_t const * p_rev,
+                                     ble_gap_addr_t const      * p_addr,
+                                     ble_nus_c_t               * p_ble_nus_c,
+                                     ble_db_discovery_t        * p_db_disc,
+                                     bool                      * p_cached)
+{
+    ble_nus_c_handles_t handles;
+
+    *p_cached = handle_cache_find(p_addr, p_rev->value, p_rev->len, &handles);
+    if (*p_cached)
+    {
+        NRF_LOG_INFO("Handles cached, discovery skipped.");
+        return ble_nus_c_handles_assign(p_ble_nus_c, p_rev->conn_handle, &handles);
+    }
+    // The NUS client waits for the discovery result.
+    return ble_db_discovery_start(p_db_disc, p_rev->conn_handle);
+}
+
+
+bool hearable_gatt_status_stale(uint16_t gatt_status)
+{
+    switch (gatt_status)
+    {
+        case BLE_GATT_STATUS_ATTERR_INVALID_HANDLE:
+        case BLE_GATT_STATUS_ATTERR_READ_NOT_PERMITTED:
+        case BLE_GATT_STATUS_ATTERR_WRITE_NOT_PERMITTED:
+        case BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+ret_code_t hearable_gatt_handles_rediscover(ble_gap_addr_t const * p_addr,
+                                            ble_nus_c_t          * p_ble_nus_c,
+                                            ble_db_discovery_t   * p_db_disc)
+{
+    uint16_t   conn_handle = p_ble_nus_c->conn_handle;
+    ret_code_t err_code;
+
+    NRF_LOG_WARNING("Cached handles stale, discovering.");
+    handle_cache_remove(p_addr);
+    err_code = ble_nus_c_handles_assign(p_ble_nus_c, conn_handle, NULL);
+    VERIFY_SUCCESS(err_code);
+    return ble_db_discovery_start(p_db_disc, conn_handle);
+}
@@ -0,0 +1,137 @@
+/**@file
+ *
+ * @defgroup hearable_gatt Hearable GATT database
+ * @{
+ *
+ * @brief    What the dongle uses of the attribute database of a Hearable, and the read of its
+ *           revision on connection.
+ *
+ * @details  @ref hearable_gatt_chars lists the characteristics of a Hearable for the NUS client.
+ *
+ *           The revision of the database tells whether the handles cached for a Hearable still
+ *           hold. It is read by UUID: the Database Hash, or failing that the firmware revision
+ *           string of the Device Information Service. A link runs one GATT client procedure at a
+ *           time, so the read is refused while another one runs, typically the ATT MTU exchange
+ *           started on connection; it is then retried on the next GATT client event of the link.
+ *
+ *           Once the revision is read, the handles cached for the Hearable are used if its
+ *           revision still matches, otherwise its database is discovered. A Hearable whose database
+ *           changed without a new revision answers the first request on the cached handles with an
+ *           ATT error; its entry is then dropped and its database discovered after all.
+ *
+ *           The functions must be called from the BLE event context.
+ */
+
+#ifndef HEARABLE_GATT_H__
+#define HEARABLE_GATT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "ble_nus_c.h"
+#include "handle_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLE_UUID_DATABASE_HASH_CHAR 0x2B2A  /**< GATT Database Hash characteristic, not in the SoftDevice headers. */
+
+/**@brief Characteristics of a Hearable. They drive discovery, notification enable and dispatch; a
+ *        characteristic the Hearable lacks only disables what depends on it. A new stream needs its
+ *        notifying characteristic here, with its stream id, plus its entry in the stream arrays of
+ *        src/main.c.
+ */
+extern ble_nus_c_char_desc_t const hearable_gatt_chars[];
+
+/**@brief Number of entries in @ref hearable_gatt_chars. */
+extern uint8_t const hearable_gatt_char_count;
+
+// Forward declaration of the hearable_gatt_rev_t type.
+typedef struct hearable_gatt_rev_s hearable_gatt_rev_t;
+
+/**@brief Called once the revision read of a link is over, found or not. */
+typedef void (* hearable_gatt_rev_done_t)(hearable_gatt_rev_t * p_rev);
+
+/**@brief Revision read of a link. */
+struct hearable_gatt_rev_s
+{
+    uint16_t                 conn_handle;   /**< Link the revision is read on. */
+    hearable_gatt_rev_done_t done;          /**< Called once the read is over. */
+    uint8_t                  step;          /**< Index of the revision characteristic being read. */
+    bool                     reading;       /**< A read was taken by the SoftDevice and awaits its response. */
+    bool                     busy;          /**< The read was refused while another GATT client procedure ran. */
+    uint8_t                  len;           /**< Length of value, 0 if the Hearable reported none. */
+    uint8_t                  value[HANDLE_CACHE_REVISION_MAX_LEN];  /**< Revision of the Hearable's database. */
+};
+
+
+/**@brief Function for starting the revision read of a link that has just connected.
+ *
+ * @param[out] p_rev       Revision read of the link.
+ * @param[in]  conn_handle Connection handle of the link.
+ * @param[in]  done        Called once the read is over, possibly from this function.
+ */
+void hearable_gatt_rev_read(hearable_gatt_rev_t * p_rev, uint16_t conn_handle, hearable_gatt_rev_done_t done);
+
+
+/**@brief Function for handling the BLE events of the link of a revision read.
+ *
+ * @param[in] p_rev     Revision read of the link.
+ * @param[in] p_ble_evt BLE event.
+ */
+void hearable_gatt_rev_on_ble_evt(hearable_gatt_rev_t * p_rev, ble_evt_t const * p_ble_evt);
+
+
+/**@brief Function for giving a link the handles of its Hearable once its revision is read.
+ *
+ * @param[in]  p_rev       Revision read of the link, over.
+ * @param[in]  p_addr      Address of the Hearable.
+ * @param[in]  p_ble_nus_c NUS client of the link.
+ * @param[in]  p_db_disc   Database discovery instance of the link.
+ * @param[out] p_cached    Whether the cached handles were assigned. Otherwise the handles come
+ *                         with the discovery events.
+ *
+ * @retval NRF_SUCCESS If the cached handles were assigned or the discovery was started. Otherwise
+ *                     the error of the assignment or of the discovery start is returned.
+ */
+ret_code_t hearable_gatt_handles_get(hearable_gatt_rev_t const * p_rev,
+                                     ble_gap_addr_t const      * p_addr,
+                                     ble_nus_c_t               * p_ble_nus_c,
+                                     ble_db_discovery_t        * p_db_disc,
+                                     bool                      * p_cached);
+
+
+/**@brief Function for telling whether the status of a request on cached handles shows them stale.
+ *
+ * @details The attribute is missing or is not the one cached: its handle is invalid, or it takes
+ *          neither the access nor the length of the request.
+ *
+ * @param[in] gatt_status Status of the response.
+ */
+bool hearable_gatt_status_stale(uint16_t gatt_status);
+
+
+/**@brief Function for discovering the database of a Hearable whose cached handles are stale.
+ *
+ * @details The entry of the Hearable is dropped from the cache, and the handles of the NUS client
+ *          cleared along with the requests queued on them, before the discovery starts.
+ *
+ * @param[in] p_addr      Address of the Hearable.
+ * @param[in] p_ble_nus_c NUS client of the link.
+ * @param[in] p_db_disc   Database discovery instance of the link.
+ *
+ * @retval NRF_SUCCESS If the discovery was started. Otherwise the error of its start is returned.
+ */
+ret_code_t hearable_gatt_handles_rediscover(ble_gap_addr_t const * p_addr,
+                                            ble_nus_c_t          * p_ble_nus_c,
+                                            ble_db_discovery_t   * p_db_disc);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEARABLE_GATT_H__
+
+/** @} */
@@ -0,0 +1,143 @@
+/**@file
+ *
+ * @brief Host command framing implementation.
+ */
+
+#include <string.h>
+#include "app_util.h"
+#include "crc16.h"
+#include "host_cmd.h"
+
+#define MAGIC_FIRST ((uint8_t)(HOST_CMD_MAGIC & 0xFF))     /**< First byte of a binary command. */
+#define MAGIC_SECOND ((uint8_t)(HOST_CMD_MAGIC >> 8))      /**< Second byte of a binary command. */
+
+
+/**@brief Function for passing a binary command, or its framing error, to the handler. */
+static void frame_report(host_cmd_parser_t * p_parser, host_cmd_status_t status, uint16_t payload_len)
+{
+    host_cmd_t cmd =
+    {
+        .binary = true,
+        .status = status,
+        .type   = p_parser->buf[2],
+        .req_id = p_parser->buf[3],
+        .p_data = &p_parser->buf[HOST_CMD_HEADER_LEN],
+        .len    = payload_len,
+    };
+
+    p_parser->handler(&cmd);
+}
+
+
+/**@brief Function for dropping the command being received up to the next magic in it.
+ *
+ * @details Its bytes after the first one may start a real frame, so they are scanned again.
+ */
+static void resync(host_cmd_parser_t * p_parser)
+{
+    uint16_t skip = 1;
+
+    while ((skip < p_parser->len) && (p_parser->buf[skip] != MAGIC_FIRST))
+    {
+        skip++;
+    }
+    p_parser->len -= skip;
+    memmove(p_parser->buf, &p_parser->buf[skip], p_parser->len);
+
+    // What is left was a header in progress; it cannot be a whole frame yet, but may be a bad one.
+    if ((p_parser->len >= 2) && (p_parser->buf[1] != MAGIC_SECOND))
+    {
+        resync(p_parser);
+    }
+}
+
+
+/**@brief Function for handling a byte added to a binary command. */
+static void frame_byte(host_cmd_parser_t * p_parser)
+{
+    uint16_t payload_len;
+    uint16_t crc;
+
+    if (p_parser->len == 2)
+    {
+        if (p_parser->buf[1] != MAGIC_SECOND)
+        {
+            resync(p_parser);
+        }
+        return;
+    }
+    if (p_parser->len < HOST_CMD_HEADER_LEN)
+    {
+        return;
+    }
+
+    payload_len = uint16_decode(&p_parser->buf[4]);
+    if (payload_len > HOST_CMD_PAYLOAD_MAX)
+    {
+        frame_report(p_parser, HOST_CMD_STATUS_BAD_LENGTH, 0);
+        resync(p_parser);
+        return;
+    }
+    if (p_parser->len < HOST_CMD_HEADER_LEN + payload_len + HOST_CMD_CRC_LEN)
+    {
+        return;
+    }
+
+    crc = crc16_compute(p_parser->buf, HOST_CMD_HEADER_LEN + payload_len, NULL);
+    if (crc == uint16_decode(&p_parser->buf[HOST_CMD_HEADER_LEN + payload_len]))
+    {
+        frame_report(p_parser, HOST_CMD_STATUS_OK, payload_len);
+    }
+    else
+    {
+        frame_report(p_parser, HOST_CMD_STATUS_BAD_CRC, 0);
+    }
+    p_parser->len = 0;
+}
+
+
+/**@brief Function for handling a byte added to an ASCII command line. */
+static void line_byte(host_cmd_parser_t * p_parser)
+{
+    uint8_t    last = p_parser->buf[p_parser->len - 1];
+    bool       end  = (last == '\r') || (last == '\n');
+    host_cmd_t cmd  = {.binary = false, .status = HOST_CMD_STATUS_OK, .p_data = p_parser->buf};
+
+    if (!end && (p_parser->len < HOST_CMD_LINE_MAX))
+    {
+        return;
+    }
+
+    cmd.len = end ? (p_parser->len - 1) : p_parser->len;
+    // The "\r\n" of a terminal ends a line and then an empty one.
+    if (cmd.len > 0)
+    {
+        p_parser->handler(&cmd);
+    }
+    p_parser->len = 0;
+}
+
+
+void host_cmd_parser_init(host_cmd_parser_t * p_parser, host_cmd_handler_t handler)
+{
+    p_parser->handler = handler;
+    p_parser->len     = 0;
+}
+
+
+void host_cmd_parse(host_cmd_parser_t * p_parser, uint8_t const * p_data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        p_parser->buf[p_parser->len++] = p_data[i];
+
+        if (p_parser->buf[0] == MAGIC_FIRST)
+        {
+            frame_byte(p_parser);
+        }
+        else
+        {
+            line_byte(p_parser);
+        }
+    }
+}
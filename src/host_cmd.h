@@ -0,0 +1,129 @@
+/**@file
+ *
+ * @defgroup host_cmd Host command framing
+ * @{
+ *
+ * @brief    Splits the bytes received from the host into commands.
+ *
+ * @details  Two kinds of command share the CDC ACM port, told apart by their first byte.
+ *
+ *           Binary commands are frames, all fields little endian:
+ *           | Offset | Size | Field                                                         |
+ *           | 0      | 2    | Magic, @ref HOST_CMD_MAGIC                                    |
+ *           | 2      | 1    | Command type, @ref host_cmd_type_t                            |
+ *           | 3      | 1    | Request id, echoed in the response                            |
+ *           | 4      | 2    | Payload length, at most @ref HOST_CMD_PAYLOAD_MAX             |
+ *           | 6      | n    | Payload                                                       |
+ *           | 6 + n  | 2    | CRC-16/CCITT-FALSE of bytes 0 to 5 followed by the payload    |
+ *
+ *           The payload is binary, so configuration bytes may take any value, and a configuration
+ *           may be longer than one write to a Hearable: the dongle splits it into write commands
+ *           of ATT MTU - 3 bytes. Every frame is answered, in order, by a response packet carrying
+ *           the type, the request id and a @ref host_cmd_status_t, so the host may send several
+ *           frames without waiting.
+ *
+ *           Anything else is an ASCII command line ending in '\r' or '\n', as sent by a
+ *           terminal, and gets no response. A line longer than @ref HOST_CMD_LINE_MAX is cut
+ *           into several.
+ *
+ *           A frame whose header does not hold a valid length is dropped up to the next magic,
+ *           after its error is reported. A frame with a bad CRC is reported and dropped.
+ */
+
+#ifndef HOST_CMD_H__
+#define HOST_CMD_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_CMD_MAGIC          0x5CC5  /**< First field of a binary command, sent as 0xC5 0x5C. */
+#define HOST_CMD_HEADER_LEN     6       /**< Length of the header of a binary command. */
+#define HOST_CMD_CRC_LEN        2       /**< Length of the CRC closing a binary command. */
+#define HOST_CMD_PAYLOAD_MAX    256     /**< Longest payload of a binary command: the longest Hearable configuration. */
+#define HOST_CMD_LINE_MAX       64      /**< Longest ASCII command line. */
+#define HOST_CMD_BUF_LEN        (HOST_CMD_HEADER_LEN + HOST_CMD_PAYLOAD_MAX + HOST_CMD_CRC_LEN)
+
+/**@brief Binary command types. */
+typedef enum
+{
+    HOST_CMD_TYPE_START      = 0x01,    /**< Start streaming. No payload. */
+    HOST_CMD_TYPE_STOP       = 0x02,    /**< Stop streaming. No payload. */
+    HOST_CMD_TYPE_FORMAT     = 0x03,    /**< Select the USB frame format. Payload: format (uint8, 1 or 2). */
+    HOST_CMD_TYPE_RECORDS    = 0x04,    /**< Record mode. Payload: on (uint8, 0 or 1). */
+    HOST_CMD_TYPE_STATS      = 0x05,    /**< Send a STAT packet now. No payload. */
+    HOST_CMD_TYPE_UNAME      = 0x06,    /**< Read the hardware names. No payload. */
+    HOST_CMD_TYPE_CONFIG_EEG = 0x07,    /**< EEG configuration. Payload: the configuration. */
+    HOST_CMD_TYPE_CONFIG_PPG = 0x08,    /**< PPG configuration. Payload: the configuration. */
+    HOST_CMD_TYPE_CONFIG_ACC = 0x09,    /**< ACC configuration. Payload: the configuration. */
+    HOST_CMD_TYPE_PING       = 0x0A,    /**< Answered at once with its payload, for round trip timing. */
+    HOST_CMD_TYPE_BENCH      = 0x0B,    /**< Loopback benchmark. Payload: on (uint8), optionally followed by
+                                             the chunk length (uint16) and the rate in bytes/s (uint32, 0 as fast as possible). */
+} host_cmd_type_t;
+
+/**@brief Statuses of a response. */
+typedef enum
+{
+    HOST_CMD_STATUS_OK            = 0x00,   /**< Command carried out, or queued to every connected Hearable. */
+    HOST_CMD_STATUS_BAD_CRC       = 0x01,   /**< CRC mismatch. The command was dropped. */
+    HOST_CMD_STATUS_BAD_LENGTH    = 0x02,   /**< Payload length invalid for the command. */
+    HOST_CMD_STATUS_UNKNOWN       = 0x03,   /**< Unknown command type. */
+    HOST_CMD_STATUS_NOT_CONNECTED = 0x04,   /**< No Hearable can take the command. */
+    HOST_CMD_STATUS_QUEUE_FULL    = 0x05,   /**< A Hearable's queue stayed full through every retry, or the dongle's queue was full. */
+    HOST_CMD_STATUS_FAILED        = 0x06,   /**< Any other error. */
+    HOST_CMD_STATUS_BUSY          = 0x07,   /**< What the command needs is in use, such as the bench link. */
+} host_cmd_status_t;
+
+/**@brief Command split from the received bytes. */
+typedef struct
+{
+    bool              binary;       /**< A binary command, to be answered. Otherwise an ASCII line. */
+    host_cmd_status_t status;       /**< @ref HOST_CMD_STATUS_OK, or the framing error of a binary command. */
+    uint8_t           type;         /**< Command type of a binary command. */
+    uint8_t           req_id;       /**< Request id of a binary command. */
+    uint8_t const   * p_data;       /**< Payload, or the line without its end. */
+    uint16_t          len;          /**< Length of p_data. */
+} host_cmd_t;
+
+/**@brief Handler of the commands split by a parser. p_cmd is only valid during the call. */
+typedef void (* host_cmd_handler_t)(host_cmd_t const * p_cmd);
+
+/**@brief Parser state. */
+typedef struct
+{
+    host_cmd_handler_t handler;                 /**< Handler of the commands. */
+    uint16_t           len;                     /**< Bytes in buf. */
+    uint8_t            buf[HOST_CMD_BUF_LEN];   /**< Command being received. */
+} host_cmd_parser_t;
+
+
+/**@brief Function for initializing a parser.
+ *
+ * @param[out] p_parser Parser.
+ * @param[in]  handler  Handler of the commands.
+ */
+void host_cmd_parser_init(host_cmd_parser_t * p_parser, host_cmd_handler_t handler);
+
+
+/**@brief Function for feeding received bytes to a parser.
+ *
+ * @details The handler is called for every command completed by the bytes.
+ *
+ * @param[in] p_parser Parser.
+ * @param[in] p_data   Bytes received, any number, in any split.
+ * @param[in] len      Number of bytes.
+ */
+void host_cmd_parse(host_cmd_parser_t * p_parser, uint8_t const * p_data, size_t len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_CMD_H__
+
+/** @} */
@@ -45,6 +45,7 @@
 #include "ble_db_discovery.h"
 #include "app_timer.h"
 #include "app_util.h"
+#include "app_util_platform.h"
 #include "bsp_btn_ble.h"
 #include "ble.h"
 #include "ble_gap.h"
@@ -68,7 +69,15 @@
 #include "app_usbd_string_desc.h"
 #include "app_usbd_cdc_acm.h"
 #include "app_usbd_serial_num.h"
-#include "ringbuf.h"
+#include "pktbuf.h"
+#include "data_path.h"
+#include "usb_frame.h"
+#include "handle_cache.h"
+#include "hearable_gatt.h"
+#include "clock_sync.h"
+#include "host_cmd.h"
+#include "sdk_macros.h"
+#include "crc16.h"
 #include "ble_srv_common.h"
 
 #define ENDLINE_STRING "\r\n"
@@ -87,7 +96,10 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
 #define CDC_ACM_DATA_EPIN       NRF_DRV_USBD_EPIN1
 #define CDC_ACM_DATA_EPOUT      NRF_DRV_USBD_EPOUT1
 
-static char m_cdc_data_array[BLE_NUS_MAX_DATA_LEN];
+#define CDC_ACM_RX_BLOCK_SIZE   NRF_DRV_USBD_EPSIZE                     /**< Bytes read from the host at once, one full OUT packet. */
+
+static uint8_t           m_cdc_rx_block[CDC_ACM_RX_BLOCK_SIZE];     /**< Bytes read from the host. */
+static host_cmd_parser_t m_host_cmd_parser;                         /**< Splits the bytes read into commands. */
 
 /** @brief CDC_ACM class instance */
 APP_USBD_CDC_ACM_GLOBAL_DEF(m_app_cdc_acm,
@@ -121,11 +133,34 @@ APP_USBD_CDC_ACM_GLOBAL_DEF(m_app_cdc_acm,
 //#define CONNECTED_MESSAGE "Connected to device with Hearable EEG & PPG Service."
 
 //TODO Change this?
-BLE_NUS_C_DEF(m_ble_nus_c);                                             /**< BLE Nordic UART Service (NUS) client instance. */
+#define LINK_COUNT NRF_SDH_BLE_CENTRAL_LINK_COUNT                        /**< Hearables streamed at once. Each link is indexed by its connection handle. */
+
+#define LINK_MIN_CONN_INTERVAL (LINK_COUNT*NRF_SDH_BLE_GAP_EVENT_LENGTH) /**< Shortest connection interval leaving every link its connection event, in 1.25 ms units. */
+
+// Link policy, asked for on every link. What the Hearable does not support falls back to what it
+// does (1M PHY, shorter data length or MTU, its own interval); the achieved values are logged and
+// kept per link. With 2M PHY, 251 byte PDUs and a 15 ms interval, a 6 x 1.25 ms event carries
+// about 5 full notifications, and event length extension lets a link use the idle time of the others.
+// host/link_model.c works out these figures from config/sdk_config.h for each event length.
+#define LINK_PHYS               BLE_GAP_PHY_2MBPS                       /**< PHY asked for. */
+#define LINK_DATA_LENGTH        NRF_SDH_BLE_GAP_DATA_LENGTH             /**< Link layer payload asked for, in bytes. */
+#define LINK_ATT_MTU            NRF_SDH_BLE_GATT_MAX_MTU_SIZE           /**< ATT MTU asked for, in bytes. */
+#define LINK_CONN_INTERVAL      MSEC_TO_UNITS(NRF_BLE_SCAN_MIN_CONNECTION_INTERVAL, UNIT_1_25_MS) /**< Interval settled on whenever the Hearable's range allows it, in 1.25 ms units. */
+#define WRITE_CMD_TX_QUEUE_SIZE 4                                       /**< Write commands the SoftDevice buffers per link. */
+#define LINK_CONN_EVT_EXT       1                                       /**< Let connection events run past their length while the radio is free. */
+
+// After a Hearable drops its link unexpectedly, the dongle scans continuously for that Hearable alone
+// for FAST_RECONNECT_WINDOW_MS, then falls back to the normal name filtered duty-cycled scan.
+#define FAST_RECONNECT_WINDOW_MS     3000                               /**< Time spent scanning for dropped Hearables only. 0 disables fast reconnect. */
+#define FAST_RECONNECT_SCAN_INTERVAL 0x0030                             /**< Interval and window of the fast reconnect scan (30 ms, 100% duty), in 0.625 ms units. */
+
+BLE_NUS_C_ARRAY_DEF(m_ble_nus_c, LINK_COUNT);                           /**< BLE Nordic UART Service (NUS) client instances, one per link. */
 NRF_BLE_GATT_DEF(m_gatt);                                               /**< GATT module instance. */
-BLE_DB_DISCOVERY_DEF(m_db_disc);                                        /**< Database discovery module instance. */
+BLE_DB_DISCOVERY_ARRAY_DEF(m_db_disc, LINK_COUNT);                      /**< Database discovery module instances, one per link. */
 NRF_BLE_SCAN_DEF(m_scan);                                               /**< Scanning Module instance. */
 
+static ble_gap_phys_t const m_link_phys = {.tx_phys = LINK_PHYS, .rx_phys = LINK_PHYS};  /**< PHYs asked for on every link. */
+
 static uint16_t m_ble_nus_max_data_len = BLE_GATT_ATT_MTU_DEFAULT - OPCODE_LENGTH - HANDLE_LENGTH; /**< Maximum length of data (in bytes) that can be transmitted to the peer by the Nordic UART service module. */
 
 /**@brief NUS UUID. */
@@ -137,28 +172,212 @@ static uint16_t m_ble_nus_max_data_len = BLE_GATT_ATT_MTU_DEFAULT - OPCODE_LENGT
 //};
 
 static char const m_target_periph_name[] = "Hearable";
-#define PREFIX_LENGTH 4
-#define EEG_PREFIX "EEG "
-#define PPG_PREFIX "PPG "
-#define ACC_PREFIX "ACC "
-#define RINGBUF_SIZE 8192 //Power of 2!
-#define USB_PACKET_SIZE 2048
-
-static uint8_t usbBuffer[4][USB_PACKET_SIZE];
-
-struct ringbuf eegRing,ppgRing,accRing;
-static uint8_t ringBuffer[RINGBUF_SIZE];
-static uint8_t ringBuffer2[RINGBUF_SIZE];
-static uint8_t ringBuffer3[RINGBUF_SIZE];
-
+#define EEG_PREFIX "EEG_"
+#define PPG_PREFIX "PPG_"
+#define ACC_PREFIX "ACC_"
+#define NAME_PREFIX "NAME"
+#define STAT_PREFIX "STAT"
+#define LINK_PREFIX "LINK"
+#define RESP_PREFIX "RESP"
+// The stream packets, their pool, reservations, weights and latencies are set in data_path.h.
+#define USB_PACKET_SIZE DATA_PATH_FRAME_SIZE
+#define PACKET_POOL_SIZE (DATA_PATH_FRAMES_PER_LINK*LINK_COUNT) //USB packets shared by all streams of all links
+#define FLUSH_TIMER_TICK_MS DATA_PATH_TICK_MS
+
+#define STATS_INTERVAL_MS 1000 //Period of the STAT packet; 0 sends it only when the host asks with "stats"
+
+// Position of the device time (uint32, 31.25 kHz) in the notifications of a stream, for tracking the
+// Hearable clock. A PPG notification is one whole block: a 4 byte keyword, the device time, then the
+// samples. EEG blocks span several notifications, so only the first one of a block would carry a time.
+#define STREAM_NO_TIME 0xFFFF
+#define EEG_TIME_OFFSET STREAM_NO_TIME
+#define PPG_TIME_OFFSET 4
+#define ACC_TIME_OFFSET STREAM_NO_TIME
+
+#if (PACKET_POOL_SIZE > PKTBUF_MAX_FRAMES) || (LINK_COUNT > USB_FRAME_LINK_MAX) || (LINK_COUNT > DATA_PATH_LINK_MAX)
+#error Too many links for the packet pool, the data path or the USB frame format.
+#endif
+
+static char const * const m_stream_prefix[STREAM_COUNT] = {EEG_PREFIX, PPG_PREFIX, ACC_PREFIX};
+static uint16_t const m_stream_time_offset[STREAM_COUNT] = {EEG_TIME_OFFSET, PPG_TIME_OFFSET, ACC_TIME_OFFSET};
+
+// LINK packet payload, one per connected link with every STAT packet, all fields little endian:
+//   version (1), link, tx PHY, rx PHY, RSSI in dBm (int8, LINK_RSSI_UNKNOWN before the first
+//   measurement), channel of the RSSI measurement, connection interval (uint16, 1.25 ms units),
+//   slave latency (uint16), supervision timeout (uint16, 10 ms units), ATT MTU (uint16), data
+//   length (uint16), time since the previous LINK packet of the link in ms (uint16), notifications
+//   received in that time (uint32), connection events in that time (uint16, from the interval),
+//   notifications per connection event times 100 (uint16), then the Hearable clock estimate: state
+//   (clock_sync_state_t), device time of the anchor (uint32, 31.25 kHz ticks), dongle time of the
+//   anchor (uint32, app_timer ticks), offset in us (int32), drift in ppb (int32), device times used
+//   and rejected in that time (uint16 each). See clock_sync.h.
+#define LINK_VERSION 2
+#define LINK_PAYLOAD_LENGTH 47
+#define LINK_RSSI_UNKNOWN 127
+
+/**@brief Link parameters achieved with a Hearable. */
+typedef struct
+{
+    uint8_t  tx_phy;                /**< PHY the dongle sends on. */
+    uint8_t  rx_phy;                /**< PHY the dongle receives on. */
+    uint16_t data_length;           /**< Link layer payload length, in bytes. */
+    uint16_t att_mtu;               /**< ATT MTU, in bytes. */
+    uint16_t conn_interval;         /**< Connection interval, in 1.25 ms units. */
+    uint16_t slave_latency;         /**< Connection events the Hearable may skip. */
+    uint16_t sup_timeout;           /**< Supervision timeout, in 10 ms units. */
+} link_params_t;
+
+/**@brief State of the link to one Hearable, indexed by its connection handle. */
+typedef struct
+{
+    uint32_t           stat_notifications_prev[STREAM_COUNT];  /**< Notifications of each stream counted at the previous STAT packet. */
+    bool               in_use;                          /**< A Hearable is connected on this link. */
+    bool               notif_enabled;                   /**< Notifications have been enabled on this link. */
+    ble_gap_addr_t     peer_addr;                       /**< Address of the connected Hearable, the handle cache key. */
+    link_params_t      params;                          /**< Link parameters achieved. */
+    uint32_t           connect_ticks;                   /**< Time of the connection, for the setup time. */
+    int8_t             cccd_pending;                    /**< CCCD writes queued but not answered yet. Goes below 0 while a write completes before the count is known. */
+    hearable_gatt_rev_t rev;                            /**< Read of the revision of the Hearable's database. */
+    bool               handles_cached;                  /**< The handles of the link came from the handle cache. */
+    volatile bool      name_received;                   /**< name holds a hardware name not sent to the host yet. */
+    volatile uint16_t  name_len;                        /**< Length of the hardware name. */
+    uint8_t            name[NRF_SDH_BLE_GATT_MAX_MTU_SIZE];   /**< Hardware name read from the Hearable. */
+    bool               name_queued;                     /**< name_buffer is queued and must not be rewritten. */
+    uint16_t           name_seq;                        /**< Sequence number of the next name packet. */
+    uint8_t            name_buffer[USB_FRAME_HEADER_MAX_LEN + NRF_SDH_BLE_GATT_MAX_MTU_SIZE];  /**< Name packet. */
+    uint32_t           notifications;                   /**< Stream notifications received, free-running. */
+    uint32_t           link_notifications_prev;         /**< notifications at the previous LINK packet. */
+    uint32_t           link_prev_ticks;                 /**< Time of the previous LINK packet. */
+    volatile bool      link_requested;                  /**< A LINK packet is due. */
+    bool               link_queued;                     /**< link_buffer is queued and must not be rewritten. */
+    uint16_t           link_seq;                        /**< Sequence number of the next LINK packet. */
+    uint8_t            link_buffer[USB_FRAME_HEADER_MAX_LEN + LINK_PAYLOAD_LENGTH];  /**< LINK packet. */
+    clock_sync_t       clock;                           /**< Hearable clock against the dongle clock. */
+} link_t;
+
+// Stream data is packetised in place: every stream fills USB packets taken from one shared pool,
+// and the header slot of a packet is filled in just before it is written out. Only the name and
+// STAT and LINK packets need their own buffers.
+static uint8_t packetPool[PACKET_POOL_SIZE*USB_PACKET_SIZE];
+static data_path_t m_data_path;         /**< Stream rings, scheduler and USB transmit queue of all links. */
+static link_t m_links[LINK_COUNT];
+
+// The main loop sleeps until an interrupt wakes it. The BLE handler notes when a stream commits a
+// packet, and the main loop bins the delay until it wakes to send it: bin i counts delays below 2^i
+// app_timer ticks (30.5 us), the last bin the longer ones.
+#define LOOP_LATENCY_BINS 9
+
+/**@brief Main loop counters, reset with every STAT packet. */
+typedef struct
+{
+    uint32_t wakeups;                           /**< Passes through the main loop. */
+    uint16_t latency_hist[LOOP_LATENCY_BINS];   /**< Delays from a packet commit to the next pass. */
+} loop_stats_t;
+
+static loop_stats_t       m_loop_stats;
+static volatile bool      m_commit_pending = false;                  /**< A packet was committed since the last pass. */
+static volatile uint32_t  m_commit_ticks;                            /**< Time of that commit. */
+
+// STAT packet payload, all fields little endian:
+//   version (3), link count, streams per link, 0, time since the previous STAT packet in ms (uint16),
+//   then for each stream of each link, link by link: notifications, bytes in, bytes dropped,
+//   bytes out, USB write failures (uint32 each, free-running), notifications per second since the
+//   previous STAT packet (uint16), most packets held at once and packet limit (uint8 each),
+//   then main loop passes since the previous STAT packet (uint32), the number of latency bins and
+//   the count of each (uint16 each).
+#define STAT_VERSION 3
+#define STAT_HEADER_LENGTH 6
+#define STAT_STREAM_LENGTH 24
+#define STAT_LOOP_LENGTH (5 + 2*LOOP_LATENCY_BINS)
+#define STAT_PAYLOAD_LENGTH (STAT_HEADER_LENGTH + LINK_COUNT*STREAM_COUNT*STAT_STREAM_LENGTH + STAT_LOOP_LENGTH)
+
+static uint8_t            statBuffer[USB_FRAME_HEADER_MAX_LEN + STAT_PAYLOAD_LENGTH];
+static uint16_t           m_stat_seq;                                /**< Sequence number of the next STAT packet. */
+static uint32_t           m_stat_prev_ticks;                         /**< Time of the previous STAT packet. */
+static volatile bool      m_stat_requested = false;                  /**< A STAT packet is due. */
+
+// Response packet payload, one per binary host command, in the order of the commands:
+//   command type, request id, status (host_cmd_status_t), then for a ping its payload.
+#define RESP_HEADER_LENGTH 3
+#define RESP_SLOTS 4 //Responses waiting for USB; a response finding none free is dropped
+
+/**@brief Response to a binary host command. */
+typedef struct
+{
+    bool     ready;             /**< buffer holds a response not queued for USB yet. */
+    bool     queued;            /**< buffer is queued and must not be rewritten. */
+    uint16_t len;               /**< Length of the payload. */
+    uint8_t  buffer[USB_FRAME_HEADER_MAX_LEN + RESP_HEADER_LENGTH + HOST_CMD_PAYLOAD_MAX];  /**< Response packet. */
+} host_resp_t;
+
+static host_resp_t        m_host_resps[RESP_SLOTS];
+static uint8_t            m_host_resp_head  = 0;                     /**< Oldest slot in use. */
+static uint8_t            m_host_resp_count = 0;                     /**< Slots in use. */
+static uint16_t           m_host_resp_seq;                           /**< Sequence number of the next response packet. */
+
+// Host commands run one at a time, in order, from the main loop. A write a Hearable has no room
+// for is retried at most HOST_CMD_RETRIES times, HOST_CMD_RETRY_MS apart, then fails as queue full.
+#define HOST_CMD_QUEUE_SIZE 8 //Commands waiting; a command finding none free fails at once
+#define HOST_CMD_RETRIES 20
+#define HOST_CMD_RETRY_MS FLUSH_TIMER_TICK_MS //The flush timer wakes the main loop this often
+
+/**@brief Host command waiting to run. */
+typedef struct
+{
+    bool              binary;       /**< Answered with a response packet when done. */
+    host_cmd_status_t status;       /**< Framing error found by the parser, or HOST_CMD_STATUS_OK. */
+    uint8_t           type;         /**< Command type. */
+    uint8_t           req_id;       /**< Request id. */
+    bool              started;      /**< The links to write to have been chosen. */
+    bool              failed;       /**< A write was refused for a reason other than a full queue. */
+    uint8_t           links;        /**< Links the command still has to be written to, one bit each. */
+    uint8_t           retries;      /**< Attempts refused for a full queue so far. */
+    uint32_t          retry_ticks;  /**< Time of the latest refused attempt. */
+    uint16_t          len;          /**< Length of the payload. */
+    uint8_t           payload[HOST_CMD_PAYLOAD_MAX];
+} host_cmd_entry_t;
+
+static host_cmd_entry_t   m_host_cmds[HOST_CMD_QUEUE_SIZE];
+static uint8_t            m_host_cmd_head  = 0;                      /**< Oldest command. */
+static uint8_t            m_host_cmd_count = 0;                      /**< Commands waiting. */
+
+#if STATS_INTERVAL_MS > 0
+APP_TIMER_DEF(m_stats_timer);
+#endif
+
+APP_TIMER_DEF(m_flush_timer);
+APP_TIMER_DEF(m_gatt_req_timer);
+#define GATT_REQ_TICK_MS 100 //Period of the retries and timeouts of the GATT request queues
+static volatile bool m_flush_tick = false;               /**< Set by the flush timer, cleared by the main loop. */
+static volatile bool m_bench_tick = false;               /**< Set by the flush timer, cleared by the bench generation. */
+
+// Loopback benchmark: the main loop puts pattern chunks into the EEG stream of link 0 as if a
+// Hearable sent them, so they take the production path to USB. Each chunk is a
+// counter (uint32), filler bytes of (counter + offset) & 0xFF, then a CRC-16/CCITT-FALSE of the rest.
+#define BENCH_LINK 0
+#define BENCH_STREAM STREAM_EEG
+#define BENCH_CHUNK_MIN 8                           //Counter, CRC and some filler
+#define BENCH_CHUNK_DEFAULT BLE_NUS_MAX_DATA_LEN    //The longest notification
+#define BENCH_PAYLOAD_LENGTH 7                      //On (uint8), chunk length (uint16), rate in bytes/s (uint32, 0 as fast as USB takes it)
+
+/**@brief Loopback benchmark settings and state, written by the main loop only. */
+typedef struct
+{
+    volatile bool on;
+    uint16_t      chunk_len;    /**< Bytes per chunk. */
+    uint32_t      rate;         /**< Bytes per second, or 0 to keep the stream just short of its packet limit. */
+    uint32_t      credit;       /**< Bytes the rate allows but not generated yet. */
+    uint32_t      counter;      /**< Counter of the next chunk. Chunks dropped for lack of packets still count. */
+    uint8_t       chunk[BLE_NUS_MAX_DATA_LEN];
+} bench_t;
 
-static uint8_t BLE_connected=0;
+static bench_t m_bench;
 
-volatile bool nameReceived = false;
-volatile int hardwareNameLength=0;
-uint8_t  hardwareName[NRF_SDH_BLE_GATT_MAX_MTU_SIZE];
+static bool m_usb_tx_stat_queued = false;  /**< statBuffer is queued and must not be rewritten. */
 
 
+// Shortest configuration of each stream, the settings every Hearable takes. Newer Hearables take
+// longer ones, up to HOST_CMD_PAYLOAD_MAX bytes, written in as many write commands as the ATT MTU needs.
 #define EEG_CONFIG_LENGTH 11
 #define PPG_CONFIG_LENGTH 11
 #define ACC_CONFIG_LENGTH 10
@@ -180,13 +399,57 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name)
 }
 
 
-/**@brief Function for starting scanning. */
+/**@brief Reconnect latency counters, from an unexpected disconnect to the next connection to the same Hearable. */
+typedef struct
+{
+    uint32_t reconnects;            /**< Reconnects measured. */
+    uint32_t fast;                  /**< Reconnects made by the fast reconnect scan. */
+    uint32_t fallbacks;             /**< Fast reconnect windows that ended without every dropped Hearable back. */
+    uint32_t last_ms;               /**< Latency of the latest reconnect. */
+    uint32_t min_ms;                /**< Shortest latency. */
+    uint32_t max_ms;                /**< Longest latency. */
+    uint32_t total_ms;              /**< Sum of all latencies, for the mean. */
+} reconnect_stats_t;
+
+/**@brief Hearable that dropped its link and has not reconnected yet. */
+typedef struct
+{
+    ble_gap_addr_t addr;            /**< Address of the Hearable. */
+    uint32_t       drop_ticks;      /**< Time of the disconnect. */
+} reconnect_peer_t;
+
+static reconnect_peer_t   m_reconnect_peers[LINK_COUNT];
+static ble_gap_addr_t const * m_reconnect_whitelist[LINK_COUNT];
+static uint8_t            m_reconnect_count = 0;        /**< Dropped Hearables in m_reconnect_peers. */
+static bool               m_fast_reconnect  = false;    /**< The scan is the fast reconnect one. */
+static reconnect_stats_t  m_reconnect_stats = {.min_ms = UINT32_MAX};
+#if FAST_RECONNECT_WINDOW_MS > 0
+APP_TIMER_DEF(m_fast_reconnect_timer);
+#endif
+
+
+/**@brief Function for starting scanning, if a link is free for another Hearable. */
 static void scan_start(void)
 {
     ret_code_t ret;
+    bool       link_free = false;
+
+    for (int i = 0; i < LINK_COUNT; i++)
+    {
+        link_free |= !m_links[i].in_use;
+    }
+    if (!link_free)
+    {
+        return;
+    }
 
     NRF_LOG_INFO("STARTING SCAN");
     ret = nrf_ble_scan_start(&m_scan);
+    if (ret == NRF_ERROR_INVALID_STATE)
+    {
+        // A connection is being set up; its CONNECTED or TIMEOUT event starts the scan again.
+        return;
+    }
     APP_ERROR_CHECK(ret);
 
     ret = bsp_indication_set(BSP_INDICATE_SCANNING);
@@ -195,6 +458,143 @@ static void scan_start(void)
 }
 
 
+/**@brief Function for switching between the fast reconnect scan and the normal scan.
+ *
+ * @details The fast reconnect scan runs at 100% duty and only reports the dropped Hearables, which
+ *          are put in the whitelist when the scan starts.
+ *
+ * @param[in] fast true for the fast reconnect scan.
+ */
+static void scan_mode_set(bool fast)
+{
+    ret_code_t                  ret;
+    ble_gap_scan_params_t const fast_params =
+    {
+        .active        = 1,
+        .interval      = FAST_RECONNECT_SCAN_INTERVAL,
+        .window        = FAST_RECONNECT_SCAN_INTERVAL,
+        .timeout       = 0,
+        .scan_phys     = BLE_GAP_PHY_1MBPS,
+        .filter_policy = BLE_GAP_SCAN_FP_WHITELIST,
+    };
+
+    m_fast_reconnect = fast;
+
+    // Stops the scan; NULL restores the parameters of sdk_config.h.
+    ret = nrf_ble_scan_params_set(&m_scan, fast ? &fast_params : NULL);
+    APP_ERROR_CHECK(ret);
+    scan_start();
+}
+
+
+/**@brief Function for noting an unexpected disconnect, so the Hearable is scanned for on its own.
+ *
+ * @param[in] p_addr Address of the Hearable that dropped its link.
+ */
+static void reconnect_begin(ble_gap_addr_t const * p_addr)
+{
+#if FAST_RECONNECT_WINDOW_MS > 0
+    ret_code_t ret;
+    uint8_t    i;
+
+    for (i = 0; i < m_reconnect_count; i++)
+    {
+        if (memcmp(m_reconnect_peers[i].addr.addr, p_addr->addr, BLE_GAP_ADDR_LEN) == 0)
+        {
+            break;
+        }
+    }
+    if (i == m_reconnect_count)
+    {
+        if (m_reconnect_count == LINK_COUNT)
+        {
+            return;
+        }
+        m_reconnect_count++;
+    }
+    m_reconnect_peers[i].addr       = *p_addr;
+    m_reconnect_peers[i].drop_ticks = app_timer_cnt_get();
+
+    // Every drop gives the fast scan a full window again.
+    (void)app_timer_stop(m_fast_reconnect_timer);
+    ret = app_timer_start(m_fast_reconnect_timer, APP_TIMER_TICKS(FAST_RECONNECT_WINDOW_MS), NULL);
+    APP_ERROR_CHECK(ret);
+
+    NRF_LOG_INFO("Fast reconnect scan for %d Hearable(s).", m_reconnect_count);
+    scan_mode_set(true);
+#else
+    UNUSED_PARAMETER(p_addr);
+    scan_start();
+#endif
+}
+
+
+/**@brief Function for counting a connection to a Hearable that dropped its link.
+ *
+ * @details Connections to other Hearables are not counted. The normal scan is resumed once every
+ *          dropped Hearable is back.
+ *
+ * @param[in] p_addr Address of the connected Hearable.
+ */
+static void reconnect_end(ble_gap_addr_t const * p_addr)
+{
+    reconnect_stats_t * p_stats = &m_reconnect_stats;
+    ret_code_t          ret;
+    uint32_t            latency_ms;
+    uint8_t             i;
+
+    for (i = 0; i < m_reconnect_count; i++)
+    {
+        if (memcmp(m_reconnect_peers[i].addr.addr, p_addr->addr, BLE_GAP_ADDR_LEN) == 0)
+        {
+            break;
+        }
+    }
+    if (i == m_reconnect_count)
+    {
+        return;
+    }
+
+    latency_ms = (uint32_t)(((uint64_t)app_timer_cnt_diff_compute(app_timer_cnt_get(), m_reconnect_peers[i].drop_ticks) * 1000) / APP_TIMER_CLOCK_FREQ);
+    p_stats->reconnects++;
+    p_stats->fast     += m_fast_reconnect ? 1 : 0;
+    p_stats->last_ms   = latency_ms;
+    p_stats->min_ms    = MIN(p_stats->min_ms, latency_ms);
+    p_stats->max_ms    = MAX(p_stats->max_ms, latency_ms);
+    p_stats->total_ms += latency_ms;
+    NRF_LOG_INFO("Reconnected in %d ms (%s). Min %d, mean %d, max %d ms over %d reconnects.",
+                 latency_ms, m_fast_reconnect ? "fast" : "normal",
+                 p_stats->min_ms, p_stats->total_ms / p_stats->reconnects, p_stats->max_ms, p_stats->reconnects);
+
+    m_reconnect_peers[i] = m_reconnect_peers[--m_reconnect_count];
+
+    if ((m_reconnect_count == 0) && m_fast_reconnect)
+    {
+#if FAST_RECONNECT_WINDOW_MS > 0
+        (void)app_timer_stop(m_fast_reconnect_timer);
+#endif
+        // The scan was stopped by the connection; the CONNECTED handler restarts it.
+        m_fast_reconnect = false;
+        ret = nrf_ble_scan_params_set(&m_scan, NULL);
+        APP_ERROR_CHECK(ret);
+    }
+}
+
+
+#if FAST_RECONNECT_WINDOW_MS > 0
+/**@brief Function for falling back to the normal scan when the fast reconnect window ends. */
+static void fast_reconnect_timer_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    // Still measured if they come back through the normal scan.
+    NRF_LOG_INFO("Fast reconnect window over, %d Hearable(s) not back.", m_reconnect_count);
+    m_reconnect_stats.fallbacks++;
+    scan_mode_set(false);
+}
+#endif
+
+
 /**@brief Function for handling Scanning Module events.
  */
 static void scan_evt_handler(scan_evt_t const * p_scan_evt)
@@ -224,6 +624,16 @@ static void scan_evt_handler(scan_evt_t const * p_scan_evt)
                       );
          } break;
 
+         case NRF_BLE_SCAN_EVT_WHITELIST_REQUEST:
+         {
+             for (uint8_t i = 0; i < m_reconnect_count; i++)
+             {
+                 m_reconnect_whitelist[i] = &m_reconnect_peers[i].addr;
+             }
+             err_code = sd_ble_gap_whitelist_set(m_reconnect_whitelist, m_reconnect_count);
+             APP_ERROR_CHECK(err_code);
+         } break;
+
          case NRF_BLE_SCAN_EVT_SCAN_TIMEOUT:
          {
              NRF_LOG_INFO("Scan timed out.");
@@ -276,10 +686,229 @@ static void scan_init(void)
 //TODO Change this?
 static void db_disc_handler(ble_db_discovery_evt_t * p_evt)
 {
-    ble_nus_c_on_db_disc_evt(&m_ble_nus_c, p_evt);
+    ble_nus_c_on_db_disc_evt(&m_ble_nus_c[p_evt->conn_handle], p_evt);
+}
+
+
+/**@brief Function for logging the time from connecting to the last CCCD write answered. */
+static void link_setup_log(link_t const * p_link)
+{
+    NRF_LOG_INFO("Streaming set up %d ms after connecting.",
+                 (uint32_t)(((uint64_t)app_timer_cnt_diff_compute(app_timer_cnt_get(), p_link->connect_ticks) * 1000) / APP_TIMER_CLOCK_FREQ));
+}
+
+
+/**@brief Function for counting the CCCD writes of a link as they are answered. */
+static void link_cccd_done(ble_nus_c_t * p_ble_nus_c, uint16_t handle, uint16_t gatt_status)
+{
+    link_t * p_link = &m_links[p_ble_nus_c - m_ble_nus_c];
+
+    if (gatt_status != BLE_GATT_STATUS_SUCCESS)
+    {
+        NRF_LOG_WARNING("CCCD 0x%x write failed, status 0x%x.", handle, gatt_status);
+    }
+    if (p_link->handles_cached && hearable_gatt_status_stale(gatt_status))
+    {
+        ret_code_t err_code;
+
+        // The other writes queued on the cached handles are dropped, and notifications enabled
+        // again once the discovery is over.
+        p_link->handles_cached = false;
+        p_link->notif_enabled  = false;
+        p_link->cccd_pending   = 0;
+        err_code = hearable_gatt_handles_rediscover(&p_link->peer_addr, p_ble_nus_c, &m_db_disc[p_ble_nus_c - m_ble_nus_c]);
+        APP_ERROR_CHECK(err_code);
+        return;
+    }
+    if (--p_link->cccd_pending == 0)
+    {
+        link_setup_log(p_link);
+    }
+}
+
+
+/**@brief Function for enabling the notifications of a link once its handles are known.
+ *
+ * @param[in] conn_handle Connection handle of the link.
+ */
+static void link_notif_enable(uint16_t conn_handle)
+{
+    ret_code_t err_code;
+    uint8_t    enabled;
+
+    if (m_links[conn_handle].notif_enabled)
+    {
+        return;
+    }
+
+    // Characteristics the Hearable lacks are skipped, so the streams it has still run.
+    err_code = ble_nus_c_notif_enable_all(&m_ble_nus_c[conn_handle], &enabled, link_cccd_done);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Only %d CCCD writes queued, error 0x%x.", enabled, err_code);
+    }
+    m_links[conn_handle].cccd_pending += enabled;
+    if ((enabled > 0) && (m_links[conn_handle].cccd_pending == 0))
+    {
+        link_setup_log(&m_links[conn_handle]);
+    }
+    NRF_LOG_INFO("Notifications enabled on %d characteristics.", enabled);
+    m_links[conn_handle].notif_enabled = true;
+}
+
+
+/**@brief Function for storing stream data in its ring, as a record when record mode is on.
+ *
+ * @param[in] p_link    Link of the stream.
+ * @param[in] stream_id Stream of the data.
+ * @param[in] p_data    Data.
+ * @param[in] len       Length of the data.
+ * @param[in] timestamp Time the data arrived.
+ */
+static void stream_ring_put(link_t * p_link, uint8_t stream_id, uint8_t const * p_data, uint16_t len, uint32_t timestamp)
+{
+    ret_code_t ret = data_path_put(&m_data_path, (uint8_t)(p_link - m_links), stream_id, p_data, len, timestamp);
+
+    if (ret != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("%s data lost", m_stream_prefix[stream_id]);
+        bsp_indication_set(BSP_INDICATE_RCV_ERROR);
+    }
+}
+
+
+/**@brief Function for storing a notification of a stream.
+ *
+ * @details The stream sink of the NUS client of every link, so it is called straight from the BLE
+ *          event handler with the link as context.
+ */
+static void stream_data_put(void * p_context, uint8_t stream_id, uint8_t const * p_data, uint16_t len)
+{
+    link_t   * p_link      = (link_t *)p_context;
+    pktbuf_t * p_ring      = &m_data_path.ring[p_link - m_links][stream_id];
+    uint32_t   timestamp   = app_timer_cnt_get();
+    uint16_t   time_offset = m_stream_time_offset[stream_id];
+    uint8_t    ready       = pktbuf_frames_ready(p_ring);
+
+    p_link->notifications++;
+    if (m_bench.on && (p_link == &m_links[BENCH_LINK]))
+    {
+        // The main loop is the only producer of the bench link's rings until the bench stops.
+        return;
+    }
+    if ((time_offset != STREAM_NO_TIME) && (len >= time_offset + sizeof(uint32_t)))
+    {
+        clock_sync_sample(&p_link->clock, uint32_decode(&p_data[time_offset]), timestamp);
+    }
+
+    stream_ring_put(p_link, stream_id, p_data, len, timestamp);
+    // Returning from this interrupt wakes the main loop; time how long it takes to get to the packet.
+    if (!m_commit_pending && (pktbuf_frames_ready(p_ring) > ready))
+    {
+        m_commit_ticks   = timestamp;
+        m_commit_pending = true;
+    }
+}
+
+
+/**@brief Function for generating the loopback benchmark chunks, called from the main loop.
+ *
+ * @details A fixed rate is credited on every flush timer tick; without one, the ring is topped up
+ *          on every pass. Notifications of the bench link are dropped meanwhile, so the chunks
+ *          have the ring to themselves. The chunks carry no Hearable time, so the clock of the link
+ *          is not fed.
+ */
+static void bench_generate(void)
+{
+    pktbuf_t * p_ring = &m_data_path.ring[BENCH_LINK][BENCH_STREAM];
+    uint16_t   len    = m_bench.chunk_len;
+    bool       tick   = m_bench_tick;
+
+    if (tick)
+    {
+        m_bench_tick = false;
+    }
+    if (!m_bench.on)
+    {
+        return;
+    }
+    if ((m_bench.rate > 0) && tick)
+    {
+        m_bench.credit += m_bench.rate / (1000 / FLUSH_TIMER_TICK_MS);
+    }
+
+    for (;;)
+    {
+        uint32_t drops = p_ring->stats.drops;
+
+        if (m_bench.rate > 0)
+        {
+            if (m_bench.credit < len)
+            {
+                break;
+            }
+            m_bench.credit -= len;
+        }
+        else if (pktbuf_frames_used(p_ring) + 2 > p_ring->limit) //A chunk may spill into a second packet
+        {
+            break;
+        }
+
+        (void)uint32_encode(m_bench.counter, m_bench.chunk);
+        for (uint16_t i = sizeof(uint32_t); i < len - sizeof(uint16_t); i++)
+        {
+            m_bench.chunk[i] = (uint8_t)(m_bench.counter + i);
+        }
+        (void)uint16_encode(crc16_compute(m_bench.chunk, len - sizeof(uint16_t), NULL), &m_bench.chunk[len - sizeof(uint16_t)]);
+        m_bench.counter++;
+
+        // The other links' producer is the BLE event handler, and the pool is shared: take frames
+        // from it with that handler held off.
+        CRITICAL_REGION_ENTER();
+        stream_ring_put(&m_links[BENCH_LINK], BENCH_STREAM, m_bench.chunk, len, app_timer_cnt_get());
+        CRITICAL_REGION_EXIT();
+        if (p_ring->stats.drops != drops)
+        {
+            // The rate is more than USB takes; the rest of this tick would only be dropped as well.
+            m_bench.credit = 0;
+            break;
+        }
+    }
 }
 
 
+/**@brief Function for starting or stopping the loopback benchmark.
+ *
+ * @param[in] on        Start rather than stop.
+ * @param[in] chunk_len Bytes per chunk.
+ * @param[in] rate      Bytes per second, or 0 to send as fast as USB takes them.
+ *
+ * @return Status to answer a binary command with.
+ */
+static host_cmd_status_t bench_set(bool on, uint16_t chunk_len, uint32_t rate)
+{
+    m_bench.on = false;
+    if (!on)
+    {
+        NRF_LOG_INFO("Bench stopped after %d chunks", m_bench.counter);
+        return HOST_CMD_STATUS_OK;
+    }
+    VERIFY_TRUE((chunk_len >= BENCH_CHUNK_MIN) && (chunk_len <= sizeof(m_bench.chunk)), HOST_CMD_STATUS_BAD_LENGTH);
+    // A Hearable on the bench link would be a second producer into its ring.
+    VERIFY_FALSE(m_links[BENCH_LINK].in_use, HOST_CMD_STATUS_BUSY);
+
+    // Not racing with the generation, which runs from the main loop as this does. The ring is
+    // flushed once on keeps a Hearable connecting meanwhile out of it.
+    m_bench.chunk_len = chunk_len;
+    m_bench.rate      = rate;
+    m_bench.credit    = 0;
+    m_bench.counter   = 0;
+    m_bench.on        = true;
+    pktbuf_flush(&m_data_path.ring[BENCH_LINK][BENCH_STREAM]);
+    NRF_LOG_INFO("Bench: %d byte chunks at %d bytes/s (0: as fast as USB takes them)", chunk_len, rate);
+    return HOST_CMD_STATUS_OK;
+}
+
 
 /**@brief Callback handling Nordic UART Service (NUS) client events.
  *
@@ -294,104 +923,45 @@ static void ble_nus_c_evt_handler(ble_nus_c_t * p_ble_nus_c, ble_nus_c_evt_t con
 {
     ret_code_t err_code;
     int i;
-    uint16_t count=0;
+    link_t * p_link = &m_links[p_ble_nus_c - m_ble_nus_c];
+
     switch (p_ble_nus_evt->evt_type)
     {
     	case BLE_NUS_C_EVT_DISCOVERY_AVAILABLE:
     		NRF_LOG_INFO("Discovery available.");
-			if (p_ble_nus_c->handles.nus_eeg_rx_handle
-					&& p_ble_nus_c->handles.nus_eeg_tx_handle
-					&& p_ble_nus_c->handles.nus_eeg_tx_cccd_handle
-					&& p_ble_nus_c->handles.nus_ppg_rx_handle
-					&& p_ble_nus_c->handles.nus_ppg_tx_handle
-					&& p_ble_nus_c->handles.nus_ppg_tx_cccd_handle
-					&& p_ble_nus_c->handles.nus_acc_rx_handle
-					&& p_ble_nus_c->handles.nus_acc_tx_handle
-					&& p_ble_nus_c->handles.nus_acc_tx_cccd_handle
-					&& p_ble_nus_c->handles.nus_dev_status_tx_handle
-					&& p_ble_nus_c->handles.nus_dev_status_tx_cccd_handle
-					&& p_ble_nus_c->handles.nus_dev_ctrl_rx_handle
-					&& p_ble_nus_c->handles.nus_dev_tstart_tx_handle
-					&& p_ble_nus_c->handles.nus_dev_tstart_tx_cccd_handle
-					&& p_ble_nus_c->handles.nus_dis_hw_rev_handle
-			)
-			{
-				if (!BLE_connected)
-				{
-					err_code = ble_nus_c_tx_notif_enable(p_ble_nus_c,&(p_ble_nus_c->handles.nus_ppg_tx_cccd_handle));
-					APP_ERROR_CHECK(err_code);
-					err_code = ble_nus_c_tx_notif_enable(p_ble_nus_c,&(p_ble_nus_c->handles.nus_eeg_tx_cccd_handle));
-					APP_ERROR_CHECK(err_code);
-					err_code = ble_nus_c_tx_notif_enable(p_ble_nus_c,&(p_ble_nus_c->handles.nus_acc_tx_cccd_handle));
-					APP_ERROR_CHECK(err_code);
-					err_code = ble_nus_c_tx_notif_enable(p_ble_nus_c,&(p_ble_nus_c->handles.nus_dev_tstart_tx_cccd_handle));
-					APP_ERROR_CHECK(err_code);
-					printf("Connected to device with Hearable EEG & PPG & ACCEL & DEV Service.");
-					BLE_connected=1;
-				}
-			}
-			else
-			{
-//				err_code = ble_db_discovery_start(&m_db_disc, p_ble_evt->evt.gap_evt.conn_handle);
-//				APP_ERROR_CHECK(err_code);
-				NRF_LOG_DEBUG("Didn't discover all the necessary characteristic handles");
-			}
+			// The next connection to this Hearable can skip discovery while its revision is unchanged.
+			handle_cache_store(&p_link->peer_addr, p_link->rev.value, p_link->rev.len, &p_ble_nus_c->handles);
+			link_notif_enable(p_ble_nus_evt->conn_handle);
 			break;
         case BLE_NUS_C_EVT_DISCOVERY_COMPLETE:
         	NRF_LOG_INFO("Discovery complete event.");
-            err_code = ble_nus_c_handles_assign(p_ble_nus_c, p_ble_nus_evt->conn_handle, p_ble_nus_evt->srv_uuid, &p_ble_nus_evt->handles);
+            err_code = ble_nus_c_handles_assign(p_ble_nus_c, p_ble_nus_evt->conn_handle, &p_ble_nus_evt->handles);
             APP_ERROR_CHECK(err_code);
 			break;
 
-        case BLE_NUS_C_EVT_NUS_EEG_TX_EVT:
-        	count =0;
-        	for (i=0;i<p_ble_nus_evt->data_len;i++)
-        		count+= ringbuf_put( &eegRing, *(p_ble_nus_evt->p_data +i)  );
-         	if (count != p_ble_nus_evt->data_len)
+        case BLE_NUS_C_EVT_HVX:
+        	if ((p_ble_nus_evt->char_uuid == BLE_UUID_DEV_TSTART_TX_CHARACTERISTIC) && (p_ble_nus_evt->data_len >= sizeof(uint32_t)))
         	{
-        		NRF_LOG_ERROR("EEG data lost");
-        		bsp_indication_set(BSP_INDICATE_RCV_ERROR);
+        		// The Hearable started streaming; its start time anchors its clock to ours.
+        		clock_sync_anchor(&p_link->clock, uint32_decode(p_ble_nus_evt->p_data), app_timer_cnt_get());
+        		NRF_LOG_INFO("Start time %u received.", uint32_decode(p_ble_nus_evt->p_data));
+        		break;
         	}
-        	break;
-
-        case BLE_NUS_C_EVT_NUS_PPG_TX_EVT:
-        	count =0;
-			for (i=0;i<p_ble_nus_evt->data_len;i++)
-				count+= ringbuf_put(&ppgRing, *(p_ble_nus_evt->p_data +i));
-			if (count != p_ble_nus_evt->data_len)
-			{
-				NRF_LOG_ERROR("PPG data lost");
-				bsp_indication_set(BSP_INDICATE_RCV_ERROR);
-			}
-        	break;
-
-        case BLE_NUS_C_EVT_NUS_ACC_TX_EVT:
-			count =0;
-			for (i=0;i<p_ble_nus_evt->data_len;i++)
-				count+= ringbuf_put(&accRing, *(p_ble_nus_evt->p_data +i));
-			if (count != p_ble_nus_evt->data_len)
-			{
-				NRF_LOG_ERROR("ACCEL data lost");
-				bsp_indication_set(BSP_INDICATE_RCV_ERROR);
-			}
-			break;
-
-        case BLE_NUS_C_EVT_NUS_DEV_TX_EVT:
-        	NRF_LOG_INFO("DEV service data received - no functionality programmed yet");
+        	NRF_LOG_INFO("Characteristic 0x%x data received - no functionality programmed yet", p_ble_nus_evt->char_uuid);
 			break;
 
         case BLE_NUS_C_EVT_DISCONNECTED:
             NRF_LOG_INFO("Disconnected.");
-            BLE_connected=0;
-            scan_start();
+            p_link->notif_enabled = false;
             break;
 
-        case BLE_NUS_C_EVT_DIS_READ_RESP:
-        	hardwareNameLength = p_ble_nus_evt->data_len;
-        	for (i=0;i<hardwareNameLength;i++) hardwareName[i] = p_ble_nus_evt->p_data[i];
-        	hardwareName[hardwareNameLength+1] = '\0';
-        	NRF_LOG_INFO("Name received is length %d and is %s", hardwareNameLength,hardwareName);
-        	nameReceived = true;
+        case BLE_NUS_C_EVT_READ_RESP:
+        	if (p_ble_nus_evt->char_uuid != BLE_UUID_HARDWARE_REVISION_STRING_CHAR) break;
+        	p_link->name_len = MIN(p_ble_nus_evt->data_len, sizeof(p_link->name) - 1);
+        	for (i=0;i<p_link->name_len;i++) p_link->name[i] = p_ble_nus_evt->p_data[i];
+        	p_link->name[p_link->name_len] = '\0';
+        	NRF_LOG_INFO("Name received is length %d and is %s", p_link->name_len, p_link->name);
+        	p_link->name_received = true;
         	break;
     }
 }
@@ -428,6 +998,29 @@ static bool shutdown_handler(nrf_pwr_mgmt_evt_t event)
 NRF_PWR_MGMT_HANDLER_REGISTER(shutdown_handler, APP_SHUTDOWN_HANDLER_PRIORITY);
 
 
+/**@brief Function for acting on the revision of a link once it has been read.
+ *
+ * @details The cached handles of the Hearable are used if its revision matches the cached one,
+ *          otherwise its database is discovered.
+ *
+ * @param[in] p_rev Revision read of the link.
+ */
+static void link_revision_done(hearable_gatt_rev_t * p_rev)
+{
+    ret_code_t err_code;
+    uint16_t   conn_handle = p_rev->conn_handle;
+    link_t   * p_link      = &m_links[conn_handle];
+
+    err_code = hearable_gatt_handles_get(p_rev, &p_link->peer_addr, &m_ble_nus_c[conn_handle],
+                                         &m_db_disc[conn_handle], &p_link->handles_cached);
+    APP_ERROR_CHECK(err_code);
+    if (p_link->handles_cached)
+    {
+        link_notif_enable(conn_handle);
+    }
+}
+
+
 /**@brief Function for handling BLE events.
  *
  * @param[in]   p_ble_evt   Bluetooth stack event.
@@ -439,39 +1032,56 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
     ble_gap_evt_t const * p_gap_evt = &p_ble_evt->evt.gap_evt;
 
     NRF_LOG_DEBUG("BLE_EVT: 0x%x, ",p_ble_evt->header.evt_id);
+    // The revision read of a link is retried on its GATT client events while refused as busy.
+    if ((p_ble_evt->header.evt_id >= BLE_GATTC_EVT_BASE) && (p_ble_evt->header.evt_id <= BLE_GATTC_EVT_LAST)
+            && (p_ble_evt->evt.gattc_evt.conn_handle < LINK_COUNT))
+    {
+        hearable_gatt_rev_on_ble_evt(&m_links[p_ble_evt->evt.gattc_evt.conn_handle].rev, p_ble_evt);
+    }
     switch (p_ble_evt->header.evt_id)
     {
         case BLE_GAP_EVT_CONNECTED:
-            err_code = ble_nus_c_handles_assign(&m_ble_nus_c, p_ble_evt->evt.gap_evt.conn_handle,BLE_UUID_EEG_NUS_SERVICE, NULL);
-            APP_ERROR_CHECK(err_code);
-            err_code = ble_nus_c_handles_assign(&m_ble_nus_c, p_ble_evt->evt.gap_evt.conn_handle,BLE_UUID_PPG_NUS_SERVICE, NULL);
+            // The SoftDevice hands out connection handles from 0, so they index the links directly.
+            APP_ERROR_CHECK_BOOL(p_gap_evt->conn_handle < LINK_COUNT);
+            m_links[p_gap_evt->conn_handle].in_use    = true;
+            m_links[p_gap_evt->conn_handle].peer_addr = p_gap_evt->params.connected.peer_addr;
+            m_links[p_gap_evt->conn_handle].connect_ticks = app_timer_cnt_get();
+            m_links[p_gap_evt->conn_handle].cccd_pending  = 0;
+            m_links[p_gap_evt->conn_handle].handles_cached = false;
+            m_links[p_gap_evt->conn_handle].link_notifications_prev = m_links[p_gap_evt->conn_handle].notifications;
+            m_links[p_gap_evt->conn_handle].link_prev_ticks         = m_links[p_gap_evt->conn_handle].connect_ticks;
+            clock_sync_reset(&m_links[p_gap_evt->conn_handle].clock);
+            reconnect_end(&p_gap_evt->params.connected.peer_addr);
+
+            err_code = ble_nus_c_handles_assign(&m_ble_nus_c[p_gap_evt->conn_handle], p_gap_evt->conn_handle, NULL);
             APP_ERROR_CHECK(err_code);
-            err_code = ble_nus_c_handles_assign(&m_ble_nus_c, p_ble_evt->evt.gap_evt.conn_handle,BLE_UUID_ACC_NUS_SERVICE, NULL);
-            APP_ERROR_CHECK(err_code);
-            err_code = ble_nus_c_handles_assign(&m_ble_nus_c, p_ble_evt->evt.gap_evt.conn_handle,BLE_UUID_DEV_NUS_SERVICE, NULL);
-			APP_ERROR_CHECK(err_code);
-			err_code = ble_nus_c_handles_assign(&m_ble_nus_c, p_ble_evt->evt.gap_evt.conn_handle,BLE_UUID_DEVICE_INFORMATION_SERVICE, NULL);
-			APP_ERROR_CHECK(err_code);
 
 
             err_code = bsp_indication_set(BSP_INDICATE_CONNECTED);
             APP_ERROR_CHECK(err_code);
-            NRF_LOG_INFO("Connected");
-//            ble_gap_phys_t const desired_phys =
-//			{
-//					.rx_phys = BLE_GAP_PHY_2MBPS,
-//					.tx_phys = BLE_GAP_PHY_2MBPS,
-//			};
-            ble_gap_phys_t const desired_phys =
-			{
-					.rx_phys = BLE_GAP_PHY_AUTO,
-					.tx_phys = BLE_GAP_PHY_AUTO,
-			};
-            err_code = sd_ble_gap_phy_update(p_gap_evt->conn_handle,&desired_phys);
+            NRF_LOG_INFO("Connected, interval %d units.", p_gap_evt->params.connected.conn_params.max_conn_interval);
+            {
+                link_params_t * p_params = &m_links[p_gap_evt->conn_handle].params;
+
+                p_params->tx_phy        = BLE_GAP_PHY_1MBPS;
+                p_params->rx_phy        = BLE_GAP_PHY_1MBPS;
+                p_params->data_length   = BLE_GAP_DATA_LENGTH_DEFAULT;
+                p_params->att_mtu       = BLE_GATT_ATT_MTU_DEFAULT;
+                p_params->conn_interval = p_gap_evt->params.connected.conn_params.max_conn_interval;
+                p_params->slave_latency = p_gap_evt->params.connected.conn_params.slave_latency;
+                p_params->sup_timeout   = p_gap_evt->params.connected.conn_params.conn_sup_timeout;
+            }
+            // Measured on every packet received; read back for the LINK packets, so no RSSI events.
+            err_code = sd_ble_gap_rssi_start(p_gap_evt->conn_handle, BLE_GAP_RSSI_THRESHOLD_INVALID, 0);
             APP_ERROR_CHECK(err_code);
-            // start discovery of services. The NUS Client waits for a discovery result
-            err_code = ble_db_discovery_start(&m_db_disc, p_ble_evt->evt.gap_evt.conn_handle);
+            // The data length and MTU are negotiated by the GATT module, see gatt_init.
+            err_code = sd_ble_gap_phy_update(p_gap_evt->conn_handle, &m_link_phys);
             APP_ERROR_CHECK(err_code);
+            // Reuse the cached handles of a known Hearable, else discover its services.
+            hearable_gatt_rev_read(&m_links[p_gap_evt->conn_handle].rev, p_gap_evt->conn_handle, link_revision_done);
+
+            // Connecting stopped the scan; look for the next Hearable while links are free.
+            scan_start();
             break;
 
         case BLE_GAP_EVT_DISCONNECTED:
@@ -479,12 +1089,22 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             NRF_LOG_INFO("Disconnected. conn_handle: 0x%x, reason: 0x%x",
                          p_gap_evt->conn_handle,
                          p_gap_evt->params.disconnected.reason);
+            m_links[p_gap_evt->conn_handle].in_use = false;
+            if (p_gap_evt->params.disconnected.reason != BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION)
+            {
+                reconnect_begin(&m_links[p_gap_evt->conn_handle].peer_addr);
+            }
+            else
+            {
+                scan_start();
+            }
             break;
 
         case BLE_GAP_EVT_TIMEOUT:
             if (p_gap_evt->params.timeout.src == BLE_GAP_TIMEOUT_SRC_CONN)
             {
                 NRF_LOG_INFO("Connection Request timed out.");
+                scan_start();
             }
             break;
 
@@ -495,34 +1115,64 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             break;
 
         case BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST:
-            // Accepting parameters requested by peer.
+        {
+            // Accepting parameters requested by peer, but never an interval too short for every link to get its event.
+            ble_gap_conn_params_t conn_params = p_gap_evt->params.conn_param_update_request.conn_params;
+            uint32_t              min_timeout;
+
+            conn_params.min_conn_interval = MAX(conn_params.min_conn_interval, LINK_MIN_CONN_INTERVAL);
+            conn_params.max_conn_interval = MAX(conn_params.max_conn_interval, conn_params.min_conn_interval);
+            // Settle on the target interval when the requested range holds it.
+            if ((LINK_CONN_INTERVAL >= conn_params.min_conn_interval) && (LINK_CONN_INTERVAL <= conn_params.max_conn_interval))
+            {
+                conn_params.min_conn_interval = LINK_CONN_INTERVAL;
+                conn_params.max_conn_interval = LINK_CONN_INTERVAL;
+            }
         	NRF_LOG_INFO("Updating connection parameters, min: %d, max:%d, latency: %d, timeout: %d", \
         			p_gap_evt->params.conn_param_update_request.conn_params.min_conn_interval, \
 					p_gap_evt->params.conn_param_update_request.conn_params.max_conn_interval, \
 					p_gap_evt->params.conn_param_update_request.conn_params.slave_latency, \
 					p_gap_evt->params.conn_param_update_request.conn_params.conn_sup_timeout);
-            err_code = sd_ble_gap_conn_param_update(p_gap_evt->conn_handle,
-                                                    &p_gap_evt->params.conn_param_update_request.conn_params);
+            // A raised interval may leave the requested timeout too short, which the SoftDevice refuses:
+            // it must exceed (1 + latency) * max interval * 2, in 10 ms units here.
+            min_timeout = (1 + conn_params.slave_latency) * conn_params.max_conn_interval / 4 + 1;
+            if (min_timeout > BLE_GAP_CP_CONN_SUP_TIMEOUT_MAX)
+            {
+                NRF_LOG_WARNING("No supervision timeout fits latency %d at interval %d, request rejected.",
+                                conn_params.slave_latency, conn_params.max_conn_interval);
+                err_code = sd_ble_gap_conn_param_update(p_gap_evt->conn_handle, NULL);
+                APP_ERROR_CHECK(err_code);
+                break;
+            }
+            conn_params.conn_sup_timeout = (uint16_t)MAX(conn_params.conn_sup_timeout, min_timeout);
+            err_code = sd_ble_gap_conn_param_update(p_gap_evt->conn_handle, &conn_params);
             APP_ERROR_CHECK(err_code);
-            break;
+        } break;
 
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
         {
             NRF_LOG_INFO("PHY update request.");
-//            ble_gap_phys_t const phys =
-//            {
-//                    .rx_phys = BLE_GAP_PHY_2MBPS,
-//                    .tx_phys = BLE_GAP_PHY_2MBPS,
-//            };
-            ble_gap_phys_t const phys =
-				{
-						.rx_phys = BLE_GAP_PHY_AUTO,
-						.tx_phys = BLE_GAP_PHY_AUTO,
-				};
-            err_code = sd_ble_gap_phy_update(p_ble_evt->evt.gap_evt.conn_handle, &phys);
+            err_code = sd_ble_gap_phy_update(p_ble_evt->evt.gap_evt.conn_handle, &m_link_phys);
             APP_ERROR_CHECK(err_code);
         } break;
 
+        case BLE_GAP_EVT_PHY_UPDATE:
+            // A Hearable without 2M PHY simply stays on 1M.
+            m_links[p_gap_evt->conn_handle].params.tx_phy = p_gap_evt->params.phy_update.tx_phy;
+            m_links[p_gap_evt->conn_handle].params.rx_phy = p_gap_evt->params.phy_update.rx_phy;
+            NRF_LOG_INFO("PHY update, status 0x%x, tx %d, rx %d.",
+                         p_gap_evt->params.phy_update.status,
+                         p_gap_evt->params.phy_update.tx_phy,
+                         p_gap_evt->params.phy_update.rx_phy);
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            m_links[p_gap_evt->conn_handle].params.conn_interval = p_gap_evt->params.conn_param_update.conn_params.max_conn_interval;
+            m_links[p_gap_evt->conn_handle].params.slave_latency = p_gap_evt->params.conn_param_update.conn_params.slave_latency;
+            m_links[p_gap_evt->conn_handle].params.sup_timeout   = p_gap_evt->params.conn_param_update.conn_params.conn_sup_timeout;
+            NRF_LOG_INFO("Connection interval %d units.", p_gap_evt->params.conn_param_update.conn_params.max_conn_interval);
+            break;
+
         case BLE_GATTC_EVT_TIMEOUT:
             // Disconnect on GATT Client timeout event.
             NRF_LOG_DEBUG("GATT Client Timeout.");
@@ -562,12 +1212,35 @@ static void ble_stack_init(void)
     err_code = nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start);
     APP_ERROR_CHECK(err_code);
 
-    // Enable BLE stack.
+    // Several write commands per connection event, so commands go out at the link rate.
+    ble_cfg_t ble_cfg;
+
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag                                   = APP_BLE_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.gattc_conn_cfg.write_cmd_tx_queue_size = WRITE_CMD_TX_QUEUE_SIZE;
+    err_code = sd_ble_cfg_set(BLE_CONN_CFG_GATTC, &ble_cfg, ram_start);
+    APP_ERROR_CHECK(err_code);
+
+    // Enable BLE stack. ram_start comes back as the start the SoftDevice needs for this
+    // configuration; the linker RAM origin was set without a board, so report any difference.
+    uint32_t const app_ram_start = ram_start;
     err_code = nrf_sdh_ble_enable(&ram_start);
+    if (ram_start != app_ram_start)
+    {
+        NRF_LOG_WARNING("App RAM starts at 0x%x, the SoftDevice needs 0x%x: set the RAM ORIGIN in the linker script.",
+                        app_ram_start, ram_start);
+    }
     APP_ERROR_CHECK(err_code);
 
     // Register a handler for BLE events.
     NRF_SDH_BLE_OBSERVER(m_ble_observer, APP_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+    ble_opt_t opt;
+
+    memset(&opt, 0, sizeof(opt));
+    opt.common_opt.conn_evt_ext.enable = LINK_CONN_EVT_EXT;
+    err_code = sd_ble_opt_set(BLE_COMMON_OPT_CONN_EVT_EXT, &opt);
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -580,6 +1253,19 @@ void gatt_evt_handler(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t const * p_evt)
 
         m_ble_nus_max_data_len = p_evt->params.att_mtu_effective - OPCODE_LENGTH - HANDLE_LENGTH;
         NRF_LOG_INFO("Ble NUS max data length set to 0x%X(%d)", m_ble_nus_max_data_len, m_ble_nus_max_data_len);
+        if (p_evt->conn_handle < LINK_COUNT)
+        {
+            m_links[p_evt->conn_handle].params.att_mtu = p_evt->params.att_mtu_effective;
+            ble_nus_c_att_mtu_set(&m_ble_nus_c[p_evt->conn_handle], p_evt->params.att_mtu_effective);
+        }
+    }
+    else if (p_evt->evt_id == NRF_BLE_GATT_EVT_DATA_LENGTH_UPDATED)
+    {
+        NRF_LOG_INFO("Data length set to %d.", p_evt->params.data_length);
+        if (p_evt->conn_handle < LINK_COUNT)
+        {
+            m_links[p_evt->conn_handle].params.data_length = p_evt->params.data_length;
+        }
     }
 }
 
@@ -592,7 +1278,10 @@ void gatt_init(void)
     err_code = nrf_ble_gatt_init(&m_gatt, gatt_evt_handler);
     APP_ERROR_CHECK(err_code);
 
-    err_code = nrf_ble_gatt_att_mtu_central_set(&m_gatt, NRF_SDH_BLE_GATT_MAX_MTU_SIZE);
+    err_code = nrf_ble_gatt_att_mtu_central_set(&m_gatt, LINK_ATT_MTU);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_ble_gatt_data_length_set(&m_gatt, BLE_CONN_HANDLE_INVALID, LINK_DATA_LENGTH);
     APP_ERROR_CHECK(err_code);
 
 }
@@ -613,11 +1302,14 @@ void bsp_event_handler(bsp_event_t event)
             break;
 
         case BSP_EVENT_DISCONNECT:
-            err_code = sd_ble_gap_disconnect(m_ble_nus_c.conn_handle,
-                                             BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
-            if (err_code != NRF_ERROR_INVALID_STATE)
+            for (int i = 0; i < LINK_COUNT; i++)
             {
-                APP_ERROR_CHECK(err_code);
+                err_code = sd_ble_gap_disconnect(m_ble_nus_c[i].conn_handle,
+                                                 BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+                if ((err_code != NRF_ERROR_INVALID_STATE) && (err_code != BLE_ERROR_INVALID_CONN_HANDLE))
+                {
+                    APP_ERROR_CHECK(err_code);
+                }
             }
             break;
 
@@ -634,9 +1326,18 @@ static void nus_c_init(void)
     ble_nus_c_init_t init;
 
     init.evt_handler = ble_nus_c_evt_handler;
+    init.p_chars     = hearable_gatt_chars;
+    init.char_count  = hearable_gatt_char_count;
+    init.sink        = stream_data_put;
 
-    err_code = ble_nus_c_init(&m_ble_nus_c, &init);
-    APP_ERROR_CHECK(err_code);
+    for (int i = 0; i < LINK_COUNT; i++)
+    {
+        // Stream notifications go straight from the NUS client to the rings of the link.
+        init.p_sink_context = &m_links[i];
+
+        err_code = ble_nus_c_init(&m_ble_nus_c[i], &init);
+        APP_ERROR_CHECK(err_code);
+    }
 }
 
 
@@ -656,20 +1357,729 @@ static void buttons_leds_init(void)
 
 //USB Code start
 
-/** @brief User event handler @ref app_usbd_cdc_acm_user_ev_handler_t */
-static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
-                                    app_usbd_cdc_acm_user_event_t event)
+/**@brief Function for queueing the hardware name packet of a link. */
+static void usb_tx_queue_name(link_t * p_link)
 {
-    app_usbd_cdc_acm_t const * p_cdc_acm = app_usbd_cdc_acm_class_get(p_inst);
+    usb_frame_info_t info;
 
-    switch (event)
+    info.p_tag     = NAME_PREFIX;
+    info.stream_id = USB_FRAME_STREAM_ID_NAME;
+    info.link      = (uint8_t)(p_link - m_links);
+    info.seq       = p_link->name_seq++;
+    info.timestamp = app_timer_cnt_get();
+    info.records   = false;
+
+    memcpy(&p_link->name_buffer[USB_FRAME_HEADER_MAX_LEN], p_link->name, p_link->name_len);
+    data_path_tx_push(&m_data_path, &info, &p_link->name_buffer[USB_FRAME_HEADER_MAX_LEN], p_link->name_len, &p_link->name_queued);
+}
+
+
+/**@brief Function for queueing a STAT packet with the counters of every stream of every link. */
+static void usb_tx_queue_stat(void)
+{
+    usb_frame_info_t info;
+    uint8_t        * p_payload  = &statBuffer[USB_FRAME_HEADER_MAX_LEN];
+    uint16_t         offset     = 0;
+    uint32_t         now        = app_timer_cnt_get();
+    uint32_t         elapsed_ms = (uint32_t)(((uint64_t)app_timer_cnt_diff_compute(now, m_stat_prev_ticks) * 1000) / APP_TIMER_CLOCK_FREQ);
+
+    m_stat_prev_ticks = now;
+
+    p_payload[offset++] = STAT_VERSION;
+    p_payload[offset++] = LINK_COUNT;
+    p_payload[offset++] = STREAM_COUNT;
+    p_payload[offset++] = 0;
+    offset += uint16_encode((uint16_t)MIN(elapsed_ms, UINT16_MAX), &p_payload[offset]);
+
+    for (int i = 0; i < LINK_COUNT*STREAM_COUNT; i++)
     {
-        case APP_USBD_CDC_ACM_USER_EVT_PORT_OPEN:
+        pktbuf_t const          * p_ring        = &m_data_path.ring[RING_LINK(i)][RING_STREAM(i)];
+        pktbuf_stats_t const    * p_stats       = &p_ring->stats;
+        data_path_stats_t const * p_usb_stats   = &m_data_path.stats[RING_LINK(i)][RING_STREAM(i)];
+        uint32_t                * p_prev        = &m_links[RING_LINK(i)].stat_notifications_prev[RING_STREAM(i)];
+        uint32_t                  notifications = p_stats->puts + p_stats->drops;
+        uint32_t                  rate          = 0;
+
+        if (elapsed_ms > 0)
         {
-            /*Set up the first transfer*/
-            ret_code_t ret = app_usbd_cdc_acm_read(&m_app_cdc_acm,
-                                                   m_cdc_data_array,
-                                                   1);
+            rate = (uint32_t)(((uint64_t)(notifications - *p_prev) * 1000) / elapsed_ms);
+        }
+        *p_prev = notifications;
+
+        offset += uint32_encode(notifications, &p_payload[offset]);
+        offset += uint32_encode(p_stats->bytes_in, &p_payload[offset]);
+        offset += uint32_encode(p_stats->bytes_dropped, &p_payload[offset]);
+        offset += uint32_encode(p_usb_stats->bytes_out, &p_payload[offset]);
+        offset += uint32_encode(p_usb_stats->usb_write_failures, &p_payload[offset]);
+        offset += uint16_encode((uint16_t)MIN(rate, UINT16_MAX), &p_payload[offset]);
+        p_payload[offset++] = p_stats->frames_hwm;
+        p_payload[offset++] = p_ring->limit;
+    }
+
+    offset += uint32_encode(m_loop_stats.wakeups, &p_payload[offset]);
+    p_payload[offset++] = LOOP_LATENCY_BINS;
+    for (int i = 0; i < LOOP_LATENCY_BINS; i++)
+    {
+        offset += uint16_encode(m_loop_stats.latency_hist[i], &p_payload[offset]);
+    }
+    memset(&m_loop_stats, 0, sizeof(m_loop_stats));
+
+    info.p_tag     = STAT_PREFIX;
+    info.stream_id = USB_FRAME_STREAM_ID_STAT;
+    info.link      = 0;
+    info.seq       = m_stat_seq++;
+    info.timestamp = now;
+    info.records   = false;
+
+    data_path_tx_push(&m_data_path, &info, p_payload, offset, &m_usb_tx_stat_queued);
+}
+
+
+/**@brief Function for queueing the LINK packet of a link, with its parameters, signal strength and
+ *        the notifications it carried per connection event since its previous LINK packet.
+ */
+static void usb_tx_queue_link(link_t * p_link)
+{
+    usb_frame_info_t      info;
+    link_params_t const * p_params   = &p_link->params;
+    uint8_t             * p_payload  = &p_link->link_buffer[USB_FRAME_HEADER_MAX_LEN];
+    uint16_t              offset     = 0;
+    uint8_t               link       = (uint8_t)(p_link - m_links);
+    int8_t                rssi       = LINK_RSSI_UNKNOWN;
+    uint8_t               ch_index   = 0;
+    uint32_t              now        = app_timer_cnt_get();
+    uint32_t              elapsed_ms = (uint32_t)(((uint64_t)app_timer_cnt_diff_compute(now, p_link->link_prev_ticks) * 1000) / APP_TIMER_CLOCK_FREQ);
+    uint32_t              notifications = p_link->notifications - p_link->link_notifications_prev;
+    uint32_t              events     = 0;
+    uint32_t              per_event  = 0;
+    clock_sync_report_t   clock;
+
+    p_link->link_prev_ticks         = now;
+    p_link->link_notifications_prev = p_link->notifications;
+
+    // The clock samples are added from the BLE event handler.
+    CRITICAL_REGION_ENTER();
+    clock_sync_report(&p_link->clock, now, &clock);
+    CRITICAL_REGION_EXIT();
+
+    // Fails until the first packet of the link has been measured, or once the link is gone.
+    if (sd_ble_gap_rssi_get(link, &rssi, &ch_index) != NRF_SUCCESS)
+    {
+        rssi     = LINK_RSSI_UNKNOWN;
+        ch_index = 0;
+    }
+    // The dongle is the master, so it opens every connection event whatever the slave latency.
+    if (p_params->conn_interval > 0)
+    {
+        events = (elapsed_ms * 4) / (p_params->conn_interval * 5);
+    }
+    if (events > 0)
+    {
+        per_event = (uint32_t)(((uint64_t)notifications * 100) / events);
+    }
+
+    p_payload[offset++] = LINK_VERSION;
+    p_payload[offset++] = link;
+    p_payload[offset++] = p_params->tx_phy;
+    p_payload[offset++] = p_params->rx_phy;
+    p_payload[offset++] = (uint8_t)rssi;
+    p_payload[offset++] = ch_index;
+    offset += uint16_encode(p_params->conn_interval, &p_payload[offset]);
+    offset += uint16_encode(p_params->slave_latency, &p_payload[offset]);
+    offset += uint16_encode(p_params->sup_timeout, &p_payload[offset]);
+    offset += uint16_encode(p_params->att_mtu, &p_payload[offset]);
+    offset += uint16_encode(p_params->data_length, &p_payload[offset]);
+    offset += uint16_encode((uint16_t)MIN(elapsed_ms, UINT16_MAX), &p_payload[offset]);
+    offset += uint32_encode(notifications, &p_payload[offset]);
+    offset += uint16_encode((uint16_t)MIN(events, UINT16_MAX), &p_payload[offset]);
+    offset += uint16_encode((uint16_t)MIN(per_event, UINT16_MAX), &p_payload[offset]);
+    p_payload[offset++] = (uint8_t)clock.state;
+    offset += uint32_encode(clock.dev_anchor, &p_payload[offset]);
+    offset += uint32_encode(clock.rx_anchor, &p_payload[offset]);
+    offset += uint32_encode((uint32_t)clock.offset_us, &p_payload[offset]);
+    offset += uint32_encode((uint32_t)clock.drift_ppb, &p_payload[offset]);
+    offset += uint16_encode(clock.samples, &p_payload[offset]);
+    offset += uint16_encode(clock.rejected, &p_payload[offset]);
+
+    info.p_tag     = LINK_PREFIX;
+    info.stream_id = USB_FRAME_STREAM_ID_LINK;
+    info.link      = link;
+    info.seq       = p_link->link_seq++;
+    info.timestamp = now;
+    info.records   = false;
+
+    data_path_tx_push(&m_data_path, &info, p_payload, offset, &p_link->link_queued);
+}
+
+
+/**@brief Function for queueing the responses to host commands, oldest first, and freeing the
+ *        slots of those already written.
+ */
+static void usb_tx_queue_resps(void)
+{
+    while ((m_host_resp_count > 0)
+            && !m_host_resps[m_host_resp_head].ready
+            && !m_host_resps[m_host_resp_head].queued)
+    {
+        m_host_resp_head = (m_host_resp_head + 1) % RESP_SLOTS;
+        m_host_resp_count--;
+    }
+
+    for (int i = 0; (i < m_host_resp_count) && data_path_tx_room(&m_data_path); i++)
+    {
+        host_resp_t    * p_resp = &m_host_resps[(m_host_resp_head + i) % RESP_SLOTS];
+        usb_frame_info_t info;
+
+        if (!p_resp->ready)
+        {
+            continue;
+        }
+        p_resp->ready  = false;
+        info.p_tag     = RESP_PREFIX;
+        info.stream_id = USB_FRAME_STREAM_ID_RESP;
+        info.link      = 0;
+        info.seq       = m_host_resp_seq++;
+        info.timestamp = app_timer_cnt_get();
+        info.records   = false;
+
+        data_path_tx_push(&m_data_path, &info, &p_resp->buffer[USB_FRAME_HEADER_MAX_LEN], p_resp->len, &p_resp->queued);
+    }
+}
+
+
+/**@brief Function for asking for a STAT packet, and a LINK packet for every connected link. */
+static void stats_request(void)
+{
+    for (int i = 0; i < LINK_COUNT; i++)
+    {
+        if (m_links[i].in_use)
+        {
+            m_links[i].link_requested = true;
+        }
+    }
+    m_stat_requested = true;
+}
+
+
+/**@brief Function for topping up the USB transmit queue from the stream rings. */
+static void usb_tx_queue_fill(void)
+{
+    // Responses, names, statistics and telemetry go ahead of stream data, or they would never get through while the link is saturated.
+    usb_tx_queue_resps();
+    if (m_stat_requested && !m_usb_tx_stat_queued && data_path_tx_room(&m_data_path))
+    {
+        m_stat_requested = false;
+        usb_tx_queue_stat();
+    }
+    for (int i = 0; (i < LINK_COUNT) && data_path_tx_room(&m_data_path); i++)
+    {
+        if (m_links[i].link_requested && !m_links[i].link_queued)
+        {
+            m_links[i].link_requested = false;
+            usb_tx_queue_link(&m_links[i]);
+        }
+    }
+    for (int i = 0; (i < LINK_COUNT) && data_path_tx_room(&m_data_path); i++)
+    {
+        if (m_links[i].name_received && !m_links[i].name_queued)
+        {
+            m_links[i].name_received = false;
+            usb_tx_queue_name(&m_links[i]);
+        }
+    }
+
+    data_path_tx_fill(&m_data_path);
+}
+
+
+/**@brief Function for finding the connected Hearables a characteristic can be written on.
+ *
+ * @param[in] char_uuid Characteristic to write.
+ *
+ * @return The links, one bit each.
+ */
+static uint8_t nus_c_links_get(uint16_t char_uuid)
+{
+    uint8_t links = 0;
+
+    for (int i = 0; i < LINK_COUNT; i++)
+    {
+        ble_nus_c_t * p_nus_c = &m_ble_nus_c[i];
+
+        if ((p_nus_c->conn_handle != BLE_CONN_HANDLE_INVALID)
+                && (ble_nus_c_handle_get(p_nus_c, char_uuid) != BLE_GATT_HANDLE_INVALID))
+        {
+            links |= (1 << i);
+        }
+    }
+    return links;
+}
+
+
+/**@brief Function for writing a command to the same characteristic of the Hearables it still has
+ *        to reach.
+ *
+ * @details A link that takes the command, or has dropped since, is cleared from the command's
+ *          links. A link whose write queue is full stays set, for a retry.
+ *
+ * @param[in] p_entry   Command.
+ * @param[in] p_data    Bytes to write.
+ * @param[in] len       Number of bytes.
+ * @param[in] char_uuid Characteristic to write.
+ */
+static void nus_c_send_links(host_cmd_entry_t * p_entry, uint8_t const * p_data, uint16_t len, uint16_t char_uuid)
+{
+    for (int i = 0; i < LINK_COUNT; i++)
+    {
+        ble_nus_c_t * p_nus_c = &m_ble_nus_c[i];
+        uint16_t      handle  = ble_nus_c_handle_get(p_nus_c, char_uuid);
+        ret_code_t    ret;
+
+        if ((p_entry->links & (1 << i)) == 0)
+        {
+            continue;
+        }
+        if (handle == BLE_GATT_HANDLE_INVALID)
+        {
+            ret = NRF_ERROR_INVALID_STATE;
+        }
+        else
+        {
+            // Queued, so a full SoftDevice buffer only delays the command.
+            ret = ble_nus_c_string_send(p_nus_c, (uint8_t *)p_data, len, handle);
+        }
+
+        switch (ret)
+        {
+            case NRF_ERROR_NO_MEM:
+                continue;
+
+            case NRF_SUCCESS:
+                break;
+
+            case NRF_ERROR_INVALID_STATE:
+                NRF_LOG_INFO("Link %d dropped, command 0x%x not sent to it.", i, p_entry->type);
+                break;
+
+            default:
+                NRF_LOG_ERROR("Command 0x%x failed on link %d, error 0x%x.", p_entry->type, i, ret);
+                p_entry->failed = true;
+                break;
+        }
+        p_entry->links &= ~(1 << i);
+    }
+}
+
+
+/**@brief Function for reading the hardware name of every connected Hearable. A link without one
+ *        sends an empty name, so the host hears from every link.
+ */
+static void name_request_all(void)
+{
+    for (int i = 0; i < LINK_COUNT; i++)
+    {
+        uint16_t hw_rev_handle = ble_nus_c_handle_get(&m_ble_nus_c[i], BLE_UUID_HARDWARE_REVISION_STRING_CHAR);
+
+        if ((hw_rev_handle != BLE_GATT_HANDLE_INVALID) && (m_ble_nus_c[i].conn_handle != BLE_CONN_HANDLE_INVALID)) //if connected and service exists
+        {
+            if (ble_nus_c_read(&m_ble_nus_c[i], hw_rev_handle, NULL) == NRF_SUCCESS)
+            {
+                NRF_LOG_INFO("Name requested on link %d", i);
+            }
+        }
+        else
+        {
+            m_links[i].name_len = 0;
+            m_links[i].name_received = true; //Send out dummy data to indicate lack of connection
+        }
+    }
+}
+
+
+/**@brief Function for carrying out a host command that stays on the dongle.
+ *
+ * @return Status to answer a binary command with.
+ */
+static host_cmd_status_t host_cmd_local_execute(host_cmd_entry_t const * p_entry)
+{
+    uint8_t const * p_payload = p_entry->payload;
+    uint16_t        len       = p_entry->len;
+
+    switch (p_entry->type)
+    {
+        case HOST_CMD_TYPE_FORMAT:
+            VERIFY_TRUE((len == 1) && ((p_payload[0] == USB_FRAME_FORMAT_V1) || (p_payload[0] == USB_FRAME_FORMAT_V2)),
+                        HOST_CMD_STATUS_BAD_LENGTH);
+            m_data_path.format = (usb_frame_format_t)p_payload[0]; //Applies from the next packet queued
+            NRF_LOG_INFO("USB frame format %d", p_payload[0]);
+            return HOST_CMD_STATUS_OK;
+
+        case HOST_CMD_TYPE_RECORDS:
+            VERIFY_TRUE((len == 1) && (p_payload[0] <= 1), HOST_CMD_STATUS_BAD_LENGTH);
+            m_data_path.records = (p_payload[0] != 0); //Applies from the next notification received
+            NRF_LOG_INFO("Record mode %s", m_data_path.records ? "on" : "off");
+            return HOST_CMD_STATUS_OK;
+
+        case HOST_CMD_TYPE_STATS:
+            VERIFY_TRUE(len == 0, HOST_CMD_STATUS_BAD_LENGTH);
+            stats_request();
+            return HOST_CMD_STATUS_OK;
+
+        case HOST_CMD_TYPE_UNAME:
+            VERIFY_TRUE(len == 0, HOST_CMD_STATUS_BAD_LENGTH);
+            name_request_all();
+            return HOST_CMD_STATUS_OK;
+
+        case HOST_CMD_TYPE_BENCH:
+            VERIFY_TRUE((len == 1) || (len == BENCH_PAYLOAD_LENGTH), HOST_CMD_STATUS_BAD_LENGTH);
+            if (len == 1)
+            {
+                return bench_set(p_payload[0] != 0, BENCH_CHUNK_DEFAULT, 0);
+            }
+            return bench_set(p_payload[0] != 0, uint16_decode(&p_payload[1]), uint32_decode(&p_payload[3]));
+
+        case HOST_CMD_TYPE_PING:
+            return HOST_CMD_STATUS_OK;
+
+        default:
+            return HOST_CMD_STATUS_UNKNOWN;
+    }
+}
+
+
+/**@brief Function for taking a host command one step further.
+ *
+ * @details A command for the Hearables is written to every connected one. Links whose write
+ *          queue is full are tried again on later calls, until they take it or the retries run out.
+ *
+ * @param[in]  p_entry  Command.
+ * @param[out] p_status Status to answer a binary command with, once done.
+ *
+ * @return True once the command is done.
+ */
+static bool host_cmd_step(host_cmd_entry_t * p_entry, host_cmd_status_t * p_status)
+{
+    static uint8_t const start_cmd = 1;
+    static uint8_t const stop_cmd  = 0;
+    uint8_t const *      p_data    = p_entry->payload;
+    uint16_t             len       = p_entry->len;
+    uint16_t             char_uuid;
+    uint16_t             min_len;       // Of the payload from the host
+    uint16_t             max_len;
+
+    if (p_entry->status != HOST_CMD_STATUS_OK)
+    {
+        NRF_LOG_WARNING("Command 0x%x, request %d: framing error %d.", p_entry->type, p_entry->req_id, p_entry->status);
+        *p_status = p_entry->status;
+        return true;
+    }
+
+    switch (p_entry->type)
+    {
+        case HOST_CMD_TYPE_START:
+            p_data       = &start_cmd;
+            char_uuid    = BLE_UUID_DEV_CTRL_RX_CHARACTERISTIC;
+            min_len      = 0;
+            max_len      = 0;
+            len          = sizeof(start_cmd);
+            break;
+
+        case HOST_CMD_TYPE_STOP:
+            p_data       = &stop_cmd;
+            char_uuid    = BLE_UUID_DEV_CTRL_RX_CHARACTERISTIC;
+            min_len      = 0;
+            max_len      = 0;
+            len          = sizeof(stop_cmd);
+            break;
+
+        case HOST_CMD_TYPE_CONFIG_EEG:
+            char_uuid    = BLE_UUID_NUS_EEG_RX_CHARACTERISTIC;
+            min_len      = EEG_CONFIG_LENGTH;
+            max_len      = HOST_CMD_PAYLOAD_MAX;
+            break;
+
+        case HOST_CMD_TYPE_CONFIG_PPG:
+            char_uuid    = BLE_UUID_NUS_PPG_RX_CHARACTERISTIC;
+            min_len      = PPG_CONFIG_LENGTH;
+            max_len      = HOST_CMD_PAYLOAD_MAX;
+            break;
+
+        case HOST_CMD_TYPE_CONFIG_ACC:
+            char_uuid    = BLE_UUID_NUS_ACC_RX_CHARACTERISTIC;
+            min_len      = ACC_CONFIG_LENGTH;
+            max_len      = HOST_CMD_PAYLOAD_MAX;
+            break;
+
+        default:
+            *p_status = host_cmd_local_execute(p_entry);
+            return true;
+    }
+
+    if (!p_entry->started)
+    {
+        if ((p_entry->len < min_len) || (p_entry->len > max_len))
+        {
+            *p_status = HOST_CMD_STATUS_BAD_LENGTH;
+            return true;
+        }
+        p_entry->started = true;
+        p_entry->links   = nus_c_links_get(char_uuid);
+        if (p_entry->links == 0)
+        {
+            NRF_LOG_INFO("BLE NUS unavailable, command 0x%x dropped.", p_entry->type);
+            *p_status = HOST_CMD_STATUS_NOT_CONNECTED;
+            return true;
+        }
+        if (p_entry->type == HOST_CMD_TYPE_START)
+        {
+            // Discard stale data from the consumer side; re-initialising would race with the BLE handler.
+            data_path_flush(&m_data_path);
+        }
+    }
+    else if (app_timer_cnt_diff_compute(app_timer_cnt_get(), p_entry->retry_ticks) < APP_TIMER_TICKS(HOST_CMD_RETRY_MS))
+    {
+        return false;
+    }
+
+    nus_c_send_links(p_entry, p_data, len, char_uuid);
+
+    if (p_entry->links != 0)
+    {
+        if (p_entry->retries < HOST_CMD_RETRIES)
+        {
+            p_entry->retries++;
+            p_entry->retry_ticks = app_timer_cnt_get();
+            return false;
+        }
+        NRF_LOG_ERROR("BLE NUS command queue full, command 0x%x dropped after %d retries.", p_entry->type, p_entry->retries);
+        *p_status = HOST_CMD_STATUS_QUEUE_FULL;
+        return true;
+    }
+
+    if (p_entry->failed)
+    {
+        *p_status = HOST_CMD_STATUS_FAILED;
+        return true;
+    }
+    if (p_entry->type >= HOST_CMD_TYPE_CONFIG_EEG)
+    {
+        bsp_indication_set(BSP_INDICATE_SENT_OK);
+    }
+    *p_status = HOST_CMD_STATUS_OK;
+    return true;
+}
+
+
+/**@brief Function for answering a binary host command.
+ *
+ * @param[in] type   Type of the command answered.
+ * @param[in] req_id Request id of the command answered.
+ * @param[in] status Status of the command.
+ * @param[in] p_data Data returned with the status, or NULL.
+ * @param[in] len    Length of the data.
+ */
+static void host_resp_send(uint8_t type, uint8_t req_id, host_cmd_status_t status, uint8_t const * p_data, uint16_t len)
+{
+    host_resp_t * p_resp;
+    uint8_t     * p_payload;
+
+    if (m_host_resp_count >= RESP_SLOTS)
+    {
+        NRF_LOG_WARNING("No room for the response to request %d.", req_id);
+        return;
+    }
+    p_resp    = &m_host_resps[(m_host_resp_head + m_host_resp_count) % RESP_SLOTS];
+    p_payload = &p_resp->buffer[USB_FRAME_HEADER_MAX_LEN];
+    m_host_resp_count++;
+
+    len          = MIN(len, HOST_CMD_PAYLOAD_MAX);
+    p_payload[0] = type;
+    p_payload[1] = req_id;
+    p_payload[2] = status;
+    if (p_data != NULL)
+    {
+        memcpy(&p_payload[RESP_HEADER_LENGTH], p_data, len);
+    }
+    p_resp->len   = RESP_HEADER_LENGTH + ((p_data != NULL) ? len : 0);
+    p_resp->ready = true;
+}
+
+
+/**@brief Function for running the waiting host commands, oldest first, from the main loop.
+ *
+ * @details A command the Hearables cannot take yet holds back the ones behind it, so they run and
+ *          are answered in the order they were sent. A binary command waits for a free response
+ *          slot before running.
+ */
+static void host_cmd_queue_process(void)
+{
+    while (m_host_cmd_count > 0)
+    {
+        host_cmd_entry_t * p_entry = &m_host_cmds[m_host_cmd_head];
+        host_cmd_status_t  status;
+
+        if (p_entry->binary && (m_host_resp_count >= RESP_SLOTS))
+        {
+            return;
+        }
+        if (!host_cmd_step(p_entry, &status))
+        {
+            return;
+        }
+
+        if (p_entry->binary)
+        {
+            // A ping echoes its payload, so the host can time the round trip of any size.
+            bool echo = (p_entry->type == HOST_CMD_TYPE_PING) && (status == HOST_CMD_STATUS_OK);
+
+            host_resp_send(p_entry->type, p_entry->req_id, status, echo ? p_entry->payload : NULL, p_entry->len);
+        }
+        m_host_cmd_head = (m_host_cmd_head + 1) % HOST_CMD_QUEUE_SIZE;
+        m_host_cmd_count--;
+    }
+}
+
+
+/**@brief Function for queueing a host command to run from the main loop.
+ *
+ * @return False if the queue is full.
+ */
+static bool host_cmd_enqueue(bool binary, host_cmd_status_t status, uint8_t type, uint8_t req_id,
+                             uint8_t const * p_payload, uint16_t len)
+{
+    host_cmd_entry_t * p_entry;
+
+    if (m_host_cmd_count >= HOST_CMD_QUEUE_SIZE)
+    {
+        return false;
+    }
+    p_entry = &m_host_cmds[(m_host_cmd_head + m_host_cmd_count) % HOST_CMD_QUEUE_SIZE];
+    m_host_cmd_count++;
+
+    memset(p_entry, 0, sizeof(host_cmd_entry_t));
+    p_entry->binary = binary;
+    p_entry->status = status;
+    p_entry->type   = type;
+    p_entry->req_id = req_id;
+    p_entry->len    = MIN(len, HOST_CMD_PAYLOAD_MAX);
+    if (p_payload != NULL)
+    {
+        memcpy(p_entry->payload, p_payload, p_entry->len);
+    }
+    return true;
+}
+
+
+#define ASCII_ARG_NONE -1   /**< The ASCII command has no payload. */
+#define ASCII_ARG_LINE -2   /**< The payload is the rest of the line. */
+
+/**@brief ASCII command, standing for a binary one. */
+typedef struct
+{
+    char const * p_text;    /**< Text the line starts with. */
+    uint8_t      type;      /**< Binary command type. */
+    int16_t      arg;       /**< Single payload byte, @ref ASCII_ARG_NONE or @ref ASCII_ARG_LINE. */
+    uint16_t     line_len;  /**< Payload length taken from the rest of the line, for @ref ASCII_ARG_LINE. */
+} ascii_cmd_t;
+
+static ascii_cmd_t const m_ascii_cmds[] =
+{
+    {"start",     HOST_CMD_TYPE_START,      ASCII_ARG_NONE, 0},
+    {"stop",      HOST_CMD_TYPE_STOP,       ASCII_ARG_NONE, 0},
+    {"format1",   HOST_CMD_TYPE_FORMAT,     USB_FRAME_FORMAT_V1, 0},
+    {"format2",   HOST_CMD_TYPE_FORMAT,     USB_FRAME_FORMAT_V2, 0},
+    {"records1",  HOST_CMD_TYPE_RECORDS,    1, 0},
+    {"records0",  HOST_CMD_TYPE_RECORDS,    0, 0},
+    {"stats",     HOST_CMD_TYPE_STATS,      ASCII_ARG_NONE, 0},
+    {"uname",     HOST_CMD_TYPE_UNAME,      ASCII_ARG_NONE, 0},
+    {"bench1",    HOST_CMD_TYPE_BENCH,      1, 0},
+    {"bench0",    HOST_CMD_TYPE_BENCH,      0, 0},
+    {"configeeg", HOST_CMD_TYPE_CONFIG_EEG, ASCII_ARG_LINE, EEG_CONFIG_LENGTH},
+    {"configppg", HOST_CMD_TYPE_CONFIG_PPG, ASCII_ARG_LINE, PPG_CONFIG_LENGTH},
+    {"configacc", HOST_CMD_TYPE_CONFIG_ACC, ASCII_ARG_LINE, ACC_CONFIG_LENGTH},
+};
+
+
+/**@brief Function for queueing an ASCII command line, the compatibility mode. It is not answered. */
+static void host_cmd_line_enqueue(uint8_t const * p_line, uint16_t len)
+{
+    for (int i = 0; i < ARRAY_SIZE(m_ascii_cmds); i++)
+    {
+        ascii_cmd_t const * p_ascii  = &m_ascii_cmds[i];
+        uint16_t            text_len = strlen(p_ascii->p_text);
+        uint8_t             arg;
+        bool                queued;
+
+        if ((len < text_len) || (memcmp(p_line, p_ascii->p_text, text_len) != 0))
+        {
+            continue;
+        }
+        if (p_ascii->arg == ASCII_ARG_LINE)
+        {
+            // Configuration bytes come raw after the text, so they must not hold '\r' or '\n'.
+            if (len - text_len < p_ascii->line_len)
+            {
+                break;
+            }
+            queued = host_cmd_enqueue(false, HOST_CMD_STATUS_OK, p_ascii->type, 0, &p_line[text_len], p_ascii->line_len);
+        }
+        else if (p_ascii->arg == ASCII_ARG_NONE)
+        {
+            queued = host_cmd_enqueue(false, HOST_CMD_STATUS_OK, p_ascii->type, 0, NULL, 0);
+        }
+        else
+        {
+            arg    = (uint8_t)p_ascii->arg;
+            queued = host_cmd_enqueue(false, HOST_CMD_STATUS_OK, p_ascii->type, 0, &arg, sizeof(arg));
+        }
+        if (!queued)
+        {
+            NRF_LOG_ERROR("Host command queue full, command dropped.");
+        }
+        return;
+    }
+    NRF_LOG_INFO("Invalid command");
+}
+
+
+/**@brief Function for handling a command split from the bytes read from the host.
+ *
+ * @details Only queues the command, so reading from USB never waits for the Hearables. Runs from
+ *          the main loop, like @ref host_cmd_queue_process.
+ */
+static void host_cmd_handler(host_cmd_t const * p_cmd)
+{
+    if (!p_cmd->binary)
+    {
+        NRF_LOG_HEXDUMP_DEBUG(p_cmd->p_data, p_cmd->len);
+        host_cmd_line_enqueue(p_cmd->p_data, p_cmd->len);
+        return;
+    }
+
+    if (!host_cmd_enqueue(true, p_cmd->status, p_cmd->type, p_cmd->req_id, p_cmd->p_data, p_cmd->len))
+    {
+        // Answered ahead of the commands still waiting.
+        NRF_LOG_ERROR("Host command queue full, request %d dropped.", p_cmd->req_id);
+        host_resp_send(p_cmd->type, p_cmd->req_id, HOST_CMD_STATUS_QUEUE_FULL, NULL, 0);
+    }
+}
+
+
+/** @brief User event handler @ref app_usbd_cdc_acm_user_ev_handler_t */
+static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
+                                    app_usbd_cdc_acm_user_event_t event)
+{
+    app_usbd_cdc_acm_t const * p_cdc_acm = app_usbd_cdc_acm_class_get(p_inst);
+
+    switch (event)
+    {
+        case APP_USBD_CDC_ACM_USER_EVT_PORT_OPEN:
+        {
+            host_cmd_parser_init(&m_host_cmd_parser, host_cmd_handler);
+            /*Set up the first transfer*/
+            ret_code_t ret = app_usbd_cdc_acm_read_any(&m_app_cdc_acm,
+                                                       m_cdc_rx_block,
+                                                       sizeof(m_cdc_rx_block));
             UNUSED_VARIABLE(ret);
             NRF_LOG_INFO("CDC ACM port opened");
             break;
@@ -680,149 +2090,28 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
             if (m_usb_connected)
             {
             }
+            data_path_tx_abort(&m_data_path);
             break;
 
         case APP_USBD_CDC_ACM_USER_EVT_TX_DONE:
+            data_path_tx_done(&m_data_path);
             break;
 
         case APP_USBD_CDC_ACM_USER_EVT_RX_DONE:
         {
-            ret_code_t ret,ble_ret;
-            static uint8_t index = 0;
-            uint8_t cmd[BLE_NUS_MAX_DATA_LEN];
-            uint16_t cmd_length;
-            index++;
+            ret_code_t ret;
 
+            /* Parse every block read, until the internal buffer is empty */
             do
             {
-                if ((m_cdc_data_array[index - 1] == '\n') ||
-                    (m_cdc_data_array[index - 1] == '\r') ||
-                    (index >= (m_ble_nus_max_data_len)))
-                {
-                    if (index > 1)
-                    {
-                        NRF_LOG_DEBUG("Ready to send data over BLE NUS");
-                        NRF_LOG_HEXDUMP_DEBUG(m_cdc_data_array, index);
-
-                        do
-                        {
-                            uint16_t length = (uint16_t)index;
-//                            if (length + sizeof(ENDLINE_STRING) < BLE_NUS_MAX_DATA_LEN)
-//                            {
-//                                memcpy(m_cdc_data_array + length, ENDLINE_STRING, sizeof(ENDLINE_STRING));
-//                                length += sizeof(ENDLINE_STRING);
-//                            }
-
-                            if (strncmp(m_cdc_data_array,"start",5)==0)
-                            {
-
-                            	ringbuf_init (&eegRing, ringBuffer, RINGBUF_SIZE);
-								ringbuf_init (&ppgRing, ringBuffer2, RINGBUF_SIZE);
-								ringbuf_init (&accRing, ringBuffer3, RINGBUF_SIZE);
-
-                            	cmd[0] = 1;
-                            	cmd_length=1;
-                            	ret = ble_nus_c_string_send(&m_ble_nus_c,
-									&cmd[0],
-									cmd_length,
-									m_ble_nus_c.handles.nus_dev_ctrl_rx_handle);
-                            }
-							else if (strncmp(m_cdc_data_array,"stop",4)==0)
-							{
-								cmd[0] = 0;
-								cmd_length=1;
-								ret = ble_nus_c_string_send(&m_ble_nus_c,
-									&cmd[0],
-									cmd_length,
-									m_ble_nus_c.handles.nus_dev_ctrl_rx_handle);
-							}
-							else if (strncmp(m_cdc_data_array,"uname",5)==0)
-							{
-								if ((m_ble_nus_c.handles.nus_dis_hw_rev_handle != BLE_GATT_HANDLE_INVALID) && (m_ble_nus_c.conn_handle != BLE_CONN_HANDLE_INVALID)) //if connected and service exists
-								{
-									ble_ret = sd_ble_gattc_read(m_ble_nus_c.conn_handle,m_ble_nus_c.handles.nus_dis_hw_rev_handle,0);
-//									APP_ERROR_CHECK(ble_ret);
-									if (ble_ret == NRF_SUCCESS) NRF_LOG_INFO("Name requested");
-								}
-								else
-								{
-									hardwareNameLength = 0;
-									nameReceived = true; //Send out dummy data to indicate lack of connection
-
-								}
-							}
-							else if ((strncmp(m_cdc_data_array,"configeeg",9)==0) && (length>=9+EEG_CONFIG_LENGTH))
-							{
-								for (int i=0;i<EEG_CONFIG_LENGTH;i++) cmd[i] = m_cdc_data_array[9+i];
-								cmd_length=EEG_CONFIG_LENGTH;
-								ret = ble_nus_c_string_send(&m_ble_nus_c,
-									&cmd[0],
-									cmd_length,
-									m_ble_nus_c.handles.nus_eeg_rx_handle);
-								if (ret==NRF_SUCCESS) bsp_indication_set(BSP_INDICATE_SENT_OK);
-							}
-							else if ((strncmp(m_cdc_data_array,"configppg",9)==0) && (length>=9+PPG_CONFIG_LENGTH))
-							{
-								for (int i=0;i<PPG_CONFIG_LENGTH;i++) cmd[i] = m_cdc_data_array[9+i];
-								cmd_length=PPG_CONFIG_LENGTH;
-								ret = ble_nus_c_string_send(&m_ble_nus_c,
-									&cmd[0],
-									cmd_length,
-									m_ble_nus_c.handles.nus_ppg_rx_handle);
-								if (ret==NRF_SUCCESS) bsp_indication_set(BSP_INDICATE_SENT_OK);
-							}
-							else if ((strncmp(m_cdc_data_array,"configacc",9)==0) && (length>=9+ACC_CONFIG_LENGTH))
-							{
-								for (int i=0;i<ACC_CONFIG_LENGTH;i++) cmd[i] = m_cdc_data_array[9+i];
-								cmd_length=ACC_CONFIG_LENGTH;
-								ret = ble_nus_c_string_send(&m_ble_nus_c,
-									&cmd[0],
-									cmd_length,
-									m_ble_nus_c.handles.nus_acc_rx_handle);
-								if (ret==NRF_SUCCESS) bsp_indication_set(BSP_INDICATE_SENT_OK);
-							}
-							else
-							{
-								NRF_LOG_INFO("Invalid command");
-								ret = NRF_SUCCESS;
-							}
-
-
-                            if (ret == NRF_ERROR_NOT_FOUND)
-                            {
-                                NRF_LOG_INFO("BLE NUS unavailable, data received: %s", m_cdc_data_array);
-                                break;
-                            }
-
-                            if (ret == NRF_ERROR_RESOURCES)
-                            {
-                                NRF_LOG_ERROR("BLE NUS Too many notifications queued.");
-                                break;
-                            }
-
-                            if ((ret != NRF_ERROR_INVALID_STATE) && (ret != NRF_ERROR_BUSY))
-                            {
-                                APP_ERROR_CHECK(ret);
-                            }
-                        }
-                        while (ret == NRF_ERROR_BUSY);
-                    }
-
-                    index = 0;
-                }
-
-                /*Get amount of data transferred*/
                 size_t size = app_usbd_cdc_acm_rx_size(p_cdc_acm);
-                NRF_LOG_DEBUG("RX: size: %lu char: %c", size, m_cdc_data_array[index - 1]);
 
-                /* Fetch data until internal buffer is empty */
-                ret = app_usbd_cdc_acm_read(&m_app_cdc_acm,
-                                            &m_cdc_data_array[index],
-                                            1);
-                if (ret == NRF_SUCCESS)
-                {
-                    index++;
-                }
+                NRF_LOG_DEBUG("RX: size: %lu", size);
+                host_cmd_parse(&m_host_cmd_parser, m_cdc_rx_block, size);
+
+                ret = app_usbd_cdc_acm_read_any(&m_app_cdc_acm,
+                                                m_cdc_rx_block,
+                                                sizeof(m_cdc_rx_block));
             }
             while (ret == NRF_SUCCESS);
 
@@ -847,6 +2136,8 @@ static void usbd_user_ev_handler(app_usbd_event_type_t event)
             break;
 
         case APP_USBD_EVT_STOPPED:
+            // Transfers aborted by the stop never report TX_DONE.
+            data_path_tx_abort(&m_data_path);
             app_usbd_disable();
             break;
 
@@ -883,11 +2174,105 @@ static void usbd_user_ev_handler(app_usbd_event_type_t event)
 // USB CODE END
 
 
+/**@brief Function for counting a pass through the main loop, and binning the delay since the
+ *        packet commit that woke it, if any.
+ */
+static void loop_wakeup_record(void)
+{
+    uint32_t delay;
+    uint8_t  bin = 0;
+
+    m_loop_stats.wakeups++;
+    if (!m_commit_pending)
+    {
+        return;
+    }
+    delay = app_timer_cnt_diff_compute(app_timer_cnt_get(), m_commit_ticks);
+    m_commit_pending = false;
+
+    while ((bin < LOOP_LATENCY_BINS - 1) && (delay >= (1UL << bin)))
+    {
+        bin++;
+    }
+    if (m_loop_stats.latency_hist[bin] < UINT16_MAX)
+    {
+        m_loop_stats.latency_hist[bin]++;
+    }
+}
+
+
+/**@brief Function for handling the flush timer. The partial packets are committed and the
+ *        benchmark chunks generated from the main loop.
+ */
+static void flush_timer_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+    m_flush_tick = true;
+    m_bench_tick = true;
+}
+
+
+/**@brief Function for committing the partial packets of streams whose data has waited too long,
+ *        once per flush timer tick.
+ */
+static void stream_latency_check(void)
+{
+    if (!m_flush_tick)
+    {
+        return;
+    }
+    m_flush_tick = false;
+
+    data_path_tick(&m_data_path);
+}
+
+
+#if STATS_INTERVAL_MS > 0
+/**@brief Function for handling the statistics timer. */
+static void stats_timer_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+    stats_request();
+}
+#endif
+
+
+/**@brief Function for retrying and timing out the GATT requests of every link.
+ *
+ * @details Runs at the BLE event priority, like the request queues it works.
+ */
+static void gatt_req_timer_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    for (int i = 0; i < LINK_COUNT; i++)
+    {
+        ble_nus_c_req_tick(&m_ble_nus_c[i], GATT_REQ_TICK_MS);
+    }
+}
+
+
 /**@brief Function for initializing the timer. */
 static void timer_init(void)
 {
     ret_code_t err_code = app_timer_init();
     APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_flush_timer, APP_TIMER_MODE_REPEATED, flush_timer_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_gatt_req_timer, APP_TIMER_MODE_REPEATED, gatt_req_timer_handler);
+    APP_ERROR_CHECK(err_code);
+
+#if STATS_INTERVAL_MS > 0
+    err_code = app_timer_create(&m_stats_timer, APP_TIMER_MODE_REPEATED, stats_timer_handler);
+    APP_ERROR_CHECK(err_code);
+#endif
+
+#if FAST_RECONNECT_WINDOW_MS > 0
+    err_code = app_timer_create(&m_fast_reconnect_timer, APP_TIMER_MODE_SINGLE_SHOT, fast_reconnect_timer_handler);
+    APP_ERROR_CHECK(err_code);
+#endif
 }
 
 
@@ -927,7 +2312,7 @@ static void idle_state_handle(void)
 {
     if (NRF_LOG_PROCESS() == false)
     {
-//        nrf_pwr_mgmt_run();
+        nrf_pwr_mgmt_run();
     }
 }
 
@@ -935,7 +2320,6 @@ static void idle_state_handle(void)
 int main(void)
 {
     // Initialize.
-	int i;
 	ret_code_t ret;
 	static const app_usbd_config_t usbd_config = {.ev_state_proc = usbd_user_ev_handler    };
     log_init();
@@ -955,6 +2339,9 @@ int main(void)
     ble_stack_init();
     gatt_init();
     nus_c_init();
+    ret = handle_cache_init(crc16_compute((uint8_t const *)hearable_gatt_chars,
+                                     hearable_gatt_char_count * sizeof(hearable_gatt_chars[0]), NULL));
+    APP_ERROR_CHECK(ret);
     scan_init();
     
 	ret = app_usbd_power_events_enable();
@@ -965,33 +2352,23 @@ int main(void)
     /////////////////////
     //Ring buffer init
 
-    ringbuf_init (&eegRing, ringBuffer, RINGBUF_SIZE);
-    ringbuf_init (&ppgRing, ringBuffer2, RINGBUF_SIZE);
-    ringbuf_init (&accRing, ringBuffer3, RINGBUF_SIZE);
-
-
-    //TODO Fix this initialisation so that it automatically changes with changes in prefix and prefix length
-    	usbBuffer[0][0]='E';
-    	usbBuffer[0][1]='E';
-    	usbBuffer[0][2]='G';
-    	usbBuffer[0][3]='_';
-
-    	usbBuffer[1][0]='P';
-    	usbBuffer[1][1]='P';
-    	usbBuffer[1][2]='G';
-    	usbBuffer[1][3]='_';
-
-    	usbBuffer[2][0]='A';
-		usbBuffer[2][1]='C';
-		usbBuffer[2][2]='C';
-		usbBuffer[2][3]='_';
+    {
+        data_path_cfg_t cfg;
 
-		usbBuffer[3][0]='N';
-		usbBuffer[3][1]='A';
-		usbBuffer[3][2]='M';
-		usbBuffer[3][3]='E';
+        data_path_cfg_default(&cfg, LINK_COUNT);
+        ret = data_path_init(&m_data_path, &cfg, packetPool, sizeof(packetPool), &m_app_cdc_acm);
+        APP_ERROR_CHECK(ret);
+    }
     ///////////////////////////////////
 
+    ret = app_timer_start(m_flush_timer, APP_TIMER_TICKS(FLUSH_TIMER_TICK_MS), NULL);
+    APP_ERROR_CHECK(ret);
+    ret = app_timer_start(m_gatt_req_timer, APP_TIMER_TICKS(GATT_REQ_TICK_MS), NULL);
+    APP_ERROR_CHECK(ret);
+#if STATS_INTERVAL_MS > 0
+    ret = app_timer_start(m_stats_timer, APP_TIMER_TICKS(STATS_INTERVAL_MS), NULL);
+    APP_ERROR_CHECK(ret);
+#endif
 
 
     // Start execution.
@@ -999,39 +2376,21 @@ int main(void)
     NRF_LOG_INFO("BLE UART central example started.");
     scan_start();
 
-    // Enter main loop.
+    // Enter main loop. It sleeps until an interrupt: BLE events, USB events or the app_timer, whose
+    // flush timer also retries USB writes the driver refused.
     for (;;)
     {
+		loop_wakeup_record();
 		while (app_usbd_event_queue_process());
 
-		while (ringbuf_elements(&eegRing) >= (USB_PACKET_SIZE-PREFIX_LENGTH))
-		{
-			for (i=0;i<(USB_PACKET_SIZE-PREFIX_LENGTH);i++) 	usbBuffer[0][i+PREFIX_LENGTH] = ringbuf_get(&eegRing);
-			ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &usbBuffer[0],USB_PACKET_SIZE);
-			if(ret != NRF_SUCCESS) NRF_LOG_INFO("CDC ACM unavailable");
-		}
-
-		while (ringbuf_elements(&ppgRing) >= (USB_PACKET_SIZE -PREFIX_LENGTH))
-		{
-			for (i=0;i<(USB_PACKET_SIZE-PREFIX_LENGTH);i++) 	usbBuffer[1][i+PREFIX_LENGTH] = ringbuf_get(&ppgRing);
-			ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &usbBuffer[1],USB_PACKET_SIZE);
-			if(ret != NRF_SUCCESS) NRF_LOG_INFO("CDC ACM unavailable");
-		}
-
-		while (ringbuf_elements(&accRing) >= (USB_PACKET_SIZE -PREFIX_LENGTH))
-		{
-			for (i=0;i<(USB_PACKET_SIZE-PREFIX_LENGTH);i++) 	usbBuffer[2][i+PREFIX_LENGTH] = ringbuf_get(&accRing);
-			ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &usbBuffer[2],USB_PACKET_SIZE);
-			if(ret != NRF_SUCCESS) NRF_LOG_INFO("CDC ACM unavailable");
-		}
-		if (nameReceived)
-		{
-			nameReceived = false;
-			for (i=0;i<hardwareNameLength;i++) 	usbBuffer[3][i+PREFIX_LENGTH] = hardwareName[i];
-			for (i=0; i<(USB_PACKET_SIZE-PREFIX_LENGTH-hardwareNameLength);i++) usbBuffer[3][i+PREFIX_LENGTH+hardwareNameLength] = 0;
-			ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &usbBuffer[3],USB_PACKET_SIZE);
-			if(ret != NRF_SUCCESS) NRF_LOG_INFO("CDC ACM unavailable");
-		}
+		stream_latency_check();
+		bench_generate();
+
+		// Only one CDC ACM write can be in progress; the next one starts on TX_DONE.
+		host_cmd_queue_process();
+
+		usb_tx_queue_fill();
+		data_path_tx_start(&m_data_path);
 
         idle_state_handle();
     }
@@ -0,0 +1,366 @@
+/**@file
+ *
+ * @brief Packet buffer implementation.
+ */
+
+#include <string.h>
+#include "nordic_common.h"
+#include "app_util_platform.h"
+#include "pktbuf.h"
+
+
+/**@brief Function for getting the start (header slot) of a frame from its index. */
+static uint8_t * frame_ptr(pktbuf_pool_t const * p_pool, uint8_t idx)
+{
+    return p_pool->p_frames + (uint32_t)idx * p_pool->frame_size;
+}
+
+
+/**@brief Function for returning a frame to the pool.
+ *
+ * @details The free bit and the count change together. Between the two, the frame would count
+ *          both as free and as used by its stream, which lowers what the other streams are owed,
+ *          and a producer on another stream could borrow a frame from a reservation.
+ */
+static void frame_free(pktbuf_t * p_buf, uint8_t idx)
+{
+    CRITICAL_REGION_ENTER();
+    (void)nrf_atomic_u32_or(&p_buf->p_pool->free_mask, 1UL << idx);
+    p_buf->free_cnt++;
+    CRITICAL_REGION_EXIT();
+}
+
+
+/**@brief Function for queueing the frame being filled to the consumer, with the payload it holds. */
+static void frame_commit(pktbuf_t * p_buf)
+{
+    p_buf->p_pool->frame_len[p_buf->wr_frame] = p_buf->wr_offset;
+
+    // ringbuf_put orders the payload and its length before the index it publishes.
+    (void)ringbuf_put(&p_buf->ready, p_buf->wr_frame);
+    p_buf->wr_frame = PKTBUF_NO_FRAME;
+}
+
+
+/**@brief Function for checking whether a stream may take n more frames from the pool.
+ *
+ * @details Frames are only lent beyond the stream's own reservation while enough free frames
+ *          remain for the reservations the other streams have not used yet.
+ */
+static bool frames_available(pktbuf_t const * p_buf, uint8_t n)
+{
+    pktbuf_pool_t const * p_pool = p_buf->p_pool;
+    uint8_t               free   = (uint8_t)__builtin_popcount(p_pool->free_mask);
+    uint8_t               owed   = 0;
+
+    if (pktbuf_frames_used(p_buf) + n > p_buf->limit)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < p_pool->stream_count; i++)
+    {
+        pktbuf_t const * p_other = p_pool->p_streams[i];
+        uint8_t          used    = pktbuf_frames_used(p_other);
+
+        if ((p_other != p_buf) && (used < p_other->reserved))
+        {
+            owed += p_other->reserved - used;
+        }
+    }
+
+    return free >= n + owed;
+}
+
+
+/**@brief Function for taking a free frame from the pool. The caller checks availability first. */
+static uint8_t frame_alloc(pktbuf_t * p_buf)
+{
+    uint8_t idx = (uint8_t)__builtin_ctz(p_buf->p_pool->free_mask);
+
+    (void)nrf_atomic_u32_and(&p_buf->p_pool->free_mask, ~(1UL << idx));
+    p_buf->alloc_cnt++;
+    p_buf->stats.frames_hwm = MAX(p_buf->stats.frames_hwm, pktbuf_frames_used(p_buf));
+
+    return idx;
+}
+
+
+/**@brief Function for taking a free frame from the pool and starting to fill it. */
+static void frame_open(pktbuf_t * p_buf, uint32_t timestamp, bool records)
+{
+    p_buf->wr_frame  = frame_alloc(p_buf);
+    p_buf->wr_offset = 0;
+    p_buf->p_pool->frame_time[p_buf->wr_frame]    = timestamp;
+    p_buf->p_pool->frame_records[p_buf->wr_frame] = records;
+}
+
+
+/**@brief Function for copying data to the end of the frame being filled, committing it once full. */
+static void frame_append(pktbuf_t * p_buf, uint8_t const * p_data, uint16_t len)
+{
+    pktbuf_pool_t * p_pool = p_buf->p_pool;
+
+    memcpy(frame_ptr(p_pool, p_buf->wr_frame) + p_pool->header_len + p_buf->wr_offset, p_data, len);
+    p_buf->wr_offset += len;
+
+    if (p_buf->wr_offset == p_pool->frame_size - p_pool->header_len)
+    {
+        frame_commit(p_buf);
+    }
+}
+
+
+void pktbuf_pool_init(pktbuf_pool_t * p_pool,
+                      uint8_t       * p_storage,
+                      uint8_t         frame_count,
+                      uint16_t        frame_size,
+                      uint16_t        header_len)
+{
+    p_pool->p_frames     = p_storage;
+    p_pool->frame_size   = frame_size;
+    p_pool->header_len   = header_len;
+    p_pool->frame_count  = frame_count;
+    p_pool->stream_count = 0;
+    p_pool->free_mask    = (frame_count >= 32) ? 0xFFFFFFFFUL : ((1UL << frame_count) - 1);
+}
+
+
+ret_code_t pktbuf_init(pktbuf_t      * p_buf,
+                       pktbuf_pool_t * p_pool,
+                       uint8_t         stream_id,
+                       uint8_t         reserved,
+                       uint8_t         limit)
+{
+    uint8_t reserved_total = reserved;
+
+    if (p_pool->stream_count >= PKTBUF_MAX_STREAMS)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+    for (uint8_t i = 0; i < p_pool->stream_count; i++)
+    {
+        reserved_total += p_pool->p_streams[i]->reserved;
+    }
+    if ((reserved_total > p_pool->frame_count) || (limit < reserved))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    p_buf->p_pool    = p_pool;
+    p_buf->stream_id = stream_id;
+    p_buf->reserved  = reserved;
+    p_buf->limit     = MIN(limit, p_pool->frame_count);
+    p_buf->wr_frame  = PKTBUF_NO_FRAME;
+    p_buf->wr_offset = 0;
+    p_buf->alloc_cnt = 0;
+    p_buf->free_cnt  = 0;
+    p_buf->aged      = false;
+    memset(&p_buf->stats, 0, sizeof(p_buf->stats));
+    ringbuf_init(&p_buf->ready, p_buf->ready_data, sizeof(p_buf->ready_data));
+
+    p_pool->p_streams[p_pool->stream_count++] = p_buf;
+
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t pktbuf_put(pktbuf_t * p_buf, uint8_t const * p_data, uint16_t len, uint32_t timestamp)
+{
+    pktbuf_pool_t * p_pool      = p_buf->p_pool;
+    uint16_t const  payload_len = p_pool->frame_size - p_pool->header_len;
+    bool const      open_plain  = (p_buf->wr_frame != PKTBUF_NO_FRAME) && !p_pool->frame_records[p_buf->wr_frame];
+    uint16_t        room        = open_plain ? (payload_len - p_buf->wr_offset) : 0;
+
+    if (len > room)
+    {
+        uint8_t needed = (uint8_t)((len - room + payload_len - 1) / payload_len);
+
+        if (!frames_available(p_buf, needed))
+        {
+            p_buf->stats.drops++;
+            p_buf->stats.bytes_dropped += len;
+            return NRF_ERROR_NO_MEM;
+        }
+    }
+
+    // Plain data never goes into a frame of records.
+    if ((p_buf->wr_frame != PKTBUF_NO_FRAME) && !open_plain)
+    {
+        frame_commit(p_buf);
+    }
+
+    p_buf->stats.puts++;
+    p_buf->stats.bytes_in += len;
+
+    while (len > 0)
+    {
+        uint16_t chunk;
+
+        if (p_buf->wr_frame == PKTBUF_NO_FRAME)
+        {
+            frame_open(p_buf, timestamp, false);
+        }
+
+        chunk = MIN(len, payload_len - p_buf->wr_offset);
+        frame_append(p_buf, p_data, chunk);
+        p_data += chunk;
+        len    -= chunk;
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t pktbuf_put_record(pktbuf_t * p_buf, uint8_t const * p_data, uint16_t len, uint32_t timestamp)
+{
+    pktbuf_pool_t * p_pool      = p_buf->p_pool;
+    uint16_t const  payload_len = p_pool->frame_size - p_pool->header_len;
+    uint8_t         record_header[PKTBUF_RECORD_HEADER_LEN];
+
+    if (len > payload_len - PKTBUF_RECORD_HEADER_LEN)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    if ((p_buf->wr_frame == PKTBUF_NO_FRAME)
+            || !p_pool->frame_records[p_buf->wr_frame]
+            || (PKTBUF_RECORD_HEADER_LEN + len > payload_len - p_buf->wr_offset))
+    {
+        if (!frames_available(p_buf, 1))
+        {
+            p_buf->stats.drops++;
+            p_buf->stats.bytes_dropped += len;
+            return NRF_ERROR_NO_MEM;
+        }
+        if (p_buf->wr_frame != PKTBUF_NO_FRAME)
+        {
+            frame_commit(p_buf);
+        }
+        frame_open(p_buf, timestamp, true);
+    }
+
+    p_buf->stats.puts++;
+    p_buf->stats.bytes_in += len;
+
+    record_header[0] = (uint8_t)len;
+    record_header[1] = (uint8_t)(len >> 8);
+    record_header[2] = (uint8_t)timestamp;
+    record_header[3] = (uint8_t)(timestamp >> 8);
+    record_header[4] = (uint8_t)(timestamp >> 16);
+    record_header[5] = (uint8_t)(timestamp >> 24);
+    frame_append(p_buf, record_header, PKTBUF_RECORD_HEADER_LEN);
+    if (len > 0)
+    {
+        frame_append(p_buf, p_data, len);
+    }
+
+    return NRF_SUCCESS;
+}
+
+
+bool pktbuf_frame_get(pktbuf_t * p_buf, pktbuf_frame_t * p_frame)
+{
+    int idx = ringbuf_get(&p_buf->ready);
+
+    if (idx < 0)
+    {
+        return false;
+    }
+    p_frame->p_frame   = frame_ptr(p_buf->p_pool, (uint8_t)idx);
+    p_frame->len       = p_buf->p_pool->frame_len[idx];
+    p_frame->timestamp = p_buf->p_pool->frame_time[idx];
+    p_frame->records   = p_buf->p_pool->frame_records[idx];
+    return true;
+}
+
+
+void pktbuf_frame_release(pktbuf_t * p_buf, uint8_t const * p_frame)
+{
+    uint8_t idx = (uint8_t)((p_frame - p_buf->p_pool->p_frames) / p_buf->p_pool->frame_size);
+
+    // The USB transfer must be finished with the frame before the producer may refill it.
+    __DMB();
+    frame_free(p_buf, idx);
+}
+
+
+void pktbuf_flush(pktbuf_t * p_buf)
+{
+    int idx;
+
+    CRITICAL_REGION_ENTER();
+
+    while ((idx = ringbuf_get(&p_buf->ready)) >= 0)
+    {
+        frame_free(p_buf, (uint8_t)idx);
+    }
+    if (p_buf->wr_frame != PKTBUF_NO_FRAME)
+    {
+        frame_free(p_buf, p_buf->wr_frame);
+        p_buf->wr_frame  = PKTBUF_NO_FRAME;
+        p_buf->wr_offset = 0;
+    }
+
+    CRITICAL_REGION_EXIT();
+}
+
+
+bool pktbuf_commit_aged(pktbuf_t * p_buf)
+{
+    bool committed = false;
+
+    // The producer must not be half way through filling the frame while it is committed.
+    CRITICAL_REGION_ENTER();
+
+    if (p_buf->wr_frame == PKTBUF_NO_FRAME)
+    {
+        p_buf->aged = false;
+    }
+    else if (p_buf->aged && (p_buf->aged_alloc_cnt == p_buf->alloc_cnt))
+    {
+        // The frame would not be sent before the other frames of the stream, waiting or being
+        // sent, so committing it now would only spend a whole frame on its tail. It keeps filling
+        // and stays aged until they are released.
+        if (pktbuf_frames_used(p_buf) == 1)
+        {
+            // Frames are taken from the pool only when data arrives, so an open frame is never empty.
+            frame_commit(p_buf);
+            p_buf->aged = false;
+            committed   = true;
+        }
+    }
+    else
+    {
+        p_buf->aged           = true;
+        p_buf->aged_alloc_cnt = p_buf->alloc_cnt;
+    }
+
+    CRITICAL_REGION_EXIT();
+
+    return committed;
+}
+
+
+uint8_t pktbuf_frames_ready(pktbuf_t * p_buf)
+{
+    return (uint8_t)ringbuf_elements(&p_buf->ready);
+}
+
+
+uint8_t pktbuf_frames_used(pktbuf_t const * p_buf)
+{
+    return (uint8_t)(p_buf->alloc_cnt - p_buf->free_cnt);
+}
+
+
+uint8_t pktbuf_frames_room(pktbuf_t const * p_buf)
+{
+    uint8_t room = 0;
+
+    while (frames_available(p_buf, room + 1))
+    {
+        room++;
+    }
+    return room;
+}
@@ -0,0 +1,260 @@
+/**@file
+ *
+ * @defgroup pktbuf Packet buffer
+ * @{
+ *
+ * @brief    Pool of fixed-size USB frames shared by several streams, filled in place.
+ *
+ * @details  The pool storage is split into frames of frame_size bytes. The first header_len bytes
+ *           of every frame are never written by the producer; they are left for the consumer to
+ *           fill with the packet header just before the frame is handed to the USB driver. A
+ *           committed frame is therefore one contiguous [header | payload] block that can be
+ *           transferred straight out of the pool, without copying it into a separate USB buffer.
+ *
+ *           Every stream takes frames from the same pool, so RAM goes to whichever stream is
+ *           currently busy. A stream is guaranteed its reserved number of frames and may borrow
+ *           further free frames, up to its limit, as long as that leaves enough free frames for
+ *           the reservations of the other streams. Committed frames are queued per stream, oldest
+ *           first, so every frame is tagged with the stream it belongs to.
+ *
+ *           Data is either appended as a plain byte stream with @ref pktbuf_put, or as records with
+ *           @ref pktbuf_put_record. A record is its length as a little endian uint16, then the time
+ *           it was received as a little endian uint32, then its data. It is never split across
+ *           frames, so the consumer can tell where every record starts. A frame holds either plain
+ *           data or records, never both.
+ *
+ *           A frame is normally committed when its payload is full. A low-rate stream can have its
+ *           partially filled frame committed early with @ref pktbuf_commit_aged, so its data does
+ *           not wait for a full frame; such a frame carries a shorter payload length. It is only
+ *           committed early while the stream holds no other frame.
+ *
+ *           Each stream is single-producer/single-consumer. @ref pktbuf_put may be called from the
+ *           BLE event handler while the main loop calls @ref pktbuf_frame_get and
+ *           @ref pktbuf_frame_release. The producers of all streams of a pool must run in the same
+ *           context. A frame handed out by @ref pktbuf_frame_get stays owned by the consumer
+ *           until it is released, so it must only be released once the USB transfer from it has
+ *           completed.
+ */
+
+#ifndef PKTBUF_H__
+#define PKTBUF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+#include "nrf_atomic.h"
+#include "ringbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PKTBUF_MAX_FRAMES   32      /**< Maximum number of frames in a pool (one bit each in the free mask). */
+#define PKTBUF_MAX_STREAMS  16      /**< Maximum number of streams sharing a pool. */
+#define PKTBUF_NO_FRAME     0xFF    /**< Frame index meaning no frame. */
+#define PKTBUF_RECORD_HEADER_LEN 6  /**< Length and receive time fields in front of every record. */
+
+typedef struct pktbuf_s pktbuf_t;
+
+/**@brief Data path counters of a stream. They are free-running and written by the producer only. */
+typedef struct
+{
+    uint32_t puts;              /**< Calls that stored their data. */
+    uint32_t drops;             /**< Calls whose data was dropped for lack of frames. */
+    uint32_t bytes_in;          /**< Bytes stored. */
+    uint32_t bytes_dropped;     /**< Bytes dropped. */
+    uint8_t  frames_hwm;        /**< Most frames held at once. */
+} pktbuf_stats_t;
+
+/**@brief Committed frame handed out to the consumer. */
+typedef struct
+{
+    uint8_t * p_frame;      /**< Start of the frame, that is of its header slot. The payload follows the header slot. */
+    uint16_t  len;          /**< Length of the payload. */
+    uint32_t  timestamp;    /**< Timestamp passed with the first data of the frame. */
+    bool      records;      /**< The payload is made of records rather than plain data. */
+} pktbuf_frame_t;
+
+/**@brief Frame pool shared by several streams. */
+typedef struct
+{
+    uint8_t          * p_frames;                        /**< Storage for frame_count frames of frame_size bytes each. */
+    uint16_t           frame_size;                      /**< Size of a frame including its header, in bytes. */
+    uint16_t           header_len;                      /**< Bytes reserved for the header at the start of every frame. */
+    uint8_t            frame_count;                     /**< Number of frames in the storage. */
+    uint8_t            stream_count;                    /**< Number of streams attached to the pool. */
+    nrf_atomic_u32_t   free_mask;                       /**< One bit per frame, set while the frame is free. */
+    uint16_t           frame_len[PKTBUF_MAX_FRAMES];    /**< Payload length of each committed frame. */
+    uint32_t           frame_time[PKTBUF_MAX_FRAMES];   /**< Timestamp of the first data put in each frame. */
+    bool               frame_records[PKTBUF_MAX_FRAMES];/**< Each frame holds records. */
+    pktbuf_t         * p_streams[PKTBUF_MAX_STREAMS];   /**< Streams attached to the pool. */
+} pktbuf_pool_t;
+
+/**@brief Stream taking its frames from a pool. */
+struct pktbuf_s
+{
+    pktbuf_pool_t    * p_pool;                          /**< Pool the frames come from. */
+    uint8_t            stream_id;                       /**< Identifier of the stream the frames belong to. */
+    uint8_t            reserved;                        /**< Frames the stream is always able to get. */
+    uint8_t            limit;                           /**< Frames the stream may hold at most, borrowed ones included. */
+    uint8_t            wr_frame;                        /**< Frame being filled, or @ref PKTBUF_NO_FRAME. Producer only. */
+    uint16_t           wr_offset;                       /**< Payload bytes already in wr_frame. Producer only. */
+    volatile uint8_t   alloc_cnt;                       /**< Frames taken from the pool, free-running. Written by the producer only. */
+    volatile uint8_t   free_cnt;                        /**< Frames given back to the pool, free-running. Written by the consumer only. */
+    bool               aged;                            /**< wr_frame was already open at the previous @ref pktbuf_commit_aged. Consumer only. */
+    uint8_t            aged_alloc_cnt;                  /**< alloc_cnt at that call, identifying the frame. Consumer only. */
+    pktbuf_stats_t     stats;                           /**< Counters of the data passed to the stream. */
+    struct ringbuf     ready;                           /**< Indices of committed frames, oldest first. */
+    uint8_t            ready_data[PKTBUF_MAX_FRAMES];   /**< Storage for ready. */
+};
+
+
+/**@brief Function for initializing a frame pool.
+ *
+ * @param[in] p_pool      Pool instance.
+ * @param[in] p_storage   Storage of at least frame_count * frame_size bytes.
+ * @param[in] frame_count Number of frames, no more than @ref PKTBUF_MAX_FRAMES.
+ * @param[in] frame_size  Size of each frame including the header.
+ * @param[in] header_len  Bytes reserved at the start of each frame for the header.
+ */
+void pktbuf_pool_init(pktbuf_pool_t * p_pool,
+                      uint8_t       * p_storage,
+                      uint8_t         frame_count,
+                      uint16_t        frame_size,
+                      uint16_t        header_len);
+
+
+/**@brief Function for attaching a stream to a frame pool.
+ *
+ * @details The reservations of all streams of a pool must not add up to more than its frames.
+ *
+ * @param[in] p_buf     Stream instance.
+ * @param[in] p_pool    Pool to take frames from.
+ * @param[in] stream_id Identifier the frames of this stream are tagged with.
+ * @param[in] reserved  Frames the stream is always able to get.
+ * @param[in] limit     Frames the stream may hold at most.
+ *
+ * @retval NRF_SUCCESS             If the stream was attached.
+ * @retval NRF_ERROR_NO_MEM        If the pool already has @ref PKTBUF_MAX_STREAMS streams.
+ * @retval NRF_ERROR_INVALID_PARAM If the reservations would exceed the pool.
+ */
+ret_code_t pktbuf_init(pktbuf_t      * p_buf,
+                       pktbuf_pool_t * p_pool,
+                       uint8_t         stream_id,
+                       uint8_t         reserved,
+                       uint8_t         limit);
+
+
+/**@brief Function for appending data to the payload of a stream.
+ *
+ * @details The data is copied into the frame being filled and, when that frame is full, into new
+ *          frames taken from the pool. Every frame that becomes full is committed to the consumer.
+ *          The data is either stored completely or not at all.
+ *
+ * @param[in] p_buf     Stream instance.
+ * @param[in] p_data    Data to append.
+ * @param[in] len       Length of the data.
+ * @param[in] timestamp Time the data was received. Kept for each frame the data starts.
+ *
+ * @retval NRF_SUCCESS       If the data was stored.
+ * @retval NRF_ERROR_NO_MEM  If the stream could not get enough frames for all of the data.
+ */
+ret_code_t pktbuf_put(pktbuf_t * p_buf, uint8_t const * p_data, uint16_t len, uint32_t timestamp);
+
+
+/**@brief Function for appending one record to the payload of a stream.
+ *
+ * @details The record is stored whole in the frame being filled if it fits there. Otherwise that
+ *          frame is committed and the record starts a new frame.
+ *
+ * @param[in] p_buf     Stream instance.
+ * @param[in] p_data    Record data.
+ * @param[in] len       Length of the record data.
+ * @param[in] timestamp Time the record was received. Stored with the record.
+ *
+ * @retval NRF_SUCCESS              If the record was stored.
+ * @retval NRF_ERROR_NO_MEM         If the stream could not get a frame for the record.
+ * @retval NRF_ERROR_INVALID_LENGTH If the record does not fit in a frame.
+ */
+ret_code_t pktbuf_put_record(pktbuf_t * p_buf, uint8_t const * p_data, uint16_t len, uint32_t timestamp);
+
+
+/**@brief Function for handing out the oldest committed frame of a stream.
+ *
+ * @details The frame remains valid until @ref pktbuf_frame_release is called for it.
+ *
+ * @param[in]  p_buf   Stream instance.
+ * @param[out] p_frame The frame, its payload length and its timestamp.
+ *
+ * @return false if no frame is committed.
+ */
+bool pktbuf_frame_get(pktbuf_t * p_buf, pktbuf_frame_t * p_frame);
+
+
+/**@brief Function for returning a handed out frame to the pool.
+ *
+ * @param[in] p_buf   Stream instance the frame was handed out from.
+ * @param[in] p_frame Any pointer into a frame handed out by @ref pktbuf_frame_get.
+ */
+void pktbuf_frame_release(pktbuf_t * p_buf, uint8_t const * p_frame);
+
+
+/**@brief Function for discarding all data of a stream that has not been handed out yet.
+ *
+ * @details Committed frames that were not handed out are returned to the pool, as is the
+ *          partially filled frame. Frames that are handed out stay valid until they are released.
+ *          Must be called from the consumer side.
+ *
+ * @param[in] p_buf Stream instance.
+ */
+void pktbuf_flush(pktbuf_t * p_buf);
+
+
+/**@brief Function for committing a partially filled frame once its data has waited long enough.
+ *
+ * @details Call this periodically from the consumer side. The frame being filled is committed
+ *          with the payload it holds if it was already being filled at the previous call, so data
+ *          waits at most two call periods before it can be sent. While the stream holds other
+ *          frames, committed or handed out, the frame is not committed but keeps filling, as it
+ *          could not be sent before them anyway; it is committed at the first call after they are
+ *          released, or once full. A stream slowed down by USB thus packs its data into full
+ *          frames instead of spending a frame on each partial commit.
+ *
+ * @param[in] p_buf Stream instance.
+ *
+ * @return true if a partial frame was committed.
+ */
+bool pktbuf_commit_aged(pktbuf_t * p_buf);
+
+
+/**@brief Function for getting the number of committed frames that have not been handed out.
+ *
+ * @param[in] p_buf Stream instance.
+ */
+uint8_t pktbuf_frames_ready(pktbuf_t * p_buf);
+
+
+/**@brief Function for getting the number of frames a stream currently holds.
+ *
+ * @param[in] p_buf Stream instance.
+ */
+uint8_t pktbuf_frames_used(pktbuf_t const * p_buf);
+
+
+/**@brief Function for getting the number of frames a stream could still take: up to its limit, as
+ *        long as the pool has them free beyond the unused reservations of the other streams.
+ *
+ * @details Read from the consumer side, the count may be out of date by the time it is used.
+ *
+ * @param[in] p_buf Stream instance.
+ */
+uint8_t pktbuf_frames_room(pktbuf_t const * p_buf);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PKTBUF_H__
+
+/** @} */
@@ -1 +1,177 @@
-/*  * Copyright (c) 2008, Swedish Institute of Computer Science.  * All rights reserved.  *  * Redistribution and use in source and binary forms, with or without  * modification, are permitted provided that the following conditions  * are met:  * 1. Redistributions of source code must retain the above copyright  *    notice, this list of conditions and the following disclaimer.  * 2. Redistributions in binary form must reproduce the above copyright  *    notice, this list of conditions and the following disclaimer in the  *    documentation and/or other materials provided with the distribution.  * 3. Neither the name of the Institute nor the names of its contributors  *    may be used to endorse or promote products derived from this software  *    without specific prior written permission.  *  * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS  * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)  * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT  * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY  * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF  * SUCH DAMAGE.  *  * This file is part of the Contiki operating system.  *  * $Id: ringbuf.c,v 1.2 2010/06/15 13:31:22 nifi Exp $  */  /**  * \file  *         Ring buffer library implementation  * \author  *         Adam Dunkels <adam@sics.se>  */  #include "ringbuf.h" /*---------------------------------------------------------------------------*/ void ringbuf_init(struct ringbuf *r, uint8_t *dataptr, uint16_t size) {   r->data = dataptr;   r->mask = size - 1;   r->put_ptr = 0;   r->get_ptr = 0; } /*---------------------------------------------------------------------------*/ int ringbuf_put(struct ringbuf *r, uint8_t c) {   /* Check if buffer is full. If it is full, return 0 to indicate that      the element was not inserted into the buffer.       XXX: there is a potential risk for a race condition here, because      the ->get_ptr field may be written concurrently by the      ringbuf_get() function. To avoid this, access to ->get_ptr must      be atomic. We use an uint8_t type, which makes access atomic on      most platforms, but C does not guarantee this.   */   if(((r->put_ptr - r->get_ptr) & r->mask) == r->mask) {     return 0;   }   r->data[r->put_ptr] = c;   r->put_ptr = (r->put_ptr + 1) & r->mask;   return 1; } /*---------------------------------------------------------------------------*/ int ringbuf_get(struct ringbuf *r) {   uint8_t c;      /* Check if there are bytes in the buffer. If so, we return the      first one and increase the pointer. If there are no bytes left, we      return -1.       XXX: there is a potential risk for a race condition here, because      the ->put_ptr field may be written concurrently by the      ringbuf_put() function. To avoid this, access to ->get_ptr must      be atomic. We use an uint8_t type, which makes access atomic on      most platforms, but C does not guarantee this.   */   if(((r->put_ptr - r->get_ptr) & r->mask) > 0) {     c = r->data[r->get_ptr];     r->get_ptr = (r->get_ptr + 1) & r->mask;     return c;   } else {     return -1;   } } /*---------------------------------------------------------------------------*/ int ringbuf_size(struct ringbuf *r) {   return r->mask + 1; } /*---------------------------------------------------------------------------*/ int ringbuf_elements(struct ringbuf *r) {   return (r->put_ptr - r->get_ptr) & r->mask; } /*---------------------------------------------------------------------------*/
\ No newline at end of file
+/*
+ * Copyright (c) 2008, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ * $Id: ringbuf.c,v 1.2 2010/06/15 13:31:22 nifi Exp $
+ */
+
+/**
+ * \file
+ *         Ring buffer library implementation
+ * \author
+ *         Adam Dunkels <adam@sics.se>
+ */
+
+#include "ringbuf.h"
+/*---------------------------------------------------------------------------*/
+void
+ringbuf_init(struct ringbuf *r, uint8_t *dataptr, uint16_t size)
+{
+  r->data = dataptr;
+  r->mask = size - 1;
+  r->put_ptr = 0;
+  r->get_ptr = 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+ringbuf_put(struct ringbuf *r, uint8_t c)
+{
+  uint16_t put_ptr = r->put_ptr;
+
+  /* Check if buffer is full. If it is full, return 0 to indicate that
+     the element was not inserted into the buffer.
+
+     get_ptr is only written by the consumer, and a 16-bit aligned
+     load is atomic on the Cortex-M4, so a stale value can only make
+     the buffer look fuller than it is.
+  */
+  if((uint16_t)(put_ptr - r->get_ptr) > r->mask) {
+    return 0;
+  }
+  r->data[put_ptr & r->mask] = c;
+
+  /* The byte must be in memory before the consumer can see the new
+     put_ptr. */
+  RINGBUF_MEMORY_BARRIER();
+  r->put_ptr = put_ptr + 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+ringbuf_put_block(struct ringbuf *r, const uint8_t *a, uint16_t len)
+{
+  uint16_t put_ptr = r->put_ptr;
+  uint16_t offset = put_ptr & r->mask;
+  uint16_t first;
+
+  if(len == 0 || len > (uint16_t)ringbuf_space(r)) {
+    return 0;
+  }
+
+  /* Copy up to the end of the storage, then the remainder (if any)
+     to the start of it. */
+  first = (uint16_t)(r->mask + 1 - offset);
+  if(first > len) {
+    first = len;
+  }
+  memcpy(&r->data[offset], a, first);
+  memcpy(r->data, a + first, len - first);
+
+  RINGBUF_MEMORY_BARRIER();
+  r->put_ptr = put_ptr + len;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+int
+ringbuf_get(struct ringbuf *r)
+{
+  uint8_t c;
+  uint16_t get_ptr = r->get_ptr;
+
+  /* Check if there are bytes in the buffer. If so, we return the
+     first one and increase the pointer. If there are no bytes left, we
+     return -1.
+  */
+  if((uint16_t)(r->put_ptr - get_ptr) > 0) {
+    /* Do not read the byte before put_ptr says it is there. */
+    RINGBUF_MEMORY_BARRIER();
+    c = r->data[get_ptr & r->mask];
+
+    /* The byte must be read before the producer may overwrite it. */
+    RINGBUF_MEMORY_BARRIER();
+    r->get_ptr = get_ptr + 1;
+    return c;
+  } else {
+    return -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+ringbuf_get_block(struct ringbuf *r, uint8_t *a, uint16_t len)
+{
+  uint16_t get_ptr = r->get_ptr;
+  uint16_t offset = get_ptr & r->mask;
+  uint16_t elements = (uint16_t)(r->put_ptr - get_ptr);
+  uint16_t first;
+
+  if(len > elements) {
+    len = elements;
+  }
+  if(len == 0) {
+    return 0;
+  }
+  RINGBUF_MEMORY_BARRIER();
+
+  first = (uint16_t)(r->mask + 1 - offset);
+  if(first > len) {
+    first = len;
+  }
+  memcpy(a, &r->data[offset], first);
+  memcpy(a + first, r->data, len - first);
+
+  RINGBUF_MEMORY_BARRIER();
+  r->get_ptr = get_ptr + len;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+void
+ringbuf_flush(struct ringbuf *r)
+{
+  RINGBUF_MEMORY_BARRIER();
+  r->get_ptr = r->put_ptr;
+}
+/*---------------------------------------------------------------------------*/
+int
+ringbuf_size(struct ringbuf *r)
+{
+  return r->mask + 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+ringbuf_elements(struct ringbuf *r)
+{
+  return (uint16_t)(r->put_ptr - r->get_ptr);
+}
+/*---------------------------------------------------------------------------*/
+int
+ringbuf_space(struct ringbuf *r)
+{
+  return r->mask + 1 - ringbuf_elements(r);
+}
+/*---------------------------------------------------------------------------*/
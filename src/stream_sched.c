@@ -0,0 +1,118 @@
+/**@file
+ *
+ * @brief Stream scheduler implementation.
+ */
+
+#include "nordic_common.h"
+#include "stream_sched.h"
+
+
+/**@brief Function for keeping a credit within the limit of the scheduler. */
+static int16_t credit_clamp(stream_sched_t const * p_sched, int32_t credit)
+{
+    return (int16_t)MAX(MIN(credit, p_sched->credit_limit), -p_sched->credit_limit);
+}
+
+
+void stream_sched_init(stream_sched_t * p_sched, uint8_t urgent_percent, uint8_t urgent_max, int16_t credit_limit)
+{
+    p_sched->count          = 0;
+    p_sched->urgent_percent = urgent_percent;
+    p_sched->urgent_max     = urgent_max;
+    p_sched->urgent_turns   = 0;
+    p_sched->credit_limit   = credit_limit;
+}
+
+
+ret_code_t stream_sched_add(stream_sched_t * p_sched, pktbuf_t * p_ring, uint8_t weight)
+{
+    stream_sched_entry_t * p_entry;
+
+    if (p_sched->count >= STREAM_SCHED_MAX_STREAMS)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+    if (weight == 0)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    p_entry         = &p_sched->entries[p_sched->count++];
+    p_entry->p_ring = p_ring;
+    p_entry->weight = weight;
+    p_entry->credit = 0;
+    p_entry->drops  = p_ring->stats.drops;
+
+    return NRF_SUCCESS;
+}
+
+
+pktbuf_t * stream_sched_next(stream_sched_t * p_sched)
+{
+    int      pick        = -1;
+    int      urgent      = -1;
+    uint32_t urgent_fill = 0;
+    uint32_t urgent_used = 0;
+    int32_t  pick_credit = 0;
+    int32_t  total       = 0;
+    uint32_t ready_mask  = 0;  // One bit per stream
+
+    for (int i = 0; i < p_sched->count; i++)
+    {
+        stream_sched_entry_t * p_entry = &p_sched->entries[i];
+        int32_t                credit  = p_entry->credit + p_entry->weight;
+        uint32_t               used;
+        uint32_t               fill;
+        bool                   dropping;
+
+        if (pktbuf_frames_ready(p_entry->p_ring) == 0)
+        {
+            p_entry->credit = 0;
+            continue;
+        }
+        ready_mask |= (1UL << i);
+        total      += p_entry->weight;
+        if ((pick < 0) || (credit > pick_credit))
+        {
+            pick        = i;
+            pick_credit = credit;
+        }
+
+        // Against what the stream can reach now: its limit, or less while other streams hold the
+        // frames it would borrow. A stream that dropped data since the previous choice is
+        // overloaded, and serving it first would not save it.
+        used     = pktbuf_frames_used(p_entry->p_ring);
+        fill     = (used * 100) / (used + pktbuf_frames_room(p_entry->p_ring));
+        dropping = (p_entry->p_ring->stats.drops != p_entry->drops);
+        p_entry->drops = p_entry->p_ring->stats.drops;
+        if (!dropping && (fill >= p_sched->urgent_percent)
+                && ((fill > urgent_fill) || ((fill == urgent_fill) && (used < urgent_used))))
+        {
+            urgent      = i;
+            urgent_fill = fill;
+            urgent_used = used;
+        }
+    }
+
+    if (pick < 0)
+    {
+        return NULL;
+    }
+    if ((urgent >= 0) && (p_sched->urgent_turns < p_sched->urgent_max))
+    {
+        p_sched->urgent_turns++;
+        return p_sched->entries[urgent].p_ring;
+    }
+    p_sched->urgent_turns = 0;
+
+    for (int i = 0; i < p_sched->count; i++)
+    {
+        if (ready_mask & (1UL << i))
+        {
+            stream_sched_entry_t * p_entry = &p_sched->entries[i];
+
+            p_entry->credit = credit_clamp(p_sched, p_entry->credit + p_entry->weight - ((i == pick) ? total : 0));
+        }
+    }
+    return p_sched->entries[pick].p_ring;
+}
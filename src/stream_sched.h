@@ -0,0 +1,105 @@
+/**@file
+ *
+ * @defgroup stream_sched Stream scheduler
+ * @{
+ *
+ * @brief    Choice of the stream whose packet is written to USB next.
+ *
+ * @details  The streams of a pool share the USB writes by smooth weighted round robin: every stream
+ *           with a packet ready gains its weight in credit, and the one with the most credit is
+ *           served and pays back the weights gained in this round. A stream with nothing ready
+ *           starts again from no credit, so it cannot save up turns while idle. Credits are kept
+ *           within a limit either way.
+ *
+ *           Streams holding the urgent share of the packets they can reach or more are served
+ *           first, the fullest first, before they have to drop data. A stream reaches its packet
+ *           limit, or fewer packets while the other streams hold those it would borrow. Such a turn
+ *           is out of the round, so it leaves every credit as it was; otherwise a stream kept urgent
+ *           by sustained overload would run up a debt without bound. A stream that dropped data
+ *           since the previous choice is overloaded and not urgent, as serving it first would not
+ *           save it, and at most a set number of urgent turns go in a row before a turn of the
+ *           round, so the other streams keep a share of the writes and do not fill up behind it.
+ *
+ *           The scheduler only reads the rings, so it runs on the consumer side, with
+ *           @ref pktbuf_frame_get.
+ */
+
+#ifndef STREAM_SCHED_H__
+#define STREAM_SCHED_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_errors.h"
+#include "pktbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_SCHED_MAX_STREAMS PKTBUF_MAX_STREAMS   /**< Maximum number of streams scheduled. */
+
+/**@brief Stream taking part in the scheduling. */
+typedef struct
+{
+    pktbuf_t * p_ring;      /**< Ring of the stream. */
+    uint8_t    weight;      /**< Turns the stream gets in a round while every stream is busy. */
+    int16_t    credit;      /**< Weighted round robin credit. */
+    uint32_t   drops;       /**< Drops of the ring at the previous choice. */
+} stream_sched_entry_t;
+
+/**@brief Scheduler instance. */
+typedef struct
+{
+    stream_sched_entry_t entries[STREAM_SCHED_MAX_STREAMS];  /**< Streams, in the order added. */
+    uint8_t              count;                              /**< Number of streams added. */
+    uint8_t              urgent_percent;                     /**< Share of the packets it can reach making a stream urgent. */
+    uint8_t              urgent_max;                         /**< Urgent turns in a row before a turn of the round. */
+    uint8_t              urgent_turns;                       /**< Urgent turns since the last turn of the round. */
+    int16_t              credit_limit;                       /**< Bound of a credit either way. */
+} stream_sched_t;
+
+
+/**@brief Function for initializing a scheduler with no streams.
+ *
+ * @param[in] p_sched        Scheduler instance.
+ * @param[in] urgent_percent Share of the packets it can reach, in percent, making a stream urgent.
+ *                           Above 100 no stream is ever urgent.
+ * @param[in] urgent_max     Urgent turns in a row before a turn of the round. 0 turns urgency off.
+ * @param[in] credit_limit   Bound of a credit either way. At least twice the sum of the weights,
+ *                           or the round robin shares drift.
+ */
+void stream_sched_init(stream_sched_t * p_sched, uint8_t urgent_percent, uint8_t urgent_max, int16_t credit_limit);
+
+
+/**@brief Function for adding a stream to a scheduler.
+ *
+ * @param[in] p_sched Scheduler instance.
+ * @param[in] p_ring  Ring of the stream.
+ * @param[in] weight  Turns the stream gets in a round while every stream is busy, at least 1.
+ *
+ * @retval NRF_SUCCESS             If the stream was added.
+ * @retval NRF_ERROR_NO_MEM        If the scheduler already has @ref STREAM_SCHED_MAX_STREAMS streams.
+ * @retval NRF_ERROR_INVALID_PARAM If the weight is 0.
+ */
+ret_code_t stream_sched_add(stream_sched_t * p_sched, pktbuf_t * p_ring, uint8_t weight);
+
+
+/**@brief Function for choosing the stream to serve next and settling the credits of the turn.
+ *
+ * @details The caller is expected to take a packet from the returned ring with
+ *          @ref pktbuf_frame_get straight away.
+ *
+ * @param[in] p_sched Scheduler instance.
+ *
+ * @return Ring of the stream, or NULL if no stream has a packet ready.
+ */
+pktbuf_t * stream_sched_next(stream_sched_t * p_sched);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STREAM_SCHED_H__
+
+/** @} */
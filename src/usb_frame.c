@@ -0,0 +1,50 @@
+/**@file
+ *
+ * @brief USB frame format implementation.
+ */
+
+#include <string.h>
+#include "app_util.h"
+#include "crc16.h"
+#include "usb_frame.h"
+
+
+uint8_t * usb_frame_header_write(usb_frame_format_t       format,
+                                 usb_frame_info_t const * p_info,
+                                 uint8_t                * p_payload,
+                                 uint16_t                 len,
+                                 uint16_t               * p_size)
+{
+    uint8_t * p_header;
+    uint16_t  crc;
+
+    if (format == USB_FRAME_FORMAT_V1)
+    {
+        p_header = p_payload - USB_FRAME_V1_HEADER_LEN;
+        memcpy(p_header, p_info->p_tag, USB_FRAME_TAG_LEN);
+        if (p_info->records)
+        {
+            p_header[USB_FRAME_TAG_LEN - 1] = 'R';
+        }
+        (void)uint16_encode(len, &p_header[4]);
+        *p_size = USB_FRAME_V1_HEADER_LEN + len;
+        return p_header;
+    }
+
+    p_header = p_payload - USB_FRAME_V2_HEADER_LEN;
+    (void)uint16_encode(USB_FRAME_V2_MAGIC, &p_header[0]);
+    p_header[2] = USB_FRAME_FORMAT_V2;
+    p_header[3] = (p_info->stream_id & USB_FRAME_STREAM_ID_MASK)
+                | (uint8_t)(p_info->link << USB_FRAME_LINK_POS)
+                | (p_info->records ? USB_FRAME_STREAM_RECORDS : 0);
+    (void)uint16_encode(p_info->seq, &p_header[4]);
+    (void)uint16_encode(len, &p_header[6]);
+    (void)uint32_encode(p_info->timestamp, &p_header[8]);
+
+    crc = crc16_compute(p_header, 12, NULL);
+    crc = crc16_compute(p_payload, len, &crc);
+    (void)uint16_encode(crc, &p_header[12]);
+
+    *p_size = USB_FRAME_V2_HEADER_LEN + len;
+    return p_header;
+}
@@ -0,0 +1,107 @@
+/**@file
+ *
+ * @defgroup usb_frame USB frame format
+ * @{
+ *
+ * @brief    Headers of the packets sent to the host over the CDC ACM port.
+ *
+ * @details  Every packet is a header followed by the payload of one stream. Two header formats
+ *           are supported, and the host selects one with a command.
+ *
+ *           Version 1 (6 bytes): the 4-character stream tag ("EEG_", "PPG_", "ACC_", "NAME", "STAT",
+ *           "LINK" or "RESP"), then the payload length. When the payload is made of records the last
+ *           character of the tag is 'R' instead of '_'. Version 1 carries no link, so it only suits a single link.
+ *
+ *           Version 2 (14 bytes):
+ *           | Offset | Size | Field                                                         |
+ *           | 0      | 2    | Magic, @ref USB_FRAME_V2_MAGIC                                |
+ *           | 2      | 1    | Version, 2                                                    |
+ *           | 3      | 1    | Bits 0 to 3: stream id, @ref USB_FRAME_STREAM_ID_NAME,        |
+ *           |        |      | @ref USB_FRAME_STREAM_ID_STAT,                                |
+ *           |        |      | @ref USB_FRAME_STREAM_ID_LINK or                              |
+ *           |        |      | @ref USB_FRAME_STREAM_ID_RESP. Bits 4 to 6: link the stream   |
+ *           |        |      | belongs to. Bit 7 (@ref USB_FRAME_STREAM_RECORDS): the        |
+ *           |        |      | payload is records                                            |
+ *           | 4      | 2    | Sequence number, counted per stream of each link              |
+ *           | 6      | 2    | Payload length                                                |
+ *           | 8      | 4    | Time the first payload byte was received, in app_timer ticks  |
+ *           | 12     | 2    | CRC-16/CCITT-FALSE of bytes 0 to 11 followed by the payload   |
+ *
+ *           A payload of records is a sequence of BLE notifications, each preceded by its length as
+ *           a uint16 and the time it was received as a uint32, in app_timer ticks, and always starts
+ *           with a whole record.
+ *
+ *           All fields are little endian. A gap in the sequence numbers of a stream means packets
+ *           were lost, and the magic and CRC let the host find the next packet after corruption.
+ *
+ *           The header is written directly in front of the payload, which must be preceded by at
+ *           least @ref USB_FRAME_HEADER_MAX_LEN bytes of free space.
+ */
+
+#ifndef USB_FRAME_H__
+#define USB_FRAME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define USB_FRAME_TAG_LEN           4       /**< Length of the stream tag of a version 1 header. */
+#define USB_FRAME_V1_HEADER_LEN     6       /**< Length of a version 1 header. */
+#define USB_FRAME_V2_HEADER_LEN     14      /**< Length of a version 2 header. */
+#define USB_FRAME_HEADER_MAX_LEN    USB_FRAME_V2_HEADER_LEN  /**< Space to leave in front of every payload. */
+#define USB_FRAME_V2_MAGIC          0x5AA5  /**< First field of a version 2 header. */
+#define USB_FRAME_STREAM_ID_NAME    0x0F    /**< Stream id of the hardware name packet. */
+#define USB_FRAME_STREAM_ID_STAT    0x0E    /**< Stream id of the statistics packet, sent on link 0. */
+#define USB_FRAME_STREAM_ID_LINK    0x0D    /**< Stream id of the link telemetry packet of a link. */
+#define USB_FRAME_STREAM_ID_RESP    0x0C    /**< Stream id of the response to a host command, sent on link 0. */
+#define USB_FRAME_STREAM_ID_MASK    0x0F    /**< Stream id bits of the stream byte. */
+#define USB_FRAME_LINK_POS          4       /**< Position of the link in the stream byte. */
+#define USB_FRAME_LINK_MAX          8       /**< Number of links the stream byte can tell apart. */
+#define USB_FRAME_STREAM_RECORDS    0x80    /**< Stream byte flag of a payload made of records. */
+
+/**@brief Header formats. */
+typedef enum
+{
+    USB_FRAME_FORMAT_V1 = 1,
+    USB_FRAME_FORMAT_V2 = 2
+} usb_frame_format_t;
+
+/**@brief Description of a packet, used to fill in its header. */
+typedef struct
+{
+    char const * p_tag;       /**< Stream tag, used by version 1. */
+    uint8_t      stream_id;   /**< Stream id, used by version 2. */
+    uint8_t      link;        /**< Link the stream belongs to, below @ref USB_FRAME_LINK_MAX. Used by version 2. */
+    uint16_t     seq;         /**< Sequence number, used by version 2. */
+    uint32_t     timestamp;   /**< Receive time of the payload, used by version 2. */
+    bool         records;     /**< The payload is made of records. */
+} usb_frame_info_t;
+
+
+/**@brief Function for writing the header of a packet in front of its payload.
+ *
+ * @param[in]  format    Header format.
+ * @param[in]  p_info    Description of the packet.
+ * @param[in]  p_payload Payload, preceded by @ref USB_FRAME_HEADER_MAX_LEN bytes of free space.
+ * @param[in]  len       Length of the payload.
+ * @param[out] p_size    Length of the packet, header included.
+ *
+ * @return Start of the packet.
+ */
+uint8_t * usb_frame_header_write(usb_frame_format_t       format,
+                                 usb_frame_info_t const * p_info,
+                                 uint8_t                * p_payload,
+                                 uint16_t                 len,
+                                 uint16_t               * p_size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USB_FRAME_H__
+
+/** @} */